@@ -1,11 +1,73 @@
 #pragma once
 
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
 
 namespace dd {
     // Tune these safely; start conservative, then increase after testing.
+    inline constexpr std::int64_t UPLOAD_CHUNK_BYTES = 256ll * 1024 * 1024; // default stored chunk size (upload --chunk-size); files without recorded chunk sizes are read with it
     inline constexpr std::size_t DEFAULT_CHUNK_SIZE = 128ull * 1024ull * 1024ull; // 128 MB per chunk
     inline constexpr int MAX_INFLIGHT_UPLOADS = 3;        // limit memory while using big chunks
     inline constexpr int MAX_RETRIES = 5;
     inline constexpr int BASE_BACKOFF_MS = 500;           // 0.5s → 8s
+
+    // Replication
+    inline constexpr int DEFAULT_REPLICAS = 1;            // copies of each chunk on distinct accounts
+    inline constexpr int RACE_TAIL_CHUNKS = 2;            // with --race, last N chunks race two replicas
+
+    // Multi-file upload
+    inline constexpr int UPLOAD_WORKERS = 16;             // chunks read and uploaded concurrently per batch
+    inline constexpr int UPLOAD_SCAN_THREADS = 8;         // threads walking a directory tree for upload -r
+    inline constexpr std::int64_t SMALL_UPLOAD_BYTES = 8ll * 1024 * 1024; // spread through the batch instead of size-ordered
+
+    // Upload protocol
+    inline constexpr std::size_t MULTIPART_UPLOAD_MAX_BYTES = 5ull * 1024 * 1024; // single-request upload up to this size (Drive allows 5 MB)
+    inline constexpr std::size_t UPLOAD_SESSION_POOL_SIZE = 4;   // resumable sessions kept initiated per account
+    inline constexpr std::chrono::seconds UPLOAD_SESSION_MAX_AGE{3600}; // pooled sessions older than this are discarded
+    inline constexpr bool PREALLOCATE_FILE_IDS = false;   // pooled sessions reserve their file id via files.generateIds
+    inline constexpr int FILE_ID_BATCH = 100;             // ids fetched per generateIds call
+    inline constexpr std::size_t DRIVE_BATCH_MAX_CALLS = 100; // calls per batch request (Drive's limit)
+    inline constexpr const char* DRIVE_API_URL = "https://www.googleapis.com"; // Drive API base URL
+    inline constexpr const char* DRIVE_API_URL_ENV = "DD_DRIVE_API_URL"; // overrides it, e.g. http://127.0.0.1:9090 for drive_emulator
+    inline constexpr std::chrono::seconds TOKEN_REFRESH_MARGIN{300}; // access tokens are refreshed this long before they expire
+
+    // Random-access reads
+    inline constexpr std::int64_t READ_SPAN_BYTES = 16ll * 1024 * 1024;   // largest single ranged GET; longer ranges are split
+    inline constexpr int READ_WORKERS = 8;                // ranged GETs in flight for one read
+    inline constexpr std::int64_t READ_AHEAD_BYTES = 128ll * 1024 * 1024;   // prefetched ahead of a sequential reader
+    inline constexpr std::int64_t STREAM_BUFFER_BYTES = 128ll * 1024 * 1024; // reorder buffer for cat and download to stdout
+
+    // Local chunk cache (data/cache)
+    inline constexpr std::int64_t CHUNK_CACHE_BYTES = 2ll * 1024 * 1024 * 1024; // size budget; 0 disables the cache
+    inline constexpr bool CACHE_UPLOADS = false;          // also keep chunks of uploaded files (not streams) in the cache
+
+    // HTTP gateway (serve)
+    inline constexpr std::size_t SERVE_THREADS = 16;      // requests handled concurrently
+    inline constexpr std::size_t SERVE_MAX_READERS = 16;  // read-ahead streams kept between requests
+    inline constexpr std::chrono::seconds SERVE_READER_IDLE{30}; // kept streams unused this long are dropped
+    inline constexpr std::int64_t SERVE_READ_AHEAD_BYTES = 1ll * 1024 * 1024 * 1024; // blocks prefetched by all of a server's streams together
+    inline constexpr std::int64_t SERVE_UPLOAD_BUFFER_BYTES = 2ll * 1024 * 1024 * 1024; // chunk buffers held by all S3 uploads together
+
+    // Small-file packing
+    inline constexpr std::int64_t PACK_MAX_FILE_BYTES = 1ll * 1024 * 1024;  // files up to this size share pack objects
+    inline constexpr std::int64_t PACK_TARGET_BYTES = 64ll * 1024 * 1024;   // pack objects are filled up to this size
+
+    // Metrics (stats, /metrics)
+    inline constexpr int METRICS_PORT = 9464;             // default port of stats --serve
+    inline constexpr const char* METRICS_PORT_ENV = "DD_METRICS_PORT"; // if set, /metrics is served on 127.0.0.1 at this port while the process runs
+
+    // Progress display
+    inline constexpr int PROGRESS_REFRESH_HZ = 10;        // redraws per second; transfers never wait on drawing
+    inline constexpr std::chrono::seconds PROGRESS_RATE_WINDOW{3}; // rates shown are averaged over this long
+
+    // Tracing (--trace)
+    inline constexpr std::size_t TRACE_BUFFER_EVENTS = 1 << 16; // spans kept per thread; older ones are overwritten
+
+    // Daemon
+    inline constexpr const char* DAEMON_SOCKET = "data/daemon.sock"; // relative like the rest of data/: commands run in the daemon's directory use it
+    inline constexpr std::chrono::seconds DAEMON_CLIENT_TIMEOUT{60}; // a client that has not sent its command after this long is dropped
+
+    // Metadata log
+    inline constexpr std::size_t METADATA_COMPACT_RECORDS = 50000; // fold the log into a snapshot past this
 }
@@ -1,4 +1,15 @@
 #include "Shell.h"
+#include "ordered_fetch.h"
+#include "http_gateway.h"
+#include "chunk_writer.h"
+#include "s3_gateway.h"
+#include "drive_backend.h"
+#include "metrics.h"
+#include "metrics_server.h"
+#include "trace.h"
+#include "progress.h"
+#include "daemon.h"
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -9,42 +20,115 @@
 #include <iterator>
 #include <algorithm>
 #include <chrono>
-#include <indicators/progress_bar.hpp>
-#include <indicators/cursor_control.hpp>
+#include <ctime>
+#include <limits>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
 
 namespace fs = std::filesystem;
 
+// Accounts that are not Drive accounts: local directories and emulators.
+static const char* const kBackendsPath = "data/backends.json";
+
 struct ChunkData {
     int part_number;
     std::vector<char> buffer;
 };
 
+// Feeds one transfer's progress into an account's byte counter as it moves,
+// so rates can be watched mid-transfer. Backends that report no progress are
+// counted in one step by finish().
+class ByteMeter {
+public:
+    explicit ByteMeter(Counter& counter) : m_counter(counter) {}
+
+    void progress(std::int64_t done) {
+        if (done > m_counted) {
+            m_counter.add(done - m_counted);
+            m_counted = done;
+        }
+    }
+    // The transfer starts over, so its bytes move again.
+    void restart() { m_counted = 0; }
+    void finish(std::int64_t bytes) { progress(bytes); }
+
+private:
+    Counter& m_counter;
+    std::int64_t m_counted = 0;
+};
+
+// Labels of the metrics of transfers to ("up") or from ("down") an account.
+static MetricLabels transferLabels(const std::string& account, const char* direction) {
+    return {{"account", account}, {"direction", direction}};
+}
+
+// Counts one finished transfer and records its duration.
+static void recordTransferMetrics(const std::string& account, const char* direction, bool ok, double seconds) {
+    metrics().counter("dd_transfers_total",
+                      {{"account", account}, {"direction", direction}, {"result", ok ? "ok" : "failed"}}).add();
+    if (ok) {
+        metrics().histogram("dd_transfer_seconds", transferLabels(account, direction)).record(seconds);
+    }
+}
+
 Shell::Shell()
     : m_creds_path("data/credentials/credentials.json"),
-      m_metadata_changed(false),
       m_upload_slots(16) 
 {
     initializeState();
 
     m_commands = {
-        {"add-account", {"Add a new Google Drive account", [this](const auto& args) { addAccount(args); }}},
-        {"upload", {"Upload a file", [this](const auto& args) { uploadFile(args); }}},
-        {"download", {"Download a file", [this](const auto& args) { downloadFile(args); }}},
+        {"add-account", {"Add a Google Drive account (--local <name> <dir> or --emulator <name> for offline accounts)", [this](const auto& args) { addAccount(args); }}},
+        {"upload", {"Upload files (-r for directories, - for stdin, --to <remote>, --replicas N, --chunk-size MB)", [this](const auto& args) { uploadFile(args); }}},
+        {"download", {"Download a file (--race to race replicas for the last chunks)", [this](const auto& args) { downloadFile(args); }}},
+        {"cat", {"Write a file, or part of it (--range <offset>:<length>), to stdout", [this](const auto& args) { catFile(args); }}},
+        {"serve", {"Serve files over HTTP with range support (--s3 for an S3 endpoint, --port N, --bind <addr>)", [this](const auto& args) { serveFiles(args); }}},
         {"list", {"List uploaded files", [this](const auto& args) { listFiles(args); }}},
-        {"accounts", {"List connected accounts", [this](const auto& args) { listAccounts(args); }}},
+        {"ls", {"List a directory (-r to recurse)", [this](const auto& args) { listDirectory(args); }}},
+        {"find", {"Find files by glob pattern (*, ?, **)", [this](const auto& args) { findFiles(args); }}},
+        {"accounts", {"List connected accounts (--usage for space used)", [this](const auto& args) { listAccounts(args); }}},
+        {"cache", {"Show local chunk cache usage (cache clear to empty it)", [this](const auto& args) { cacheCommand(args); }}},
+        {"stats", {"Show transfer, request and queue metrics (--timing [--json] for Drive API phase timings, --serve [--port N] [--bind <addr>] for a /metrics endpoint)", [this](const auto& args) { statsCommand(args); }}},
+        {"daemon", {"Keep everything loaded and run other filesplitter commands from this directory (daemon stop to end it)", [this](const auto& args) { daemonCommand(args); }}},
         {"help", {"Show help", [this](const auto& args) { showHelp(args); }}},
-        {"exit", {"Exit the application", [this](const auto& args) { saveMetadataOnExit(); exit(0); }}},
+        {"exit", {"Exit the application", [this](const auto&) { saveMetadataOnExit(); exit(0); }}},
         {"delete", {"Delete a file from D-Drive", [this](const auto& args) { deleteFile(args); }}},
+        {"export-metadata", {"Export the catalog as JSON", [this](const auto& args) { exportMetadata(args); }}},
+        {"import-metadata", {"Merge a JSON catalog export into the catalog", [this](const auto& args) { importMetadata(args); }}},
         
     };
+
+    m_session_pool = std::make_unique<UploadSessionPool>(
+        [this](const std::string& account) {
+            // Pooled sessions are created before the chunk they will carry is
+            // known, so the object gets a generic name.
+            TraceSpan span("upload", "start pooled session", {}, account);
+            return backendFor(account)->startUpload("dd-chunk");
+        },
+        dd::UPLOAD_SESSION_POOL_SIZE, dd::UPLOAD_SESSION_MAX_AGE);
+
+    // One-shot commands cannot run `stats --serve` alongside themselves, so
+    // the endpoint can also be asked for through the environment.
+    const char* metrics_port = std::getenv(dd::METRICS_PORT_ENV);
+    if (metrics_port && *metrics_port) {
+        try {
+            startMetricsServer("127.0.0.1", std::stoi(metrics_port));
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: " << e.what() << std::endl;
+        }
+    }
 }
 
+Shell::~Shell() = default;
+
 void Shell::run() {
     std::cout << "Welcome to D-Drive CLI\nType 'help' to list available commands\n";
     std::string input;
     while (true) {
         std::cout << ">> ";
-        std::getline(std::cin, input);
+        if (!std::getline(std::cin, input)) break;
         auto tokens = parseCommand(input);
         if (tokens.empty()) continue;
         std::string cmd = tokens[0];
@@ -52,7 +136,7 @@ void Shell::run() {
         auto it = m_commands.find(cmd);
         if (it != m_commands.end()) {
             try {
-                it->second.handler(tokens);
+                runCommand(it->second, tokens);
             } catch (const std::exception& e) {
                 std::cerr << "Error: " << e.what() << std::endl;
             }
@@ -63,191 +147,1411 @@ void Shell::run() {
     saveMetadataOnExit();
 }
 
+// Runs a single command given on the command line, e.g.
+// `filesplitter download backups/db.tar - | tar x`, or sent to the daemon.
+// Nothing but the command's own output reaches stdout. Returns the process
+// exit status.
+int Shell::execute(const std::vector<std::string>& tokens) {
+    int status = 0;
+    auto it = m_commands.find(tokens[0]);
+    if (it == m_commands.end()) {
+        std::cerr << "Unknown command: " << tokens[0] << std::endl;
+        status = 1;
+    } else {
+        try {
+            runCommand(it->second, tokens);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            status = 1;
+        }
+    }
+    saveMetadataOnExit();
+    return status;
+}
+
+// Runs one command. Any command accepts `--trace <file>`: its spans are
+// recorded and written there as a Chrome trace when it finishes, or fails.
+void Shell::runCommand(const Command& command, std::vector<std::string> tokens) {
+    std::string trace_path;
+    auto flag = std::find(tokens.begin() + 1, tokens.end(), "--trace");
+    if (flag != tokens.end()) {
+        if (flag + 1 == tokens.end()) {
+            throw std::runtime_error("--trace needs an output file");
+        }
+        trace_path = *(flag + 1);
+        tokens.erase(flag, flag + 2);
+        trace::start();
+    }
+    auto writeTrace = [&] {
+        if (trace_path.empty()) return;
+        trace::writeTo(trace_path);
+        std::cerr << "Trace written to " << trace_path << " (open it in https://ui.perfetto.dev)" << std::endl;
+    };
+    try {
+        command.handler(tokens);
+    } catch (...) {
+        writeTrace();
+        throw;
+    }
+    writeTrace();
+}
+
+// Why a command cannot be run by the daemon for a client, or null if it can.
+// The daemon runs one command at a time, so one that never returns would
+// hold up every client after it, `daemon stop` included.
+static const char* refusedByDaemon(const std::vector<std::string>& tokens) {
+    if (tokens[0] == "serve") {
+        return "serve runs until stopped and would block the daemon; run it with the daemon stopped.";
+    }
+    if (tokens[0] == "exit") {
+        return "exit ends an interactive shell; stop the daemon with 'filesplitter daemon stop'.";
+    }
+    if (tokens[0] == "daemon" && (tokens.size() != 2 || tokens[1] != "stop")) {
+        return "A daemon is already running.";
+    }
+    return nullptr;
+}
+
+// daemon [stop]. Serves commands from other filesplitter processes started in
+// this directory (see DaemonServer) until `daemon stop`, which arrives as one
+// of them. It runs in the foreground; put it in the background with & or a
+// service manager. A command whose client goes away is cancelled: transfers
+// still running are aborted and nothing is committed.
+void Shell::daemonCommand(const std::vector<std::string>& args) {
+    if (args.size() > 2 || (args.size() == 2 && args[1] != "stop")) {
+        throw std::runtime_error("Usage: daemon [stop]");
+    }
+    if (args.size() == 2) {
+        if (!m_daemon) {
+            throw std::runtime_error("No daemon is running.");
+        }
+        m_daemon->stop();
+        std::cout << "Daemon stopping." << std::endl;
+        return;
+    }
+    if (m_daemon) {
+        throw std::runtime_error("The daemon is already running.");
+    }
+    m_daemon = std::make_unique<DaemonServer>(
+        dd::DAEMON_SOCKET, [this](const std::vector<std::string>& tokens, const std::atomic<bool>& cancelled) {
+            if (const char* reason = refusedByDaemon(tokens)) {
+                std::cerr << "Error: " << reason << std::endl;
+                return 1;
+            }
+            m_cancel = &cancelled;
+            const int status = execute(tokens);
+            m_cancel = nullptr;
+            return status;
+        });
+    try {
+        m_daemon->listen();
+        std::cout << "Serving commands on " << dd::DAEMON_SOCKET << "; stop with 'filesplitter daemon stop'." << std::endl;
+        m_daemon->serve();
+    } catch (...) {
+        m_daemon.reset();
+        throw;
+    }
+    m_daemon.reset();
+}
+
+// File contents read from stdin or written to stdout must not go through
+// newline translation.
+void Shell::setBinaryStdio() {
+#ifdef _WIN32
+    _setmode(_fileno(stdin), _O_BINARY);
+    _setmode(_fileno(stdout), _O_BINARY);
+#endif
+}
+
+// Final component of a local path, ignoring a trailing separator.
+static fs::path localBaseName(const fs::path& path) {
+    fs::path normal = path.lexically_normal();
+    return normal.has_filename() ? normal.filename() : normal.parent_path().filename();
+}
+
+// Remote path used when none is given: the local path relative to the
+// working directory, or just the final name for absolute and "../" paths.
+static std::string defaultRemotePath(const std::string& localPath) {
+    fs::path local = fs::path(localPath).lexically_normal();
+    if (local.is_absolute() || *local.begin() == "..") {
+        return normalizePath(localBaseName(local).generic_string());
+    }
+    return normalizePath(local.generic_string());
+}
+
 void Shell::uploadFile(const std::vector<std::string>& args) {
-    if (args.size() < 2)
-        throw std::runtime_error("Usage: upload <file_path>");
-    uploadFile(args[1]);
+    std::vector<std::string> paths;
+    std::optional<std::string> target;
+    bool recursive = false;
+    bool pack = true;
+    int replicas = dd::DEFAULT_REPLICAS;
+    std::int64_t chunkBytes = dd::UPLOAD_CHUNK_BYTES;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "--replicas" && i + 1 < args.size()) {
+            replicas = std::stoi(args[++i]);
+        } else if (args[i] == "--chunk-size" && i + 1 < args.size()) {
+            chunkBytes = static_cast<std::int64_t>(std::stod(args[++i]) * 1024 * 1024);
+            if (chunkBytes < 1)
+                throw std::runtime_error("Chunk size must be positive.");
+        } else if (args[i] == "--to" && i + 1 < args.size()) {
+            target = args[++i];
+        } else if (args[i] == "-r") {
+            recursive = true;
+        } else if (args[i] == "--no-pack") {
+            pack = false;
+        } else {
+            paths.push_back(args[i]);
+        }
+    }
+    if (paths.empty())
+        throw std::runtime_error("Usage: upload [-r] <path>... [--to <remote_path>] [--replicas N] [--chunk-size MB] [--no-pack]\n"
+                                 "       upload - [<remote_path>] [--replicas N] [--chunk-size MB]");
+
+    // "-" reads the file from stdin, e.g. `pg_dump db | filesplitter upload - backups/db.sql`.
+    if (paths[0] == "-") {
+        if (recursive || paths.size() > 2 || (paths.size() == 2 && target))
+            throw std::runtime_error("upload - takes a single remote path.");
+        std::string remotePath = paths.size() == 2 ? paths[1] : target ? *target : "";
+        if (remotePath.empty()) {
+            std::time_t now = std::time(nullptr);
+            char stamp[32];
+            std::strftime(stamp, sizeof(stamp), "stdin-%Y%m%d-%H%M%S", std::localtime(&now));
+            remotePath = stamp;
+        }
+        remotePath = normalizePath(remotePath);
+        if (remotePath.empty())
+            throw std::runtime_error("Remote path must name a file.");
+        setBinaryStdio();
+        uploadStream(std::cin, remotePath, replicas, chunkBytes);
+        return;
+    }
+
+    // Like cp: --to names the remote file when uploading one plain file,
+    // otherwise (or when it ends in '/') the remote directory to upload into.
+    const bool targetIsFile = target && paths.size() == 1 && !recursive && target->back() != '/';
+    std::vector<UploadJob> jobs;
+    for (const auto& path : paths) {
+        if (fs::is_directory(path)) {
+            if (!recursive)
+                throw std::runtime_error(path + " is a directory (use upload -r).");
+            std::string remoteDir = target ? normalizePath(joinPath(*target, localBaseName(path).generic_string()))
+                                           : defaultRemotePath(path);
+            std::vector<UploadJob> found = scanUploadTree(path, remoteDir, dd::UPLOAD_SCAN_THREADS);
+            jobs.insert(jobs.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+        } else if (fs::is_regular_file(path)) {
+            std::string remotePath = targetIsFile ? normalizePath(*target)
+                                   : target       ? normalizePath(joinPath(*target, localBaseName(path).generic_string()))
+                                                  : defaultRemotePath(path);
+            if (remotePath.empty())
+                throw std::runtime_error("Remote path must name a file.");
+            jobs.push_back({path, remotePath, static_cast<std::int64_t>(fs::file_size(path))});
+        } else {
+            throw std::runtime_error("Cannot open file: " + path);
+        }
+    }
+    if (jobs.empty()) {
+        std::cout << "Nothing to upload." << std::endl;
+        return;
+    }
+    uploadBatch(jobs, replicas, pack, chunkBytes);
 }
 
-void Shell::uploadFile(const std::string& localFilePath) {
-    if (m_local_accounts.empty()) {
+void Shell::uploadBatch(const std::vector<UploadJob>& jobs, int replicas, bool pack, std::int64_t chunk_bytes) {
+    if (m_accounts.empty()) {
         throw std::runtime_error("No linked accounts. Use 'add-account' first.");
     }
+    if (replicas < 1 || replicas > static_cast<int>(m_accounts.size())) {
+        throw std::runtime_error("Replica count must be between 1 and the number of linked accounts ("
+                                 + std::to_string(m_accounts.size()) + ").");
+    }
 
-    std::ifstream file(localFilePath, std::ios::binary | std::ios::ate);
-    if (!file) {
-        throw std::runtime_error("Cannot open file: " + localFilePath);
-    }
-
-    const std::streamsize fileSize = file.tellg();
-    file.seekg(0, std::ios::beg);
-
-    const int64_t chunkSize = 256 * 1024 * 1024;
-    const int totalChunks = (fileSize + chunkSize - 1) / chunkSize;
-    
-    const std::string fileName = fs::path(localFilePath).filename().string();
-    const std::string metadataKey = fileName;
-
-    m_metadata["files"][metadataKey]["total_size"] = fileSize;
-    m_metadata["files"][metadataKey]["chunks"] = json::array();
-
-    ThreadSafeQueue<ChunkData> chunkQueue;
-    std::mutex meta_mutex;
-    std::mutex progress_mutex;
-    std::atomic<long long> uploaded_bytes = 0;
-    std::atomic<int> successful_chunks = 0;
-    std::vector<std::future<void>> consumer_futures;
-
-    indicators::ProgressBar bar{
-        indicators::option::BarWidth{50},
-        indicators::option::Start{"["},
-        indicators::option::Fill{"="},
-        indicators::option::Lead{">"},
-        indicators::option::Remainder{" "},
-        indicators::option::End{"]"},
-        indicators::option::MaxProgress{static_cast<size_t>(fileSize)},
-        indicators::option::ShowPercentage{true},
-        indicators::option::ShowElapsedTime{true},
-        indicators::option::ShowRemainingTime{true}
+    const std::vector<PackPlan> packs = pack ? planPacks(jobs, dd::PACK_MAX_FILE_BYTES, dd::PACK_TARGET_BYTES)
+                                             : std::vector<PackPlan>{};
+    const std::vector<ChunkTask> tasks = scheduleChunks(jobs, packs, chunk_bytes, dd::SMALL_UPLOAD_BYTES);
+
+    // Per-file state. A file is committed to the catalog in one record once
+    // its last chunk is stored, so a failed or interrupted upload never shows
+    // up as a partial file.
+    struct FileState {
+        std::vector<ChunkEntry> chunks;
+        std::atomic<int> remaining{0};
+        std::atomic<bool> failed{false};
     };
-    
-    indicators::show_console_cursor(false);
-    auto start_time = std::chrono::steady_clock::now();
-
-    // 1. PRODUCER THREAD: Reads the file and pushes chunks into the queue
-    std::thread producer_thread([&]() {
-        for (int i = 0; i < totalChunks; ++i) {
-            int64_t currentChunkSize = std::min(chunkSize, static_cast<int64_t>(fileSize) - (static_cast<int64_t>(i) * chunkSize));
-            std::vector<char> buffer(currentChunkSize);
-            file.read(buffer.data(), currentChunkSize);
-            chunkQueue.push({i, std::move(buffer)});
-        }
-        chunkQueue.done(); // Signal that we are done producing chunks
-    });
+    std::vector<FileState> files(jobs.size());
+    std::int64_t totalBytes = 0;
+    for (const auto& task : tasks) {
+        if (task.pack >= 0) {
+            for (size_t j : packs[task.pack].jobs) files[j].remaining++;
+        } else {
+            files[task.job].remaining++;
+        }
+        totalBytes += task.length;
+    }
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        files[j].chunks.resize(files[j].remaining);
+    }
 
-    // 2. CONSUMER THREADS: The upload pool
-    for (int i = 0; i < totalChunks; ++i) {
-        consumer_futures.emplace_back(std::async(std::launch::async, [&, i] {
-            ChunkData chunk_data;
-            if (!chunkQueue.pop(chunk_data)) {
-                // This can happen if another thread failed and we are cleaning up
-                return;
+    std::mutex output_mutex;
+    std::vector<size_t> failed_files;
+    ProgressDisplay progress("Uploading", accountNames(), totalBytes * replicas, ProgressDisplay::Unit::Bytes,
+                             static_cast<std::int64_t>(jobs.size()), "files");
+
+    auto commitFile = [&](size_t j) {
+        if (files[j].failed) {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            failed_files.push_back(j);
+            return;
+        }
+        TraceSpan span("upload", "commit", jobs[j].remote_path);
+        json chunks = json::array();
+        for (const auto& chunk : files[j].chunks) {
+            chunks.push_back(toJson(chunk));
+        }
+        m_metadata->apply({
+            {"op", "put_file"},
+            {"file", jobs[j].remote_path},
+            {"total_size", jobs[j].size},
+            {"replicas", replicas},
+            {"chunks", chunks}
+        });
+        progress.itemDone();
+    };
+    for (size_t j = 0; j < jobs.size(); ++j) {
+        if (files[j].chunks.empty()) commitFile(j);
+    }
+
+    // Uploads one copy of a chunk to one account. Returns the object id, or
+    // an empty string if this replica could not be stored.
+    auto uploadReplica = [&](const ChunkData& chunk_data, const std::string& objectName, const std::string& account,
+                             const std::string& sessionUri) -> std::string {
+        std::int64_t chunk_uploaded = 0;
+        try {
+            return uploadObject(chunk_data.buffer, objectName, account, sessionUri,
+                [&](std::int64_t now_ul, std::int64_t) -> bool {
+                    progress.add(account, now_ul - chunk_uploaded);
+                    chunk_uploaded = now_ul;
+                    return true;
+                });
+        } catch (const std::exception& e) {
+            progress.add(account, -chunk_uploaded);
+            std::lock_guard<std::mutex> lock(output_mutex);
+            std::cerr << "\nError uploading " << objectName << " to " << account << ": " << e.what() << std::endl;
+            return std::string();
+        }
+    };
+
+    // One pool of workers drains the scheduled chunks of every file. Each
+    // worker reads its chunk just before uploading it, so memory stays bounded
+    // by the worker count. Accounts are assigned round-robin across the whole
+    // batch, so many single-chunk files still spread over every account.
+    std::atomic<size_t> next_task = 0;
+    std::atomic<size_t> next_account = 0;
+
+    // The next `replicas` consecutive accounts in the batch-wide rotation.
+    using AccountRef = std::map<std::string, std::shared_ptr<StorageBackend>>::const_iterator;
+    auto pickAccounts = [&] {
+        const size_t first = next_account++;
+        std::vector<AccountRef> accounts;
+        for (int r = 0; r < replicas; ++r) {
+            accounts.push_back(std::next(m_accounts.cbegin(), (first + r) % m_accounts.size()));
+        }
+        return accounts;
+    };
+
+    // Objects above the multipart limit need a resumable session on backends
+    // that have them. A session from the pool is used when one is ready;
+    // otherwise it is started before the chunk is read, overlapping the
+    // initiation round trip with the disk read. A session that fails to start
+    // is retried inline.
+    auto startSessions = [&](const std::vector<AccountRef>& accounts, const std::string& objectName) {
+        std::vector<std::future<std::string>> sessions;
+        for (const auto& account_it : accounts) {
+            std::string pooled = account_it->second->hasUploadSessions() ? m_session_pool->take(account_it->first)
+                                                                         : std::string();
+            if (!pooled.empty() || !account_it->second->hasUploadSessions()) {
+                sessions.emplace_back(std::async(std::launch::deferred, [pooled] { return pooled; }));
+                continue;
             }
+            sessions.emplace_back(std::async(std::launch::async, [account_it, objectName] {
+                TraceSpan span("upload", "start session", objectName, account_it->first);
+                try {
+                    return account_it->second->startUpload(objectName);
+                } catch (const std::exception&) {
+                    return std::string();
+                }
+            }));
+        }
+        return sessions;
+    };
 
-            m_upload_slots.acquire();
-            try {
-                auto account_it = std::next(m_local_accounts.begin(), chunk_data.part_number % m_local_accounts.size());
-                std::string account = account_it->first;
-                std::string tokenPath = account_it->second;
-
-                GDriveHandler gdrive(tokenPath, m_creds_path);
-                gdrive.ensureAuthenticated();
-                
-                const std::string CHUNK_FOLDER_NAME = "D-Drive Chunks";
-                std::string chunkFolderId = gdrive.findFileOrFolder(CHUNK_FOLDER_NAME, "root");
-                if (chunkFolderId.empty()) {
-                    chunkFolderId = gdrive.createFolder(CHUNK_FOLDER_NAME, "root");
+    // Stores one copy of a buffer on each account and returns the copies
+    // that succeeded.
+    auto storeCopies = [&](const ChunkData& chunk_data, const std::string& objectName,
+                           const std::vector<AccountRef>& accounts, std::vector<std::future<std::string>> sessions) {
+        std::vector<std::future<std::string>> replica_futures;
+        for (size_t r = 0; r < accounts.size(); ++r) {
+            std::string sessionUri;
+            if (r < sessions.size()) {
+                TraceSpan span("upload", "wait for session", objectName, accounts[r]->first);
+                sessionUri = sessions[r].get();
+            }
+            replica_futures.emplace_back(std::async(std::launch::async, [&, r, sessionUri] {
+                return uploadReplica(chunk_data, objectName, accounts[r]->first, sessionUri);
+            }));
+        }
+        std::vector<Replica> copies;
+        for (size_t r = 0; r < accounts.size(); ++r) {
+            std::string fileId = replica_futures[r].get();
+            if (!fileId.empty()) {
+                copies.push_back({accounts[r]->first, fileId});
+            }
+        }
+        return copies;
+    };
+
+    // Records one finished chunk; the file is committed with its last one.
+    auto finishChunk = [&](size_t j, ChunkEntry chunk) {
+        FileState& state = files[j];
+        if (chunk.replicas.empty()) {
+            state.failed = true;
+        } else if (static_cast<int>(chunk.replicas.size()) < replicas) {
+            std::lock_guard<std::mutex> lock(output_mutex);
+            std::cerr << "\nWarning: " << jobs[j].remote_path << " chunk " << chunk.part << " stored on only "
+                      << chunk.replicas.size() << "/" << replicas << " accounts." << std::endl;
+        }
+        const int part = chunk.part;
+        state.chunks[part] = std::move(chunk);
+        if (--state.remaining == 0) {
+            commitFile(j);
+        }
+    };
+
+    // Small files travel as one pack object; each member's catalog entry is a
+    // single chunk pointing at its slice of the pack.
+    const std::string packPrefix = "dd-pack-" + std::to_string(
+        std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    auto uploadPack = [&](int index) {
+        const PackPlan& plan = packs[index];
+        ChunkData chunk_data{0, std::vector<char>(static_cast<size_t>(plan.size))};
+        Gauge::Scope held(metrics().gauge("dd_buffer_bytes", {{"pool", "upload"}}), plan.size);
+        std::vector<bool> readable(plan.jobs.size(), false);
+        bool anyReadable = false;
+        const std::string packName = packPrefix + "-" + std::to_string(index) + ".part0";
+        std::optional<TraceSpan> reading(std::in_place, "upload", "read", packName);
+        for (size_t m = 0; m < plan.jobs.size(); ++m) {
+            const UploadJob& job = jobs[plan.jobs[m]];
+            std::ifstream in(job.local_path, std::ios::binary);
+            readable[m] = static_cast<bool>(in.read(chunk_data.buffer.data() + plan.offsets[m], job.size));
+            anyReadable = anyReadable || readable[m];
+            if (!readable[m]) {
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cerr << "\nError reading " << job.local_path << std::endl;
+            }
+        }
+        reading.reset();
+        std::vector<Replica> copies;
+        if (anyReadable) {
+            copies = storeCopies(chunk_data, packName, pickAccounts(), {});
+            cacheUploaded(copies, std::move(chunk_data.buffer));
+        }
+        for (size_t m = 0; m < plan.jobs.size(); ++m) {
+            ChunkEntry chunk;
+            chunk.pack_offset = plan.offsets[m];
+            if (readable[m]) chunk.replicas = copies;
+            finishChunk(plan.jobs[m], std::move(chunk));
+        }
+    };
+
+    // Warm the session pool while the first chunks are read.
+    if (std::any_of(tasks.begin(), tasks.end(), [](const ChunkTask& task) {
+            return static_cast<size_t>(task.length) > dd::MULTIPART_UPLOAD_MAX_BYTES;
+        })) {
+        prefillSessions();
+    }
+
+    Gauge& queued = metrics().gauge("dd_queue_depth", {{"queue", "upload_chunks"}});
+    Gauge& buffered = metrics().gauge("dd_buffer_bytes", {{"pool", "upload"}});
+    queued.add(static_cast<std::int64_t>(tasks.size()));
+    auto worker = [&] {
+        for (size_t t = next_task++; t < tasks.size(); t = next_task++) {
+            queued.add(-1);
+            const ChunkTask& task = tasks[t];
+            if (task.pack >= 0) {
+                uploadPack(task.pack);
+                continue;
+            }
+            const UploadJob& job = jobs[task.job];
+
+            // Each chunk records its size, so reads locate bytes whatever
+            // chunk size the file was uploaded with.
+            ChunkEntry chunk;
+            chunk.part = task.part;
+            chunk.size = task.length;
+            if (!files[task.job].failed) {
+                const std::string objectName = std::string(baseName(job.remote_path)) + ".part" + std::to_string(task.part);
+                const std::vector<AccountRef> accounts = pickAccounts();
+                std::vector<std::future<std::string>> sessions;
+                if (static_cast<size_t>(task.length) > dd::MULTIPART_UPLOAD_MAX_BYTES) {
+                    sessions = startSessions(accounts, objectName);
                 }
+                ChunkData chunk_data{task.part, std::vector<char>(static_cast<size_t>(task.length))};
+                Gauge::Scope held(buffered, task.length);
+                std::ifstream in(job.local_path, std::ios::binary);
+                in.seekg(task.offset);
+                bool read_ok;
+                {
+                    TraceSpan span("upload", "read", objectName);
+                    read_ok = static_cast<bool>(in.read(chunk_data.buffer.data(), task.length));
+                }
+                if (read_ok) {
+                    chunk.replicas = storeCopies(chunk_data, objectName, accounts, std::move(sessions));
+                    cacheUploaded(chunk.replicas, std::move(chunk_data.buffer));
+                } else {
+                    std::lock_guard<std::mutex> lock(output_mutex);
+                    std::cerr << "\nError reading " << job.local_path << " at offset " << task.offset << std::endl;
+                }
+            }
+            finishChunk(task.job, std::move(chunk));
+        }
+    };
 
-                cpr::cpr_off_t chunk_uploaded = 0;
-                std::string fileId = gdrive.uploadChunk(
-                    chunk_data.buffer,
-                    fileName + ".part" + std::to_string(chunk_data.part_number),
-                    chunkFolderId,
-                    [&](cpr::cpr_off_t, cpr::cpr_off_t, cpr::cpr_off_t, cpr::cpr_off_t now_ul, intptr_t) -> bool {
-                        cpr::cpr_off_t delta = now_ul - chunk_uploaded;
-                        chunk_uploaded = now_ul;
-                        uploaded_bytes += delta;
-
-                        std::lock_guard<std::mutex> lock(progress_mutex);
-                        auto now = std::chrono::steady_clock::now();
-                        auto elapsed_seconds = std::chrono::duration_cast<std::chrono::seconds>(now - start_time).count();
-                        if (elapsed_seconds > 0) {
-                            double speed = static_cast<double>(uploaded_bytes) / elapsed_seconds;
-                            std::stringstream speed_ss;
-                            speed_ss << std::fixed << std::setprecision(1) << (speed / (1024.0 * 1024.0)) << " MB/s";
-                            bar.set_option(indicators::option::PostfixText{speed_ss.str()});
-                        }
-                        bar.set_progress(uploaded_bytes);
+    std::vector<std::thread> workers;
+    const size_t workerCount = std::min<size_t>(dd::UPLOAD_WORKERS, tasks.size());
+    for (size_t i = 0; i < workerCount; ++i) {
+        workers.emplace_back(worker);
+    }
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    // Chunks of failed files are not referenced by the catalog; remove them
+    // rather than leaving orphans on the accounts.
+    std::vector<Replica> orphans;
+    for (size_t j : failed_files) {
+        for (const auto& chunk : files[j].chunks) {
+            if (chunk.packed()) continue;   // a failed member holds no copies of its pack
+            orphans.insert(orphans.end(), chunk.replicas.begin(), chunk.replicas.end());
+        }
+    }
+    deleteObjects(orphans);
+
+    progress.finish(failed_files.empty() ? "Upload Complete!" : "Upload Failed!");
+    if (failed_files.empty()) {
+        if (jobs.size() == 1) {
+            std::cout << "File uploaded successfully. Metadata saved." << std::endl;
+        } else {
+            std::cout << jobs.size() << " files uploaded successfully. Metadata saved." << std::endl;
+        }
+    } else {
+        std::cerr << "Upload failed for " << failed_files.size() << "/" << jobs.size() << " file(s):" << std::endl;
+        for (size_t j : failed_files) {
+            std::cerr << "  " << jobs[j].local_path << std::endl;
+        }
+    }
+
+    m_metadata->sync();
+}
+
+// Uploads a stream of unknown length, such as a pipe, as `remote_path`.
+// Chunks are cut as data arrives and uploaded while the next one is read; at
+// most MAX_INFLIGHT_UPLOADS chunks are held in memory, so reading pauses when
+// the uploads fall behind. The file is committed with its final size and
+// chunk list once the stream ends and every chunk is stored; on failure the
+// chunks already stored are removed again.
+void Shell::uploadStream(std::istream& in, const std::string& remote_path, int replicas, std::int64_t chunk_bytes) {
+    if (m_accounts.empty()) {
+        throw std::runtime_error("No linked accounts. Use 'add-account' first.");
+    }
+    if (replicas < 1 || replicas > static_cast<int>(m_accounts.size())) {
+        throw std::runtime_error("Replica count must be between 1 and the number of linked accounts ("
+                                 + std::to_string(m_accounts.size()) + ").");
+    }
+    prefillSessions();
+
+    // The stream's length is unknown, so progress is the bytes uploaded so
+    // far and the rate.
+    std::int64_t read_bytes = 0;
+    ProgressDisplay progress("Uploading", accountNames(), 0);
+
+    ChunkWriter writer(
+        [&](int part, const std::vector<char>& data) {
+            return storeChunk(std::string(baseName(remote_path)) + ".part" + std::to_string(part), data, replicas,
+                              static_cast<size_t>(part) * replicas,
+                              [&](const std::string& account, std::int64_t sent) { progress.add(account, sent); });
+        },
+        chunk_bytes, dd::MAX_INFLIGHT_UPLOADS);
+
+    // istream::read keeps reading a pipe until the block is full or the
+    // stream ends.
+    bool failed = false;
+    std::vector<char> block(4 * 1024 * 1024);
+    while (true) {
+        in.read(block.data(), static_cast<std::streamsize>(block.size()));
+        const size_t got = static_cast<size_t>(in.gcount());
+        if (in.bad()) {
+            failed = true;
+            std::cerr << "\nError reading the input stream." << std::endl;
+            break;
+        }
+        read_bytes += static_cast<std::int64_t>(got);
+        if (!writer.write(block.data(), got) || got < block.size()) {
+            break;
+        }
+    }
+    // Input cut short by a client that went away is not the whole stream.
+    if (cancelled()) {
+        failed = true;
+    }
+    const std::vector<ChunkEntry> chunks = writer.finish();
+    for (const auto& chunk : chunks) {
+        if (chunk.replicas.empty()) {
+            failed = true;
+        } else if (static_cast<int>(chunk.replicas.size()) < replicas) {
+            std::cerr << "\nWarning: " << remote_path << " chunk " << chunk.part << " stored on only "
+                      << chunk.replicas.size() << "/" << replicas << " accounts." << std::endl;
+        }
+    }
+    progress.finish(failed ? "Upload Failed!" : "Upload Complete!");
+
+    if (failed) {
+        std::vector<Replica> orphans;
+        for (const auto& chunk : chunks) {
+            orphans.insert(orphans.end(), chunk.replicas.begin(), chunk.replicas.end());
+        }
+        deleteObjects(orphans);
+        throw std::runtime_error("Upload of " + remote_path + " from the input stream failed.");
+    }
+
+    TraceSpan span("upload", "commit", remote_path);
+    json chunkList = json::array();
+    for (const auto& chunk : chunks) {
+        chunkList.push_back(toJson(chunk));
+    }
+    m_metadata->apply({
+        {"op", "put_file"},
+        {"file", remote_path},
+        {"total_size", read_bytes},
+        {"replicas", replicas},
+        {"chunks", chunkList}
+    });
+    m_metadata->sync();
+    std::cout << "Uploaded " << read_bytes << " bytes in " << chunks.size() << " chunks as " << remote_path << "."
+              << std::endl;
+}
+
+// Stores one chunk on `replicas` consecutive accounts starting at
+// `first_account`, in parallel. Returns the copies that were stored; failures
+// are reported as warnings. `on_sent` receives each account's upload progress
+// as byte deltas (negative when a failed copy's bytes are taken back).
+std::vector<Replica> Shell::storeChunk(const std::string& object_name, const std::vector<char>& data, int replicas,
+                                       size_t first_account,
+                                       const std::function<void(const std::string&, std::int64_t)>& on_sent) {
+    Gauge::Scope held(metrics().gauge("dd_buffer_bytes", {{"pool", "stream"}}), static_cast<std::int64_t>(data.size()));
+    std::vector<std::future<std::string>> copies;
+    std::vector<std::string> accounts;
+    for (int r = 0; r < replicas; ++r) {
+        auto account_it = std::next(m_accounts.cbegin(), (first_account + r) % m_accounts.size());
+        accounts.push_back(account_it->first);
+        copies.emplace_back(std::async(std::launch::async, [&, account_it] {
+            const std::string session =
+                data.size() > dd::MULTIPART_UPLOAD_MAX_BYTES && account_it->second->hasUploadSessions()
+                    ? m_session_pool->take(account_it->first)
+                    : std::string();
+            std::int64_t sent = 0;
+            try {
+                return uploadObject(data, object_name, account_it->first, session,
+                    [&](std::int64_t now_ul, std::int64_t) -> bool {
+                        if (on_sent) on_sent(account_it->first, now_ul - sent);
+                        sent = now_ul;
                         return true;
                     });
+            } catch (const std::exception& e) {
+                if (on_sent) on_sent(account_it->first, -sent);
+                std::cerr << "\nError uploading " << object_name << " to " << account_it->first << ": "
+                          << e.what() << std::endl;
+                return std::string();
+            }
+        }));
+    }
+    std::vector<Replica> stored;
+    for (size_t r = 0; r < copies.size(); ++r) {
+        std::string fileId = copies[r].get();
+        if (!fileId.empty()) {
+            stored.push_back({accounts[r], fileId});
+        }
+    }
+    return stored;
+}
 
-                {
-                    std::lock_guard<std::mutex> lock(meta_mutex);
-                    m_metadata["files"][metadataKey]["chunks"].push_back({
-                        {"part", chunk_data.part_number},
-                        {"account", account},
-                        {"drive_file_id", fileId}
-                    });
+// Uploads one copy of a buffer to one account while holding an upload slot;
+// the account stats count it as load on the account while it runs.
+// `session_uri` may name a session started ahead of time; such a session may
+// have gone stale, so if sending through it fails the upload is retried once
+// on a fresh session, after reporting zero progress so that callers tracking
+// deltas stay consistent. Returns the object id; throws on failure.
+std::string Shell::uploadObject(const std::vector<char>& data, const std::string& object_name,
+                                const std::string& account, const std::string& session_uri,
+                                const StorageBackend::Progress& progress) {
+    const std::shared_ptr<StorageBackend> backend = backendFor(account);
+    {
+        TraceSpan span("upload", "wait for slot", object_name, account);
+        Gauge::Scope waiting(metrics().gauge("dd_queue_depth", {{"queue", "upload_slots"}}));
+        m_upload_slots.acquire();
+    }
+    const MetricLabels labels = transferLabels(account, "up");
+    try {
+        AccountStats::InFlight in_flight(m_account_stats, account);
+        auto transfer_start = std::chrono::steady_clock::now();
+        Gauge::Scope in_flight_metric(metrics().gauge("dd_transfers_in_flight", labels));
+        ByteMeter meter(metrics().counter("dd_transfer_bytes_total", labels));
+        const StorageBackend::Progress metered = [&](std::int64_t done, std::int64_t total) {
+            meter.progress(done);
+            return !cancelled() && (!progress || progress(done, total));
+        };
+
+        std::string session = session_uri;
+        std::string fileId;
+        while (true) {
+            try {
+                if (cancelled()) {
+                    throw std::runtime_error("Cancelled");
+                }
+                TraceSpan span("upload", "transfer", object_name, account);
+                fileId = backend->put(data, object_name, session, metered);
+                break;
+            } catch (const std::exception&) {
+                if (session.empty() || cancelled()) throw;
+                session.clear();
+                meter.restart();
+                metrics().counter("dd_retries_total", {{"kind", "upload_session"}}).add();
+                if (progress) progress(0, static_cast<std::int64_t>(data.size()));
+            }
+        }
+        meter.finish(static_cast<std::int64_t>(data.size()));
+
+        std::chrono::duration<double> took = std::chrono::steady_clock::now() - transfer_start;
+        recordTransferMetrics(account, "up", true, took.count());
+        m_upload_slots.release();
+        return fileId;
+    } catch (...) {
+        // A cancelled command's transfers did nothing wrong.
+        if (!cancelled()) {
+            recordTransferMetrics(account, "up", false, 0);
+        }
+        m_upload_slots.release();
+        throw;
+    }
+}
+
+// With CACHE_UPLOADS, keeps a just-uploaded file chunk or pack in the local
+// cache under its primary copy's object key, which downloads look it up by.
+// The write and its sync happen on a thread of their own, one chunk at a
+// time; a chunk finishing while the previous one is still being written is
+// not cached, so caching never holds up an upload or keeps more than one
+// extra buffer alive. Streamed uploads are never cached.
+void Shell::cacheUploaded(const std::vector<Replica>& copies, std::vector<char>&& data) {
+    if (!dd::CACHE_UPLOADS || !m_chunk_cache->enabled() || copies.empty()) return;
+    std::lock_guard<std::mutex> lock(m_cache_write_mutex);
+    if (m_cache_write.valid() && m_cache_write.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return;
+    }
+    m_cache_write = std::async(std::launch::async, [this, key = objectKey(copies[0]), data = std::move(data)] {
+        m_chunk_cache->insert(key, data.data(), data.size());
+    });
+}
+
+void Shell::cacheCommand(const std::vector<std::string>& args) {
+    if (args.size() > 1 && args[1] == "clear") {
+        m_chunk_cache->clear();
+        std::cout << "Chunk cache cleared." << std::endl;
+        return;
+    }
+    if (!m_chunk_cache->enabled()) {
+        std::cout << "The chunk cache is disabled (CHUNK_CACHE_BYTES is 0)." << std::endl;
+        return;
+    }
+    const ChunkCache::Stats stats = m_chunk_cache->stats();
+    const double mb = 1024.0 * 1024.0;
+    const std::int64_t lookups = stats.hits + stats.misses;
+    std::cout << std::fixed << std::setprecision(1)
+              << "Cached objects: " << stats.entries << "\n"
+              << "Used:           " << stats.resident_bytes / mb << " / " << stats.budget_bytes / mb << " MB\n"
+              << "  seen once:    " << stats.recent_bytes / mb << " MB (target " << stats.recent_target / mb << " MB)\n"
+              << "  seen again:   " << stats.frequent_bytes / mb << " MB\n"
+              << "Hit rate:       " << (lookups > 0 ? 100.0 * stats.hits / lookups : 0.0) << "% of " << lookups
+              << " lookups this session" << std::endl;
+}
+
+// Value of label `name` in a series' labels, or "" if it has none.
+static std::string labelValue(const MetricLabels& labels, const std::string& name) {
+    for (const auto& [key, value] : labels) {
+        if (key == name) return value;
+    }
+    return std::string();
+}
+
+// Drive API request timing per account and endpoint: request and new
+// connection counts, bytes, and quantiles of the total time and of each
+// phase curl reports.
+static json httpTiming() {
+    Metrics& registry = metrics();
+    std::map<std::pair<std::string, std::string>, json> rows;
+    auto rowOf = [&](const MetricLabels& labels) -> json& {
+        json& row = rows[{labelValue(labels, "account"), labelValue(labels, "endpoint")}];
+        if (row.is_null()) {
+            row = {{"account", labelValue(labels, "account")}, {"endpoint", labelValue(labels, "endpoint")},
+                   {"requests", 0}, {"new_connections", 0}, {"bytes_up", 0}, {"bytes_down", 0},
+                   {"seconds", json::object()}};
+        }
+        return row;
+    };
+    auto quantiles = [](const Histogram::Snapshot& snap) {
+        return json{{"p50", snap.quantile(0.5)}, {"p90", snap.quantile(0.9)}, {"p99", snap.quantile(0.99)},
+                    {"max", snap.max}, {"mean", snap.count > 0 ? snap.sum / static_cast<double>(snap.count) : 0.0}};
+    };
+    for (const auto& [labels, histogram] : registry.histograms("dd_http_request_seconds")) {
+        const Histogram::Snapshot snap = histogram->snapshot();
+        json& row = rowOf(labels);
+        row["requests"] = snap.count;
+        row["seconds"]["total"] = quantiles(snap);
+        row["busy_seconds"] = snap.sum;
+    }
+    for (const auto& [labels, histogram] : registry.histograms("dd_http_phase_seconds")) {
+        rowOf(labels)["seconds"][labelValue(labels, "phase")] = quantiles(histogram->snapshot());
+    }
+    for (const auto& [labels, counter] : registry.counters("dd_http_connections_total")) {
+        rowOf(labels)["new_connections"] = counter->value();
+    }
+    for (const auto& [labels, counter] : registry.counters("dd_http_bytes_total")) {
+        rowOf(labels)[labelValue(labels, "direction") == "up" ? "bytes_up" : "bytes_down"] = counter->value();
+    }
+    json out = json::array();
+    for (auto& [key, row] : rows) {
+        const double busy = row.value("busy_seconds", 0.0);
+        const double bytes = row["bytes_up"].get<double>() + row["bytes_down"].get<double>();
+        row["mb_per_s"] = busy > 0 ? bytes / (1024.0 * 1024.0) / busy : 0.0;
+        row.erase("busy_seconds");
+        out.push_back(std::move(row));
+    }
+    return out;
+}
+
+// Prints httpTiming() as a table of medians, in milliseconds.
+static void printHttpTiming(const json& timing) {
+    if (timing.empty()) {
+        std::cout << "No Drive API requests yet." << std::endl;
+        return;
+    }
+    const char* phases[] = {"dns", "connect", "tls", "wait", "transfer"};
+    std::cout << "--- Drive API timing (median ms per phase) ---\n" << std::left << std::setw(28) << "account"
+              << std::setw(24) << "endpoint" << std::right << std::setw(8) << "calls" << std::setw(7) << "new"
+              << std::setw(9) << "dns" << std::setw(9) << "connect" << std::setw(9) << "tls" << std::setw(9)
+              << "wait" << std::setw(10) << "transfer" << std::setw(10) << "total" << std::setw(10) << "p99"
+              << std::setw(9) << "MB/s" << "\n";
+    for (const auto& row : timing) {
+        const json& seconds = row["seconds"];
+        auto ms = [&](const char* phase, const char* quantile) {
+            return seconds.contains(phase) ? seconds[phase][quantile].get<double>() * 1000 : 0.0;
+        };
+        std::cout << std::left << std::setw(28) << row["account"].get<std::string>() << std::setw(24)
+                  << row["endpoint"].get<std::string>() << std::right << std::setw(8) << row["requests"].get<std::int64_t>()
+                  << std::setw(7) << row["new_connections"].get<std::int64_t>() << std::fixed << std::setprecision(1);
+        for (const char* phase : phases) {
+            std::cout << std::setw(std::string(phase) == "transfer" ? 10 : 9) << ms(phase, "p50");
+        }
+        std::cout << std::setw(10) << ms("total", "p50") << std::setw(10) << ms("total", "p99") << std::setw(9)
+                  << row["mb_per_s"].get<double>() << "\n";
+    }
+    std::cout << "new: connections opened rather than reused; wait: request sent to first response byte "
+                 "(includes the body for uploads)" << std::endl;
+}
+
+void Shell::statsCommand(const std::vector<std::string>& args) {
+    if (args.size() > 1 && args[1] == "--timing") {
+        const json timing = httpTiming();
+        if (args.size() > 2 && args[2] == "--json") {
+            std::cout << timing.dump(2) << std::endl;
+        } else {
+            printHttpTiming(timing);
+        }
+        return;
+    }
+    if (args.size() > 1 && args[1] == "--serve") {
+        std::string host = "127.0.0.1";
+        int port = dd::METRICS_PORT;
+        for (size_t i = 2; i < args.size(); ++i) {
+            if (args[i] == "--port" && i + 1 < args.size()) {
+                port = std::stoi(args[++i]);
+            } else if (args[i] == "--bind" && i + 1 < args.size()) {
+                host = args[++i];
+            } else {
+                throw std::runtime_error("Usage: stats [--timing [--json] | --serve [--port <port>] [--bind <address>]]");
+            }
+        }
+        startMetricsServer(host, port);
+        return;
+    }
+
+    refreshGauges();
+    Metrics& registry = metrics();
+    const double mb = 1024.0 * 1024.0;
+
+    // Per account and direction: bytes, transfers, failures, in flight and
+    // transfer time quantiles.
+    struct Row {
+        std::int64_t bytes = 0, ok = 0, failed = 0, in_flight = 0;
+        Histogram::Snapshot seconds;
+    };
+    std::map<std::pair<std::string, std::string>, Row> rows;
+    for (const auto& [account, backend] : m_accounts) {
+        rows[{account, "up"}];
+        rows[{account, "down"}];
+    }
+    auto rowOf = [&](const MetricLabels& labels) -> Row& {
+        return rows[{labelValue(labels, "account"), labelValue(labels, "direction")}];
+    };
+    for (const auto& [labels, counter] : registry.counters("dd_transfer_bytes_total")) rowOf(labels).bytes = counter->value();
+    for (const auto& [labels, counter] : registry.counters("dd_transfers_total")) {
+        (labelValue(labels, "result") == "ok" ? rowOf(labels).ok : rowOf(labels).failed) = counter->value();
+    }
+    for (const auto& [labels, gauge] : registry.gauges("dd_transfers_in_flight")) rowOf(labels).in_flight = gauge->value();
+    for (const auto& [labels, histogram] : registry.histograms("dd_transfer_seconds")) rowOf(labels).seconds = histogram->snapshot();
+
+    std::cout << "--- Transfers by account ---\n" << std::left << std::setw(32) << "account" << std::setw(6) << "dir"
+              << std::right << std::setw(12) << "MB" << std::setw(10) << "objects" << std::setw(8) << "failed"
+              << std::setw(10) << "running" << std::setw(10) << "p50 s" << std::setw(10) << "p99 s" << "\n";
+    for (const auto& [key, row] : rows) {
+        std::cout << std::left << std::setw(32) << key.first << std::setw(6) << key.second << std::right << std::fixed
+                  << std::setprecision(1) << std::setw(12) << row.bytes / mb << std::setw(10) << row.ok << std::setw(8)
+                  << row.failed << std::setw(10) << row.in_flight << std::setprecision(2) << std::setw(10)
+                  << row.seconds.quantile(0.5) << std::setw(10) << row.seconds.quantile(0.99) << "\n";
+    }
+
+    // Drive API requests by endpoint, with the statuses seen.
+    std::map<std::string, std::map<std::string, std::int64_t>> statuses;
+    for (const auto& [labels, counter] : registry.counters("dd_http_requests_total")) {
+        statuses[labelValue(labels, "endpoint")][labelValue(labels, "status")] += counter->value();
+    }
+    if (!statuses.empty()) {
+        std::map<std::string, Histogram::Snapshot> latency;
+        for (const auto& [labels, histogram] : registry.histograms("dd_http_request_seconds")) {
+            latency[labelValue(labels, "endpoint")].merge(histogram->snapshot());
+        }
+        std::cout << "\n--- Drive API requests ---\n" << std::left << std::setw(24) << "endpoint" << std::right
+                  << std::setw(10) << "requests" << std::setw(10) << "p50 ms" << std::setw(10) << "p99 ms"
+                  << std::setw(10) << "max ms" << "  statuses\n";
+        for (const auto& [endpoint, by_status] : statuses) {
+            const Histogram::Snapshot& snap = latency[endpoint];
+            std::ostringstream seen;
+            for (const auto& [status, count] : by_status) seen << " " << status << ":" << count;
+            std::cout << std::left << std::setw(24) << endpoint << std::right << std::setw(10) << snap.count
+                      << std::fixed << std::setprecision(1) << std::setw(10) << snap.quantile(0.5) * 1000
+                      << std::setw(10) << snap.quantile(0.99) * 1000 << std::setw(10) << snap.max * 1000 << " "
+                      << seen.str() << "\n";
+        }
+    }
+
+    auto listCounters = [&](const std::string& name, const std::string& label) {
+        std::ostringstream out;
+        for (const auto& [labels, counter] : registry.counters(name)) {
+            out << (out.tellp() > 0 ? ", " : "") << labelValue(labels, label) << " " << counter->value();
+        }
+        return out.tellp() > 0 ? out.str() : std::string("none");
+    };
+    auto listGauges = [&](const std::string& name, const std::string& label, double scale, const char* unit) {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(scale == 1 ? 0 : 1);
+        for (const auto& [labels, gauge] : registry.gauges(name)) {
+            out << (out.tellp() > 0 ? ", " : "") << labelValue(labels, label) << " " << gauge->value() / scale << unit;
+        }
+        return out.tellp() > 0 ? out.str() : std::string("none");
+    };
+    std::cout << "\nRetries:         " << listCounters("dd_retries_total", "kind") << "\n"
+              << "Token refreshes: " << listCounters("dd_token_refreshes_total", "result") << "\n"
+              << "Queued:          " << listGauges("dd_queue_depth", "queue", 1, "") << "\n"
+              << "Buffers:         " << listGauges("dd_buffer_bytes", "pool", mb, " MB") << std::endl;
+}
+
+// Starts serving /metrics in the background for the rest of the session.
+void Shell::startMetricsServer(const std::string& host, int port) {
+    if (m_metrics_server) {
+        throw std::runtime_error("The metrics endpoint is already running.");
+    }
+    auto server = std::make_unique<MetricsServer>([this] { return renderMetrics(); });
+    if (!server->start(host, port)) {
+        throw std::runtime_error("Could not listen on " + host + ":" + std::to_string(port) + " for metrics");
+    }
+    m_metrics_server = std::move(server);
+    std::cerr << "Serving metrics on http://" << host << ":" << port << "/metrics" << std::endl;
+}
+
+std::string Shell::renderMetrics() {
+    refreshGauges();
+    return metrics().prometheus();
+}
+
+// Sets the gauges that are read from their owners rather than updated as
+// things happen.
+void Shell::refreshGauges() {
+    const ChunkCache::Stats cache = m_chunk_cache->stats();
+    metrics().gauge("dd_buffer_bytes", {{"pool", "chunk_cache"}}).set(cache.resident_bytes);
+}
+
+// Deletes stored objects, one deletion stream per account running in
+// parallel. Returns how many are gone; failures are reported as warnings.
+std::size_t Shell::deleteObjects(const std::vector<Replica>& objects, ProgressDisplay* progress) {
+    std::map<std::string, std::vector<std::string>> by_account;
+    for (const auto& object : objects) {
+        by_account[object.account].push_back(object.drive_file_id);
+        m_chunk_cache->erase(objectKey(object));
+    }
+    std::atomic<std::size_t> deleted = 0;
+    std::mutex output_mutex;
+    std::vector<std::future<void>> futures;
+    for (const auto& [account, file_ids] : by_account) {
+        auto account_it = m_accounts.find(account);
+        if (account_it == m_accounts.end()) {
+            std::cerr << "\nWarning: account " << account << " is not connected; "
+                      << file_ids.size() << " chunk copies left on it." << std::endl;
+            continue;
+        }
+        const std::shared_ptr<StorageBackend> backend = account_it->second;
+        futures.emplace_back(std::async(std::launch::async, [&, backend] {
+            TraceSpan span("delete", "delete objects", std::to_string(file_ids.size()) + " objects", account);
+            try {
+                // Removed a batch request's worth at a time, so that progress
+                // moves as the batches complete.
+                for (size_t first = 0; first < file_ids.size(); first += dd::DRIVE_BATCH_MAX_CALLS) {
+                    const std::vector<std::string> batch(
+                        file_ids.begin() + static_cast<std::ptrdiff_t>(first),
+                        file_ids.begin() + static_cast<std::ptrdiff_t>(std::min(first + dd::DRIVE_BATCH_MAX_CALLS, file_ids.size())));
+                    const std::vector<bool> ok = backend->remove(batch);
+                    for (size_t i = 0; i < ok.size(); ++i) {
+                        if (ok[i]) {
+                            deleted++;
+                            if (progress) progress->add(account, 1);
+                        } else {
+                            std::lock_guard<std::mutex> lock(output_mutex);
+                            std::cerr << "\nWarning: Could not delete chunk " << batch[i] << std::endl;
+                        }
+                    }
                 }
-                successful_chunks++;
             } catch (const std::exception& e) {
-                std::lock_guard<std::mutex> lock(progress_mutex);
-                std::cerr << "\nError uploading chunk " << chunk_data.part_number << ": " << e.what() << std::endl;
+                std::lock_guard<std::mutex> lock(output_mutex);
+                std::cerr << "\nWarning: Could not delete chunks on " << account << ". Reason: " << e.what() << std::endl;
             }
-            m_upload_slots.release();
         }));
     }
-
-    // 3. CLEANUP: Wait for all threads to complete
-    producer_thread.join();
-    for (auto& f : consumer_futures) {
+    for (auto& f : futures) {
         f.get();
     }
-    
-    indicators::show_console_cursor(true);
-    
-    if (successful_chunks == totalChunks) {
-        bar.set_option(indicators::option::PostfixText{"Upload Complete!"});
-        if(!bar.is_completed()) bar.mark_as_completed();
-        std::cout << "\nFile uploaded successfully. Metadata saved." << std::endl;
-    } else {
-        bar.set_option(indicators::option::PostfixText{"Upload Failed!"});
-        if(!bar.is_completed()) bar.mark_as_completed();
-        std::cerr << "\nUpload failed. " << successful_chunks << "/" << totalChunks << " chunks were successful." << std::endl;
+    return deleted;
+}
+
+// Starts pooled upload sessions on every account whose backend has them,
+// ahead of a large upload.
+void Shell::prefillSessions() {
+    for (const auto& [account, backend] : m_accounts) {
+        if (backend->hasUploadSessions()) {
+            m_session_pool->prefill(account);
+        }
+    }
+}
+
+// The backend of a linked account. Throws if the account is not linked.
+std::shared_ptr<StorageBackend> Shell::backendFor(const std::string& account) const {
+    std::lock_guard<std::mutex> lock(m_accounts_mutex);
+    auto it = m_accounts.find(account);
+    if (it == m_accounts.end()) {
+        throw std::runtime_error("Account " + account + " is not linked on this machine.");
+    }
+    return it->second;
+}
+
+std::vector<std::string> Shell::accountNames() const {
+    std::lock_guard<std::mutex> lock(m_accounts_mutex);
+    std::vector<std::string> names;
+    for (const auto& [account, backend] : m_accounts) {
+        names.push_back(account);
+    }
+    return names;
+}
+
+// Downloads one replica of a chunk into `save_path`. Throws on failure. When
+// `cancel` becomes true the transfer is aborted (used when racing replicas).
+// A non-negative `offset` fetches only [offset, offset + length) of the
+// object, which is how a packed file is read out of its pack. `on_received`
+// gets download progress as byte deltas.
+void Shell::downloadReplica(const std::string& account, const std::string& file_id,
+                            const std::string& save_path, const std::atomic<bool>* cancel,
+                            std::int64_t offset, std::int64_t length,
+                            const std::function<void(std::int64_t)>& on_received) {
+    transferReplica(account, file_id, cancel, [&](StorageBackend& backend, const StorageBackend::Progress& transfer) {
+        std::int64_t received = 0;
+        const StorageBackend::Progress progress = [&](std::int64_t done, std::int64_t total) {
+            if (on_received) on_received(done - received);
+            received = done;
+            return transfer(done, total);
+        };
+        std::ofstream out(save_path, std::ios::binary);
+        if (!out) {
+            throw std::runtime_error("Could not open file for writing download: " + save_path);
+        }
+        // An empty range is an empty file.
+        if (offset < 0 || length > 0) {
+            backend.get(file_id, std::max<std::int64_t>(offset, 0), offset >= 0 ? length : -1,
+                        [&](std::string_view data) { out.write(data.data(), static_cast<std::streamsize>(data.size())); },
+                        progress);
+        }
+        out.close();
+        if (!out) {
+            throw std::runtime_error("Could not write download: " + save_path);
+        }
+        std::error_code ec;
+        auto bytes = fs::file_size(save_path, ec);
+        return ec ? std::int64_t{-1} : static_cast<std::int64_t>(bytes);
+    });
+}
+
+// Reads bytes [offset, offset + length) of one replica into memory. When
+// `cancel` becomes true the transfer is aborted.
+std::string Shell::readReplica(const std::string& account, const std::string& file_id,
+                               std::int64_t offset, std::int64_t length, const std::atomic<bool>* cancel) {
+    std::string data;
+    transferReplica(account, file_id, cancel, [&](StorageBackend& backend, const StorageBackend::Progress& progress) {
+        data = backend.read(file_id, offset, length, progress);
+        return static_cast<std::int64_t>(data.size());
+    });
+    return data;
+}
+
+// Runs one transfer of `object` against `account` and feeds the outcome into
+// the replica ranking. `fetch` returns the bytes moved, or -1 if unknown.
+void Shell::transferReplica(const std::string& account, const std::string& object, const std::atomic<bool>* cancel,
+                            const std::function<std::int64_t(StorageBackend&, const StorageBackend::Progress&)>& fetch) {
+    const std::shared_ptr<StorageBackend> backend = backendFor(account);
+
+    AccountStats::InFlight in_flight(m_account_stats, account);
+    const MetricLabels labels = transferLabels(account, "down");
+    Gauge::Scope in_flight_metric(metrics().gauge("dd_transfers_in_flight", labels));
+    ByteMeter meter(metrics().counter("dd_transfer_bytes_total", labels));
+    TraceSpan span("download", "transfer", object, account);
+    auto transfer_start = std::chrono::steady_clock::now();
+    std::int64_t bytes = -1;
+    try {
+        const StorageBackend::Progress progress = [&](std::int64_t done, std::int64_t) {
+            meter.progress(done);
+            return (!cancel || !cancel->load()) && !cancelled();
+        };
+        if (cancelled()) {
+            throw std::runtime_error("Cancelled");
+        }
+        bytes = fetch(*backend, progress);
+    } catch (...) {
+        // A cancelled racer, or a transfer of a cancelled command, did
+        // nothing wrong; do not penalise its account.
+        if ((!cancel || !cancel->load()) && !cancelled()) {
+            m_account_stats.recordFailure(account);
+            recordTransferMetrics(account, "down", false, 0);
+        }
+        throw;
     }
-    
-    std::ofstream out("data/metadata.json");
-    out << m_metadata.dump(4);
+
+    std::chrono::duration<double> took = std::chrono::steady_clock::now() - transfer_start;
+    recordTransferMetrics(account, "down", true, took.count());
+    if (bytes >= 0) {
+        meter.finish(bytes);
+        m_account_stats.recordTransfer(account, bytes, took.count());
+    }
+}
+
+// Reads `length` bytes at `object_offset` within a chunk's object, from the
+// local cache if it holds the object, otherwise trying its replicas in
+// preference order. Throws once every replica has failed.
+std::string Shell::readChunk(const ChunkEntry& chunk, std::int64_t object_offset, std::int64_t length,
+                             const std::atomic<bool>* cancel) {
+    std::string cached;
+    if (m_chunk_cache->read(packId(chunk), object_offset, length, cached)) {
+        return cached;
+    }
+    std::vector<std::string> accounts;
+    for (const auto& replica : chunk.replicas) {
+        accounts.push_back(replica.account);
+    }
+    std::string last_error = "no replicas";
+    bool first = true;
+    for (const std::string& account : m_account_stats.rank(accounts)) {
+        auto replica = std::find_if(chunk.replicas.begin(), chunk.replicas.end(),
+                                    [&](const Replica& r) { return r.account == account; });
+        if (cancel && cancel->load()) {
+            throw std::runtime_error("Read cancelled");
+        }
+        if (!first) {
+            metrics().counter("dd_retries_total", {{"kind", "read_failover"}}).add();
+        }
+        first = false;
+        try {
+            return readReplica(account, replica->drive_file_id, object_offset, length, cancel);
+        } catch (const std::exception& e) {
+            last_error = account + ": " + e.what();
+        }
+    }
+    throw std::runtime_error("Part " + std::to_string(chunk.part) + " could not be read (" + last_error + ")");
+}
+
+// The ranged GETs that read bytes [offset, offset + length) of `file`: its
+// chunk spans, split so that none exceeds READ_SPAN_BYTES.
+static std::vector<ChunkSpan> readPieces(const FileEntry& file, std::int64_t offset, std::int64_t length) {
+    std::vector<ChunkSpan> pieces;
+    for (const ChunkSpan& span : chunkSpans(file, dd::UPLOAD_CHUNK_BYTES, offset, length)) {
+        for (std::int64_t done = 0; done < span.length; done += dd::READ_SPAN_BYTES) {
+            pieces.push_back({span.chunk, span.object_offset + done, std::min(dd::READ_SPAN_BYTES, span.length - done),
+                              span.buffer_offset + done});
+        }
+    }
+    return pieces;
+}
+
+// Reads bytes [offset, offset + length) of a stored file. Only the objects
+// covering the range are touched, each with a ranged GET; ranges spanning
+// several chunks, or more than READ_SPAN_BYTES of one, are fetched in
+// parallel.
+std::string Shell::readFile(const std::string& path, std::int64_t offset, std::int64_t length) {
+    const std::optional<FileEntry> file = m_metadata->find(path);
+    if (!file) {
+        throw std::runtime_error("File not found in metadata: " + path);
+    }
+    const std::vector<ChunkSpan> pieces = readPieces(*file, offset, length);
+
+    std::string data(static_cast<size_t>(length), '\0');
+    std::atomic<size_t> next_piece = 0;
+    std::mutex error_mutex;
+    std::string error;
+    auto worker = [&] {
+        for (size_t i = next_piece++; i < pieces.size(); i = next_piece++) {
+            const ChunkSpan& piece = pieces[i];
+            try {
+                std::string bytes = readChunk(file->chunks[piece.chunk], piece.object_offset, piece.length);
+                std::copy(bytes.begin(), bytes.end(), data.begin() + piece.buffer_offset);
+            } catch (const std::exception& e) {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (error.empty()) error = e.what();
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < std::min<size_t>(dd::READ_WORKERS, pieces.size()); ++i) {
+        workers.emplace_back(worker);
+    }
+    worker();
+    for (auto& w : workers) {
+        w.join();
+    }
+    if (!error.empty()) {
+        throw std::runtime_error("Read of " + path + " failed: " + error);
+    }
+    return data;
 }
 
+// Opens a stored file for a consumer that issues its own successive reads,
+// such as a client reading a file with HTTP range requests. Sequential reads
+// are detected and the next READ_AHEAD_BYTES fetched ahead in READ_SPAN_BYTES
+// blocks; a block never crosses a chunk, so each is one ranged GET, and
+// blocks in flight together are spread over the chunk's replicas by the
+// account ranking. The stream keeps its own copy of the file's metadata.
+// With a `budget`, its prefetched blocks count against it together with those
+// of every other stream given the same one.
+std::unique_ptr<ReadAheadStream> Shell::openReader(const std::string& path, std::shared_ptr<PrefetchBudget> budget) {
+    std::optional<FileEntry> found = m_metadata->find(path);
+    if (!found) {
+        throw std::runtime_error("File not found in metadata: " + path);
+    }
+    auto file = std::make_shared<const FileEntry>(std::move(*found));
+    chunkSpans(*file, dd::UPLOAD_CHUNK_BYTES, 0, 0);   // reject an unexpected chunk layout now
+    return std::make_unique<ReadAheadStream>(
+        file->total_size,
+        [this, file](std::int64_t offset, std::int64_t length, const std::atomic<bool>* cancel) {
+            std::string data;
+            data.reserve(static_cast<size_t>(length));
+            for (const ChunkSpan& piece : readPieces(*file, offset, length)) {
+                data += readChunk(file->chunks[piece.chunk], piece.object_offset, piece.length, cancel);
+            }
+            return data;
+        },
+        dd::READ_SPAN_BYTES, dd::READ_AHEAD_BYTES, std::move(budget));
+}
+
+// Writes bytes [offset, offset + length) of a stored file to `out` in order.
+// Pieces are fetched in parallel, lowest offsets first, through a reorder
+// buffer of STREAM_BUFFER_BYTES: memory stays constant whatever the size, the
+// first bytes go out as soon as the first piece arrives, and a slow reader
+// holds back the fetches rather than letting them pile up.
+void Shell::streamFile(const std::string& path, std::int64_t offset, std::int64_t length, std::ostream& out) {
+    const std::optional<FileEntry> file = m_metadata->find(path);
+    if (!file) {
+        throw std::runtime_error("File not found in metadata: " + path);
+    }
+    const std::vector<ChunkSpan> pieces = readPieces(*file, offset, length);
+    fetchInOrder(
+        pieces.size(), dd::READ_WORKERS, static_cast<size_t>(dd::STREAM_BUFFER_BYTES / dd::READ_SPAN_BYTES),
+        [&](size_t i) {
+            const ChunkSpan& piece = pieces[i];
+            return readChunk(file->chunks[piece.chunk], piece.object_offset, piece.length);
+        },
+        [&](std::string&& piece) {
+            TraceSpan span("download", "write out", path);
+            if (!out.write(piece.data(), static_cast<std::streamsize>(piece.size()))) {
+                throw std::runtime_error("Write to output failed while streaming " + path);
+            }
+        });
+    out.flush();
+}
 
 void Shell::downloadFile(const std::vector<std::string>& args) {
     if (args.size() < 3)
-        throw std::runtime_error("Usage: download <remote_file_name> <save_as_path>");
+        throw std::runtime_error("Usage: download <remote_path> <save_as_path | -> [--race]");
 
-    std::string remoteFileName = args[1];
+    std::string remoteFileName = normalizePath(args[1]);
+    const std::string partName(baseName(remoteFileName));
     std::string savePath = args[2];
+    bool race = std::find(args.begin() + 3, args.end(), "--race") != args.end();
 
-    if (!m_metadata["files"].contains(remoteFileName))
+    const std::optional<FileEntry> fileMeta = m_metadata->find(remoteFileName);
+    if (!fileMeta)
         throw std::runtime_error("No metadata found for: " + remoteFileName);
 
-    const auto& fileMeta = m_metadata["files"][remoteFileName];
-    const auto& chunks = fileMeta["chunks"];
+    // "-" streams the file to stdout in order instead of assembling it on disk.
+    if (savePath == "-") {
+        setBinaryStdio();
+        streamFile(remoteFileName, 0, fileMeta->total_size, std::cout);
+        return;
+    }
+
+    const auto& chunks = fileMeta->chunks;
 
     std::string tempDir = "./temp_chunks_download";
     if (fs::exists(tempDir)) fs::remove_all(tempDir);
     fs::create_directories(tempDir);
 
+    std::mutex log_mutex;
+    std::atomic<int> failed_chunks = 0;
+    ProgressDisplay progress("Downloading", accountNames(), fileMeta->total_size, ProgressDisplay::Unit::Bytes,
+                             static_cast<std::int64_t>(chunks.size()), "chunks");
     std::vector<std::thread> threads;
     for (const auto& chunk : chunks) {
         threads.emplace_back([&, chunk]() {
-            std::string account = chunk["account"];
-            std::string file_id = chunk["drive_file_id"];
-            int part = chunk["part"];
-            std::string token_path = m_local_accounts[account];
-            std::string chunkPath = (fs::path(tempDir) / (remoteFileName + ".part" + std::to_string(part))).string();
-
-            GDriveHandler gdrive(token_path, m_creds_path);
-            gdrive.downloadChunk(file_id, chunkPath, nullptr);
+            int part = chunk.part;
+            std::string chunkPath = (fs::path(tempDir) / (partName + ".part" + std::to_string(part))).string();
+            TraceSpan span("download", "chunk", partName + ".part" + std::to_string(part));
+
+            // Whole chunks are served from and added to the local cache; a
+            // packed file is just a slice of its cached pack.
+            const std::int64_t length = chunk.packed() ? fileMeta->total_size : -1;
+            const std::string cacheKey = packId(chunk);
+            // Cache hits count towards the total under no account.
+            if (chunk.packed()) {
+                std::string bytes;
+                if (m_chunk_cache->read(cacheKey, chunk.pack_offset, length, bytes) &&
+                    std::ofstream(chunkPath, std::ios::binary).write(bytes.data(), static_cast<std::streamsize>(bytes.size()))) {
+                    progress.add("", static_cast<std::int64_t>(bytes.size()));
+                    progress.itemDone();
+                    return;
+                }
+            } else if (m_chunk_cache->copyTo(cacheKey, chunkPath)) {
+                std::error_code ec;
+                const auto bytes = fs::file_size(chunkPath, ec);
+                progress.add("", ec ? 0 : static_cast<std::int64_t>(bytes));
+                progress.itemDone();
+                return;
+            }
+            auto fetched = [&] {
+                if (!chunk.packed()) m_chunk_cache->insertFile(cacheKey, chunkPath);
+                progress.itemDone();
+            };
+
+            std::map<std::string, std::string> replicaIds;
+            std::vector<std::string> accounts;
+            for (const auto& replica : chunk.replicas) {
+                replicaIds[replica.account] = replica.drive_file_id;
+                accounts.push_back(replica.account);
+            }
+            std::vector<std::string> ranked = m_account_stats.rank(accounts);
+
+            // Bytes of a copy that fails or loses a race are taken back.
+            auto fetch = [&](const std::string& account, const std::string& path, const std::atomic<bool>* cancel) {
+                std::int64_t received = 0;
+                try {
+                    downloadReplica(account, replicaIds.at(account), path, cancel, chunk.pack_offset, length,
+                                    [&](std::int64_t n) {
+                                        progress.add(account, n);
+                                        received += n;
+                                    });
+                } catch (...) {
+                    progress.add(account, -received);
+                    throw;
+                }
+                return received;
+            };
+            size_t next = 0;
+
+            // Optionally race the two best replicas for the tail of the file,
+            // where a single slow account would otherwise hold up completion.
+            bool inTail = part >= static_cast<int>(chunks.size()) - dd::RACE_TAIL_CHUNKS;
+            if (race && inTail && ranked.size() >= 2) {
+                std::atomic<bool> won{false};
+                auto racer = [&](const std::string& account, const std::string& racePath) {
+                    try {
+                        const std::int64_t received = fetch(account, racePath, &won);
+                        bool expected = false;
+                        if (won.compare_exchange_strong(expected, true)) {
+                            fs::rename(racePath, chunkPath);
+                            return;
+                        }
+                        progress.add(account, -received);
+                    } catch (const std::exception&) {
+                    }
+                    std::error_code ec;
+                    fs::remove(racePath, ec);
+                };
+                auto first = std::async(std::launch::async, racer, ranked[0], chunkPath + ".race0");
+                auto second = std::async(std::launch::async, racer, ranked[1], chunkPath + ".race1");
+                first.get();
+                second.get();
+                if (won) {
+                    fetched();
+                    return;
+                }
+                next = 2;
+            }
+
+            // Fail over through the remaining replicas in preference order.
+            for (; next < ranked.size(); ++next) {
+                try {
+                    fetch(ranked[next], chunkPath, nullptr);
+                    fetched();
+                    return;
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(log_mutex);
+                    std::cerr << "\nWarning: part " << part << " failed on " << ranked[next] << ": " << e.what()
+                              << (next + 1 < ranked.size() ? " (trying another replica)" : "") << std::endl;
+                }
+            }
+            failed_chunks++;
         });
     }
 
     for (auto& t : threads) t.join();
+    progress.finish(failed_chunks > 0 ? "Download Failed!" : "");
 
+    if (failed_chunks > 0) {
+        fs::remove_all(tempDir);
+        throw std::runtime_error("Download failed: " + std::to_string(failed_chunks) + " chunk(s) could not be fetched from any replica.");
+    }
+
+    TraceSpan span("download", "assemble", savePath);
     std::ofstream out(savePath, std::ios::binary);
     for (size_t i = 0; i < chunks.size(); ++i) {
-        std::string partPath = (fs::path(tempDir) / (remoteFileName + ".part" + std::to_string(i))).string();
+        std::string partPath = (fs::path(tempDir) / (partName + ".part" + std::to_string(i))).string();
         std::ifstream in(partPath, std::ios::binary);
         out << in.rdbuf();
         in.close();
@@ -258,35 +1562,272 @@ void Shell::downloadFile(const std::vector<std::string>& args) {
     std::cout << " Download completed to: " << savePath << std::endl;
 }
 
+void Shell::catFile(const std::vector<std::string>& args) {
+    const std::string usage = "Usage: cat <remote_path> [--range <offset>:<length>]";
+    if (args.size() < 2) {
+        throw std::runtime_error(usage);
+    }
+    const std::string path = normalizePath(args[1]);
+    const std::optional<FileEntry> file = m_metadata->find(path);
+    if (!file) {
+        throw std::runtime_error("File not found in metadata: " + path);
+    }
+
+    // An omitted length, or one running past the end, reads to the end.
+    std::int64_t offset = 0;
+    std::int64_t length = file->total_size;
+    auto range = std::find(args.begin() + 2, args.end(), "--range");
+    if (range != args.end()) {
+        if (range + 1 == args.end()) {
+            throw std::runtime_error(usage);
+        }
+        const std::string& spec = *(range + 1);
+        const size_t colon = spec.find(':');
+        try {
+            offset = std::stoll(spec.substr(0, colon));
+            if (colon != std::string::npos && colon + 1 < spec.size()) {
+                length = std::stoll(spec.substr(colon + 1));
+            }
+        } catch (const std::exception&) {
+            throw std::runtime_error(usage);
+        }
+        if (offset < 0 || length < 0 || offset > file->total_size) {
+            throw std::runtime_error("Range is outside " + path + " (" + std::to_string(file->total_size) + " bytes)");
+        }
+        length = std::min(length, file->total_size - offset);
+    }
+
+    setBinaryStdio();
+    streamFile(path, offset, length, std::cout);
+}
+
+// Serves the catalog over HTTP until the process is stopped. Every request
+// reads through openReader, so ranges touch only the chunks they cover, come
+// from the local cache when resident, and sequential clients are read ahead of.
+void Shell::serveFiles(const std::vector<std::string>& args) {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    bool s3 = false;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "--port" && i + 1 < args.size()) {
+            port = std::stoi(args[++i]);
+        } else if (args[i] == "--bind" && i + 1 < args.size()) {
+            host = args[++i];
+        } else if (args[i] == "--s3") {
+            s3 = true;
+        } else {
+            throw std::runtime_error("Usage: serve [--s3] [--port <port>] [--bind <address>]");
+        }
+    }
+    if (s3) {
+        serveS3(host, port);
+        return;
+    }
+
+    HttpGateway::Source source;
+    source.file_size = [this](const std::string& path) -> std::optional<std::int64_t> {
+        const std::optional<FileEntry> file = m_metadata->find(path);
+        if (!file) return std::nullopt;
+        return file->total_size;
+    };
+    // Every connection's stream prefetches out of one budget.
+    auto budget = std::make_shared<PrefetchBudget>(dd::SERVE_READ_AHEAD_BYTES);
+    source.open = [this, budget](const std::string& path) { return openReader(path, budget); };
+    source.list = [this](const std::string& dir) {
+        json listing = {{"path", dir}, {"dirs", json::array()}, {"files", json::array()}};
+        const bool found = m_metadata->list(dir,
+            [&](const std::string& name, const DirStats& stats) {
+                listing["dirs"].push_back({{"name", name}, {"files", stats.files}, {"total_size", stats.total_size}});
+            },
+            [&](const FileSummary& file) {
+                listing["files"].push_back({{"name", std::string(baseName(file.name))}, {"size", file.total_size}});
+            });
+        return found ? listing : json();
+    };
+
+    HttpGateway gateway(std::move(source));
+    std::cout << "Serving D-Drive on http://" << host << ":" << port << "/files/ (Ctrl+C to stop)" << std::endl;
+    if (!gateway.listen(host, port)) {
+        throw std::runtime_error("Could not listen on " + host + ":" + std::to_string(port));
+    }
+}
+
+// Serves the catalog as an S3 endpoint. Uploads are stored exactly like
+// `upload -` (chunks cut as the body streams in, several in flight), except
+// that each chunk records its size: multipart parts become chunks as they
+// are, so a completed upload's chunks vary in size.
+void Shell::serveS3(const std::string& host, int port) {
+    if (m_accounts.empty()) {
+        throw std::runtime_error("No linked accounts. Use 'add-account' first.");
+    }
+    prefillSessions();
+    const int replicas = std::min<int>(dd::DEFAULT_REPLICAS, static_cast<int>(m_accounts.size()));
+
+    S3Gateway::Backend backend;
+    backend.find = [this](const std::string& path) { return m_metadata->find(path); };
+    auto read_budget = std::make_shared<PrefetchBudget>(dd::SERVE_READ_AHEAD_BYTES);
+    backend.open = [this, read_budget](const std::string& path) { return openReader(path, read_budget); };
+    backend.list = [this](const std::string& prefix) {
+        std::vector<FileSummary> files;
+        const size_t slash = prefix.rfind('/');
+        const std::string dir = normalizePath(slash == std::string::npos ? std::string() : prefix.substr(0, slash));
+        m_metadata->walk(dir, [&](const FileSummary& file) {
+            if (file.name.compare(0, prefix.size(), prefix) == 0) files.push_back(file);
+        });
+        return files;
+    };
+    backend.buckets = [this] {
+        std::vector<std::string> buckets;
+        m_metadata->list("", [&](const std::string& name, const DirStats&) { buckets.push_back(name); },
+                         [](const FileSummary&) {});
+        return buckets;
+    };
+    // Each upload holds at most MAX_INFLIGHT_UPLOADS + 1 chunks; together
+    // they share one budget, so concurrent PUTs cannot multiply that.
+    auto budget = std::make_shared<BufferBudget>(dd::SERVE_UPLOAD_BUFFER_BYTES);
+    backend.store = [this, replicas, budget](const std::string& path, size_t stripe, std::int64_t size_hint,
+                                             const S3Gateway::Body& body) {
+        const std::string base(baseName(path));
+        ChunkWriter writer(
+            [&](int part, const std::vector<char>& data) {
+                return storeChunk(base + ".part" + std::to_string(part), data, replicas,
+                                  (stripe + static_cast<size_t>(part)) * replicas);
+            },
+            dd::UPLOAD_CHUNK_BYTES, dd::MAX_INFLIGHT_UPLOADS, size_hint, budget.get());
+        const bool received = body([&](const char* data, size_t size) { return writer.write(data, size); });
+        std::vector<ChunkEntry> chunks = writer.finish();
+        bool stored = received;
+        std::vector<Replica> objects;
+        for (const auto& chunk : chunks) {
+            stored = stored && !chunk.replicas.empty();
+            objects.insert(objects.end(), chunk.replicas.begin(), chunk.replicas.end());
+        }
+        if (!stored) {
+            deleteObjects(objects);
+            throw std::runtime_error("Storing " + path + " failed");
+        }
+        return chunks;
+    };
+    backend.commit = [this](const std::string& path, const std::vector<ChunkEntry>& chunks) {
+        const std::optional<FileEntry> previous = m_metadata->find(path);
+        json chunkList = json::array();
+        std::int64_t total = 0;
+        int copies = std::numeric_limits<int>::max();
+        for (const auto& chunk : chunks) {
+            chunkList.push_back(toJson(chunk));
+            total += chunk.size;
+            copies = std::min(copies, static_cast<int>(chunk.replicas.size()));
+        }
+        m_metadata->waitDurable(m_metadata->apply({
+            {"op", "put_file"},
+            {"file", path},
+            {"total_size", total},
+            {"replicas", chunks.empty() ? 1 : copies},
+            {"chunks", chunkList}
+        }));
+        if (previous) {
+            deleteObjects(unreferencedObjects(*previous));
+        }
+    };
+    backend.discard = [this](const std::vector<ChunkEntry>& chunks) {
+        std::vector<Replica> objects;
+        for (const auto& chunk : chunks) {
+            objects.insert(objects.end(), chunk.replicas.begin(), chunk.replicas.end());
+        }
+        deleteObjects(objects);
+    };
+    backend.remove = [this](const std::string& path) {
+        const std::optional<FileEntry> file = m_metadata->find(path);
+        if (!file) return false;
+        m_metadata->waitDurable(m_metadata->apply({{"op", "delete_file"}, {"file", path}}));
+        deleteObjects(unreferencedObjects(*file));
+        return true;
+    };
+
+    S3Gateway gateway(std::move(backend));
+    std::cout << "Serving D-Drive as S3 on http://" << host << ":" << port
+              << " (path-style; buckets are top-level directories; Ctrl+C to stop)" << std::endl;
+    if (!gateway.listen(host, port)) {
+        throw std::runtime_error("Could not listen on " + host + ":" + std::to_string(port));
+    }
+}
+
 void Shell::listFiles(const std::vector<std::string>&) {
     std::cout << "--- Uploaded Files ---\n";
-    if (m_metadata.contains("files")) {
-        for (const auto& [key, value] : m_metadata["files"].items()) {
-            std::cout << key << " (" << value["chunks"].size() << " chunks)\n";
-        }
+    m_metadata->forEachFile([](const FileEntry& file) {
+        std::cout << file.name << " (" << file.chunks.size() << " chunks)\n";
+    });
+}
+
+void Shell::listDirectory(const std::vector<std::string>& args) {
+    bool recursive = false;
+    std::string dir;
+    for (size_t i = 1; i < args.size(); ++i) {
+        if (args[i] == "-r") recursive = true;
+        else dir = normalizePath(args[i]);
+    }
+
+    if (recursive) {
+        if (!m_metadata->dirExists(dir))
+            throw std::runtime_error("No such directory: " + dir);
+        m_metadata->walk(dir, [](const FileSummary& file) {
+            std::cout << file.name << "  " << file.total_size << " bytes, " << file.chunk_count << " chunks\n";
+        });
+    } else {
+        bool found = m_metadata->list(dir,
+            [](const std::string& name, const DirStats& stats) {
+                std::cout << name << "/  " << stats.files << " files, " << stats.total_size << " bytes\n";
+            },
+            [](const FileSummary& file) {
+                std::cout << baseName(file.name) << "  " << file.total_size << " bytes, " << file.chunk_count << " chunks\n";
+            });
+        if (!found)
+            throw std::runtime_error("No such directory: " + dir);
     }
+    DirStats total = m_metadata->dirStats(dir);
+    std::cout << "Total: " << total.files << " files, " << total.total_size << " bytes\n";
+}
+
+void Shell::findFiles(const std::vector<std::string>& args) {
+    if (args.size() < 2)
+        throw std::runtime_error("Usage: find <pattern>  (e.g. find 'backups/**/*.tar')");
+    size_t matches = 0;
+    m_metadata->glob(args[1], [&](const FileSummary& file) {
+        std::cout << file.name << "  " << file.total_size << " bytes\n";
+        ++matches;
+    });
+    std::cout << matches << " match(es)\n";
 }
 
 void Shell::initializeState() {
     fs::create_directories("data/tokens");
-    if (fs::exists("data/metadata.json")) {
-        std::ifstream in("data/metadata.json");
-        if (in.peek() != std::ifstream::traits_type::eof()) {
-            in >> m_metadata;
-        }
-    }
+    m_metadata = std::make_unique<MetadataStore>("data/catalog.bin", "data/metadata.log", "data/metadata.json");
+    m_chunk_cache = std::make_unique<ChunkCache>("data/cache", dd::CHUNK_CACHE_BYTES);
     for (const auto& file : fs::directory_iterator("data/tokens")) {
+        if (file.path().extension() != ".json") continue;   // such as a token file being replaced
         std::string email = file.path().stem().string();
-        m_local_accounts[email] = file.path().string();
+        m_accounts[email] = std::make_shared<DriveBackend>(file.path().string(), m_creds_path);
+    }
+    for (const auto& spec : loadBackendSpecs()) {
+        try {
+            m_accounts[spec.at("name").get<std::string>()] = makeBackend(spec);
+        } catch (const std::exception& e) {
+            std::cerr << "Warning: skipping account " << spec.value("name", "?") << ": " << e.what() << std::endl;
+        }
     }
-   
+}
+
+// Accounts other than Drive ones, which are known by their token files.
+json Shell::loadBackendSpecs() {
+    std::ifstream in(kBackendsPath);
+    if (!in) return json::array();
+    json specs;
+    in >> specs;
+    return specs.is_array() ? specs : json::array();
 }
 
 void Shell::saveMetadataOnExit() {
-    if (m_metadata_changed) {
-        std::ofstream out("data/metadata.json");
-        out << m_metadata.dump(4);
-    }
+    m_metadata->sync();
 }
 
 std::vector<std::string> Shell::parseCommand(const std::string& input) {
@@ -294,27 +1835,27 @@ std::vector<std::string> Shell::parseCommand(const std::string& input) {
     return {std::istream_iterator<std::string>{iss}, std::istream_iterator<std::string>{}};
 }
 
-void Shell::addAccount(const std::vector<std::string>&) {
+void Shell::addAccount(const std::vector<std::string>& args) {
+    if (args.size() > 1) {
+        addBackendAccount(args);
+        return;
+    }
     std::cout << "Adding new account..." << std::endl;
     GDriveHandler auth_handler("", m_creds_path);
     std::string email = auth_handler.authenticateNewAccount("data/tokens");
 
     std::string token_path = "data/tokens/" + email + ".json";
-    m_local_accounts[email] = token_path;
+    auto backend = std::make_shared<DriveBackend>(token_path, m_creds_path);
+    {
+        std::lock_guard<std::mutex> lock(m_accounts_mutex);
+        m_accounts[email] = backend;
+    }
     std::cout << "Account for " << email << " added locally." << std::endl;
 
     try {
         std::cout << "Setting up storage folder in " << email << "'s Drive..." << std::endl;
-        GDriveHandler new_account_gdrive(token_path, m_creds_path);
-
-        const std::string CHUNK_FOLDER_NAME = "D-Drive Chunks";
-        std::string chunkFolderId = new_account_gdrive.findFileOrFolder(CHUNK_FOLDER_NAME, "root");
-        if (chunkFolderId.empty()) {
-            new_account_gdrive.createFolder(CHUNK_FOLDER_NAME, "root");
-            std::cout << "Created 'D-Drive Chunks' folder." << std::endl;
-        } else {
-            std::cout << "'D-Drive Chunks' folder already exists." << std::endl;
-        }
+        // Listing the chunk folder creates it if it does not exist yet.
+        backend->list();
         std::cout << "Setup complete for " << email << "!" << std::endl;
 
     } catch (const std::exception& e) {
@@ -322,16 +1863,78 @@ void Shell::addAccount(const std::vector<std::string>&) {
     }
 }
 
-void Shell::listAccounts(const std::vector<std::string>&) {
+// add-account --local <name> <dir>
+// add-account --emulator <name> [--bandwidth MB/s] [--latency ms] [--error-rate p] [--quota GB]
+void Shell::addBackendAccount(const std::vector<std::string>& args) {
+    const std::string usage = "Usage: add-account [--local <name> <dir> | --emulator <name> [--bandwidth MB/s] "
+                              "[--latency ms] [--error-rate p] [--quota GB]]";
+    if (args.size() < 3) {
+        throw std::runtime_error(usage);
+    }
+    json spec = {{"name", args[2]}};
+    if (args[1] == "--local" && args.size() == 4) {
+        spec["kind"] = "local";
+        spec["path"] = fs::absolute(args[3]).string();
+    } else if (args[1] == "--emulator") {
+        spec["kind"] = "emulator";
+        for (size_t i = 3; i < args.size(); i += 2) {
+            if (i + 1 >= args.size()) throw std::runtime_error(usage);
+            const double value = std::stod(args[i + 1]);
+            if (args[i] == "--bandwidth") spec["bandwidth_mbps"] = value;
+            else if (args[i] == "--latency") spec["latency_ms"] = static_cast<int>(value);
+            else if (args[i] == "--error-rate") spec["error_rate"] = value;
+            else if (args[i] == "--quota") spec["quota_gb"] = value;
+            else throw std::runtime_error(usage);
+        }
+    } else {
+        throw std::runtime_error(usage);
+    }
+    const std::string name = args[2];
+    if (m_accounts.count(name)) {
+        throw std::runtime_error("An account named " + name + " is already linked.");
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_accounts_mutex);
+        m_accounts[name] = makeBackend(spec);
+    }
+    json specs = loadBackendSpecs();
+    specs.push_back(spec);
+    std::ofstream out(kBackendsPath);
+    out << specs.dump(4);
+    if (!out) {
+        throw std::runtime_error("Cannot write " + std::string(kBackendsPath));
+    }
+    std::cout << "Account " << name << " (" << spec["kind"].get<std::string>() << ") added." << std::endl;
+    if (spec["kind"] == "emulator") {
+        std::cout << "Objects on an emulated account last only until D-Drive exits." << std::endl;
+    }
+}
+
+void Shell::listAccounts(const std::vector<std::string>& args) {
+    const bool usage = args.size() > 1 && args[1] == "--usage";
     std::cout << "Connected accounts:\n";
-    for (const auto& [email, _] : m_local_accounts)
-        std::cout << "- " << email << std::endl;
+    for (const auto& [name, backend] : m_accounts) {
+        std::cout << "- " << name << " (" << backend->kind() << ")";
+        if (usage) {
+            try {
+                const StorageQuota quota = backend->quota();
+                const double gb = 1024.0 * 1024.0 * 1024.0;
+                std::cout << std::fixed << std::setprecision(2) << "  " << quota.used / gb << " GB used";
+                if (quota.limit >= 0) std::cout << " of " << quota.limit / gb << " GB";
+            } catch (const std::exception& e) {
+                std::cout << "  usage unavailable: " << e.what();
+            }
+        }
+        std::cout << std::endl;
+    }
 }
 
 void Shell::showHelp(const std::vector<std::string>&) {
     std::cout << "Available commands:\n";
     for (const auto& [cmd, info] : m_commands)
         std::cout << std::setw(12) << std::left << cmd << " : " << info.description << std::endl;
+    std::cout << "Add --trace <file> to any command to write a Chrome trace of it.\n";
     std::cout << "Type 'exit' to quit.\n";
 }
 
@@ -339,42 +1942,72 @@ void Shell::deleteFile(const std::vector<std::string>& args) {
     if (args.size() < 2) {
         throw std::runtime_error("Usage: delete <remote_file_name>");
     }
-    std::string remoteFileName = args[1];
+    std::string remoteFileName = normalizePath(args[1]);
 
-    if (!m_metadata["files"].contains(remoteFileName)) {
+    const std::optional<FileEntry> fileMeta = m_metadata->find(remoteFileName);
+    if (!fileMeta) {
         throw std::runtime_error("File not found in metadata: " + remoteFileName);
     }
 
-    const auto& chunks = m_metadata["files"][remoteFileName]["chunks"];
+    const auto& chunks = fileMeta->chunks;
     std::cout << "Deleting " << remoteFileName << " (" << chunks.size() << " chunks)..." << std::endl;
 
-    std::vector<std::future<void>> futures;
-    std::atomic<int> successful_deletes = 0;
+    {
+        TraceSpan span("delete", "commit", remoteFileName);
+        m_metadata->waitDurable(m_metadata->apply({{"op", "delete_file"}, {"file", remoteFileName}}));
+    }
 
-    for (const auto& chunk_info : chunks) {
-        std::string account_email = chunk_info["account"];
-        std::string file_id = chunk_info["drive_file_id"];
-        std::string token_path = m_local_accounts[account_email];
+    size_t shared_packs = 0;
+    const std::vector<Replica> objects = unreferencedObjects(*fileMeta, &shared_packs);
+    ProgressDisplay progress("Deleting", accountNames(), static_cast<std::int64_t>(objects.size()),
+                             ProgressDisplay::Unit::Objects);
+    const size_t successful_deletes = deleteObjects(objects, &progress);
+    progress.finish("");
 
-        futures.emplace_back(std::async(std::launch::async, [this, token_path, file_id, &successful_deletes]() {
-            try {
-                GDriveHandler gdrive(token_path, m_creds_path);
-                gdrive.deleteFileById(file_id);
-                successful_deletes++;
-            } catch (const std::exception& e) {
-                std::cerr << "\nWarning: Could not delete chunk " << file_id << ". Reason: " << e.what() << std::endl;
-            }
-        }));
+    std::cout << "Successfully deleted '" << remoteFileName << "' from D-Drive." << std::endl;
+    std::cout << successful_deletes << "/" << objects.size() << " chunk copies deleted from storage." << std::endl;
+    if (shared_packs > 0) {
+        std::cout << "Its pack object is kept: other files are still stored in it." << std::endl;
     }
+}
 
-    for (auto& f : futures) {
-        f.get();
+// The Drive objects of a file that has left the catalog which no other file
+// uses. A pack object also holds other small files; it goes with the last
+// one, and `shared_packs` counts those kept.
+std::vector<Replica> Shell::unreferencedObjects(const FileEntry& file, size_t* shared_packs) {
+    std::vector<Replica> objects;
+    for (const auto& chunk : file.chunks) {
+        if (chunk.packed() && m_metadata->packReferences(packId(chunk)) > 0) {
+            if (shared_packs) ++*shared_packs;
+            continue;
+        }
+        objects.insert(objects.end(), chunk.replicas.begin(), chunk.replicas.end());
     }
+    return objects;
+}
 
-    m_metadata["files"].erase(remoteFileName);
-    m_metadata_changed = true;
-    saveMetadataOnExit();
+void Shell::exportMetadata(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        throw std::runtime_error("Usage: export-metadata <json_path>");
+    }
+    std::ofstream out(args[1]);
+    if (!out) {
+        throw std::runtime_error("Cannot write: " + args[1]);
+    }
+    out << m_metadata->exportJson().dump(4);
+    std::cout << "Catalog exported to " << args[1] << std::endl;
+}
 
-    std::cout << "Successfully deleted '" << remoteFileName << "' from D-Drive." << std::endl;
-    std::cout << successful_deletes << "/" << chunks.size() << " chunks deleted from Google Drive." << std::endl;
-}
\ No newline at end of file
+void Shell::importMetadata(const std::vector<std::string>& args) {
+    if (args.size() < 2) {
+        throw std::runtime_error("Usage: import-metadata <json_path>");
+    }
+    std::ifstream in(args[1]);
+    if (!in) {
+        throw std::runtime_error("Cannot open: " + args[1]);
+    }
+    json metadata;
+    in >> metadata;
+    std::size_t imported = m_metadata->importJson(metadata);
+    std::cout << "Imported " << imported << " file(s) from " << args[1] << std::endl;
+}
@@ -4,14 +4,33 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
 #include <functional>
 #include <mutex>
 #include <condition_variable>
-#include "gdrive_handler.h"
+#include <atomic>
+#include <future>
+#include <istream>
+#include <ostream>
+#include <queue>
+#include "storage_backend.h"
+#include "account_stats.h"
+#include "metadata_store.h"
+#include "upload_scheduler.h"
+#include "session_pool.h"
+#include "chunk_cache.h"
+#include "read_ahead.h"
+#include "DDConfig.h"
 #include <nlohmann/json.hpp>
 
 using json = nlohmann::json;
 
+class MetricsServer;
+class ProgressDisplay;
+class DaemonServer;
+
+// Blocking queue from the original producer/consumer upload pipeline. Uploads
+// are now scheduled by uploadBatch; only dd_microbench still uses it.
 template<typename T>
 class ThreadSafeQueue {
 public:
@@ -72,15 +91,25 @@ private:
 class Shell {
 public:
     Shell();
+    ~Shell();
     void run();
+    int execute(const std::vector<std::string>& tokens);
 
 private:
     // --- State Variables ---
     std::string m_creds_path;
-    std::map<std::string, std::string> m_local_accounts;
-    json m_metadata;
-    bool m_metadata_changed;
+    // Account name -> where its objects live. Only commands add accounts;
+    // the mutex covers lookups from background threads (the session pool).
+    mutable std::mutex m_accounts_mutex;
+    std::map<std::string, std::shared_ptr<StorageBackend>> m_accounts;
+    std::unique_ptr<MetadataStore> m_metadata;
+    std::unique_ptr<ChunkCache> m_chunk_cache;
+    // The cache write of the last uploaded chunk kept (see cacheUploaded);
+    // declared after the cache so that it finishes before the cache goes.
+    std::mutex m_cache_write_mutex;
+    std::future<void> m_cache_write;
     Semaphore m_upload_slots; 
+    AccountStats m_account_stats;
 
     // --- Command Handling ---
     struct Command {
@@ -91,20 +120,79 @@ private:
     std::map<std::string, Command> m_commands;
 
     // --- Private Methods ---
+    void runCommand(const Command& command, std::vector<std::string> tokens);
     void initializeState();
+    static json loadBackendSpecs();
+    std::shared_ptr<StorageBackend> backendFor(const std::string& account) const;
+    std::vector<std::string> accountNames() const;
     void saveMetadataOnExit();
     std::vector<std::string> parseCommand(const std::string& input);
 
     // --- Command Handler Functions ---
     void addAccount(const std::vector<std::string>& args);
+    void addBackendAccount(const std::vector<std::string>& args);
     void uploadFile(const std::vector<std::string>& args);
-    void uploadFile(const std::string& localFilePath);
+    void uploadBatch(const std::vector<UploadJob>& jobs, int replicas = dd::DEFAULT_REPLICAS, bool pack = true,
+                     std::int64_t chunk_bytes = dd::UPLOAD_CHUNK_BYTES);
+    void uploadStream(std::istream& in, const std::string& remote_path, int replicas,
+                      std::int64_t chunk_bytes = dd::UPLOAD_CHUNK_BYTES);
+    std::string uploadObject(const std::vector<char>& data, const std::string& object_name,
+                             const std::string& account, const std::string& session_uri,
+                             const StorageBackend::Progress& progress);
+    std::vector<Replica> storeChunk(const std::string& object_name, const std::vector<char>& data, int replicas,
+                                    size_t first_account,
+                                    const std::function<void(const std::string&, std::int64_t)>& on_sent = nullptr);
+    void prefillSessions();
+    std::size_t deleteObjects(const std::vector<Replica>& objects, ProgressDisplay* progress = nullptr);
+    std::vector<Replica> unreferencedObjects(const FileEntry& file, size_t* shared_packs = nullptr);
+    void cacheUploaded(const std::vector<Replica>& copies, std::vector<char>&& data);
+    void cacheCommand(const std::vector<std::string>& args);
+    void statsCommand(const std::vector<std::string>& args);
+    void daemonCommand(const std::vector<std::string>& args);
+    // True once the client of the command the daemon is running has gone.
+    bool cancelled() const { return m_cancel && m_cancel->load(); }
+    void startMetricsServer(const std::string& host, int port);
+    std::string renderMetrics();
+    void refreshGauges();
     void downloadFile(const std::vector<std::string>& args);
+    void downloadReplica(const std::string& account, const std::string& file_id,
+                         const std::string& save_path, const std::atomic<bool>* cancel,
+                         std::int64_t offset = -1, std::int64_t length = -1,
+                         const std::function<void(std::int64_t)>& on_received = nullptr);
+    std::string readReplica(const std::string& account, const std::string& file_id,
+                            std::int64_t offset, std::int64_t length, const std::atomic<bool>* cancel = nullptr);
+    void transferReplica(const std::string& account, const std::string& object, const std::atomic<bool>* cancel,
+                         const std::function<std::int64_t(StorageBackend&, const StorageBackend::Progress&)>& fetch);
+    std::string readChunk(const ChunkEntry& chunk, std::int64_t object_offset, std::int64_t length,
+                          const std::atomic<bool>* cancel = nullptr);
+    std::string readFile(const std::string& path, std::int64_t offset, std::int64_t length);
+    std::unique_ptr<ReadAheadStream> openReader(const std::string& path,
+                                               std::shared_ptr<PrefetchBudget> budget = nullptr);
+    void streamFile(const std::string& path, std::int64_t offset, std::int64_t length, std::ostream& out);
+    static void setBinaryStdio();
+    void catFile(const std::vector<std::string>& args);
+    void serveFiles(const std::vector<std::string>& args);
+    void serveS3(const std::string& host, int port);
     void listFiles(const std::vector<std::string>& args);
+    void listDirectory(const std::vector<std::string>& args);
+    void findFiles(const std::vector<std::string>& args);
     void listAccounts(const std::vector<std::string>& args);
     void showHelp(const std::vector<std::string>& args);
     void deleteFile(const std::vector<std::string>& args);
-    
+    void exportMetadata(const std::vector<std::string>& args);
+    void importMetadata(const std::vector<std::string>& args);
+
+    // Serves /metrics once started (stats --serve or DD_METRICS_PORT); its
+    // requests read the chunk cache.
+    std::unique_ptr<MetricsServer> m_metrics_server;
+    // Set while `daemon` serves, so that `daemon stop` can reach it.
+    std::unique_ptr<DaemonServer> m_daemon;
+    // Set while the daemon runs a command, to its client's "gone" flag.
+    const std::atomic<bool>* m_cancel = nullptr;
+
+    // Declared last so it is destroyed first: its refill threads call back
+    // into this Shell.
+    std::unique_ptr<UploadSessionPool> m_session_pool;
 };
 
 #endif // SHELL_H
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "account_stats.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // Weight of the newest sample in the moving average.
+    constexpr double kThroughputAlpha = 0.3;
+}
+
+AccountStats::InFlight::InFlight(AccountStats& stats, const std::string& account)
+    : m_stats(stats), m_account(account) {
+    std::lock_guard<std::mutex> lock(m_stats.m_mutex);
+    m_stats.m_entries[m_account].in_flight++;
+}
+
+AccountStats::InFlight::~InFlight() {
+    std::lock_guard<std::mutex> lock(m_stats.m_mutex);
+    m_stats.m_entries[m_account].in_flight--;
+}
+
+void AccountStats::recordTransfer(const std::string& account, std::int64_t bytes, double seconds) {
+    if (bytes <= 0 || seconds <= 0.0) return;
+    const double rate = static_cast<double>(bytes) / seconds;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Entry& entry = m_entries[account];
+    entry.bytes_per_sec = entry.bytes_per_sec == 0.0
+        ? rate
+        : kThroughputAlpha * rate + (1.0 - kThroughputAlpha) * entry.bytes_per_sec;
+    entry.recent_failures = std::max(0, entry.recent_failures - 1);
+}
+
+void AccountStats::recordFailure(const std::string& account) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries[account].recent_failures++;
+}
+
+double AccountStats::scoreLocked(const Entry& entry, double fallback_rate) const {
+    // Accounts we have never measured are assumed to be as fast as the best
+    // one seen so far, so they get tried instead of starving.
+    const double rate = entry.bytes_per_sec > 0.0 ? entry.bytes_per_sec : fallback_rate;
+    return rate / (entry.in_flight + 1) / std::pow(2.0, entry.recent_failures);
+}
+
+std::vector<std::string> AccountStats::rank(const std::vector<std::string>& accounts) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    double best_rate = 1.0;
+    for (const auto& account : accounts) {
+        best_rate = std::max(best_rate, m_entries[account].bytes_per_sec);
+    }
+
+    std::vector<std::pair<double, std::string>> scored;
+    for (const auto& account : accounts) {
+        scored.emplace_back(scoreLocked(m_entries[account], best_rate), account);
+    }
+    std::stable_sort(scored.begin(), scored.end(),
+                     [](const auto& a, const auto& b) { return a.first > b.first; });
+
+    std::vector<std::string> ranked;
+    for (auto& [score, account] : scored) {
+        ranked.push_back(std::move(account));
+    }
+    return ranked;
+}
@@ -0,0 +1,51 @@
+#ifndef ACCOUNT_STATS_H
+#define ACCOUNT_STATS_H
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Tracks observed throughput and current load per account so that reads can
+// be steered to the replica that is likely to finish first. Only downloads
+// are measured, since an account's upload rate says little about how fast it
+// serves reads; transfers in either direction count as load.
+class AccountStats {
+public:
+    // RAII marker for a transfer that is currently running against an account.
+    class InFlight {
+    public:
+        InFlight(AccountStats& stats, const std::string& account);
+        ~InFlight();
+        InFlight(const InFlight&) = delete;
+        InFlight& operator=(const InFlight&) = delete;
+
+    private:
+        AccountStats& m_stats;
+        std::string m_account;
+    };
+
+    // Outcome of a download from an account.
+    void recordTransfer(const std::string& account, std::int64_t bytes, double seconds);
+    void recordFailure(const std::string& account);
+
+    // Returns the candidate accounts ordered from most to least preferred
+    // for a read, by download rate and failures and by transfers running in
+    // either direction.
+    std::vector<std::string> rank(const std::vector<std::string>& accounts);
+
+private:
+    struct Entry {
+        double bytes_per_sec = 0.0; // download EWMA, 0 until the first sample
+        int in_flight = 0;
+        int recent_failures = 0;
+    };
+
+    double scoreLocked(const Entry& entry, double fallback_rate) const;
+
+    std::mutex m_mutex;
+    std::map<std::string, Entry> m_entries;
+};
+
+#endif // ACCOUNT_STATS_H
@@ -0,0 +1,21 @@
+#include "bandwidth_limiter.h"
+#include <algorithm>
+#include <thread>
+
+BandwidthLimiter::BandwidthLimiter(double bytes_per_sec)
+    : m_bytes_per_sec(bytes_per_sec), m_free(std::chrono::steady_clock::now()) {}
+
+void BandwidthLimiter::pace(std::int64_t bytes) {
+    if (m_bytes_per_sec <= 0 || bytes <= 0) {
+        return;
+    }
+    const auto duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(static_cast<double>(bytes) / m_bytes_per_sec));
+    std::chrono::steady_clock::time_point done;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_free = std::max(m_free, std::chrono::steady_clock::now()) + duration;
+        done = m_free;
+    }
+    std::this_thread::sleep_until(done);
+}
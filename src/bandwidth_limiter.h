@@ -0,0 +1,26 @@
+#ifndef BANDWIDTH_LIMITER_H
+#define BANDWIDTH_LIMITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+
+// Paces transfers that share one link. Every caller books its bytes on a
+// single virtual clock and sleeps until its slot has passed, so concurrent
+// transfers split the bandwidth between them instead of each getting all of
+// it. Callers should send in slices of a few hundred KB so that a large
+// transfer does not hold the link while a small one waits behind it.
+class BandwidthLimiter {
+public:
+    explicit BandwidthLimiter(double bytes_per_sec = 0);   // 0: unlimited
+
+    // Blocks until `bytes` have had time to cross the link.
+    void pace(std::int64_t bytes);
+
+private:
+    double m_bytes_per_sec;
+    std::mutex m_mutex;
+    std::chrono::steady_clock::time_point m_free;
+};
+
+#endif // BANDWIDTH_LIMITER_H
@@ -0,0 +1,35 @@
+#include "base64url.h"
+#include <algorithm>
+#include <cctype>
+#include <vector>
+
+std::string decode_base64url(const std::string& input) {
+    static const std::string base64_chars =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+        "abcdefghijklmnopqrstuvwxyz"
+        "0123456789+/";
+
+    std::string base64 = input;
+    std::replace(base64.begin(), base64.end(), '-', '+');
+    std::replace(base64.begin(), base64.end(), '_', '/');
+    while (base64.length() % 4 != 0)
+        base64 += '=';
+
+    auto is_base64 = [](unsigned char c) {
+        return std::isalnum(c) || c == '+' || c == '/';
+    };
+
+    std::vector<unsigned char> bytes;
+    int val = 0, valb = -8;
+    for (unsigned char c : base64) {
+        if (!is_base64(c)) break;
+        val = (val << 6) + base64_chars.find(c);
+        valb += 6;
+        if (valb >= 0) {
+            bytes.push_back(char((val >> valb) & 0xFF));
+            valb -= 8;
+        }
+    }
+
+    return std::string(bytes.begin(), bytes.end());
+}
@@ -0,0 +1,10 @@
+#ifndef BASE64URL_H
+#define BASE64URL_H
+
+#include <string>
+
+// Decodes URL-safe base64 (RFC 4648 §5, padding optional), as used in JWT
+// segments. Decoding stops at the first character outside the alphabet.
+std::string decode_base64url(const std::string& input);
+
+#endif // BASE64URL_H
@@ -0,0 +1,912 @@
+#include "catalog.h"
+#include "fs_util.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <limits>
+#include <stdexcept>
+#include <tuple>
+#include <unordered_map>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+namespace {
+    constexpr char kMagic[8] = {'D', 'D', 'C', 'A', 'T', 'L', 'G', '\0'};
+    constexpr std::uint32_t kVersion = 1;
+    constexpr std::uint32_t kByteOrder = 0x01020304;
+
+    FileSummary summarize(const FileEntry& file) {
+        return {file.name, file.total_size, static_cast<std::int64_t>(file.chunks.size()), file.replicas};
+    }
+
+    bool startsWith(std::string_view s, std::string_view prefix) {
+        return s.substr(0, prefix.size()) == prefix;
+    }
+
+    // Compares two paths given as (parent, base) pairs in PathLess order.
+    int comparePath(std::string_view dir_a, std::string_view base_a, std::string_view dir_b, std::string_view base_b) {
+        int c = dir_a.compare(dir_b);
+        return c != 0 ? c : base_a.compare(base_b);
+    }
+}
+
+// --- On-disk records (little-endian, naturally aligned) ---
+
+struct CatalogSnapshot::Header {
+    char magic[8];
+    std::uint32_t version;
+    std::uint32_t byte_order;
+    std::uint64_t log_seq;
+    std::uint64_t dir_count;
+    std::uint64_t subdir_count;
+    std::uint64_t file_count;
+    std::uint64_t chunk_count;
+    std::uint64_t replica_count;
+    std::uint64_t string_bytes;
+    std::uint64_t dirs_offset;
+    std::uint64_t subdirs_offset;
+    std::uint64_t files_offset;
+    std::uint64_t chunks_offset;
+    std::uint64_t replicas_offset;
+    std::uint64_t strings_offset;
+};
+
+struct CatalogSnapshot::DirRecord {
+    std::uint32_t path;
+    std::uint32_t parent;
+    std::uint32_t first_subdir;
+    std::uint32_t subdir_count;
+    std::uint64_t first_file;
+    std::uint64_t file_count;
+    std::int64_t total_files;      // recursive
+    std::int64_t total_size;       // recursive
+    std::int64_t total_chunks;     // recursive
+};
+
+struct CatalogSnapshot::FileRecord {
+    std::uint32_t name;            // base name
+    std::uint32_t dir;
+    std::int64_t total_size;
+    std::uint64_t first_chunk;
+    std::uint32_t chunk_count;
+    std::uint32_t replicas;
+};
+
+struct CatalogSnapshot::ChunkRecord {
+    std::uint64_t first_replica;
+    std::uint32_t part;
+    std::uint32_t replica_count;
+    std::int64_t pack_offset;      // -1 unless the chunk is a slice of a pack
+    std::int64_t size;             // -1 for the fixed chunk layout
+};
+
+struct CatalogSnapshot::ReplicaRecord {
+    std::uint32_t account;
+    std::uint32_t drive_file_id;
+};
+
+// --- JSON conversion ---
+
+json toJson(const ChunkEntry& chunk) {
+    json replicas = json::array();
+    for (const auto& replica : chunk.replicas) {
+        replicas.push_back({{"account", replica.account}, {"drive_file_id", replica.drive_file_id}});
+    }
+    json j = {{"part", chunk.part}, {"replicas", replicas}};
+    if (!chunk.replicas.empty()) {
+        j["account"] = chunk.replicas[0].account;
+        j["drive_file_id"] = chunk.replicas[0].drive_file_id;
+    }
+    if (chunk.packed()) {
+        j["pack_offset"] = chunk.pack_offset;
+    }
+    if (chunk.size >= 0) {
+        j["size"] = chunk.size;
+    }
+    return j;
+}
+
+json toJson(const FileEntry& file) {
+    json chunks = json::array();
+    for (const auto& chunk : file.chunks) {
+        chunks.push_back(toJson(chunk));
+    }
+    return {{"total_size", file.total_size}, {"replicas", file.replicas}, {"chunks", chunks}};
+}
+
+ChunkEntry chunkFromJson(const json& j) {
+    ChunkEntry chunk;
+    chunk.part = j.at("part");
+    if (j.contains("replicas")) {
+        for (const auto& replica : j["replicas"]) {
+            chunk.replicas.push_back({replica.at("account"), replica.at("drive_file_id")});
+        }
+    } else {
+        chunk.replicas.push_back({j.at("account"), j.at("drive_file_id")});
+    }
+    chunk.pack_offset = j.value("pack_offset", std::int64_t{-1});
+    chunk.size = j.value("size", std::int64_t{-1});
+    return chunk;
+}
+
+std::string objectKey(const Replica& replica) {
+    return replica.account + '/' + replica.drive_file_id;
+}
+
+std::string packId(const ChunkEntry& chunk) {
+    return chunk.replicas.empty() ? std::string() : objectKey(chunk.replicas[0]);
+}
+
+std::vector<ChunkSpan> chunkSpans(const FileEntry& file, std::int64_t chunk_bytes, std::int64_t offset,
+                                  std::int64_t length) {
+    if (offset < 0 || length < 0 || offset > file.total_size || length > file.total_size - offset) {
+        throw std::runtime_error("Range " + std::to_string(offset) + "+" + std::to_string(length) +
+                                 " is outside " + file.name + " (" + std::to_string(file.total_size) + " bytes)");
+    }
+    std::vector<ChunkSpan> spans;
+    if (length == 0) return spans;
+
+    if (file.chunks.size() == 1 && file.chunks[0].packed()) {
+        spans.push_back({0, file.chunks[0].pack_offset + offset, length, 0});
+        return spans;
+    }
+
+    // Chunks are located by part number; the layout must be exactly the one
+    // the uploader produced.
+    const std::int64_t count = static_cast<std::int64_t>(file.chunks.size());
+    std::vector<std::size_t> by_part(file.chunks.size(), file.chunks.size());
+    bool sized = true;
+    for (std::size_t i = 0; i < file.chunks.size(); ++i) {
+        const int part = file.chunks[i].part;
+        if (part >= 0 && part < count && !file.chunks[i].packed()) by_part[part] = i;
+        sized = sized && file.chunks[i].size >= 0;
+    }
+    const bool complete = std::find(by_part.begin(), by_part.end(), file.chunks.size()) == by_part.end();
+    auto mismatch = [&](const std::string& layout) {
+        return std::runtime_error("Chunk layout of " + file.name + " does not match " + layout);
+    };
+    if (!complete) {
+        throw mismatch("its part numbers");
+    }
+
+    // starts[p] is the file offset where part p begins.
+    std::vector<std::int64_t> starts(file.chunks.size() + 1, 0);
+    for (std::size_t p = 0; p < by_part.size(); ++p) {
+        starts[p + 1] = starts[p] + (sized ? file.chunks[by_part[p]].size : chunk_bytes);
+    }
+    if (sized) {
+        if (starts.back() != file.total_size) throw mismatch("its recorded chunk sizes");
+    } else if (chunk_bytes <= 0 || file.total_size > count * chunk_bytes ||
+               file.total_size <= (count - 1) * chunk_bytes) {
+        throw mismatch(std::to_string(chunk_bytes) + "-byte chunks");
+    }
+
+    for (std::int64_t pos = offset; pos < offset + length;) {
+        const std::size_t part = static_cast<std::size_t>(std::upper_bound(starts.begin(), starts.end(), pos) - starts.begin() - 1);
+        const std::int64_t within = pos - starts[part];
+        const std::int64_t take = std::min(starts[part + 1] - pos, offset + length - pos);
+        spans.push_back({by_part[part], within, take, pos - offset});
+        pos += take;
+    }
+    return spans;
+}
+
+FileEntry fileFromJson(const std::string& name, const json& j) {
+    FileEntry file;
+    file.name = name;
+    file.total_size = j.value("total_size", std::int64_t{0});
+    file.replicas = j.value("replicas", 1);
+    if (j.contains("chunks")) {
+        for (const auto& chunk : j["chunks"]) {
+            file.chunks.push_back(chunkFromJson(chunk));
+        }
+    }
+    return file;
+}
+
+// --- Virtual paths ---
+
+std::string normalizePath(const std::string& path) {
+    std::string normalized;
+    std::size_t pos = 0;
+    while (pos <= path.size()) {
+        std::size_t end = path.find('/', pos);
+        if (end == std::string::npos) end = path.size();
+        std::string_view part(path.data() + pos, end - pos);
+        if (part == "..") {
+            throw std::runtime_error("'..' is not allowed in D-Drive paths: " + path);
+        }
+        if (!part.empty() && part != ".") {
+            if (!normalized.empty()) normalized += '/';
+            normalized.append(part.data(), part.size());
+        }
+        pos = end + 1;
+    }
+    return normalized;
+}
+
+std::string_view parentPath(std::string_view path) {
+    std::size_t slash = path.rfind('/');
+    return slash == std::string_view::npos ? std::string_view() : path.substr(0, slash);
+}
+
+std::string_view baseName(std::string_view path) {
+    std::size_t slash = path.rfind('/');
+    return slash == std::string_view::npos ? path : path.substr(slash + 1);
+}
+
+std::string joinPath(std::string_view dir, std::string_view name) {
+    std::string path(dir);
+    if (!path.empty()) path += '/';
+    path.append(name.data(), name.size());
+    return path;
+}
+
+bool globMatch(std::string_view pattern, std::string_view name) {
+    std::size_t p = 0, n = 0;
+    std::size_t star = std::string_view::npos, resume = 0;
+    while (n < name.size()) {
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p;
+            ++n;
+        } else if (p < pattern.size() && pattern[p] == '*') {
+            star = p++;
+            resume = n;
+        } else if (star != std::string_view::npos) {
+            p = star + 1;
+            n = ++resume;
+        } else {
+            return false;
+        }
+    }
+    while (p < pattern.size() && pattern[p] == '*') ++p;
+    return p == pattern.size();
+}
+
+bool PathLess::operator()(std::string_view a, std::string_view b) const {
+    return comparePath(parentPath(a), baseName(a), parentPath(b), baseName(b)) < 0;
+}
+
+// --- CatalogSnapshot ---
+
+std::shared_ptr<const CatalogSnapshot> CatalogSnapshot::open(const std::string& path) {
+    if (!fs::exists(path)) return nullptr;
+    return std::shared_ptr<const CatalogSnapshot>(new CatalogSnapshot(path));
+}
+
+CatalogSnapshot::CatalogSnapshot(const std::string& path) : m_file(path) {
+    static_assert(sizeof(Header) == 120, "catalog header layout changed");
+    static_assert(sizeof(DirRecord) == 56, "directory record layout changed");
+    static_assert(sizeof(FileRecord) == 32, "file record layout changed");
+    static_assert(sizeof(ChunkRecord) == 32, "chunk record layout changed");
+    static_assert(sizeof(ReplicaRecord) == 8, "replica record layout changed");
+
+    const char* base = m_file.data();
+    const std::size_t size = m_file.size();
+    auto corrupt = [&](const std::string& why) {
+        return std::runtime_error("Corrupt catalog " + path + ": " + why);
+    };
+
+    if (size < sizeof(Header)) throw corrupt("truncated header");
+    m_header = reinterpret_cast<const Header*>(base);
+    if (std::memcmp(m_header->magic, kMagic, sizeof(kMagic)) != 0) throw corrupt("bad magic");
+    if (m_header->byte_order != kByteOrder) throw corrupt("written on a machine with different byte order");
+    if (m_header->version != kVersion) {
+        throw corrupt("unsupported version " + std::to_string(m_header->version));
+    }
+
+    auto section = [&](std::uint64_t offset, std::uint64_t count, std::size_t record_size) {
+        if (offset > size || count > (size - offset) / record_size) throw corrupt("section out of bounds");
+        return base + offset;
+    };
+    m_dirs = reinterpret_cast<const DirRecord*>(section(m_header->dirs_offset, m_header->dir_count, sizeof(DirRecord)));
+    m_subdirs = reinterpret_cast<const std::uint32_t*>(section(m_header->subdirs_offset, m_header->subdir_count, sizeof(std::uint32_t)));
+    m_files = reinterpret_cast<const FileRecord*>(section(m_header->files_offset, m_header->file_count, sizeof(FileRecord)));
+    m_chunks = reinterpret_cast<const ChunkRecord*>(section(m_header->chunks_offset, m_header->chunk_count, sizeof(ChunkRecord)));
+    m_replicas = reinterpret_cast<const ReplicaRecord*>(section(m_header->replicas_offset, m_header->replica_count, sizeof(ReplicaRecord)));
+    m_strings = section(m_header->strings_offset, m_header->string_bytes, 1);
+    if (m_header->dir_count == 0) throw corrupt("missing root directory");
+}
+
+std::uint64_t CatalogSnapshot::logSeq() const { return m_header->log_seq; }
+
+std::size_t CatalogSnapshot::fileCount() const { return static_cast<std::size_t>(m_header->file_count); }
+
+std::string_view CatalogSnapshot::string(std::uint32_t offset) const {
+    std::uint32_t length;
+    if (std::uint64_t{offset} + sizeof(length) > m_header->string_bytes) {
+        throw std::runtime_error("Corrupt catalog: string offset out of bounds");
+    }
+    std::memcpy(&length, m_strings + offset, sizeof(length));
+    if (std::uint64_t{offset} + sizeof(length) + length > m_header->string_bytes) {
+        throw std::runtime_error("Corrupt catalog: string length out of bounds");
+    }
+    return {m_strings + offset + sizeof(length), length};
+}
+
+std::string_view CatalogSnapshot::fileDir(std::size_t file) const {
+    return dirPath(m_files[file].dir);
+}
+
+std::string_view CatalogSnapshot::fileBase(std::size_t file) const {
+    return string(m_files[file].name);
+}
+
+std::string CatalogSnapshot::name(std::size_t file) const {
+    return joinPath(fileDir(file), fileBase(file));
+}
+
+FileSummary CatalogSnapshot::summary(std::size_t file) const {
+    const FileRecord& record = m_files[file];
+    return {name(file), record.total_size, record.chunk_count, static_cast<int>(record.replicas)};
+}
+
+FileEntry CatalogSnapshot::file(std::size_t index) const {
+    const FileRecord& record = m_files[index];
+    if (record.first_chunk + record.chunk_count > m_header->chunk_count) {
+        throw std::runtime_error("Corrupt catalog: chunk range out of bounds");
+    }
+
+    FileEntry file;
+    file.name = name(index);
+    file.total_size = record.total_size;
+    file.replicas = static_cast<int>(record.replicas);
+    file.chunks.reserve(record.chunk_count);
+    for (std::uint32_t c = 0; c < record.chunk_count; ++c) {
+        const ChunkRecord& chunk_record = m_chunks[record.first_chunk + c];
+        if (chunk_record.first_replica + chunk_record.replica_count > m_header->replica_count) {
+            throw std::runtime_error("Corrupt catalog: replica range out of bounds");
+        }
+        ChunkEntry chunk;
+        chunk.part = static_cast<int>(chunk_record.part);
+        chunk.pack_offset = chunk_record.pack_offset;
+        chunk.size = chunk_record.size;
+        for (std::uint32_t r = 0; r < chunk_record.replica_count; ++r) {
+            const ReplicaRecord& replica = m_replicas[chunk_record.first_replica + r];
+            chunk.replicas.push_back({std::string(string(replica.account)), std::string(string(replica.drive_file_id))});
+        }
+        file.chunks.push_back(std::move(chunk));
+    }
+    return file;
+}
+
+std::optional<std::uint32_t> CatalogSnapshot::findDir(std::string_view path) const {
+    std::uint64_t lo = 0, hi = m_header->dir_count;
+    while (lo < hi) {
+        std::uint64_t mid = lo + (hi - lo) / 2;
+        int cmp = dirPath(static_cast<std::uint32_t>(mid)).compare(path);
+        if (cmp == 0) return static_cast<std::uint32_t>(mid);
+        if (cmp < 0) lo = mid + 1; else hi = mid;
+    }
+    return std::nullopt;
+}
+
+std::string_view CatalogSnapshot::dirPath(std::uint32_t dir) const {
+    if (dir >= m_header->dir_count) {
+        throw std::runtime_error("Corrupt catalog: directory index out of bounds");
+    }
+    return string(m_dirs[dir].path);
+}
+
+DirStats CatalogSnapshot::dirStats(std::uint32_t dir) const {
+    const DirRecord& record = m_dirs[dir];
+    return {record.total_files, record.total_size, record.total_chunks};
+}
+
+std::vector<std::uint32_t> CatalogSnapshot::subdirs(std::uint32_t dir, std::string_view prefix) const {
+    const DirRecord& record = m_dirs[dir];
+    if (std::uint64_t{record.first_subdir} + record.subdir_count > m_header->subdir_count) {
+        throw std::runtime_error("Corrupt catalog: subdirectory range out of bounds");
+    }
+    const std::uint32_t* first = m_subdirs + record.first_subdir;
+    const std::uint32_t* last = first + record.subdir_count;
+    if (!prefix.empty()) {
+        first = std::partition_point(first, last, [&](std::uint32_t d) { return baseName(dirPath(d)) < prefix; });
+        last = std::partition_point(first, last, [&](std::uint32_t d) { return startsWith(baseName(dirPath(d)), prefix); });
+    }
+    return {first, last};
+}
+
+std::pair<std::size_t, std::size_t> CatalogSnapshot::dirFiles(std::uint32_t dir, std::string_view prefix) const {
+    const DirRecord& record = m_dirs[dir];
+    if (record.first_file + record.file_count > m_header->file_count) {
+        throw std::runtime_error("Corrupt catalog: file range out of bounds");
+    }
+    std::size_t first = static_cast<std::size_t>(record.first_file);
+    std::size_t last = first + static_cast<std::size_t>(record.file_count);
+    if (!prefix.empty()) {
+        auto partition = [](std::size_t lo, std::size_t hi, auto&& pred) {
+            while (lo < hi) {
+                std::size_t mid = lo + (hi - lo) / 2;
+                if (pred(mid)) lo = mid + 1; else hi = mid;
+            }
+            return lo;
+        };
+        first = partition(first, last, [&](std::size_t f) { return fileBase(f) < prefix; });
+        last = partition(first, last, [&](std::size_t f) { return startsWith(fileBase(f), prefix); });
+    }
+    return {first, last};
+}
+
+std::optional<std::size_t> CatalogSnapshot::find(std::string_view path) const {
+    std::optional<std::uint32_t> dir = findDir(parentPath(path));
+    if (!dir) return std::nullopt;
+    auto [lo, hi] = dirFiles(*dir);
+    const std::string_view base = baseName(path);
+    while (lo < hi) {
+        std::size_t mid = lo + (hi - lo) / 2;
+        int cmp = fileBase(mid).compare(base);
+        if (cmp == 0) return mid;
+        if (cmp < 0) lo = mid + 1; else hi = mid;
+    }
+    return std::nullopt;
+}
+
+void CatalogSnapshot::write(const std::string& path, std::uint64_t log_seq, const FileSource& source) {
+    struct DirBuild {
+        std::uint32_t index = 0;
+        DirStats totals;
+        bool has_files = false;
+        std::uint64_t first_file = 0;
+        std::uint64_t file_count = 0;
+        std::vector<std::uint32_t> children;
+    };
+    std::map<std::string, DirBuild, std::less<>> dirs;
+    dirs[""];
+
+    std::vector<FileRecord> files;
+    std::vector<DirBuild*> file_dirs;
+    std::vector<ChunkRecord> chunks;
+    std::vector<ReplicaRecord> replicas;
+    std::string strings;
+    std::unordered_map<std::string, std::uint32_t> interned;
+
+    auto addString = [&](std::string_view s) -> std::uint32_t {
+        const std::uint32_t length = static_cast<std::uint32_t>(s.size());
+        if (strings.size() + sizeof(length) + s.size() > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::runtime_error("Catalog string table exceeds 4 GB");
+        }
+        const std::uint32_t offset = static_cast<std::uint32_t>(strings.size());
+        strings.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        strings.append(s.data(), s.size());
+        return offset;
+    };
+    auto internString = [&](const std::string& s) -> std::uint32_t {
+        auto it = interned.find(s);
+        if (it != interned.end()) return it->second;
+        std::uint32_t offset = addString(s);
+        interned.emplace(s, offset);
+        return offset;
+    };
+
+    std::string previous;
+    source([&](const FileEntry& file) {
+        if (!files.empty() && !PathLess()(previous, file.name)) {
+            throw std::runtime_error("Catalog entries must be written in path order");
+        }
+        previous = file.name;
+
+        // Every ancestor exists as a directory and counts this file in its
+        // recursive totals.
+        const std::string_view dir_path = parentPath(file.name);
+        for (std::string_view d = dir_path;; d = parentPath(d)) {
+            auto it = dirs.find(d);
+            if (it == dirs.end()) it = dirs.emplace(std::string(d), DirBuild{}).first;
+            it->second.totals.files++;
+            it->second.totals.total_size += file.total_size;
+            it->second.totals.chunks += static_cast<std::int64_t>(file.chunks.size());
+            if (d.empty()) break;
+        }
+        DirBuild& own = dirs.find(dir_path)->second;
+        if (!own.has_files) {
+            own.has_files = true;
+            own.first_file = files.size();
+        }
+        own.file_count++;
+
+        FileRecord record{};
+        record.name = addString(baseName(file.name));
+        record.total_size = file.total_size;
+        record.first_chunk = chunks.size();
+        record.chunk_count = static_cast<std::uint32_t>(file.chunks.size());
+        record.replicas = static_cast<std::uint32_t>(file.replicas);
+        for (const auto& chunk : file.chunks) {
+            ChunkRecord chunk_record{};
+            chunk_record.first_replica = replicas.size();
+            chunk_record.part = static_cast<std::uint32_t>(chunk.part);
+            chunk_record.replica_count = static_cast<std::uint32_t>(chunk.replicas.size());
+            chunk_record.pack_offset = chunk.pack_offset;
+            chunk_record.size = chunk.size;
+            for (const auto& replica : chunk.replicas) {
+                replicas.push_back({internString(replica.account), addString(replica.drive_file_id)});
+            }
+            chunks.push_back(chunk_record);
+        }
+        files.push_back(record);
+        file_dirs.push_back(&own);
+    });
+
+    // Directory indexes follow path order, and a parent's children are
+    // appended in that same order, which is name order among siblings.
+    std::vector<DirRecord> dir_records;
+    std::uint32_t next_index = 0;
+    for (auto& [dir_path, build] : dirs) {
+        build.index = next_index++;
+        DirRecord record{};
+        record.path = internString(dir_path);
+        record.first_file = build.first_file;
+        record.file_count = build.file_count;
+        record.total_files = build.totals.files;
+        record.total_size = build.totals.total_size;
+        record.total_chunks = build.totals.chunks;
+        if (!dir_path.empty()) {
+            DirBuild& parent = dirs.find(parentPath(dir_path))->second;
+            record.parent = parent.index;
+            parent.children.push_back(build.index);
+        }
+        dir_records.push_back(record);
+    }
+    std::vector<std::uint32_t> subdirs;
+    for (const auto& [dir_path, build] : dirs) {
+        dir_records[build.index].first_subdir = static_cast<std::uint32_t>(subdirs.size());
+        dir_records[build.index].subdir_count = static_cast<std::uint32_t>(build.children.size());
+        subdirs.insert(subdirs.end(), build.children.begin(), build.children.end());
+    }
+    for (std::size_t f = 0; f < files.size(); ++f) {
+        files[f].dir = file_dirs[f]->index;
+    }
+
+    // subdirs[] holds 4-byte entries; pad so the file records stay 8-aligned.
+    const std::size_t subdir_bytes = subdirs.size() * sizeof(std::uint32_t);
+    const std::size_t subdir_padding = (8 - subdir_bytes % 8) % 8;
+
+    Header header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.byte_order = kByteOrder;
+    header.log_seq = log_seq;
+    header.dir_count = dir_records.size();
+    header.subdir_count = subdirs.size();
+    header.file_count = files.size();
+    header.chunk_count = chunks.size();
+    header.replica_count = replicas.size();
+    header.string_bytes = strings.size();
+    header.dirs_offset = sizeof(Header);
+    header.subdirs_offset = header.dirs_offset + dir_records.size() * sizeof(DirRecord);
+    header.files_offset = header.subdirs_offset + subdir_bytes + subdir_padding;
+    header.chunks_offset = header.files_offset + files.size() * sizeof(FileRecord);
+    header.replicas_offset = header.chunks_offset + chunks.size() * sizeof(ChunkRecord);
+    header.strings_offset = header.replicas_offset + replicas.size() * sizeof(ReplicaRecord);
+
+    const std::string tmp_path = path + ".tmp";
+    std::FILE* out = std::fopen(tmp_path.c_str(), "wb");
+    if (!out) {
+        throw std::runtime_error("Cannot write catalog: " + tmp_path);
+    }
+    const char padding[8] = {};
+    std::fwrite(&header, sizeof(header), 1, out);
+    std::fwrite(dir_records.data(), sizeof(DirRecord), dir_records.size(), out);
+    std::fwrite(subdirs.data(), sizeof(std::uint32_t), subdirs.size(), out);
+    std::fwrite(padding, 1, subdir_padding, out);
+    std::fwrite(files.data(), sizeof(FileRecord), files.size(), out);
+    std::fwrite(chunks.data(), sizeof(ChunkRecord), chunks.size(), out);
+    std::fwrite(replicas.data(), sizeof(ReplicaRecord), replicas.size(), out);
+    std::fwrite(strings.data(), 1, strings.size(), out);
+    bool failed = std::ferror(out) != 0 || !syncFile(out);
+    failed = std::fclose(out) != 0 || failed;
+    if (failed) {
+        fs::remove(tmp_path);
+        throw std::runtime_error("Failed writing catalog: " + tmp_path);
+    }
+    fs::rename(tmp_path, path);
+}
+
+// --- Catalog ---
+
+void Catalog::setBase(std::shared_ptr<const CatalogSnapshot> base) {
+    m_base = std::move(base);
+    rebuildDirDeltas();
+}
+
+std::uint64_t Catalog::baseSeq() const {
+    return m_base ? m_base->logSeq() : 0;
+}
+
+FileEntry& Catalog::materialize(const std::string& name, std::uint64_t seq) {
+    FileEntry fresh;
+    fresh.name = name;
+    auto it = m_overlay.find(name);
+    if (it == m_overlay.end()) {
+        OverlayEntry entry;
+        std::optional<std::size_t> index = m_base ? m_base->find(name) : std::nullopt;
+        entry.file = index ? m_base->file(*index) : std::move(fresh);
+        it = m_overlay.emplace(name, std::move(entry)).first;
+    } else if (!it->second.file) {
+        it->second.file = std::move(fresh);
+    }
+    it->second.seq = seq;
+    return *it->second.file;
+}
+
+void Catalog::apply(const json& record, std::uint64_t seq) {
+    const std::string op = record.at("op");
+    const std::string name = normalizePath(record.at("file"));
+    const std::optional<FileSummary> before = currentSummary(name);
+    if (m_pack_refs) countPacks(find(name), -1);
+
+    if (op == "put_file") {
+        m_overlay[name] = {fileFromJson(name, record), seq};
+    } else if (op == "add_chunk") {
+        materialize(name, seq).chunks.push_back(chunkFromJson(record.at("chunk")));
+    } else if (op == "delete_file") {
+        m_overlay[name] = {std::nullopt, seq};
+    } else {
+        throw std::runtime_error("Unknown metadata log record: " + op);
+    }
+
+    trackChange(name, before, currentSummary(name));
+    if (m_pack_refs) countPacks(find(name), +1);
+}
+
+void Catalog::countPacks(const std::optional<FileEntry>& file, int delta) {
+    if (!file) return;
+    for (const auto& chunk : file->chunks) {
+        if (!chunk.packed()) continue;
+        auto it = m_pack_refs->emplace(packId(chunk), 0).first;
+        it->second += delta;
+        if (it->second <= 0) m_pack_refs->erase(it);
+    }
+}
+
+int Catalog::packReferences(const std::string& pack_id) {
+    if (!m_pack_refs) {
+        m_pack_refs.emplace();
+        forEach([&](const FileEntry& file) { countPacks(file, +1); });
+    }
+    auto it = m_pack_refs->find(pack_id);
+    return it == m_pack_refs->end() ? 0 : it->second;
+}
+
+std::optional<FileSummary> Catalog::currentSummary(const std::string& name) const {
+    auto it = m_overlay.find(name);
+    if (it != m_overlay.end()) {
+        if (!it->second.file) return std::nullopt;
+        return summarize(*it->second.file);
+    }
+    if (!m_base) return std::nullopt;
+    std::optional<std::size_t> index = m_base->find(name);
+    if (!index) return std::nullopt;
+    return m_base->summary(*index);
+}
+
+void Catalog::trackChange(const std::string& name, const std::optional<FileSummary>& before,
+                          const std::optional<FileSummary>& after) {
+    DirStats delta;
+    if (before) {
+        delta.files -= 1;
+        delta.total_size -= before->total_size;
+        delta.chunks -= before->chunk_count;
+    }
+    if (after) {
+        delta.files += 1;
+        delta.total_size += after->total_size;
+        delta.chunks += after->chunk_count;
+    }
+    for (std::string_view d = parentPath(name);; d = parentPath(d)) {
+        DirStats& stats = m_dir_deltas[std::string(d)];
+        stats.files += delta.files;
+        stats.total_size += delta.total_size;
+        stats.chunks += delta.chunks;
+        if (d.empty()) break;
+        m_overlay_subdirs[std::string(parentPath(d))].emplace(baseName(d));
+    }
+}
+
+void Catalog::rebuildDirDeltas() {
+    m_dir_deltas.clear();
+    m_overlay_subdirs.clear();
+    for (const auto& [name, entry] : m_overlay) {
+        std::optional<FileSummary> before;
+        if (m_base) {
+            if (auto index = m_base->find(name)) before = m_base->summary(*index);
+        }
+        std::optional<FileSummary> after;
+        if (entry.file) after = summarize(*entry.file);
+        trackChange(name, before, after);
+    }
+}
+
+bool Catalog::contains(const std::string& name) const {
+    auto it = m_overlay.find(name);
+    if (it != m_overlay.end()) return it->second.file.has_value();
+    return m_base && m_base->find(name).has_value();
+}
+
+std::optional<FileEntry> Catalog::find(const std::string& name) const {
+    auto it = m_overlay.find(name);
+    if (it != m_overlay.end()) return it->second.file;
+    if (!m_base) return std::nullopt;
+    std::optional<std::size_t> index = m_base->find(name);
+    if (!index) return std::nullopt;
+    return m_base->file(*index);
+}
+
+void Catalog::forEach(const std::function<void(const FileEntry&)>& fn) const {
+    forEachMerged(m_base.get(), m_overlay, fn);
+}
+
+void Catalog::forEachMerged(const CatalogSnapshot* base, const Overlay& overlay,
+                            const std::function<void(const FileEntry&)>& fn) {
+    const std::size_t base_count = base ? base->fileCount() : 0;
+    std::size_t i = 0;
+    auto it = overlay.begin();
+    while (i < base_count || it != overlay.end()) {
+        int cmp = 0;
+        if (it == overlay.end()) {
+            cmp = -1;
+        } else if (i < base_count) {
+            cmp = comparePath(base->fileDir(i), base->fileBase(i), parentPath(it->first), baseName(it->first));
+        } else {
+            cmp = 1;
+        }
+        if (cmp < 0) {
+            fn(base->file(i++));
+            continue;
+        }
+        if (cmp == 0) ++i;  // overlay shadows base
+        if (it->second.file) fn(*it->second.file);
+        ++it;
+    }
+}
+
+DirStats Catalog::dirStats(const std::string& dir) const {
+    DirStats stats;
+    if (m_base) {
+        if (auto index = m_base->findDir(dir)) stats = m_base->dirStats(*index);
+    }
+    auto delta = m_dir_deltas.find(dir);
+    if (delta != m_dir_deltas.end()) {
+        stats.files += delta->second.files;
+        stats.total_size += delta->second.total_size;
+        stats.chunks += delta->second.chunks;
+    }
+    return stats;
+}
+
+bool Catalog::dirExists(const std::string& dir) const {
+    return dir.empty() || dirStats(dir).files > 0;
+}
+
+bool Catalog::list(const std::string& dir, std::string_view prefix,
+                   const std::function<void(const std::string& name, const DirStats&)>& on_dir,
+                   const std::function<void(const FileSummary&)>& on_file) const {
+    if (!dirExists(dir)) return false;
+    std::optional<std::uint32_t> base_dir = m_base ? m_base->findDir(dir) : std::nullopt;
+
+    if (on_dir) {
+        // A directory emptied by overlay deletes is still in the base; the
+        // merged totals decide whether it is shown.
+        std::set<std::string> names;
+        if (base_dir) {
+            for (std::uint32_t child : m_base->subdirs(*base_dir, prefix)) {
+                names.emplace(baseName(m_base->dirPath(child)));
+            }
+        }
+        auto overlay_children = m_overlay_subdirs.find(dir);
+        if (overlay_children != m_overlay_subdirs.end()) {
+            const auto& children = overlay_children->second;
+            for (auto it = children.lower_bound(std::string(prefix)); it != children.end() && startsWith(*it, prefix); ++it) {
+                names.insert(*it);
+            }
+        }
+        for (const auto& name : names) {
+            DirStats stats = dirStats(joinPath(dir, name));
+            if (stats.files > 0) on_dir(name, stats);
+        }
+    }
+
+    if (on_file) {
+        std::size_t i = 0, end = 0;
+        if (base_dir) std::tie(i, end) = m_base->dirFiles(*base_dir, prefix);
+        auto it = m_overlay.lower_bound(joinPath(dir, prefix));
+        auto inRange = [&](Overlay::const_iterator pos) {
+            return pos != m_overlay.end() && parentPath(pos->first) == dir && startsWith(baseName(pos->first), prefix);
+        };
+        while (i < end || inRange(it)) {
+            int cmp = !inRange(it) ? -1 : i >= end ? 1 : m_base->fileBase(i).compare(baseName(it->first));
+            if (cmp < 0) {
+                on_file(m_base->summary(i++));
+                continue;
+            }
+            if (cmp == 0) ++i;
+            if (it->second.file) on_file(summarize(*it->second.file));
+            ++it;
+        }
+    }
+    return true;
+}
+
+void Catalog::walk(const std::string& dir, const std::function<void(const FileSummary&)>& fn) const {
+    std::vector<std::string> children;
+    list(dir, {}, [&](const std::string& name, const DirStats&) { children.push_back(joinPath(dir, name)); }, fn);
+    for (const auto& child : children) {
+        walk(child, fn);
+    }
+}
+
+void Catalog::glob(const std::string& pattern, const std::function<void(const FileSummary&)>& fn) const {
+    std::vector<std::string> parts;
+    const std::string normalized = normalizePath(pattern);
+    std::size_t pos = 0;
+    while (pos < normalized.size()) {
+        std::size_t end = normalized.find('/', pos);
+        if (end == std::string::npos) end = normalized.size();
+        parts.push_back(normalized.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    if (parts.empty()) return;
+    globFrom("", parts, 0, fn);
+}
+
+void Catalog::globFrom(const std::string& dir, const std::vector<std::string>& parts, std::size_t index,
+                       const std::function<void(const FileSummary&)>& fn) const {
+    const std::string& part = parts[index];
+    const bool last = index + 1 == parts.size();
+
+    if (part == "**") {
+        if (last) {
+            walk(dir, fn);
+            return;
+        }
+        globFrom(dir, parts, index + 1, fn);
+        std::vector<std::string> children;
+        list(dir, {}, [&](const std::string& name, const DirStats&) { children.push_back(joinPath(dir, name)); }, nullptr);
+        for (const auto& child : children) {
+            globFrom(child, parts, index, fn);
+        }
+        return;
+    }
+
+    // The literal text before the first wildcard narrows the listing to a
+    // contiguous run of the sorted children.
+    const std::size_t wildcard = part.find_first_of("*?");
+    const std::string_view prefix = std::string_view(part).substr(0, wildcard);
+
+    if (last) {
+        list(dir, prefix, nullptr, [&](const FileSummary& file) {
+            if (globMatch(part, baseName(file.name))) fn(file);
+        });
+        return;
+    }
+    if (wildcard == std::string::npos) {
+        std::string child = joinPath(dir, part);
+        if (dirExists(child)) globFrom(child, parts, index + 1, fn);
+        return;
+    }
+    std::vector<std::string> children;
+    list(dir, prefix, [&](const std::string& name, const DirStats&) {
+        if (globMatch(part, name)) children.push_back(joinPath(dir, name));
+    }, nullptr);
+    for (const auto& child : children) {
+        globFrom(child, parts, index + 1, fn);
+    }
+}
+
+Catalog::Frozen Catalog::freeze(std::uint64_t seq) const {
+    return {m_base, m_overlay, seq};
+}
+
+void Catalog::write(const Frozen& frozen, const std::string& path) {
+    CatalogSnapshot::write(path, frozen.seq, [&](const std::function<void(const FileEntry&)>& emit) {
+        forEachMerged(frozen.base.get(), frozen.overlay, emit);
+    });
+}
+
+void Catalog::adopt(std::shared_ptr<const CatalogSnapshot> base, std::uint64_t seq) {
+    m_base = std::move(base);
+    for (auto it = m_overlay.begin(); it != m_overlay.end();) {
+        if (it->second.seq <= seq) it = m_overlay.erase(it); else ++it;
+    }
+    rebuildDirDeltas();
+}
@@ -0,0 +1,242 @@
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "mapped_file.h"
+
+// --- Decoded catalog entries ---
+struct Replica {
+    std::string account;
+    std::string drive_file_id;
+};
+
+struct ChunkEntry {
+    int part = 0;
+    std::vector<Replica> replicas;    // replicas[0] is the primary copy
+    // Small files are stored as slices of a shared pack object. For such a
+    // chunk (always the file's only one) the replicas name the pack objects
+    // and the file's bytes start at pack_offset within them.
+    std::int64_t pack_offset = -1;
+    // Bytes in this chunk, recorded by uploads whose chunks vary in size (such
+    // as S3 multipart parts). -1 means the file uses the fixed chunk layout.
+    std::int64_t size = -1;
+
+    bool packed() const { return pack_offset >= 0; }
+};
+
+// Drive file ids are only unique within their account; this names an object
+// across accounts.
+std::string objectKey(const Replica& replica);
+
+// Pack objects are identified by their primary replica's object key.
+std::string packId(const ChunkEntry& chunk);
+
+// Files are keyed by a virtual path such as "backups/2024/db.tar": components
+// separated by '/', no leading slash, no empty, "." or ".." components.
+struct FileEntry {
+    std::string name;
+    std::int64_t total_size = 0;
+    int replicas = 1;
+    std::vector<ChunkEntry> chunks;
+};
+
+// Where bytes of a file live: `length` bytes starting at `object_offset`
+// within the object of chunks[chunk], landing at `buffer_offset` relative to
+// the start of the requested range.
+struct ChunkSpan {
+    std::size_t chunk = 0;
+    std::int64_t object_offset = 0;
+    std::int64_t length = 0;
+    std::int64_t buffer_offset = 0;
+};
+
+// Maps bytes [offset, offset + length) of `file` onto the chunks holding
+// them, in file order. Chunks take their recorded sizes when every chunk has
+// one; otherwise every chunk but the last holds `chunk_bytes`. Throws
+// std::runtime_error if the file's chunks do not fit the layout or the range
+// lies outside the file.
+std::vector<ChunkSpan> chunkSpans(const FileEntry& file, std::int64_t chunk_bytes, std::int64_t offset,
+                                  std::int64_t length);
+
+// What a listing needs to know about a file, without decoding its chunks.
+struct FileSummary {
+    std::string name;                 // full path
+    std::int64_t total_size = 0;
+    std::int64_t chunk_count = 0;
+    int replicas = 1;
+};
+
+// Recursive totals for a directory.
+struct DirStats {
+    std::int64_t files = 0;
+    std::int64_t total_size = 0;
+    std::int64_t chunks = 0;
+};
+
+// JSON is the import/export and log-record format. Chunks written before
+// replication existed carry a single top-level account/drive_file_id pair.
+nlohmann::json toJson(const ChunkEntry& chunk);
+nlohmann::json toJson(const FileEntry& file);
+ChunkEntry chunkFromJson(const nlohmann::json& j);
+FileEntry fileFromJson(const std::string& name, const nlohmann::json& j);
+
+// --- Virtual paths ---
+// Normalises "/a//b/./c/" to "a/b/c". Throws on "..". The root is "".
+std::string normalizePath(const std::string& path);
+std::string_view parentPath(std::string_view path);
+std::string_view baseName(std::string_view path);
+std::string joinPath(std::string_view dir, std::string_view name);
+// Shell-style match of one path component: '*' and '?'.
+bool globMatch(std::string_view pattern, std::string_view name);
+
+// Orders paths by (parent directory, base name), so that every directory's
+// own files are contiguous and directories sort before their contents.
+struct PathLess {
+    using is_transparent = void;
+    bool operator()(std::string_view a, std::string_view b) const;
+};
+
+// Immutable on-disk catalog, memory-mapped and queried in place.
+//
+//   header | dirs[] | subdirs[] | files[] | chunks[] | replicas[] | strings
+//
+// Directory records are sorted by path and carry recursive aggregates; each
+// names a run of child directory indexes in subdirs[] and a run of its own
+// file records. File records are sorted by PathLess, so a lookup is a binary
+// search for the directory followed by one within its files. Each file
+// points at a run of chunk records, which point at runs of replica records.
+// Strings live in the table as <u32 length><bytes>; account ids and
+// directory paths are interned.
+class CatalogSnapshot {
+public:
+    // Returns nullptr when `path` does not exist. Throws on a corrupt file.
+    static std::shared_ptr<const CatalogSnapshot> open(const std::string& path);
+
+    // Writes entries (which must arrive in PathLess order) to `path` atomically.
+    using FileSource = std::function<void(const std::function<void(const FileEntry&)>&)>;
+    static void write(const std::string& path, std::uint64_t log_seq, const FileSource& source);
+
+    std::uint64_t logSeq() const;
+
+    std::size_t fileCount() const;
+    std::string name(std::size_t file) const;
+    std::string_view fileDir(std::size_t file) const;
+    std::string_view fileBase(std::size_t file) const;
+    FileEntry file(std::size_t file) const;
+    FileSummary summary(std::size_t file) const;
+    std::optional<std::size_t> find(std::string_view path) const;
+
+    std::optional<std::uint32_t> findDir(std::string_view path) const;
+    std::string_view dirPath(std::uint32_t dir) const;
+    DirStats dirStats(std::uint32_t dir) const;
+    // Child directories of `dir` whose names start with `prefix`, in name order.
+    std::vector<std::uint32_t> subdirs(std::uint32_t dir, std::string_view prefix = {}) const;
+    // [first, last) file indexes directly inside `dir` whose base name
+    // starts with `prefix`.
+    std::pair<std::size_t, std::size_t> dirFiles(std::uint32_t dir, std::string_view prefix = {}) const;
+
+private:
+    struct Header;
+    struct DirRecord;
+    struct FileRecord;
+    struct ChunkRecord;
+    struct ReplicaRecord;
+
+    explicit CatalogSnapshot(const std::string& path);
+    std::string_view string(std::uint32_t offset) const;
+
+    MappedFile m_file;
+    const Header* m_header = nullptr;
+    const DirRecord* m_dirs = nullptr;
+    const std::uint32_t* m_subdirs = nullptr;
+    const FileRecord* m_files = nullptr;
+    const ChunkRecord* m_chunks = nullptr;
+    const ReplicaRecord* m_replicas = nullptr;
+    const char* m_strings = nullptr;
+};
+
+// The live catalog: a mapped snapshot plus an in-memory overlay holding every
+// file changed since that snapshot was written. Not thread-safe; the owner
+// serialises access.
+class Catalog {
+public:
+    struct OverlayEntry {
+        std::optional<FileEntry> file;   // nullopt hides a deleted base entry
+        std::uint64_t seq = 0;           // log record that last touched it
+    };
+    using Overlay = std::map<std::string, OverlayEntry, PathLess>;
+
+    // A point-in-time view that can be written out without holding the lock.
+    struct Frozen {
+        std::shared_ptr<const CatalogSnapshot> base;
+        Overlay overlay;
+        std::uint64_t seq = 0;
+    };
+
+    void setBase(std::shared_ptr<const CatalogSnapshot> base);
+    std::uint64_t baseSeq() const;
+
+    // Applies one log record (see MetadataStore::apply for the record kinds).
+    void apply(const nlohmann::json& record, std::uint64_t seq);
+
+    bool contains(const std::string& name) const;
+    std::optional<FileEntry> find(const std::string& name) const;
+    void forEach(const std::function<void(const FileEntry&)>& fn) const;
+
+    // Directory queries cost O(log n + result). `dir` must be normalised.
+    bool dirExists(const std::string& dir) const;
+    DirStats dirStats(const std::string& dir) const;
+    // Immediate children of `dir` whose names start with `prefix`, in name
+    // order. Returns false if the directory does not exist.
+    bool list(const std::string& dir, std::string_view prefix,
+              const std::function<void(const std::string& name, const DirStats&)>& on_dir,
+              const std::function<void(const FileSummary&)>& on_file) const;
+    void walk(const std::string& dir, const std::function<void(const FileSummary&)>& fn) const;
+    // Matches '*' and '?' per component and "**" across components, only
+    // descending into directories the pattern can still match.
+    void glob(const std::string& pattern, const std::function<void(const FileSummary&)>& fn) const;
+
+    Frozen freeze(std::uint64_t seq) const;
+    static void write(const Frozen& frozen, const std::string& path);
+    // Swaps in the snapshot written from freeze(seq) and drops overlay entries
+    // it already covers.
+    void adopt(std::shared_ptr<const CatalogSnapshot> base, std::uint64_t seq);
+
+    // Number of live files stored in the given pack object. The first call
+    // builds an index with one pass over the catalog; apply() keeps it current.
+    int packReferences(const std::string& pack_id);
+
+private:
+    static void forEachMerged(const CatalogSnapshot* base, const Overlay& overlay,
+                              const std::function<void(const FileEntry&)>& fn);
+    FileEntry& materialize(const std::string& name, std::uint64_t seq);
+
+    std::optional<FileSummary> currentSummary(const std::string& name) const;
+    void trackChange(const std::string& name, const std::optional<FileSummary>& before,
+                     const std::optional<FileSummary>& after);
+    void rebuildDirDeltas();
+    void countPacks(const std::optional<FileEntry>& file, int delta);
+    void globFrom(const std::string& dir, const std::vector<std::string>& parts, std::size_t index,
+                  const std::function<void(const FileSummary&)>& fn) const;
+
+    std::shared_ptr<const CatalogSnapshot> m_base;
+    Overlay m_overlay;
+
+    // How the overlay changes each directory's recursive totals relative to
+    // the base, and which child directories the overlay knows about.
+    std::map<std::string, DirStats> m_dir_deltas;
+    std::map<std::string, std::set<std::string>> m_overlay_subdirs;
+
+    std::optional<std::map<std::string, int>> m_pack_refs;
+};
+
+#endif // CATALOG_H
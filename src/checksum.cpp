@@ -0,0 +1,39 @@
+#include "checksum.h"
+
+void Checksum::update(const char* data, std::size_t size) {
+    while (size > 0 && m_pending_size > 0) {
+        m_pending[m_pending_size++] = static_cast<unsigned char>(*data++);
+        --size;
+        if (m_pending_size == 8) {
+            mix(m_pending);
+            m_pending_size = 0;
+        }
+    }
+    for (; size >= 8; data += 8, size -= 8) {
+        mix(reinterpret_cast<const unsigned char*>(data));
+    }
+    for (; size > 0; --size) {
+        m_pending[m_pending_size++] = static_cast<unsigned char>(*data++);
+    }
+}
+
+std::uint64_t Checksum::finish() {
+    std::uint64_t h = m_hash;
+    for (std::size_t i = 0; i < m_pending_size; ++i) {
+        h = (h ^ m_pending[i]) * 0x100000001b3ull;
+    }
+    h ^= m_length;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+void Checksum::mix(const unsigned char* word) {
+    std::uint64_t w = 0;
+    for (int i = 7; i >= 0; --i) w = (w << 8) | word[i];
+    m_hash = (m_hash ^ w) * 0x100000001b3ull;
+    m_length += 8;
+}
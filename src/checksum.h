@@ -0,0 +1,24 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <cstddef>
+#include <cstdint>
+
+// FNV-1a over 64-bit little-endian words with a final avalanche. Meant to
+// catch torn or corrupted files, not adversaries; any single changed word
+// changes the result. Bytes may be fed in pieces of any size.
+class Checksum {
+public:
+    void update(const char* data, std::size_t size);
+    std::uint64_t finish();
+
+private:
+    void mix(const unsigned char* word);
+
+    std::uint64_t m_hash = 0xcbf29ce484222325ull;
+    std::uint64_t m_length = 0;
+    unsigned char m_pending[8] = {};
+    std::size_t m_pending_size = 0;
+};
+
+#endif // CHECKSUM_H
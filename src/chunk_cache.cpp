@@ -0,0 +1,456 @@
+#include "chunk_cache.h"
+#include "checksum.h"
+#include "fs_util.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Cached file layout: magic, payload length, payload checksum, payload.
+constexpr char MAGIC[8] = {'D', 'D', 'C', 'H', 'U', 'N', 'K', '1'};
+constexpr std::int64_t HEADER_BYTES = 24;
+constexpr std::size_t COPY_BLOCK = 1 << 20;
+const std::string SUFFIX = ".chunk";
+const std::string TEMP_MARK = ".tmp-";
+
+void putU64(char* out, std::uint64_t v) {
+    for (int i = 0; i < 8; ++i) out[i] = static_cast<char>((v >> (8 * i)) & 0xff);
+}
+
+std::uint64_t getU64(const char* in) {
+    std::uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | static_cast<unsigned char>(in[i]);
+    return v;
+}
+
+void makeHeader(char* header, std::int64_t size, std::uint64_t checksum) {
+    std::memcpy(header, MAGIC, 8);
+    putU64(header + 8, static_cast<std::uint64_t>(size));
+    putU64(header + 16, checksum);
+}
+
+bool fileNameSafe(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_';
+}
+
+} // namespace
+
+ChunkCache::ChunkCache(std::string dir, std::int64_t budget_bytes)
+    : m_dir(std::move(dir)), m_budget(std::max<std::int64_t>(budget_bytes, 0)) {
+    if (!enabled()) return;
+    std::error_code ec;
+    fs::create_directories(m_dir, ec);
+
+    // Temporary files belong to writes that never finished. Everything else
+    // is re-admitted oldest first, so the most recently written files are the
+    // last to be evicted.
+    std::vector<std::pair<fs::file_time_type, std::pair<std::string, std::int64_t>>> found;
+    for (const auto& file : fs::directory_iterator(m_dir, ec)) {
+        const std::string name = file.path().filename().string();
+        std::error_code file_ec;
+        if (name.find(TEMP_MARK) != std::string::npos) {
+            fs::remove(file.path(), file_ec);
+            continue;
+        }
+        if (name.size() <= SUFFIX.size() || name.compare(name.size() - SUFFIX.size(), SUFFIX.size(), SUFFIX) != 0) {
+            continue;
+        }
+        std::string key;
+        const auto bytes = static_cast<std::int64_t>(file.file_size(file_ec));
+        if (file_ec || !keyFromFileName(name.substr(0, name.size() - SUFFIX.size()), key) || !validKey(key) ||
+            bytes < HEADER_BYTES) {
+            fs::remove(file.path(), file_ec);
+            continue;
+        }
+        found.push_back({file.last_write_time(file_ec), {key, bytes - HEADER_BYTES}});
+    }
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& [time, entry] : found) {
+        admitLocked(entry.first, entry.second);
+    }
+}
+
+bool ChunkCache::validKey(const std::string& key) {
+    // Escaped, a byte may take three characters, and the temporary name
+    // must still fit the usual 255-character limit.
+    return !key.empty() && key.size() <= 72;
+}
+
+// Keys hold an account name, which may contain anything; every other byte is
+// written as %XX so no key can escape the cache directory or end in SUFFIX.
+std::string ChunkCache::fileNameFor(const std::string& key) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string name;
+    for (char c : key) {
+        if (fileNameSafe(c)) {
+            name += c;
+        } else {
+            const auto byte = static_cast<unsigned char>(c);
+            name += '%';
+            name += hex[byte >> 4];
+            name += hex[byte & 0xf];
+        }
+    }
+    return name;
+}
+
+bool ChunkCache::keyFromFileName(const std::string& name, std::string& key) {
+    key.clear();
+    for (std::size_t i = 0; i < name.size(); ++i) {
+        if (fileNameSafe(name[i])) {
+            key += name[i];
+            continue;
+        }
+        if (name[i] != '%' || i + 2 >= name.size() || !std::isxdigit(static_cast<unsigned char>(name[i + 1])) ||
+            !std::isxdigit(static_cast<unsigned char>(name[i + 2]))) {
+            return false;
+        }
+        key += static_cast<char>(std::stoi(name.substr(i + 1, 2), nullptr, 16));
+        i += 2;
+    }
+    return true;
+}
+
+std::string ChunkCache::pathFor(const std::string& key) const {
+    return (fs::path(m_dir) / (fileNameFor(key) + SUFFIX)).string();
+}
+
+std::string ChunkCache::tempPathFor(const std::string& key) const {
+    std::random_device rd;
+    return pathFor(key) + TEMP_MARK + std::to_string(rd()) + std::to_string(rd());
+}
+
+bool ChunkCache::read(const std::string& key, std::int64_t offset, std::int64_t length, std::string& out) {
+    std::int64_t size = 0;
+    bool verified = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!lookupLocked(key, size, verified)) return false;
+    }
+    if (offset < 0 || length < 0 || offset > size || length > size - offset) {
+        return false;
+    }
+    const std::string path = pathFor(key);
+    if (!verified) {
+        if (!verifyFile(path, size)) {
+            erase(key);
+            return false;
+        }
+        markVerified(key);
+    }
+
+    std::ifstream in(path, std::ios::binary);
+    out.resize(static_cast<std::size_t>(length));
+    in.seekg(HEADER_BYTES + offset);
+    if (!in.read(out.data(), length)) {
+        out.clear();
+        erase(key);
+        return false;
+    }
+    return true;
+}
+
+bool ChunkCache::copyTo(const std::string& key, const std::string& path) {
+    std::int64_t size = 0;
+    bool verified = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!lookupLocked(key, size, verified)) return false;
+    }
+
+    // The whole file is read anyway, so it is verified on every copy.
+    std::ifstream in(pathFor(key), std::ios::binary);
+    char header[HEADER_BYTES];
+    bool ok = static_cast<bool>(in.read(header, HEADER_BYTES)) && std::memcmp(header, MAGIC, 8) == 0 &&
+              getU64(header + 8) == static_cast<std::uint64_t>(size);
+    if (ok) {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        Checksum checksum;
+        std::vector<char> block(COPY_BLOCK);
+        for (std::int64_t done = 0; ok && done < size;) {
+            const auto step = static_cast<std::streamsize>(std::min<std::int64_t>(COPY_BLOCK, size - done));
+            ok = static_cast<bool>(in.read(block.data(), step)) && static_cast<bool>(out.write(block.data(), step));
+            checksum.update(block.data(), static_cast<std::size_t>(step));
+            done += step;
+        }
+        ok = ok && checksum.finish() == getU64(header + 16);
+        out.close();
+        ok = ok && !out.fail();
+        if (!ok) {
+            std::error_code ec;
+            fs::remove(path, ec);
+        }
+    }
+    if (!ok) {
+        erase(key);
+        return false;
+    }
+    markVerified(key);
+    return true;
+}
+
+void ChunkCache::insert(const std::string& key, const char* data, std::size_t size) {
+    if (!enabled() || !validKey(key) || static_cast<std::int64_t>(size) > m_budget) return;
+    Checksum checksum;
+    checksum.update(data, size);
+    char header[HEADER_BYTES];
+    makeHeader(header, static_cast<std::int64_t>(size), checksum.finish());
+
+    const std::string temp = tempPathFor(key);
+    std::FILE* f = std::fopen(temp.c_str(), "wb");
+    if (!f) return;
+    bool ok = std::fwrite(header, 1, HEADER_BYTES, f) == HEADER_BYTES && std::fwrite(data, 1, size, f) == size;
+    ok = ok && syncFile(f);
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) {
+        std::error_code ec;
+        fs::remove(temp, ec);
+        return;
+    }
+    install(key, temp, static_cast<std::int64_t>(size));
+}
+
+void ChunkCache::insertFile(const std::string& key, const std::string& path) {
+    std::error_code ec;
+    const auto size = static_cast<std::int64_t>(fs::file_size(path, ec));
+    if (ec || !enabled() || !validKey(key) || size > m_budget) return;
+
+    // One pass: copy with a placeholder header, then fill in the checksum.
+    const std::string temp = tempPathFor(key);
+    std::ifstream in(path, std::ios::binary);
+    std::FILE* f = std::fopen(temp.c_str(), "wb");
+    if (!f) return;
+    char header[HEADER_BYTES] = {};
+    bool ok = std::fwrite(header, 1, HEADER_BYTES, f) == HEADER_BYTES;
+    Checksum checksum;
+    std::vector<char> block(COPY_BLOCK);
+    for (std::int64_t done = 0; ok && done < size;) {
+        const auto step = static_cast<std::size_t>(std::min<std::int64_t>(COPY_BLOCK, size - done));
+        ok = static_cast<bool>(in.read(block.data(), static_cast<std::streamsize>(step))) &&
+             std::fwrite(block.data(), 1, step, f) == step;
+        checksum.update(block.data(), step);
+        done += static_cast<std::int64_t>(step);
+    }
+    if (ok) {
+        makeHeader(header, size, checksum.finish());
+        ok = std::fseek(f, 0, SEEK_SET) == 0 && std::fwrite(header, 1, HEADER_BYTES, f) == HEADER_BYTES;
+    }
+    ok = ok && syncFile(f);
+    ok = std::fclose(f) == 0 && ok;
+    if (!ok) {
+        fs::remove(temp, ec);
+        return;
+    }
+    install(key, temp, size);
+}
+
+void ChunkCache::install(const std::string& key, const std::string& temp_path, std::int64_t size) {
+    // Renamed into place and admitted under the lock, so a concurrent
+    // eviction of the same key cannot delete the new file after the rename.
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::error_code ec;
+    fs::rename(temp_path, pathFor(key), ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+        return;
+    }
+    admitLocked(key, size);
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) it->second.verified = true;
+}
+
+bool ChunkCache::verifyFile(const std::string& path, std::int64_t size) {
+    std::ifstream in(path, std::ios::binary);
+    char header[HEADER_BYTES];
+    if (!in.read(header, HEADER_BYTES) || std::memcmp(header, MAGIC, 8) != 0 ||
+        getU64(header + 8) != static_cast<std::uint64_t>(size)) {
+        return false;
+    }
+    Checksum checksum;
+    std::vector<char> block(COPY_BLOCK);
+    for (std::int64_t done = 0; done < size;) {
+        const auto step = static_cast<std::streamsize>(std::min<std::int64_t>(COPY_BLOCK, size - done));
+        if (!in.read(block.data(), step)) return false;
+        checksum.update(block.data(), static_cast<std::size_t>(step));
+        done += step;
+    }
+    return checksum.finish() == getU64(header + 16);
+}
+
+void ChunkCache::markVerified(const std::string& key) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_entries.find(key);
+    if (it != m_entries.end()) it->second.verified = true;
+}
+
+void ChunkCache::erase(const std::string& key) {
+    if (!enabled()) return;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    forgetLocked(key);
+}
+
+void ChunkCache::clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    while (!m_entries.empty()) {
+        forgetLocked(m_entries.begin()->first);
+    }
+    m_recent_target = 0;
+}
+
+ChunkCache::Stats ChunkCache::stats() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Stats stats;
+    stats.budget_bytes = m_budget;
+    stats.recent_bytes = bytesOf(List::Recent);
+    stats.frequent_bytes = bytesOf(List::Frequent);
+    stats.resident_bytes = stats.recent_bytes + stats.frequent_bytes;
+    stats.entries = static_cast<std::int64_t>(listOf(List::Recent).size() + listOf(List::Frequent).size());
+    stats.recent_target = m_recent_target;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    return stats;
+}
+
+// --- ARC bookkeeping (all under m_mutex) ---
+
+bool ChunkCache::resident(List list) {
+    return list == List::Recent || list == List::Frequent;
+}
+
+std::list<std::string>& ChunkCache::listOf(List list) {
+    return m_lists[static_cast<int>(list)];
+}
+
+std::int64_t& ChunkCache::bytesOf(List list) {
+    return m_bytes[static_cast<int>(list)];
+}
+
+bool ChunkCache::lookupLocked(const std::string& key, std::int64_t& size, bool& verified) {
+    auto it = enabled() ? m_entries.find(key) : m_entries.end();
+    if (it == m_entries.end() || !resident(it->second.list)) {
+        m_misses++;
+        return false;
+    }
+    m_hits++;
+    moveLocked(key, it->second, List::Frequent);
+    size = it->second.size;
+    verified = it->second.verified;
+    return true;
+}
+
+void ChunkCache::moveLocked(const std::string& key, Entry& entry, List to) {
+    listOf(entry.list).erase(entry.pos);
+    bytesOf(entry.list) -= entry.size;
+    entry.list = to;
+    listOf(to).push_front(key);
+    entry.pos = listOf(to).begin();
+    bytesOf(to) += entry.size;
+}
+
+void ChunkCache::forgetLocked(const std::string& key) {
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) return;
+    if (resident(it->second.list)) {
+        std::error_code ec;
+        fs::remove(pathFor(key), ec);
+    }
+    listOf(it->second.list).erase(it->second.pos);
+    bytesOf(it->second.list) -= it->second.size;
+    m_entries.erase(it);
+}
+
+void ChunkCache::admitLocked(const std::string& key, std::int64_t size) {
+    auto it = m_entries.find(key);
+    bool frequent_ghost_hit = false;
+    if (it == m_entries.end()) {
+        Entry entry;
+        entry.list = List::Recent;
+        listOf(List::Recent).push_front(key);
+        entry.pos = listOf(List::Recent).begin();
+        entry.size = size;
+        bytesOf(List::Recent) += size;
+        m_entries.emplace(key, entry);
+    } else {
+        Entry& entry = it->second;
+        const std::int64_t recent_ghosts = std::max<std::int64_t>(bytesOf(List::RecentGhost), 1);
+        const std::int64_t frequent_ghosts = std::max<std::int64_t>(bytesOf(List::FrequentGhost), 1);
+        if (entry.list == List::RecentGhost) {
+            // Evicted from the recent side too early: give that side more room.
+            m_recent_target = std::min(m_budget, m_recent_target + size * std::max<std::int64_t>(frequent_ghosts / recent_ghosts, 1));
+        } else if (entry.list == List::FrequentGhost) {
+            m_recent_target = std::max<std::int64_t>(0, m_recent_target - size * std::max<std::int64_t>(recent_ghosts / frequent_ghosts, 1));
+            frequent_ghost_hit = true;
+        }
+        bytesOf(entry.list) -= entry.size;
+        entry.size = size;
+        bytesOf(entry.list) += entry.size;
+        entry.verified = false;
+        moveLocked(key, entry, List::Frequent);
+    }
+
+    while (bytesOf(List::Recent) + bytesOf(List::Frequent) > m_budget) {
+        if (!replaceLocked(frequent_ghost_hit, key)) {
+            // Nothing left to evict but the new entry itself.
+            forgetLocked(key);
+            break;
+        }
+    }
+    trimGhostsLocked();
+}
+
+bool ChunkCache::replaceLocked(bool frequent_ghost_hit, const std::string& keep) {
+    // Evict from the recent list while it holds more than its target share,
+    // otherwise from the frequent list; fall back to the other list when the
+    // chosen one is empty or holds only `keep`.
+    const std::int64_t recent = bytesOf(List::Recent);
+    const bool prefer_recent = recent > m_recent_target || (frequent_ghost_hit && recent == m_recent_target);
+    auto victimIn = [&](List list) {
+        return !listOf(list).empty() && listOf(list).back() != keep;
+    };
+    List from;
+    if (victimIn(prefer_recent ? List::Recent : List::Frequent)) {
+        from = prefer_recent ? List::Recent : List::Frequent;
+    } else if (victimIn(prefer_recent ? List::Frequent : List::Recent)) {
+        from = prefer_recent ? List::Frequent : List::Recent;
+    } else {
+        return false;
+    }
+
+    const std::string key = listOf(from).back();
+    Entry& entry = m_entries[key];
+    std::error_code ec;
+    fs::remove(pathFor(key), ec);
+    entry.verified = false;
+    moveLocked(key, entry, from == List::Recent ? List::RecentGhost : List::FrequentGhost);
+    return true;
+}
+
+void ChunkCache::trimGhostsLocked() {
+    auto dropOldest = [&](List list) {
+        const std::string key = listOf(list).back();
+        auto it = m_entries.find(key);
+        bytesOf(list) -= it->second.size;
+        listOf(list).pop_back();
+        m_entries.erase(it);
+    };
+    while (!listOf(List::RecentGhost).empty() &&
+           bytesOf(List::Recent) + bytesOf(List::RecentGhost) > m_budget) {
+        dropOldest(List::RecentGhost);
+    }
+    while (!listOf(List::FrequentGhost).empty() &&
+           bytesOf(List::Recent) + bytesOf(List::Frequent) + bytesOf(List::RecentGhost) +
+                   bytesOf(List::FrequentGhost) > 2 * m_budget) {
+        dropOldest(List::FrequentGhost);
+    }
+}
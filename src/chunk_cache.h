@@ -0,0 +1,104 @@
+#ifndef CHUNK_CACHE_H
+#define CHUNK_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+// Local on-disk cache of Drive objects (chunks and packs), keyed by the
+// object's key (see objectKey). Objects are immutable once uploaded, so the
+// key addresses the content; each cached file also records the length and a
+// checksum of its bytes, verified before a cached copy is first trusted.
+//
+// Files are written to a temporary name, synced and renamed into place, so a
+// crash never leaves a partial entry under a real name; leftovers are removed
+// on startup. Eviction keeps the resident bytes within the budget using ARC:
+// objects seen once and objects seen repeatedly are kept on separate lists,
+// and ghost lists of recently evicted keys steer how much of the budget each
+// side gets, so a one-off scan of a large file does not flush the hot set.
+//
+// All methods are thread-safe. A budget of 0 disables the cache.
+class ChunkCache {
+public:
+    struct Stats {
+        std::int64_t budget_bytes = 0;
+        std::int64_t resident_bytes = 0;
+        std::int64_t entries = 0;
+        std::int64_t recent_bytes = 0;     // seen once
+        std::int64_t frequent_bytes = 0;   // seen more than once
+        std::int64_t recent_target = 0;    // ARC's current share for the recent list
+        std::int64_t hits = 0;
+        std::int64_t misses = 0;
+    };
+
+    ChunkCache(std::string dir, std::int64_t budget_bytes);
+
+    ChunkCache(const ChunkCache&) = delete;
+    ChunkCache& operator=(const ChunkCache&) = delete;
+
+    bool enabled() const { return m_budget > 0; }
+
+    // Copies bytes [offset, offset + length) of a cached object into `out`.
+    // Returns false on a miss or if the cached copy fails verification.
+    bool read(const std::string& key, std::int64_t offset, std::int64_t length, std::string& out);
+
+    // Copies a whole cached object to `path`. Returns false on a miss or if
+    // the cached copy fails verification (`path` is then left untouched or
+    // removed).
+    bool copyTo(const std::string& key, const std::string& path);
+
+    // Adds an object, from memory or from a downloaded file. Objects larger
+    // than the budget are not cached.
+    void insert(const std::string& key, const char* data, std::size_t size);
+    void insertFile(const std::string& key, const std::string& path);
+
+    // Removes an object, e.g. once it is deleted from Drive.
+    void erase(const std::string& key);
+    void clear();
+    Stats stats();
+
+private:
+    enum class List { Recent, Frequent, RecentGhost, FrequentGhost };
+    struct Entry {
+        List list;
+        std::list<std::string>::iterator pos;
+        std::int64_t size = 0;
+        bool verified = false;   // checksum checked since this process started
+    };
+
+    static bool resident(List list);
+    static bool validKey(const std::string& key);
+    static std::string fileNameFor(const std::string& key);
+    static bool keyFromFileName(const std::string& name, std::string& key);
+    std::string pathFor(const std::string& key) const;
+    std::string tempPathFor(const std::string& key) const;
+    bool verifyFile(const std::string& path, std::int64_t size);
+    void install(const std::string& key, const std::string& temp_path, std::int64_t size);
+    void markVerified(const std::string& key);
+
+    bool lookupLocked(const std::string& key, std::int64_t& size, bool& verified);
+    void admitLocked(const std::string& key, std::int64_t size);
+    bool replaceLocked(bool frequent_ghost_hit, const std::string& keep);
+    void trimGhostsLocked();
+    void moveLocked(const std::string& key, Entry& entry, List to);
+    void forgetLocked(const std::string& key);
+    std::list<std::string>& listOf(List list);
+    std::int64_t& bytesOf(List list);
+
+    std::string m_dir;
+    std::int64_t m_budget;
+
+    std::mutex m_mutex;
+    std::unordered_map<std::string, Entry> m_entries;
+    std::list<std::string> m_lists[4];      // front = most recently used
+    std::int64_t m_bytes[4] = {0, 0, 0, 0};
+    std::int64_t m_recent_target = 0;       // ARC's p, in bytes
+    std::int64_t m_hits = 0;
+    std::int64_t m_misses = 0;
+    std::uint64_t m_temp_counter = 0;
+};
+
+#endif // CHUNK_CACHE_H
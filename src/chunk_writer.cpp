@@ -0,0 +1,113 @@
+#include "chunk_writer.h"
+#include <algorithm>
+#include <exception>
+#include <optional>
+#include <utility>
+#include "trace.h"
+
+std::int64_t BufferBudget::acquire(std::int64_t bytes) {
+    bytes = std::min(bytes, m_total);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_freed.wait(lock, [&] { return m_available >= bytes; });
+    m_available -= bytes;
+    return bytes;
+}
+
+void BufferBudget::release(std::int64_t bytes) {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_available += bytes;
+    }
+    m_freed.notify_all();
+}
+
+ChunkWriter::ChunkWriter(Store store, std::int64_t chunk_bytes, std::size_t max_inflight, std::int64_t size_hint,
+                         BufferBudget* budget)
+    : m_store(std::move(store)), m_chunk_bytes(std::max<std::int64_t>(chunk_bytes, 1)),
+      m_max_inflight(std::max<std::size_t>(max_inflight, 1)), m_size_hint(size_hint), m_budget(budget) {}
+
+ChunkWriter::~ChunkWriter() {
+    // Futures from std::async wait for their task when destroyed.
+    m_inflight.clear();
+    if (m_budget && m_buffer_charge > 0) m_budget->release(m_buffer_charge);
+}
+
+bool ChunkWriter::write(const char* data, std::size_t size) {
+    while (size > 0 && !m_failed) {
+        if (m_buffer.capacity() == 0) {
+            // Size the buffer for what is still expected, up to a whole chunk.
+            const std::int64_t expected = m_size_hint >= 0 ? m_size_hint - m_written : m_chunk_bytes;
+            const std::int64_t reserve = std::clamp<std::int64_t>(expected, 1, m_chunk_bytes);
+            if (m_budget) {
+                TraceSpan span("upload", "wait for buffer");
+                m_buffer_charge = m_budget->acquire(reserve);
+            }
+            m_buffer.reserve(static_cast<std::size_t>(reserve));
+        }
+        const std::size_t room = static_cast<std::size_t>(m_chunk_bytes) - m_buffer.size();
+        const std::size_t take = std::min(size, room);
+        if (m_budget && static_cast<std::int64_t>(m_buffer.size() + take) > m_buffer_charge &&
+            m_buffer_charge < std::min(m_chunk_bytes, m_budget->total())) {
+            // More data than the size hint promised: charge a whole chunk.
+            // The smaller charge is returned first, so that writers topping
+            // up at once cannot hold each other's share.
+            TraceSpan span("upload", "wait for buffer");
+            m_budget->release(m_buffer_charge);
+            m_buffer_charge = m_budget->acquire(m_chunk_bytes);
+        }
+        m_buffer.insert(m_buffer.end(), data, data + take);
+        m_written += static_cast<std::int64_t>(take);
+        data += take;
+        size -= take;
+        if (m_buffer.size() == static_cast<std::size_t>(m_chunk_bytes)) {
+            flush();
+        }
+    }
+    return !m_failed;
+}
+
+std::vector<ChunkEntry> ChunkWriter::finish() {
+    if (!m_buffer.empty() && !m_failed) {
+        flush();
+    }
+    while (!m_inflight.empty()) {
+        collect();
+    }
+    std::sort(m_done.begin(), m_done.end(), [](const ChunkEntry& a, const ChunkEntry& b) { return a.part < b.part; });
+    return std::move(m_done);
+}
+
+void ChunkWriter::flush() {
+    // The producer stalls here while the uploads catch up.
+    std::optional<TraceSpan> waiting;
+    if (m_inflight.size() >= m_max_inflight) waiting.emplace("upload", "wait for upload");
+    while (m_inflight.size() >= m_max_inflight) {
+        collect();
+    }
+    waiting.reset();
+    if (m_failed) return;
+    m_inflight.push_back(std::async(std::launch::async, [store = m_store, part = m_next_part++,
+                                                         data = std::move(m_buffer), budget = m_budget,
+                                                         charge = m_buffer_charge]() mutable {
+        ChunkEntry chunk;
+        chunk.part = part;
+        chunk.size = static_cast<std::int64_t>(data.size());
+        try {
+            chunk.replicas = store(part, data);
+        } catch (const std::exception&) {
+            chunk.replicas.clear();
+        }
+        data = std::vector<char>();
+        if (budget && charge > 0) budget->release(charge);
+        return chunk;
+    }));
+    m_buffer = std::vector<char>();
+    m_buffer_charge = 0;
+}
+
+void ChunkWriter::collect() {
+    ChunkEntry chunk = m_inflight.front().get();
+    m_inflight.pop_front();
+    m_failed = m_failed || chunk.replicas.empty();
+    m_done.push_back(std::move(chunk));
+}
@@ -0,0 +1,89 @@
+#ifndef CHUNK_WRITER_H
+#define CHUNK_WRITER_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <vector>
+#include "catalog.h"
+
+// Bytes of chunk buffers that several writers may hold between them, such as
+// every upload of one S3 gateway. A writer takes its share before filling a
+// buffer and returns it once that buffer is stored.
+class BufferBudget {
+public:
+    explicit BufferBudget(std::int64_t bytes) : m_available(bytes), m_total(bytes) {}
+
+    // Waits until `bytes` (at most the whole budget) are free and takes them.
+    // Returns the amount taken.
+    std::int64_t acquire(std::int64_t bytes);
+    void release(std::int64_t bytes);
+    std::int64_t total() const { return m_total; }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_freed;
+    std::int64_t m_available;
+    const std::int64_t m_total;
+};
+
+// Turns a byte stream of unknown length into stored chunks. Bytes are
+// pushed in with write(); every `chunk_bytes` a chunk is cut and handed to
+// `store` on its own thread, with up to `max_inflight` stores running while
+// more data arrives. Once that many are running, write() waits for the
+// oldest, so a producer faster than the uploads is held back and memory stays
+// within (max_inflight + 1) chunks. With a `budget`, each buffer is also
+// charged to it, which bounds memory across writers.
+//
+// One producer per writer: write() and finish() must not be called
+// concurrently.
+class ChunkWriter {
+public:
+    // Stores one chunk and returns its replicas (empty if no copy could be
+    // stored). Runs on a worker thread.
+    using Store = std::function<std::vector<Replica>(int part, const std::vector<char>& data)>;
+
+    // `size_hint` is the expected stream length if known, or -1; it only
+    // sizes the first buffer, so a short stream does not reserve a whole chunk.
+    ChunkWriter(Store store, std::int64_t chunk_bytes, std::size_t max_inflight, std::int64_t size_hint = -1,
+                BufferBudget* budget = nullptr);
+    ~ChunkWriter();   // waits for stores still running
+
+    ChunkWriter(const ChunkWriter&) = delete;
+    ChunkWriter& operator=(const ChunkWriter&) = delete;
+
+    // Returns false once a chunk has failed to store; the producer should
+    // stop and call finish() to collect what was stored.
+    bool write(const char* data, std::size_t size);
+
+    // Stores the final partial chunk (if any) and waits for every store.
+    // Returns the chunks in part order, with part and size set; a chunk with
+    // no replicas failed. An empty stream yields no chunks.
+    std::vector<ChunkEntry> finish();
+
+    std::int64_t bytesWritten() const { return m_written; }
+
+private:
+    void flush();
+    void collect();
+
+    Store m_store;
+    std::int64_t m_chunk_bytes;
+    std::size_t m_max_inflight;
+    std::int64_t m_size_hint;
+    BufferBudget* m_budget;
+
+    std::vector<char> m_buffer;
+    std::int64_t m_buffer_charge = 0;   // taken from m_budget for m_buffer
+    std::deque<std::future<ChunkEntry>> m_inflight;
+    std::vector<ChunkEntry> m_done;
+    int m_next_part = 0;
+    std::int64_t m_written = 0;
+    bool m_failed = false;
+};
+
+#endif // CHUNK_WRITER_H
@@ -0,0 +1,368 @@
+#include "daemon.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <streambuf>
+#include <thread>
+#include <utility>
+#include <nlohmann/json.hpp>
+#include "DDConfig.h"
+#include "progress.h"
+
+#if !defined(_WIN32)
+#include <csignal>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#if defined(_WIN32)
+
+DaemonServer::DaemonServer(std::string socket_path, Handler handler)
+    : m_socket_path(std::move(socket_path)), m_handler(std::move(handler)) {}
+
+DaemonServer::~DaemonServer() = default;
+
+void DaemonServer::listen() {
+    throw std::runtime_error("The daemon needs Unix domain sockets, which this build does not support.");
+}
+
+void DaemonServer::serve() {}
+
+void DaemonServer::handle(int) {}
+
+std::optional<int> forwardToDaemon(const std::string&, const std::vector<std::string>&) {
+    return std::nullopt;
+}
+
+#else
+
+namespace {
+    constexpr std::size_t kFrameBytes = 256 * 1024;   // largest output or stdin frame sent
+
+    bool writeAll(int fd, const char* data, std::size_t size) {
+        while (size > 0) {
+            const ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool readAll(int fd, char* data, std::size_t size) {
+        while (size > 0) {
+            const ssize_t n = ::read(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    bool sendFrame(int fd, char type, const char* data, std::size_t size) {
+        const char header[5] = {type, static_cast<char>(size >> 24), static_cast<char>(size >> 16),
+                                static_cast<char>(size >> 8), static_cast<char>(size)};
+        return writeAll(fd, header, sizeof(header)) && writeAll(fd, data, size);
+    }
+
+    bool readFrame(int fd, char& type, std::string& payload) {
+        unsigned char header[5];
+        if (!readAll(fd, reinterpret_cast<char*>(header), sizeof(header))) return false;
+        type = static_cast<char>(header[0]);
+        const std::size_t size = (std::size_t{header[1]} << 24) | (std::size_t{header[2]} << 16) |
+                                 (std::size_t{header[3]} << 8) | header[4];
+        payload.resize(size);
+        return readAll(fd, payload.data(), size);
+    }
+
+    sockaddr_un socketAddress(const std::string& path) {
+        sockaddr_un address{};
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw std::runtime_error("Socket path is too long: " + path);
+        }
+        address.sun_family = AF_UNIX;
+        path.copy(address.sun_path, path.size());
+        return address;
+    }
+
+    // A connected socket, or -1 if nothing is listening at `path`.
+    int connectTo(const std::string& path) {
+        const sockaddr_un address = socketAddress(path);
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) return -1;
+        if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // The client's stdout or stderr, sent as frames of `type`. Every thread
+    // writing to std::cout or std::cerr during a command lands here, hence
+    // the lock; `socket_mutex` keeps frames of the two streams whole. A
+    // failed send sets `gone`.
+    class FrameOutBuf : public std::streambuf {
+    public:
+        FrameOutBuf(int fd, char type, std::mutex& socket_mutex, std::atomic<bool>& gone)
+            : m_fd(fd), m_type(type), m_socket_mutex(socket_mutex), m_gone(gone) {}
+
+    protected:
+        int_type overflow(int_type c) override {
+            if (!traits_type::eq_int_type(c, traits_type::eof())) {
+                const char ch = traits_type::to_char_type(c);
+                xsputn(&ch, 1);
+            }
+            return traits_type::not_eof(c);
+        }
+
+        std::streamsize xsputn(const char* data, std::streamsize size) override {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_buffer.append(data, static_cast<std::size_t>(size));
+            if (m_buffer.size() >= kFrameBytes) flushLocked();
+            return size;
+        }
+
+        int sync() override {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            flushLocked();
+            return 0;
+        }
+
+    private:
+        // Once the client has gone, output is dropped.
+        void flushLocked() {
+            if (!m_buffer.empty() && !m_gone) {
+                std::lock_guard<std::mutex> lock(m_socket_mutex);
+                if (!sendFrame(m_fd, m_type, m_buffer.data(), m_buffer.size())) m_gone = true;
+            }
+            m_buffer.clear();
+        }
+
+        int m_fd;
+        char m_type;
+        std::mutex& m_socket_mutex;
+        std::atomic<bool>& m_gone;
+        std::mutex m_mutex;
+        std::string m_buffer;
+    };
+
+    // The client's stdin, fetched a frame at a time as the command reads.
+    // Input ends at the client's end of input, or when it has gone, which
+    // also sets `gone` so that the command does not take the input for whole.
+    class FrameInBuf : public std::streambuf {
+    public:
+        FrameInBuf(int fd, std::mutex& socket_mutex, std::atomic<bool>& gone)
+            : m_fd(fd), m_socket_mutex(socket_mutex), m_gone(gone) {}
+
+    protected:
+        int_type underflow() override {
+            if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+            if (m_ended) return traits_type::eof();
+            bool asked;
+            {
+                std::lock_guard<std::mutex> lock(m_socket_mutex);
+                asked = sendFrame(m_fd, 'R', nullptr, 0);
+            }
+            char type = 0;
+            if (!asked || !readFrame(m_fd, type, m_buffer) || type != 'I') {
+                m_gone = true;
+            }
+            if (m_gone || m_buffer.empty()) {
+                m_ended = true;
+                return traits_type::eof();
+            }
+            setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + m_buffer.size());
+            return traits_type::to_int_type(*gptr());
+        }
+
+    private:
+        int m_fd;
+        std::mutex& m_socket_mutex;
+        std::atomic<bool>& m_gone;
+        std::string m_buffer;
+        bool m_ended = false;
+    };
+
+    // Sets `gone` if the client hangs up while a command runs, which shows
+    // on the socket without anything being read from it, until `done`.
+    void watchClient(int fd, const std::atomic<bool>& done, std::atomic<bool>& gone) {
+        short events = 0;
+#ifdef POLLRDHUP
+        events |= POLLRDHUP;
+#endif
+        while (!done && !gone) {
+            pollfd watched{fd, events, 0};
+            if (::poll(&watched, 1, 200) > 0 && (watched.revents & (events | POLLHUP | POLLERR))) {
+                gone = true;
+            }
+        }
+    }
+
+    // Points a standard stream at another buffer for the life of the scope.
+    template <typename Stream>
+    class Redirect {
+    public:
+        Redirect(Stream& stream, std::streambuf* buffer) : m_stream(stream), m_saved(stream.rdbuf(buffer)) {}
+        ~Redirect() {
+            m_stream.rdbuf(m_saved);
+            m_stream.clear();
+        }
+        Redirect(const Redirect&) = delete;
+        Redirect& operator=(const Redirect&) = delete;
+
+    private:
+        Stream& m_stream;
+        std::streambuf* m_saved;
+    };
+}
+
+DaemonServer::DaemonServer(std::string socket_path, Handler handler)
+    : m_socket_path(std::move(socket_path)), m_handler(std::move(handler)) {}
+
+DaemonServer::~DaemonServer() {
+    if (m_listener >= 0) {
+        ::close(m_listener);
+        ::unlink(m_socket_path.c_str());
+    }
+}
+
+void DaemonServer::listen() {
+    // A client that goes away mid-command must not take the daemon with it.
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // A socket left behind by a daemon that died is replaced; a live one is
+    // not.
+    const int existing = connectTo(m_socket_path);
+    if (existing >= 0) {
+        ::close(existing);
+        throw std::runtime_error("A daemon is already serving on " + m_socket_path + ".");
+    }
+    ::unlink(m_socket_path.c_str());
+
+    const sockaddr_un address = socketAddress(m_socket_path);
+    m_listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_listener < 0) {
+        throw std::runtime_error("Could not create the daemon socket.");
+    }
+    // Commands run with this user's accounts, so only this user may connect.
+    const mode_t previous = ::umask(0077);
+    const bool bound = ::bind(m_listener, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+    ::umask(previous);
+    if (!bound || ::listen(m_listener, SOMAXCONN) != 0) {
+        ::close(m_listener);
+        m_listener = -1;
+        throw std::runtime_error("Could not listen on " + m_socket_path + ".");
+    }
+}
+
+void DaemonServer::serve() {
+    while (!m_stopping) {
+        const int client = ::accept(m_listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            throw std::runtime_error("The daemon could not accept a connection.");
+        }
+        // A client that connects and then never sends its command must not
+        // hold up the ones behind it.
+        const auto timeout = std::chrono::duration_cast<std::chrono::seconds>(dd::DAEMON_CLIENT_TIMEOUT).count();
+        const timeval limit{static_cast<time_t>(timeout), 0};
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &limit, sizeof(limit));
+        handle(client);
+        ::close(client);
+    }
+}
+
+void DaemonServer::handle(int client) {
+    char type = 0;
+    std::string payload;
+    if (!readFrame(client, type, payload) || type != 'C') return;
+    // Stdin may legitimately stay quiet for as long as its producer likes;
+    // from here on only a hang-up, seen by watchClient, ends the command.
+    const timeval no_limit{0, 0};
+    ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &no_limit, sizeof(no_limit));
+    const nlohmann::json request = nlohmann::json::parse(payload, nullptr, false);
+    if (request.is_discarded() || !request.contains("args") || !request["args"].is_array()) return;
+    std::vector<std::string> args;
+    for (const auto& arg : request["args"]) {
+        if (arg.is_string()) args.push_back(arg.get<std::string>());
+    }
+
+    int status = 1;
+    std::atomic<bool> gone{false};
+    std::atomic<bool> done{false};
+    std::thread watcher(watchClient, client, std::cref(done), std::ref(gone));
+    {
+        std::mutex socket_mutex;
+        FrameOutBuf out(client, 'O', socket_mutex, gone);
+        FrameOutBuf err(client, 'E', socket_mutex, gone);
+        FrameInBuf in(client, socket_mutex, gone);
+        Redirect<std::ostream> out_redirect(std::cout, &out);
+        Redirect<std::ostream> err_redirect(std::cerr, &err);
+        Redirect<std::istream> in_redirect(std::cin, &in);
+        ProgressDisplay::setTerminalColumns(request.value("columns", 0));
+        try {
+            status = args.empty() ? 1 : m_handler(args, gone);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+        }
+        std::cout.flush();
+        std::cerr.flush();
+        ProgressDisplay::setTerminalColumns(-1);
+    }
+    done = true;
+    watcher.join();
+    const char code[4] = {static_cast<char>(status >> 24), static_cast<char>(status >> 16),
+                          static_cast<char>(status >> 8), static_cast<char>(status)};
+    sendFrame(client, 'X', code, sizeof(code));
+}
+
+std::optional<int> forwardToDaemon(const std::string& socket_path, const std::vector<std::string>& args) {
+    const int fd = connectTo(socket_path);
+    if (fd < 0) return std::nullopt;
+
+    // Progress is drawn for this process's terminal, not the daemon's.
+    int columns = 0;
+    if (::isatty(STDERR_FILENO)) {
+        winsize size{};
+        columns = ::ioctl(STDERR_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0 ? size.ws_col : 100;
+    }
+    const std::string request = nlohmann::json{{"args", args}, {"columns", columns}}.dump();
+
+    if (sendFrame(fd, 'C', request.data(), request.size())) {
+        char type = 0;
+        std::string payload;
+        std::vector<char> input(kFrameBytes);
+        while (readFrame(fd, type, payload)) {
+            if (type == 'O') {
+                writeAll(STDOUT_FILENO, payload.data(), payload.size());
+            } else if (type == 'E') {
+                writeAll(STDERR_FILENO, payload.data(), payload.size());
+            } else if (type == 'R') {
+                ssize_t n;
+                do {
+                    n = ::read(STDIN_FILENO, input.data(), input.size());
+                } while (n < 0 && errno == EINTR);
+                if (!sendFrame(fd, 'I', input.data(), n > 0 ? static_cast<std::size_t>(n) : 0)) break;
+            } else if (type == 'X' && payload.size() == 4) {
+                ::close(fd);
+                const auto byte = [&](int i) { return std::uint32_t{static_cast<unsigned char>(payload[i])}; };
+                return static_cast<int>(byte(0) << 24 | byte(1) << 16 | byte(2) << 8 | byte(3));
+            }
+        }
+    }
+    ::close(fd);
+    std::cerr << "Lost the connection to the daemon." << std::endl;
+    return 1;
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <atomic>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Runs commands sent by other filesplitter processes over a Unix domain
+// socket, so that accounts, tokens, the catalog, the chunk cache and open
+// connections stay loaded between them.
+//
+// One command runs at a time, in the order clients connect. While it runs,
+// the process's std::cout, std::cerr and std::cin are the client's: output,
+// progress included, streams back as it is written, and reads of stdin are
+// answered from the client's stdin. A client that goes away has its command
+// cancelled; the output is dropped. A client that does not send its command
+// within DAEMON_CLIENT_TIMEOUT is disconnected.
+//
+// Protocol: frames of a type byte, a 4-byte big-endian length and a payload.
+// The client sends 'C' (JSON {"args": [...], "columns": N}, N the width of
+// its terminal or 0) and then 'I' (stdin bytes, empty at end of input)
+// whenever the daemon sends 'R'. The daemon sends 'O' (stdout), 'E' (stderr)
+// and finally 'X' (the exit status as 4 bytes).
+class DaemonServer {
+public:
+    // Runs one command and returns its exit status. `cancelled` becomes true
+    // once the client has gone; the command should then wind down without
+    // committing anything half done.
+    using Handler = std::function<int(const std::vector<std::string>& args, const std::atomic<bool>& cancelled)>;
+
+    DaemonServer(std::string socket_path, Handler handler);
+    ~DaemonServer();   // closes and removes the socket
+
+    DaemonServer(const DaemonServer&) = delete;
+    DaemonServer& operator=(const DaemonServer&) = delete;
+
+    // Binds the socket. Throws if it cannot be bound, or if another daemon
+    // is serving on it.
+    void listen();
+    // Serves commands until stop().
+    void serve();
+    // Makes serve() return once the current command has finished.
+    void stop() { m_stopping = true; }
+
+private:
+    void handle(int client);
+
+    std::string m_socket_path;
+    Handler m_handler;
+    int m_listener = -1;
+    std::atomic<bool> m_stopping{false};
+};
+
+// Sends a command to the daemon serving on `socket_path`, relays its output
+// and stdin until it finishes, and returns its exit status. Returns nothing,
+// having sent nothing, if no daemon is serving there.
+std::optional<int> forwardToDaemon(const std::string& socket_path, const std::vector<std::string>& args);
+
+#endif // DAEMON_H
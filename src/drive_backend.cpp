@@ -0,0 +1,96 @@
+#include "drive_backend.h"
+#include <stdexcept>
+#include <utility>
+#include "DDConfig.h"
+
+namespace {
+    const char* kChunkFolderName = "D-Drive Chunks";
+
+    // cpr reports both directions at once; a transfer only cares about one.
+    ProgressCallback uploadProgress(const StorageBackend::Progress& progress) {
+        if (!progress) return nullptr;
+        return [&progress](cpr::cpr_off_t, cpr::cpr_off_t, cpr::cpr_off_t total, cpr::cpr_off_t now, intptr_t) {
+            return progress(now, total);
+        };
+    }
+
+    ProgressCallback downloadProgress(const StorageBackend::Progress& progress) {
+        if (!progress) return nullptr;
+        return [&progress](cpr::cpr_off_t total, cpr::cpr_off_t now, cpr::cpr_off_t, cpr::cpr_off_t, intptr_t) {
+            return progress(now, total);
+        };
+    }
+}
+
+DriveBackend::DriveBackend(std::string token_path, std::string credentials_path)
+    : m_token_path(std::move(token_path)), m_credentials_path(std::move(credentials_path)) {}
+
+GDriveHandler& DriveBackend::handler() {
+    std::lock_guard<std::mutex> lock(m_handler_mutex);
+    if (!m_gdrive) {
+        m_gdrive = std::make_unique<GDriveHandler>(m_token_path, m_credentials_path);
+    }
+    return *m_gdrive;
+}
+
+std::string DriveBackend::chunkFolderId(GDriveHandler& gdrive) {
+    std::lock_guard<std::mutex> lock(m_folder_mutex);
+    if (m_folder_id.empty()) {
+        m_folder_id = gdrive.findFileOrFolder(kChunkFolderName, "root");
+        if (m_folder_id.empty()) {
+            m_folder_id = gdrive.createFolder(kChunkFolderName, "root");
+        }
+    }
+    return m_folder_id;
+}
+
+std::string DriveBackend::startUpload(const std::string& name) {
+    GDriveHandler& gdrive = handler();
+    std::string fileId;
+    if (dd::PREALLOCATE_FILE_IDS) {
+        std::lock_guard<std::mutex> lock(m_file_ids_mutex);
+        if (m_file_ids.empty()) {
+            m_file_ids = gdrive.generateIds(dd::FILE_ID_BATCH);
+        }
+        if (!m_file_ids.empty()) {
+            fileId = std::move(m_file_ids.back());
+            m_file_ids.pop_back();
+        }
+    }
+    return gdrive.startResumableUpload(fileId.empty() ? name : name + "-" + fileId, chunkFolderId(gdrive), fileId);
+}
+
+std::string DriveBackend::put(const std::vector<char>& data, const std::string& name, const std::string& session,
+                              const Progress& progress) {
+    GDriveHandler& gdrive = handler();
+    std::string fileId = gdrive.uploadChunk(data, name, chunkFolderId(gdrive), uploadProgress(progress), session);
+    if (fileId.empty()) {
+        throw std::runtime_error("Upload of " + name + " returned no file id");
+    }
+    return fileId;
+}
+
+void DriveBackend::get(const std::string& id, std::int64_t offset, std::int64_t length, const Sink& sink,
+                       const Progress& progress) {
+    GDriveHandler& gdrive = handler();
+    gdrive.streamChunkRange(id, offset, length, [&](const std::string_view& data) { sink(data); },
+                            downloadProgress(progress));
+}
+
+std::vector<bool> DriveBackend::remove(const std::vector<std::string>& ids) {
+    return handler().deleteFilesById(ids);
+}
+
+std::vector<StoredObject> DriveBackend::list() {
+    GDriveHandler& gdrive = handler();
+    std::vector<StoredObject> objects;
+    for (auto& file : gdrive.listFolder(chunkFolderId(gdrive))) {
+        objects.push_back({std::move(file.id), std::move(file.name), file.size});
+    }
+    return objects;
+}
+
+StorageQuota DriveBackend::quota() {
+    const auto [used, limit] = handler().storageQuota();
+    return {used, limit};
+}
@@ -0,0 +1,49 @@
+#ifndef DRIVE_BACKEND_H
+#define DRIVE_BACKEND_H
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "gdrive_handler.h"
+#include "storage_backend.h"
+
+// A Google Drive account. Objects live in its "D-Drive Chunks" folder, which
+// is looked up (or created) on first use. Calls from every thread go through
+// one GDriveHandler, created on first use, so the tokens are read once and
+// the access token is refreshed only when it expires; connections come from
+// the process-wide pool.
+class DriveBackend : public StorageBackend {
+public:
+    DriveBackend(std::string token_path, std::string credentials_path);
+
+    std::string kind() const override { return "drive"; }
+    bool hasUploadSessions() const override { return true; }
+    // With PREALLOCATE_FILE_IDS the object also gets an id reserved through
+    // files.generateIds, appended to its name.
+    std::string startUpload(const std::string& name) override;
+    std::string put(const std::vector<char>& data, const std::string& name, const std::string& session,
+                    const Progress& progress) override;
+    void get(const std::string& id, std::int64_t offset, std::int64_t length, const Sink& sink,
+             const Progress& progress) override;
+    std::vector<bool> remove(const std::vector<std::string>& ids) override;
+    std::vector<StoredObject> list() override;
+    StorageQuota quota() override;
+
+private:
+    GDriveHandler& handler();
+    std::string chunkFolderId(GDriveHandler& gdrive);
+
+    std::string m_token_path;
+    std::string m_credentials_path;
+
+    std::mutex m_handler_mutex;
+    std::unique_ptr<GDriveHandler> m_gdrive;
+
+    std::mutex m_folder_mutex;
+    std::string m_folder_id;
+    std::mutex m_file_ids_mutex;
+    std::vector<std::string> m_file_ids;   // unused ids from files.generateIds
+};
+
+#endif // DRIVE_BACKEND_H
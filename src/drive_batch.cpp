@@ -0,0 +1,129 @@
+#include "drive_batch.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+namespace {
+
+// Splits `text` at its first blank line into header block and remainder.
+// Accepts bare LF line endings as well as CRLF.
+void splitAtBlankLine(const std::string& text, std::string& head, std::string& rest) {
+    std::size_t crlf = text.find("\r\n\r\n");
+    std::size_t lf = text.find("\n\n");
+    if (crlf != std::string::npos && (lf == std::string::npos || crlf <= lf)) {
+        head = text.substr(0, crlf);
+        rest = text.substr(crlf + 4);
+    } else if (lf != std::string::npos) {
+        head = text.substr(0, lf);
+        rest = text.substr(lf + 2);
+    } else {
+        head = text;
+        rest.clear();
+    }
+}
+
+std::string lower(std::string s) {
+    std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return s;
+}
+
+// Value of header `name` (lowercase) in a header block, or "".
+std::string headerValue(const std::string& head, const std::string& name) {
+    std::istringstream lines(head);
+    std::string line;
+    while (std::getline(lines, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        std::size_t colon = line.find(':');
+        if (colon == std::string::npos || lower(line.substr(0, colon)) != name) continue;
+        std::size_t start = line.find_first_not_of(" \t", colon + 1);
+        return start == std::string::npos ? std::string() : line.substr(start);
+    }
+    return {};
+}
+
+// Call index from a Content-ID such as "<response-item-12>", or -1.
+long long contentIndex(const std::string& content_id) {
+    std::size_t at = content_id.rfind("item-");
+    if (at == std::string::npos) return -1;
+    std::size_t digits = at + 5;
+    std::size_t end = digits;
+    while (end < content_id.size() && std::isdigit(static_cast<unsigned char>(content_id[end]))) ++end;
+    if (end == digits) return -1;
+    return std::stoll(content_id.substr(digits, end - digits));
+}
+
+} // namespace
+
+std::string buildBatchBody(const std::vector<BatchCall>& calls, const std::vector<std::size_t>& indices,
+                           const std::string& boundary) {
+    std::string body;
+    for (std::size_t i : indices) {
+        const BatchCall& call = calls[i];
+        body += "--" + boundary + "\r\n"
+                "Content-Type: application/http\r\n"
+                "Content-ID: <item-" + std::to_string(i) + ">\r\n\r\n" +
+                call.method + " " + call.path + "\r\n";
+        if (!call.json_body.empty()) {
+            body += "Content-Type: application/json; charset=UTF-8\r\n"
+                    "Content-Length: " + std::to_string(call.json_body.size()) + "\r\n\r\n" +
+                    call.json_body;
+        }
+        body += "\r\n";
+    }
+    body += "--" + boundary + "--\r\n";
+    return body;
+}
+
+std::string multipartBoundary(const std::string& content_type) {
+    std::size_t at = lower(content_type).find("boundary=");
+    if (at == std::string::npos) return {};
+    std::string value = content_type.substr(at + 9);
+    value = value.substr(0, value.find(';'));
+    if (value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+        value = value.substr(1, value.size() - 2);
+    }
+    return value;
+}
+
+std::map<std::size_t, BatchResult> parseBatchBody(const std::string& body, const std::string& boundary,
+                                                  const std::vector<std::size_t>& indices) {
+    std::map<std::size_t, BatchResult> results;
+    const std::string delimiter = "--" + boundary;
+    std::size_t position = 0;
+    std::size_t pos = body.find(delimiter);
+    while (pos != std::string::npos) {
+        std::size_t start = pos + delimiter.size();
+        if (body.compare(start, 2, "--") == 0) break;   // closing delimiter
+        std::size_t next = body.find(delimiter, start);
+        std::string part = body.substr(start, next == std::string::npos ? std::string::npos : next - start);
+        pos = next;
+
+        // Drop the line break ending the delimiter line and the one that
+        // belongs to the next delimiter.
+        if (part.compare(0, 2, "\r\n") == 0) part.erase(0, 2);
+        else if (part.compare(0, 1, "\n") == 0) part.erase(0, 1);
+        if (part.size() >= 2 && part.compare(part.size() - 2, 2, "\r\n") == 0) part.resize(part.size() - 2);
+        else if (!part.empty() && part.back() == '\n') part.pop_back();
+
+        std::string outer_head, http;
+        splitAtBlankLine(part, outer_head, http);
+        long long index = contentIndex(headerValue(outer_head, "content-id"));
+        if (index < 0) {
+            if (position >= indices.size()) break;
+            index = static_cast<long long>(indices[position]);
+        }
+        ++position;
+
+        std::string inner_head;
+        BatchResult result;
+        splitAtBlankLine(http, inner_head, result.body);
+        // Status line: "HTTP/1.1 204 No Content".
+        std::size_t space = inner_head.find(' ');
+        if (space != std::string::npos) {
+            result.status = std::atoi(inner_head.c_str() + space + 1);
+        }
+        results[static_cast<std::size_t>(index)] = std::move(result);
+    }
+    return results;
+}
@@ -0,0 +1,41 @@
+#ifndef DRIVE_BATCH_H
+#define DRIVE_BATCH_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+// One Drive API call carried inside a batch request, e.g.
+// {"DELETE", "/drive/v3/files/<id>", ""}. A non-empty `json_body` is sent as
+// application/json.
+struct BatchCall {
+    std::string method;
+    std::string path;
+    std::string json_body;
+};
+
+// The outcome of one call. `status` is 0 when the batch response did not
+// include the call at all.
+struct BatchResult {
+    int status = 0;
+    std::string body;
+};
+
+// Builds a multipart/mixed batch body holding calls[i] for each i in
+// `indices`. Each part is tagged with Content-ID "<item-i>" so that its
+// response can be matched back to the call.
+std::string buildBatchBody(const std::vector<BatchCall>& calls, const std::vector<std::size_t>& indices,
+                           const std::string& boundary);
+
+// Extracts the boundary parameter from a multipart Content-Type header value.
+// Returns an empty string if there is none.
+std::string multipartBoundary(const std::string& content_type);
+
+// Splits a batch response into per-call results keyed by call index. Parts
+// are matched by their "<response-item-i>" Content-ID; parts without one are
+// matched by position against `indices`, which is the order they were sent in.
+std::map<std::size_t, BatchResult> parseBatchBody(const std::string& body, const std::string& boundary,
+                                                  const std::vector<std::size_t>& indices);
+
+#endif // DRIVE_BATCH_H
@@ -0,0 +1,150 @@
+#include "emulator_backend.h"
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+namespace {
+    // Transfers move in slices this size, so a large one cannot hold the link
+    // while a small one waits behind it.
+    constexpr std::int64_t kSliceBytes = 256 * 1024;
+}
+
+EmulatorBackend::EmulatorBackend(Options options)
+    : m_options(options), m_random(std::random_device{}()), m_link(options.bandwidth_bytes_per_sec) {}
+
+std::int64_t EmulatorBackend::beginRequest(std::int64_t size) {
+    if (m_options.latency.count() > 0) {
+        std::this_thread::sleep_for(m_options.latency);
+    }
+    if (m_options.error_rate <= 0) {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (std::uniform_real_distribution<double>(0, 1)(m_random) >= m_options.error_rate) {
+        return -1;
+    }
+    return size > 0 ? std::uniform_int_distribution<std::int64_t>(0, size - 1)(m_random) : 0;
+}
+
+std::string EmulatorBackend::put(const std::vector<char>& data, const std::string& name, const std::string&,
+                                 const Progress& progress) {
+    const std::int64_t total = static_cast<std::int64_t>(data.size());
+    const std::int64_t fail_at = beginRequest(total);
+    if (m_options.quota_bytes >= 0) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_used + total > m_options.quota_bytes) {
+            throw std::runtime_error("Emulated account is over its storage quota");
+        }
+    }
+    if (fail_at == 0) {
+        throw std::runtime_error("Emulated upload failure");
+    }
+    for (std::int64_t done = 0; done < total;) {
+        const std::int64_t take = std::min(kSliceBytes, total - done);
+        if (fail_at >= 0 && done + take > fail_at) {
+            m_link.pace(fail_at - done);
+            throw std::runtime_error("Emulated upload failure after " + std::to_string(fail_at) + " bytes");
+        }
+        m_link.pace(take);
+        done += take;
+        if (progress && !progress(done, total)) {
+            throw std::runtime_error("Upload of " + name + " aborted");
+        }
+    }
+
+    auto stored = std::make_shared<const std::vector<char>>(data);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_options.quota_bytes >= 0 && m_used + total > m_options.quota_bytes) {
+        throw std::runtime_error("Emulated account is over its storage quota");
+    }
+    char id[24];
+    do {
+        std::snprintf(id, sizeof(id), "emu-%016llx", static_cast<unsigned long long>(m_random()));
+    } while (m_objects.count(id));
+    m_objects[id] = {name, std::move(stored)};
+    m_used += total;
+    return id;
+}
+
+void EmulatorBackend::get(const std::string& id, std::int64_t offset, std::int64_t length, const Sink& sink,
+                          const Progress& progress) {
+    std::shared_ptr<const std::vector<char>> data;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_objects.find(id);
+        if (it != m_objects.end()) data = it->second.data;
+    }
+    const std::int64_t size = data ? static_cast<std::int64_t>(data->size()) : 0;
+    const std::int64_t end = length < 0 ? size : offset + length;
+    const std::int64_t fail_at = beginRequest(end - offset);
+    if (!data) {
+        throw std::runtime_error("Object not found: " + id);
+    }
+    if (offset < 0 || offset > end || end > size) {
+        throw std::runtime_error("Range outside object " + id);
+    }
+    if (fail_at == 0) {
+        throw std::runtime_error("Emulated download failure");
+    }
+    for (std::int64_t pos = offset; pos < end;) {
+        const std::int64_t take = std::min(kSliceBytes, end - pos);
+        if (fail_at >= 0 && pos - offset + take > fail_at) {
+            // Whatever arrived before the connection dropped still reaches the
+            // sink, as it would from a real download.
+            const std::int64_t partial = fail_at - (pos - offset);
+            m_link.pace(partial);
+            if (partial > 0) sink(std::string_view(data->data() + pos, static_cast<size_t>(partial)));
+            throw std::runtime_error("Emulated download failure after " + std::to_string(fail_at) + " bytes");
+        }
+        m_link.pace(take);
+        sink(std::string_view(data->data() + pos, static_cast<size_t>(take)));
+        pos += take;
+        if (progress && !progress(pos - offset, end - offset)) {
+            throw std::runtime_error("Read of object " + id + " aborted");
+        }
+    }
+}
+
+std::vector<bool> EmulatorBackend::remove(const std::vector<std::string>& ids) {
+    // One round trip for the whole list, like a Drive batch request, with
+    // each deletion failing on its own.
+    if (m_options.latency.count() > 0) {
+        std::this_thread::sleep_for(m_options.latency);
+    }
+    std::vector<bool> gone;
+    gone.reserve(ids.size());
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& id : ids) {
+        if (m_options.error_rate > 0 && std::uniform_real_distribution<double>(0, 1)(m_random) < m_options.error_rate) {
+            gone.push_back(false);
+            continue;
+        }
+        auto it = m_objects.find(id);
+        if (it != m_objects.end()) {
+            m_used -= static_cast<std::int64_t>(it->second.data->size());
+            m_objects.erase(it);
+        }
+        gone.push_back(true);
+    }
+    return gone;
+}
+
+std::vector<StoredObject> EmulatorBackend::list() {
+    if (beginRequest(0) >= 0) {
+        throw std::runtime_error("Emulated listing failure");
+    }
+    std::vector<StoredObject> objects;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    objects.reserve(m_objects.size());
+    for (const auto& [id, object] : m_objects) {
+        objects.push_back({id, object.name, static_cast<std::int64_t>(object.data->size())});
+    }
+    return objects;
+}
+
+StorageQuota EmulatorBackend::quota() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return {m_used, m_options.quota_bytes};
+}
@@ -0,0 +1,61 @@
+#ifndef EMULATOR_BACKEND_H
+#define EMULATOR_BACKEND_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+#include "bandwidth_limiter.h"
+#include "storage_backend.h"
+
+// An in-process stand-in for a cloud account: objects live in memory, and
+// every request pays a fixed latency, shares the account's bandwidth with
+// the other transfers in flight and fails with a configurable probability,
+// partway through, the way a dropped connection would. Lets the upload and
+// download pipelines be benchmarked and exercised offline and repeatably.
+//
+// Objects last only as long as the process.
+class EmulatorBackend : public StorageBackend {
+public:
+    struct Options {
+        double bandwidth_bytes_per_sec = 0;          // 0: unlimited
+        std::chrono::milliseconds latency{0};        // added to every request
+        double error_rate = 0;                       // probability a request fails
+        std::int64_t quota_bytes = -1;               // -1: unlimited
+    };
+
+    explicit EmulatorBackend(Options options);
+
+    std::string kind() const override { return "emulator"; }
+    std::string put(const std::vector<char>& data, const std::string& name, const std::string& session,
+                    const Progress& progress) override;
+    void get(const std::string& id, std::int64_t offset, std::int64_t length, const Sink& sink,
+             const Progress& progress) override;
+    std::vector<bool> remove(const std::vector<std::string>& ids) override;
+    std::vector<StoredObject> list() override;
+    StorageQuota quota() override;
+
+private:
+    struct Object {
+        std::string name;
+        std::shared_ptr<const std::vector<char>> data;
+    };
+
+    // Sleeps for the request latency and returns the byte offset at which the
+    // request fails, or -1 if it succeeds.
+    std::int64_t beginRequest(std::int64_t size);
+
+    Options m_options;
+
+    std::mutex m_mutex;
+    std::map<std::string, Object> m_objects;
+    std::int64_t m_used = 0;
+    std::mt19937_64 m_random;   // also draws object ids, so they differ across accounts and runs
+    BandwidthLimiter m_link;   // shared by every transfer on the account
+};
+
+#endif // EMULATOR_BACKEND_H
@@ -0,0 +1,15 @@
+#include "fs_util.h"
+#if defined(_WIN32)
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+bool syncFile(std::FILE* f) {
+    if (std::fflush(f) != 0 || std::ferror(f) != 0) return false;
+#if defined(_WIN32)
+    return _commit(_fileno(f)) == 0;
+#else
+    return fsync(fileno(f)) == 0;
+#endif
+}
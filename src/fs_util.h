@@ -0,0 +1,11 @@
+#ifndef FS_UTIL_H
+#define FS_UTIL_H
+
+#include <cstdio>
+
+// Flushes stdio buffers and forces the file's data to stable storage.
+// Returns false if either step failed (a full disk, an I/O error), in which
+// case the data must not be taken for written.
+bool syncFile(std::FILE* f);
+
+#endif // FS_UTIL_H
@@ -1,5 +1,8 @@
 #include "gdrive_handler.h"
+#include "base64url.h"
+#include "metrics.h"
 #include <cstdlib>
+#include <cstring>
 #include <filesystem>
 #include <fstream>
 #include <httplib.h>
@@ -7,6 +10,11 @@
 #include <windows.h>
 #include <sstream>
 #include <vector>
+#include <algorithm>
+#include <random>
+#include <numeric>
+#include <thread>
+#include <chrono>
 
 
 void open_url_in_browser(const std::string &url) {
@@ -20,36 +28,87 @@ void open_url_in_browser(const std::string &url) {
   std::system(command.c_str());
 }
 
-std::string decode_base64url(const std::string& input) {
-  static const std::string base64_chars =
-      "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
-      "abcdefghijklmnopqrstuvwxyz"
-      "0123456789+/";
+// Seconds of a curl timing, which libcurl reports in microseconds from the
+// start of the request; 0 for phases that did not happen.
+static double curlSeconds(CURL *handle, CURLINFO info) {
+  curl_off_t micros = 0;
+  if (curl_easy_getinfo(handle, info, &micros) != CURLE_OK) return 0;
+  return static_cast<double>(micros) / 1e6;
+}
 
-  std::string base64 = input;
-  std::replace(base64.begin(), base64.end(), '-', '+');
-  std::replace(base64.begin(), base64.end(), '_', '/');
-  while (base64.length() % 4 != 0)
-      base64 += '=';
+static curl_off_t curlBytes(CURL *handle, CURLINFO info) {
+  curl_off_t bytes = 0;
+  return curl_easy_getinfo(handle, info, &bytes) == CURLE_OK ? bytes : 0;
+}
 
-  auto is_base64 = [](unsigned char c) {
-      return std::isalnum(c) || c == '+' || c == '/';
-  };
+// One connection cache for every request of the process, so that a request
+// reuses an open, TLS-established connection to its host left by an earlier
+// one, whichever account or thread sent it. In the daemon it stays warm
+// between commands.
+static const cpr::ConnectionPool &connectionPool() {
+  static const cpr::ConnectionPool pool;
+  return pool;
+}
 
-  std::vector<unsigned char> bytes;
-  int val = 0, valb = -8;
-  for (unsigned char c : base64) {
-      if (!is_base64(c)) break;
-      val = (val << 6) + base64_chars.find(c);
-      valb += 6;
-      if (valb >= 0) {
-          bytes.push_back(char((val >> valb) & 0xFF));
-          valb -= 8;
-      }
+cpr::Response GDriveHandler::send(const char *endpoint, cpr::Session &session,
+                                  cpr::Response (cpr::Session::*method)()) {
+  session.SetConnectionPool(connectionPool());
+  cpr::Response r = (session.*method)();
+  recordRequest(endpoint, session, r);
+
+  const auto authorization = session.GetHeader().find("Authorization");
+  if (r.status_code != 401 || std::strcmp(endpoint, "oauth.token") == 0 ||
+      authorization == session.GetHeader().end()) {
+    return r;
   }
+  expireAccessToken(authorization->second);
+  ensureAuthenticated();
+  session.UpdateHeader(cpr::Header{{"Authorization", "Bearer " + getAccessToken()}});
+  metrics().counter("dd_retries_total", {{"kind", "token"}}).add();
+  r = (session.*method)();
+  recordRequest(endpoint, session, r);
+  return r;
+}
 
-  return std::string(bytes.begin(), bytes.end());
+void GDriveHandler::recordRequest(const char *endpoint, cpr::Session &session,
+                                  const cpr::Response &r) {
+  const MetricLabels labels = {{"account", m_account}, {"endpoint", endpoint}};
+  metrics().counter("dd_http_requests_total",
+                    {{"account", m_account}, {"endpoint", endpoint}, {"status", std::to_string(r.status_code)}}).add();
+  metrics().histogram("dd_http_request_seconds", labels).record(r.elapsed);
+
+  // curl's timings are cumulative from the start of the request; each phase
+  // is the step from the previous mark. A reused connection has no dns,
+  // connect or tls time. `wait` runs from the request being ready to send to
+  // the first response byte: server think time, plus the body for uploads.
+  CURL *handle = session.GetCurlHolder()->handle;
+  const double dns = curlSeconds(handle, CURLINFO_NAMELOOKUP_TIME_T);
+  const double connect = curlSeconds(handle, CURLINFO_CONNECT_TIME_T);
+  const double tls = curlSeconds(handle, CURLINFO_APPCONNECT_TIME_T);
+  const double pretransfer = curlSeconds(handle, CURLINFO_PRETRANSFER_TIME_T);
+  const double start = curlSeconds(handle, CURLINFO_STARTTRANSFER_TIME_T);
+  const double total = curlSeconds(handle, CURLINFO_TOTAL_TIME_T);
+  const std::pair<const char *, double> phases[] = {
+      {"dns", dns},
+      {"connect", connect > dns ? connect - dns : 0},
+      {"tls", tls > connect ? tls - connect : 0},
+      {"wait", start > pretransfer ? start - pretransfer : 0},
+      {"transfer", total > start && start > 0 ? total - start : 0},
+  };
+  for (const auto &[phase, seconds] : phases) {
+    metrics().histogram("dd_http_phase_seconds", {{"account", m_account}, {"endpoint", endpoint}, {"phase", phase}})
+        .record(seconds);
+  }
+  long connects = 0;
+  if (curl_easy_getinfo(handle, CURLINFO_NUM_CONNECTS, &connects) == CURLE_OK && connects > 0) {
+    metrics().counter("dd_http_connections_total", labels).add(connects);
+  }
+  metrics().counter("dd_http_bytes_total", {{"account", m_account}, {"endpoint", endpoint}, {"direction", "up"}})
+      .add(curlBytes(handle, CURLINFO_SIZE_UPLOAD_T));
+  metrics().counter("dd_http_bytes_total", {{"account", m_account}, {"endpoint", endpoint}, {"direction", "down"}})
+      .add(curlBytes(handle, CURLINFO_SIZE_DOWNLOAD_T));
 }
+
 std::vector<std::string> splitString(const std::string& s, char delimiter) {
     std::vector<std::string> tokens;
     std::string token;
@@ -61,7 +120,8 @@ std::vector<std::string> splitString(const std::string& s, char delimiter) {
 }
 GDriveHandler::GDriveHandler(const std::string &token_path,
                              const std::string &credentials_path)
-    : m_token_path(token_path) {
+    : m_token_path(token_path),
+      m_account(std::filesystem::path(token_path).stem().string()) {
   std::ifstream credentials_file(credentials_path);
   if (!credentials_file.is_open()) {
     throw std::runtime_error("FATAL: Could not open credentials file: " +
@@ -69,6 +129,19 @@ GDriveHandler::GDriveHandler(const std::string &token_path,
   }
   credentials_file >> m_credentials;
   credentials_file.close();
+  // Pointing the client at another server (such as tools/drive_emulator)
+  // redirects every API call and token refresh there.
+  const char *api_url = std::getenv(dd::DRIVE_API_URL_ENV);
+  if (api_url && *api_url) {
+    m_api_base = api_url;
+    while (!m_api_base.empty() && m_api_base.back() == '/') {
+      m_api_base.pop_back();
+    }
+    m_token_uri = m_api_base + "/token";
+  } else {
+    m_api_base = dd::DRIVE_API_URL;
+    m_token_uri = m_credentials["installed"]["token_uri"].get<std::string>();
+  }
   loadTokens();
 }
 bool GDriveHandler::loadTokens() {
@@ -80,18 +153,48 @@ bool GDriveHandler::loadTokens() {
   }
   return false;
 }
+// Written to a temporary file and renamed over the old one, so that a reader
+// (another thread's handler, or another process) never parses half a file.
+// A handler for an account not yet named has nowhere to save to.
 void GDriveHandler::saveTokens() {
-  std::ofstream token_file(m_token_path);
-  token_file << m_tokens.dump(4);
-  token_file.close();
+  if (m_token_path.empty()) return;
+  const std::string temp_path = m_token_path + ".tmp";
+  {
+    std::ofstream token_file(temp_path, std::ios::trunc);
+    token_file << m_tokens.dump(4);
+    if (!token_file.flush()) {
+      throw std::runtime_error("Could not write token file: " + temp_path);
+    }
+  }
+  std::filesystem::rename(temp_path, m_token_path);
+}
+// An access token is used until TOKEN_REFRESH_MARGIN before the expiry the
+// token endpoint gave with it; one given without an expiry is refreshed
+// before every call, as all were before.
+void GDriveHandler::setTokenExpiry(const nlohmann::json &token_response) {
+  const auto lifetime = std::chrono::seconds(token_response.value("expires_in", 0));
+  m_token_expiry = lifetime > dd::TOKEN_REFRESH_MARGIN
+                       ? std::chrono::steady_clock::now() + lifetime - dd::TOKEN_REFRESH_MARGIN
+                       : std::chrono::steady_clock::time_point{};
+}
+void GDriveHandler::expireAccessToken(const std::string &authorization) {
+  std::lock_guard<std::mutex> lock(m_tokens_mutex);
+  if (m_tokens.contains("access_token") &&
+      authorization == "Bearer " + m_tokens["access_token"].get<std::string>()) {
+    m_token_expiry = std::chrono::steady_clock::time_point{};
+  }
 }
 void GDriveHandler::ensureAuthenticated() {
+  std::lock_guard<std::mutex> lock(m_tokens_mutex);
   if (!m_tokens.contains("refresh_token")) {
     std::cout << "No existing session found. Starting authentication..."
               << std::endl;
     performAuthentication();
     return;
   }
+  if (std::chrono::steady_clock::now() < m_token_expiry) {
+    return;
+  }
   if (!refreshAccessToken()) {
     std::cout << "Could not refresh session. Please authenticate again."
               << std::endl;
@@ -99,6 +202,7 @@ void GDriveHandler::ensureAuthenticated() {
   }
 }
 std::string GDriveHandler::getAccessToken() const {
+  std::lock_guard<std::mutex> lock(m_tokens_mutex);
   return m_tokens["access_token"].get<std::string>();
 }
 
@@ -122,18 +226,16 @@ std::string GDriveHandler::authenticateNewAccount(const std::string& token_direc
   std::filesystem::create_directories(token_directory);
   std::string token_path = (std::filesystem::path(token_directory) / (email + ".json")).string();
 
-  std::ofstream out(token_path);
-  out << m_tokens.dump(4);
-  out.close();
-
   m_token_path = token_path;
+  m_account = email;
+  saveTokens();
 
   return email;
 }
 
 bool GDriveHandler::refreshAccessToken() {
-  cpr::Response r = cpr::Post(
-      cpr::Url{m_credentials["installed"]["token_uri"].get<std::string>()},
+  cpr::Response r = call("oauth.token", &cpr::Session::Post,
+      cpr::Url{m_token_uri},
       cpr::Payload{
           {"refresh_token", m_tokens["refresh_token"].get<std::string>()},
           {"client_id",
@@ -144,9 +246,12 @@ bool GDriveHandler::refreshAccessToken() {
   if (r.status_code == 200) {
     nlohmann::json new_token_data = nlohmann::json::parse(r.text);
     m_tokens["access_token"] = new_token_data["access_token"];
+    setTokenExpiry(new_token_data);
     saveTokens();
+    metrics().counter("dd_token_refreshes_total", {{"result", "ok"}}).add();
     return true;
   }
+  metrics().counter("dd_token_refreshes_total", {{"result", "failed"}}).add();
   return false;
 }
 std::string GDriveHandler::findFileOrFolder(const std::string &name,
@@ -154,10 +259,10 @@ std::string GDriveHandler::findFileOrFolder(const std::string &name,
   ensureAuthenticated();
   std::string query = "name = '" + name + "' and '" + parent_id +
                       "' in parents and trashed = false";
-  cpr::Response r = cpr::Get(
-      cpr::Url{"https://www.googleapis.com/drive/v3/files"},
+  cpr::Response r = call("files.list", &cpr::Session::Get,
+      cpr::Url{m_api_base + "/drive/v3/files"},
       cpr::Header{{"Authorization",
-                   "Bearer " + m_tokens["access_token"].get<std::string>()}},
+                   "Bearer " + getAccessToken()}},
       cpr::Parameters{{"q", query}, {"fields", "files(id, name)"}});
   if (r.status_code == 200) {
     auto json_response = nlohmann::json::parse(r.text);
@@ -173,10 +278,10 @@ std::string GDriveHandler::createFolder(const std::string &name,
   nlohmann::json metadata = {{"name", name},
                              {"mimeType", "application/vnd.google-apps.folder"},
                              {"parents", {parent_id}}};
-  cpr::Response r = cpr::Post(
-      cpr::Url{"https://www.googleapis.com/drive/v3/files"},
+  cpr::Response r = call("files.create", &cpr::Session::Post,
+      cpr::Url{m_api_base + "/drive/v3/files"},
       cpr::Header{{"Authorization",
-                   "Bearer " + m_tokens["access_token"].get<std::string>()},
+                   "Bearer " + getAccessToken()},
                   {"Content-Type", "application/json"}},
       cpr::Body{metadata.dump()});
   if (r.status_code == 200) {
@@ -194,11 +299,11 @@ std::string GDriveHandler::uploadNewFile(const std::string &content,
   nlohmann::json metadata = {{"name", remote_name}, {"parents", {parent_id}}};
   cpr::Buffer file_buffer(content.begin(), content.end(),
                           std::filesystem::path(remote_name));
-  cpr::Response r = cpr::Post(
-      cpr::Url{"https://www.googleapis.com/upload/drive/v3/"
+  cpr::Response r = call("upload.multipart", &cpr::Session::Post,
+      cpr::Url{m_api_base + "/upload/drive/v3/"
                "files?uploadType=multipart"},
       cpr::Header{{"Authorization",
-                   "Bearer " + m_tokens["access_token"].get<std::string>()}},
+                   "Bearer " + getAccessToken()}},
       cpr::Multipart{
           cpr::Part{"metadata", metadata.dump(),
                     "application/json; charset=UTF-8"},
@@ -212,11 +317,11 @@ std::string GDriveHandler::uploadNewFile(const std::string &content,
 void GDriveHandler::updateFileContent(const std::string &file_id,
                                       const std::string &content) {
   ensureAuthenticated();
-  cpr::Response r = cpr::Patch(
-      cpr::Url{"https://www.googleapis.com/upload/drive/v3/files/" + file_id +
+  cpr::Response r = call("upload.media", &cpr::Session::Patch,
+      cpr::Url{m_api_base + "/upload/drive/v3/files/" + file_id +
                "?uploadType=media"},
       cpr::Header{{"Authorization",
-                   "Bearer " + m_tokens["access_token"].get<std::string>()}},
+                   "Bearer " + getAccessToken()}},
       cpr::Body{content});
   if (r.status_code != 200) {
     throw std::runtime_error("Failed to update file content. Response: " +
@@ -225,11 +330,11 @@ void GDriveHandler::updateFileContent(const std::string &file_id,
 }
 std::string GDriveHandler::downloadFileContent(const std::string &file_id) {
   ensureAuthenticated();
-  cpr::Response r = cpr::Get(
-      cpr::Url{"https://www.googleapis.com/drive/v3/files/" + file_id +
+  cpr::Response r = call("files.get_media", &cpr::Session::Get,
+      cpr::Url{m_api_base + "/drive/v3/files/" + file_id +
                "?alt=media"},
       cpr::Header{{"Authorization",
-                   "Bearer " + m_tokens["access_token"].get<std::string>()}});
+                   "Bearer " + getAccessToken()}});
   if (r.status_code == 200) {
     return r.text;
   }
@@ -309,8 +414,8 @@ void GDriveHandler::performAuthentication() {
   std::cout << "Authorization code received. Exchanging for tokens..."
             << std::endl;
 
-  cpr::Response r = cpr::Post(
-    cpr::Url{m_credentials["installed"]["token_uri"].get<std::string>()},
+  cpr::Response r = call("oauth.token", &cpr::Session::Post,
+    cpr::Url{m_token_uri},
     cpr::Payload{
         {"code", auth_code},
         {"client_id", client_id},
@@ -324,6 +429,7 @@ void GDriveHandler::performAuthentication() {
 
   if (r.status_code == 200) {
     m_tokens = nlohmann::json::parse(r.text);
+    setTokenExpiry(m_tokens);
     saveTokens();
     std::cout << "Authentication successful!" << std::endl;
   } else {
@@ -342,48 +448,137 @@ std::string GDriveHandler::extractUploadedFileId(const cpr::Response& response)
 
 
 std::string GDriveHandler::uploadChunk(const std::vector<char>& chunk_data,
-  const std::string& remote_file_name,
-  const std::string& parentFolderId,
-  const ProgressCallback& progress_callback) {
-ensureAuthenticated();
+                                       const std::string& remote_file_name,
+                                       const std::string& parentFolderId,
+                                       const ProgressCallback& progress_callback,
+                                       const std::string& session_uri) {
+  ensureAuthenticated();
 
-// 1. Initiate a resumable upload session
-std::string session_uri = initiateResumableUpload(remote_file_name, parentFolderId);
+  // Small objects go up in one multipart request; the resumable protocol
+  // would spend a whole extra round trip initiating the session.
+  if (session_uri.empty() && chunk_data.size() <= m_multipart_limit) {
+    return uploadMultipart(chunk_data, remote_file_name, parentFolderId,
+                           progress_callback);
+  }
 
-// 2. Upload the file content using the session URI
-cpr::Session session;
-session.SetUrl(cpr::Url{session_uri});
-session.SetHeader({
-{"Authorization", "Bearer " + m_tokens["access_token"].get<std::string>()},
-{"Content-Type", "application/octet-stream"},
-{"Content-Length", std::to_string(chunk_data.size())}
-});
+  // 1. Initiate a resumable upload session, unless the caller already did
+  const std::string uri = session_uri.empty()
+                              ? initiateResumableUpload(remote_file_name, parentFolderId, "")
+                              : session_uri;
 
-session.SetBody(cpr::Body(std::string(chunk_data.begin(), chunk_data.end())));
+  // 2. Upload the file content using the session URI
+  cpr::Session session;
+  session.SetUrl(cpr::Url{uri});
+  session.SetHeader({
+      {"Authorization", "Bearer " + getAccessToken()},
+      {"Content-Type", "application/octet-stream"},
+      {"Content-Length", std::to_string(chunk_data.size())}
+  });
+
+  session.SetBody(cpr::Body(std::string(chunk_data.begin(), chunk_data.end())));
 
-if (progress_callback) {
-session.SetProgressCallback(progress_callback);
+  if (progress_callback) {
+    session.SetProgressCallback(progress_callback);
+  }
+
+  cpr::Response r = send("upload.resumable", session, &cpr::Session::Put);
+
+  if (r.status_code == 200 || r.status_code == 201) {
+    return nlohmann::json::parse(r.text)["id"];
+  } else {
+    throw std::runtime_error("Resumable upload failed. Response: " + r.text);
+  }
 }
 
-cpr::Response r = session.Put();
+std::string GDriveHandler::startResumableUpload(const std::string& remote_file_name,
+                                                const std::string& parentFolderId,
+                                                const std::string& file_id) {
+  ensureAuthenticated();
+  return initiateResumableUpload(remote_file_name, parentFolderId, file_id);
+}
 
-if (r.status_code == 200) {
-return nlohmann::json::parse(r.text)["id"];
-} else {
-throw std::runtime_error("Resumable upload failed. Response: " + r.text);
+std::vector<std::string> GDriveHandler::generateIds(int count) {
+  ensureAuthenticated();
+  cpr::Response r = call("files.generateIds", &cpr::Session::Get,
+      cpr::Url{m_api_base + "/drive/v3/files/generateIds"},
+      cpr::Header{{"Authorization",
+                   "Bearer " + getAccessToken()}},
+      cpr::Parameters{{"count", std::to_string(count)},
+                      {"space", "drive"},
+                      {"type", "files"}});
+  if (r.status_code != 200) {
+    throw std::runtime_error("Failed to generate file ids. Response: " + r.text);
+  }
+  return nlohmann::json::parse(r.text).at("ids").get<std::vector<std::string>>();
 }
+
+std::string GDriveHandler::uploadMultipart(const std::vector<char>& chunk_data,
+                                           const std::string& remote_file_name,
+                                           const std::string& parentFolderId,
+                                           const ProgressCallback& progress_callback) {
+  nlohmann::json metadata = {
+      {"name", remote_file_name},
+      {"parents", {parentFolderId}}
+  };
+
+  // multipart/related: the JSON metadata part followed by the media part.
+  std::random_device rd;
+  std::ostringstream boundary_ss;
+  boundary_ss << "dd_boundary_" << std::hex << rd() << rd() << rd() << rd();
+  const std::string boundary = boundary_ss.str();
+  const std::string head = "--" + boundary + "\r\n"
+                           "Content-Type: application/json; charset=UTF-8\r\n\r\n" +
+                           metadata.dump() + "\r\n"
+                           "--" + boundary + "\r\n"
+                           "Content-Type: application/octet-stream\r\n\r\n";
+  const std::string tail = "\r\n--" + boundary + "--\r\n";
+  std::string body;
+  body.reserve(head.size() + chunk_data.size() + tail.size());
+  body.append(head);
+  body.append(chunk_data.begin(), chunk_data.end());
+  body.append(tail);
+
+  cpr::Session session;
+  session.SetUrl(cpr::Url{m_api_base + "/upload/drive/v3/files?uploadType=multipart"});
+  session.SetHeader({
+      {"Authorization", "Bearer " + getAccessToken()},
+      {"Content-Type", "multipart/related; boundary=" + boundary}
+  });
+  session.SetBody(cpr::Body(std::move(body)));
+
+  if (progress_callback) {
+    // Report media bytes only, so callers see the same totals as a
+    // resumable upload of the same chunk.
+    const cpr::cpr_off_t head_size = static_cast<cpr::cpr_off_t>(head.size());
+    const cpr::cpr_off_t media_size = static_cast<cpr::cpr_off_t>(chunk_data.size());
+    session.SetProgressCallback(cpr::ProgressCallback(
+        [=](cpr::cpr_off_t downloadTotal, cpr::cpr_off_t downloadNow,
+            cpr::cpr_off_t uploadTotal, cpr::cpr_off_t uploadNow, intptr_t userdata) {
+          cpr::cpr_off_t media_now = std::clamp<cpr::cpr_off_t>(uploadNow - head_size, 0, media_size);
+          return progress_callback(downloadTotal, downloadNow, uploadTotal, media_now, userdata);
+        }));
+  }
+
+  cpr::Response r = send("upload.multipart", session, &cpr::Session::Post);
+  if (r.status_code == 200) {
+    return nlohmann::json::parse(r.text)["id"];
+  }
+  throw std::runtime_error("Multipart upload failed. Response: " + r.text);
 }
 
-std::string GDriveHandler::initiateResumableUpload(const std::string& remote_file_name, const std::string& parentFolderId) {
+std::string GDriveHandler::initiateResumableUpload(const std::string& remote_file_name, const std::string& parentFolderId, const std::string& file_id) {
   nlohmann::json metadata = {
       {"name", remote_file_name},
       {"parents", {parentFolderId}}
   };
+  if (!file_id.empty()) {
+    metadata["id"] = file_id;
+  }
 
-  cpr::Response r = cpr::Post(
-      cpr::Url{"https://www.googleapis.com/upload/drive/v3/files?uploadType=resumable"},
+  cpr::Response r = call("upload.resumable_start", &cpr::Session::Post,
+      cpr::Url{m_api_base + "/upload/drive/v3/files?uploadType=resumable"},
       cpr::Header{
-          {"Authorization", "Bearer " + m_tokens["access_token"].get<std::string>()},
+          {"Authorization", "Bearer " + getAccessToken()},
           {"Content-Type", "application/json; charset=UTF-8"}
       },
       cpr::Body{metadata.dump()}
@@ -400,24 +595,156 @@ std::string GDriveHandler::initiateResumableUpload(const std::string& remote_fil
 void GDriveHandler::downloadChunk(const std::string &file_id,
                                   const std::string &save_path,
                                   const ProgressCallback &progress_callback) {
+  std::ofstream of = openDownloadFile(save_path);
+  downloadMedia(file_id, "",
+                [&](const std::string_view &data) { of.write(data.data(), data.size()); },
+                progress_callback);
+}
+
+void GDriveHandler::downloadChunkRange(const std::string &file_id,
+                                       std::int64_t offset, std::int64_t length,
+                                       const std::string &save_path,
+                                       const ProgressCallback &progress_callback) {
+  std::ofstream of = openDownloadFile(save_path);
+  if (length <= 0) {
+    // An empty range cannot be expressed as a Range header.
+    return;
+  }
+  downloadMedia(file_id,
+                "bytes=" + std::to_string(offset) + "-" +
+                    std::to_string(offset + length - 1),
+                [&](const std::string_view &data) { of.write(data.data(), data.size()); },
+                progress_callback);
+}
+
+std::string GDriveHandler::readChunkRange(const std::string &file_id,
+                                          std::int64_t offset, std::int64_t length,
+                                          const ProgressCallback &progress_callback) {
+  std::string data;
+  if (length <= 0) {
+    return data;
+  }
+  data.reserve(static_cast<size_t>(length));
+  downloadMedia(file_id,
+                "bytes=" + std::to_string(offset) + "-" +
+                    std::to_string(offset + length - 1),
+                [&](const std::string_view &part) { data.append(part.data(), part.size()); },
+                progress_callback);
+  if (static_cast<std::int64_t>(data.size()) != length) {
+    throw std::runtime_error("Short read for file ID " + file_id + ": got " +
+                             std::to_string(data.size()) + " of " +
+                             std::to_string(length) + " bytes");
+  }
+  return data;
+}
+
+void GDriveHandler::streamChunkRange(const std::string &file_id,
+                                     std::int64_t offset, std::int64_t length,
+                                     const std::function<void(const std::string_view &)> &sink,
+                                     const ProgressCallback &progress_callback) {
+  if (length == 0) {
+    return;
+  }
+  std::string range;
+  if (length > 0) {
+    range = "bytes=" + std::to_string(offset) + "-" +
+            std::to_string(offset + length - 1);
+  } else if (offset > 0) {
+    range = "bytes=" + std::to_string(offset) + "-";
+  }
+  downloadMedia(file_id, range, sink, progress_callback);
+}
+
+std::vector<GDriveHandler::FileInfo> GDriveHandler::listFolder(const std::string &parent_id) {
+  ensureAuthenticated();
+  std::vector<FileInfo> files;
+  std::string page_token;
+  do {
+    cpr::Parameters params{{"q", "'" + parent_id + "' in parents and trashed = false"},
+                           {"fields", "nextPageToken, files(id, name, size)"},
+                           {"pageSize", "1000"}};
+    if (!page_token.empty()) {
+      params.Add({"pageToken", page_token});
+    }
+    cpr::Response r = call("files.list", &cpr::Session::Get,
+        cpr::Url{m_api_base + "/drive/v3/files"},
+        cpr::Header{{"Authorization", "Bearer " + getAccessToken()}}, params);
+    if (r.status_code != 200) {
+      throw std::runtime_error("Failed to list folder " + parent_id +
+                               ". Status: " + std::to_string(r.status_code));
+    }
+    auto json_response = nlohmann::json::parse(r.text);
+    for (const auto &file : json_response.value("files", nlohmann::json::array())) {
+      FileInfo info;
+      info.id = file.value("id", "");
+      info.name = file.value("name", "");
+      // Drive reports sizes as decimal strings.
+      if (file.contains("size")) {
+        info.size = std::stoll(file["size"].get<std::string>());
+      }
+      files.push_back(std::move(info));
+    }
+    page_token = json_response.value("nextPageToken", "");
+  } while (!page_token.empty());
+  return files;
+}
+
+std::pair<std::int64_t, std::int64_t> GDriveHandler::storageQuota() {
   ensureAuthenticated();
+  cpr::Response r = call("about.get", &cpr::Session::Get,
+      cpr::Url{m_api_base + "/drive/v3/about"},
+      cpr::Header{{"Authorization", "Bearer " + getAccessToken()}},
+      cpr::Parameters{{"fields", "storageQuota"}});
+  if (r.status_code != 200) {
+    throw std::runtime_error("Failed to read storage quota. Status: " +
+                             std::to_string(r.status_code));
+  }
+  const auto quota = nlohmann::json::parse(r.text).value("storageQuota", nlohmann::json::object());
+  auto field = [&](const char *key) -> std::int64_t {
+    return quota.contains(key) ? std::stoll(quota[key].get<std::string>()) : -1;
+  };
+  return {field("usage"), field("limit")};
+}
+
+std::ofstream GDriveHandler::openDownloadFile(const std::string &save_path) {
   std::ofstream of(save_path, std::ios::binary);
   if (!of.is_open()) {
     throw std::runtime_error("Could not open file for writing download: " +
                              save_path);
   }
+  return of;
+}
+
+void GDriveHandler::downloadMedia(const std::string &file_id,
+                                  const std::string &range,
+                                  const std::function<void(const std::string_view &)> &sink,
+                                  const ProgressCallback &progress_callback) {
+  ensureAuthenticated();
 
   cpr::Session session;
-  session.SetUrl(cpr::Url{"https://www.googleapis.com/drive/v3/files/" +
+  session.SetUrl(cpr::Url{m_api_base + "/drive/v3/files/" +
                           file_id + "?alt=media"});
-  session.SetHeader(
-      {{"Authorization",
-        "Bearer " + m_tokens["access_token"].get<std::string>()}});
+  cpr::Header header{
+      {"Authorization",
+       "Bearer " + getAccessToken()}};
+  if (!range.empty()) {
+    header["Range"] = range;
+  }
+  session.SetHeader(header);
 
-  // Use a WriteCallback to stream the download to the file
+  // A ranged request must come back as 206; a 200 would be the whole file.
+  const long expected = range.empty() ? 200 : 206;
+
+  // Use a WriteCallback to stream the download to the sink. The body of any
+  // other response, such as a 401 that send() retries, is not file data.
+  CURL *handle = session.GetCurlHolder()->handle;
   session.SetWriteCallback(
-      cpr::WriteCallback([&](const std::string_view &data, intptr_t) {
-        of.write(data.data(), data.size());
+      cpr::WriteCallback([&, handle](const std::string_view &data, intptr_t) {
+        long status = 0;
+        curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &status);
+        if (status == expected) {
+          sink(data);
+        }
         return true; // Return true to continue, false to abort
       }));
 
@@ -425,23 +752,91 @@ void GDriveHandler::downloadChunk(const std::string &file_id,
     session.SetProgressCallback(progress_callback);
   }
 
-  cpr::Response r = session.Get();
-  if (r.status_code != 200) {
+  cpr::Response r = send("files.get_media", session, &cpr::Session::Get);
+  if (r.status_code != expected) {
     throw std::runtime_error("Download failed for file ID " + file_id +
                              ". Status: " + std::to_string(r.status_code));
   }
 }
 
-
-
 void GDriveHandler::deleteFileById(const std::string& file_id) {
   ensureAuthenticated();
-  cpr::Response r = cpr::Delete(
-      cpr::Url{"https://www.googleapis.com/drive/v3/files/" + file_id},
+  cpr::Response r = call("files.delete", &cpr::Session::Delete,
+      cpr::Url{m_api_base + "/drive/v3/files/" + file_id},
       cpr::Header{{"Authorization", "Bearer " + getAccessToken()}}
   );
 
   if (r.status_code != 204 && r.status_code != 404) {
       throw std::runtime_error("Failed to delete file ID " + file_id + ". Status: " + std::to_string(r.status_code) + " Body: " + r.text);
   }
-}
\ No newline at end of file
+}
+
+std::vector<bool> GDriveHandler::deleteFilesById(const std::vector<std::string>& file_ids) {
+  std::vector<BatchCall> calls;
+  calls.reserve(file_ids.size());
+  for (const auto& file_id : file_ids) {
+    calls.push_back({"DELETE", "/drive/v3/files/" + file_id, ""});
+  }
+  std::vector<BatchResult> results = executeBatch(calls);
+  std::vector<bool> deleted(results.size());
+  for (size_t i = 0; i < results.size(); ++i) {
+    deleted[i] = results[i].status == 204 || results[i].status == 200 || results[i].status == 404;
+  }
+  return deleted;
+}
+
+static bool isRetryableBatchStatus(const BatchResult& result) {
+  if (result.status == 0 || result.status == 429 || result.status >= 500) return true;
+  return result.status == 403 && result.body.find("ateLimitExceeded") != std::string::npos;
+}
+
+std::vector<BatchResult> GDriveHandler::executeBatch(const std::vector<BatchCall>& calls) {
+  std::vector<BatchResult> results(calls.size());
+  std::vector<size_t> pending(calls.size());
+  std::iota(pending.begin(), pending.end(), size_t{0});
+  if (calls.empty()) return results;
+  ensureAuthenticated();
+
+  std::random_device rd;
+  for (int attempt = 0; !pending.empty(); ++attempt) {
+    if (attempt > 0) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(dd::BASE_BACKOFF_MS << std::min(attempt - 1, 4)));
+    }
+    std::vector<size_t> retry;
+    for (size_t first = 0; first < pending.size(); first += dd::DRIVE_BATCH_MAX_CALLS) {
+      const std::vector<size_t> group(
+          pending.begin() + first,
+          pending.begin() + std::min(pending.size(), first + dd::DRIVE_BATCH_MAX_CALLS));
+      std::ostringstream boundary_ss;
+      boundary_ss << "dd_batch_" << std::hex << rd() << rd() << rd() << rd();
+      const std::string boundary = boundary_ss.str();
+
+      cpr::Response r = call("batch", &cpr::Session::Post,
+          cpr::Url{m_api_base + "/batch/drive/v3"},
+          cpr::Header{{"Authorization", "Bearer " + getAccessToken()},
+                      {"Content-Type", "multipart/mixed; boundary=" + boundary}},
+          cpr::Body{buildBatchBody(calls, group, boundary)});
+
+      std::map<size_t, BatchResult> parsed;
+      if (r.status_code == 200) {
+        parsed = parseBatchBody(r.text, multipartBoundary(r.header["Content-Type"]), group);
+      }
+      for (size_t i : group) {
+        auto it = parsed.find(i);
+        if (it != parsed.end()) {
+          results[i] = std::move(it->second);
+        } else {
+          // The whole batch failed, or it came back without this call.
+          results[i] = {r.status_code == 200 ? 0 : static_cast<int>(r.status_code), r.text};
+        }
+        if (isRetryableBatchStatus(results[i])) retry.push_back(i);
+      }
+    }
+    if (attempt + 1 >= dd::MAX_RETRIES) break;
+    if (!retry.empty()) {
+      metrics().counter("dd_retries_total", {{"kind", "batch_call"}}).add(static_cast<std::int64_t>(retry.size()));
+    }
+    pending = std::move(retry);
+  }
+  return results;
+}
@@ -1,11 +1,19 @@
 #ifndef GDRIVE_HANDLER_H
 #define GDRIVE_HANDLER_H
 
+#include <chrono>
+#include <mutex>
 #include <string>
+#include <string_view>
+#include <fstream>
 #include <functional>
 #include <nlohmann/json.hpp>
 #include <vector> 
+#include <utility>
+#include <cstdint>
 #include <cpr/cpr.h>
+#include "DDConfig.h"
+#include "drive_batch.h"
 
 // Define a type for our progress callback function to match CPR's signature
 using ProgressCallback = std::function<bool(cpr::cpr_off_t downloadTotal, cpr::cpr_off_t downloadNow, cpr::cpr_off_t uploadTotal, cpr::cpr_off_t uploadNow, intptr_t userdata)>;
@@ -13,6 +21,9 @@ using ProgressCallback = std::function<bool(cpr::cpr_off_t downloadTotal, cpr::c
 class GDriveHandler {
 public:
     GDriveHandler(const std::string& token_path, const std::string& credentials_path);
+    // Signs in if there is no session, and otherwise refreshes the access
+    // token once it is about to expire. Calls from several threads share the
+    // token; one of them refreshes it while the others wait.
     void ensureAuthenticated();
     std::string authenticateNewAccount(const std::string& token_directory);
 
@@ -24,10 +35,44 @@ public:
     std::string downloadFileContent(const std::string& file_id);
     std::string getAccessToken() const;
     // --- Chunk Transfer Functions (Now with Progress) ---
-    std::string uploadChunk(const std::vector<char>& chunk_data, const std::string& remote_file_name, const std::string& parentFolderId, const ProgressCallback& progress_callback = nullptr);
+    // Chunks up to the multipart limit are sent in a single request; larger
+    // ones use a resumable session, which may have been started ahead of time
+    // with startResumableUpload().
+    std::string uploadChunk(const std::vector<char>& chunk_data, const std::string& remote_file_name, const std::string& parentFolderId, const ProgressCallback& progress_callback = nullptr, const std::string& session_uri = "");
+    // `file_id`, if given, must come from generateIds().
+    std::string startResumableUpload(const std::string& remote_file_name, const std::string& parentFolderId, const std::string& file_id = "");
+    std::vector<std::string> generateIds(int count);
+    void setMultipartLimit(std::size_t bytes) { m_multipart_limit = bytes; }
     void downloadChunk(const std::string& file_id, const std::string& save_path, const ProgressCallback& progress_callback = nullptr);
+    // Downloads bytes [offset, offset + length) of a file using an HTTP Range request.
+    void downloadChunkRange(const std::string& file_id, std::int64_t offset, std::int64_t length, const std::string& save_path, const ProgressCallback& progress_callback = nullptr);
+    // Same, returning the bytes instead of writing them to a file.
+    std::string readChunkRange(const std::string& file_id, std::int64_t offset, std::int64_t length, const ProgressCallback& progress_callback = nullptr);
+    // Same, handing the bytes to `sink` as they arrive; a negative length
+    // reads to the end of the file.
+    void streamChunkRange(const std::string& file_id, std::int64_t offset, std::int64_t length, const std::function<void(const std::string_view&)>& sink, const ProgressCallback& progress_callback = nullptr);
+
+    // Every file directly under `parent_id`, following pagination.
+    struct FileInfo {
+        std::string id;
+        std::string name;
+        std::int64_t size = -1;
+    };
+    std::vector<FileInfo> listFolder(const std::string& parent_id);
+    // Bytes used and the account's limit (-1 for unlimited storage).
+    std::pair<std::int64_t, std::int64_t> storageQuota();
 
     void deleteFileById(const std::string& file_id);
+    // Deletes many files through batch requests; result i is true if
+    // file_ids[i] is gone (already missing counts as deleted).
+    std::vector<bool> deleteFilesById(const std::vector<std::string>& file_ids);
+
+    // Sends independent API calls as multipart/mixed batch requests of up to
+    // DRIVE_BATCH_MAX_CALLS each and returns one result per call, in order.
+    // Calls that fail with a rate limit, server error or no response are
+    // resent in a later batch with exponential backoff, up to MAX_RETRIES
+    // rounds.
+    std::vector<BatchResult> executeBatch(const std::vector<BatchCall>& calls);
 
     std::string extractUploadedFileId(const cpr::Response& response);
 
@@ -36,12 +81,43 @@ private:
     bool refreshAccessToken();
     void saveTokens();
     bool loadTokens();
+    void setTokenExpiry(const nlohmann::json& token_response);
+    // Makes the next ensureAuthenticated() refresh the access token, unless
+    // `authorization` (the rejected request's header) no longer carries the
+    // current one because another thread has refreshed it already.
+    void expireAccessToken(const std::string& authorization);
+
+    static std::ofstream openDownloadFile(const std::string& save_path);
+    void downloadMedia(const std::string& file_id, const std::string& range, const std::function<void(const std::string_view&)>& sink, const ProgressCallback& progress_callback);
+    std::string initiateResumableUpload(const std::string& remote_file_name, const std::string& parentFolderId, const std::string& file_id);
+    std::string uploadMultipart(const std::vector<char>& chunk_data, const std::string& remote_file_name, const std::string& parentFolderId, const ProgressCallback& progress_callback);
 
-    std::string initiateResumableUpload(const std::string& remote_file_name, const std::string& parentFolderId);
+    // Sends one API call on `session` and records it in the request metrics.
+    // An access token the API rejects with 401 before its recorded expiry
+    // (revoked, or the clock moved) is refreshed and the call resent once;
+    // token endpoint calls are never resent.
+    cpr::Response send(const char* endpoint, cpr::Session& session, cpr::Response (cpr::Session::*method)());
+    // Records a finished call under this account and `endpoint`: status,
+    // latency, curl's per-phase timings (dns, connect, tls, wait, transfer),
+    // new connections and bytes.
+    void recordRequest(const char* endpoint, cpr::Session& session, const cpr::Response& r);
+    // The same for a call given as cpr options, like cpr::Get(options...).
+    template <typename... Options>
+    cpr::Response call(const char* endpoint, cpr::Response (cpr::Session::*method)(), Options&&... options) {
+        cpr::Session session;
+        (session.SetOption(std::forward<Options>(options)), ...);
+        return send(endpoint, session, method);
+    }
 
     std::string m_token_path;
+    std::string m_account;     // the token file's name: the account's email
+    std::string m_api_base;    // scheme and host the Drive API calls go to
+    std::string m_token_uri;   // where access tokens are refreshed
     nlohmann::json m_credentials;
+    mutable std::mutex m_tokens_mutex;   // guards m_tokens and m_token_expiry
     nlohmann::json m_tokens;
+    std::chrono::steady_clock::time_point m_token_expiry;   // refresh the access token from here on
+    std::size_t m_multipart_limit = dd::MULTIPART_UPLOAD_MAX_BYTES;
 };
 
 #endif // GDRIVE_HANDLER_H
\ No newline at end of file
@@ -0,0 +1,176 @@
+#include "http_gateway.h"
+#include <algorithm>
+#include <cctype>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "DDConfig.h"
+#include "catalog.h"
+
+// Content type by extension, enough for browsers and players to pick a
+// handler; anything else is served as a plain byte stream.
+static std::string contentType(const std::string& path) {
+    static const std::pair<const char*, const char*> types[] = {
+        {".mp4", "video/mp4"},        {".m4v", "video/mp4"},         {".mkv", "video/x-matroska"},
+        {".webm", "video/webm"},      {".mov", "video/quicktime"},   {".mp3", "audio/mpeg"},
+        {".m4a", "audio/mp4"},        {".flac", "audio/flac"},       {".ogg", "audio/ogg"},
+        {".wav", "audio/wav"},        {".jpg", "image/jpeg"},        {".jpeg", "image/jpeg"},
+        {".png", "image/png"},        {".gif", "image/gif"},         {".webp", "image/webp"},
+        {".pdf", "application/pdf"},  {".txt", "text/plain"},        {".html", "text/html"},
+        {".json", "application/json"}, {".zip", "application/zip"},
+    };
+    const size_t dot = path.find_last_of("./");
+    if (dot == std::string::npos || path[dot] != '.') {
+        return "application/octet-stream";
+    }
+    std::string ext = path.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    for (const auto& [suffix, type] : types) {
+        if (ext == suffix) return type;
+    }
+    return "application/octet-stream";
+}
+
+HttpGateway::HttpGateway(Source source) : m_source(std::move(source)) {
+    m_server.new_task_queue = [] { return new httplib::ThreadPool(dd::SERVE_THREADS); };
+
+    auto handle = [this](const httplib::Request& req, httplib::Response& res) {
+        const std::string path = normalizePath(req.matches.size() > 1 ? req.matches[1].str() : std::string());
+        try {
+            if (!path.empty()) {
+                if (const std::optional<std::int64_t> size = m_source.file_size(path)) {
+                    serveFile(req, res, path, *size);
+                    return;
+                }
+            }
+            nlohmann::json listing = m_source.list(path);
+            if (listing.is_null()) {
+                res.status = 404;
+                res.set_content("Not found: " + path + "\n", "text/plain");
+                return;
+            }
+            res.set_content(listing.dump(2), "application/json");
+        } catch (const std::exception& e) {
+            res.status = 500;
+            res.set_content(std::string(e.what()) + "\n", "text/plain");
+        }
+    };
+    m_server.Get("/files/(.*)", handle);
+    m_server.Get("/files", handle);
+    m_server.Get("/", [](const httplib::Request&, httplib::Response& res) {
+        res.set_redirect("/files/");
+    });
+}
+
+bool HttpGateway::listen(const std::string& host, int port) {
+    {
+        std::lock_guard<std::mutex> lock(m_readers_mutex);
+        m_listening = true;
+    }
+    std::thread expiry([this] { expireReaders(); });
+    const bool listened = m_server.listen(host, port);
+    {
+        std::lock_guard<std::mutex> lock(m_readers_mutex);
+        m_listening = false;
+    }
+    m_expiry_wake.notify_all();
+    expiry.join();
+    return listened;
+}
+
+void HttpGateway::stop() {
+    m_server.stop();
+}
+
+// The body is produced on demand: httplib works out the requested ranges
+// (answering HEAD, 206, 416 and multipart/byteranges itself) and asks for
+// each one in pieces, which are read through the connection's stream.
+void HttpGateway::serveFile(const httplib::Request& req, httplib::Response& res, const std::string& path,
+                            std::int64_t size) {
+    const std::string key = req.remote_addr + ":" + std::to_string(req.remote_port) + " " + path;
+    auto reader = std::make_shared<std::shared_ptr<ReadAheadStream>>();
+    res.set_header("Accept-Ranges", "bytes");
+    res.set_content_provider(
+        static_cast<size_t>(size), contentType(path),
+        [this, key, path, reader](size_t offset, size_t length, httplib::DataSink& sink) {
+            try {
+                if (!*reader) {
+                    *reader = takeReader(key, path);
+                }
+                const std::int64_t want = std::min<std::int64_t>(static_cast<std::int64_t>(length), dd::READ_SPAN_BYTES);
+                const std::string data = (*reader)->read(static_cast<std::int64_t>(offset), want);
+                return !data.empty() && sink.write(data.data(), data.size());
+            } catch (const std::exception&) {
+                return false;   // drops the connection; the client sees a short body
+            }
+        },
+        [this, key, reader](bool) {
+            if (*reader) {
+                returnReader(key, std::move(*reader));
+            }
+        });
+}
+
+// Dropped streams here and below are destroyed outside the lock, since that
+// waits for their prefetches to wind down.
+std::shared_ptr<ReadAheadStream> HttpGateway::takeReader(const std::string& key, const std::string& path) {
+    std::vector<std::shared_ptr<ReadAheadStream>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_readers_mutex);
+        dropIdleLocked(dropped);
+        auto it = m_readers.find(key);
+        if (it != m_readers.end()) {
+            std::shared_ptr<ReadAheadStream> reader = std::move(it->second.stream);
+            m_readers.erase(it);
+            return reader;
+        }
+    }
+    return std::shared_ptr<ReadAheadStream>(m_source.open(path));
+}
+
+// Keeps a stream for the connection's next request.
+void HttpGateway::returnReader(const std::string& key, std::shared_ptr<ReadAheadStream> reader) {
+    std::vector<std::shared_ptr<ReadAheadStream>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(m_readers_mutex);
+        IdleReader& slot = m_readers[key];
+        if (slot.stream) dropped.push_back(std::move(slot.stream));
+        slot = {std::move(reader), std::chrono::steady_clock::now()};
+        dropIdleLocked(dropped);
+    }
+}
+
+// Streams left idle too long, or beyond the cap, oldest first.
+void HttpGateway::dropIdleLocked(std::vector<std::shared_ptr<ReadAheadStream>>& dropped) {
+    const auto now = std::chrono::steady_clock::now();
+    for (auto it = m_readers.begin(); it != m_readers.end();) {
+        if (now - it->second.since > dd::SERVE_READER_IDLE) {
+            dropped.push_back(std::move(it->second.stream));
+            it = m_readers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    while (m_readers.size() > dd::SERVE_MAX_READERS) {
+        auto oldest = std::min_element(m_readers.begin(), m_readers.end(), [](const auto& a, const auto& b) {
+            return a.second.since < b.second.since;
+        });
+        dropped.push_back(std::move(oldest->second.stream));
+        m_readers.erase(oldest);
+    }
+}
+
+// While serving, drops idle streams even when no requests come in to do it,
+// so that their prefetched blocks do not outlive the clients that wanted
+// them.
+void HttpGateway::expireReaders() {
+    std::unique_lock<std::mutex> lock(m_readers_mutex);
+    while (!m_expiry_wake.wait_for(lock, dd::SERVE_READER_IDLE / 2, [this] { return !m_listening; })) {
+        std::vector<std::shared_ptr<ReadAheadStream>> dropped;
+        dropIdleLocked(dropped);
+        lock.unlock();
+        dropped.clear();
+        lock.lock();
+    }
+}
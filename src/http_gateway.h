@@ -0,0 +1,66 @@
+#ifndef HTTP_GATEWAY_H
+#define HTTP_GATEWAY_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <httplib.h>
+#include <nlohmann/json.hpp>
+#include "read_ahead.h"
+
+// Local HTTP server exposing stored files:
+//   GET/HEAD /files/<path>   file contents; Range requests (including
+//                            multi-range) are answered with 206
+//   GET      /files/<dir>/   JSON listing of a directory
+//
+// Each request is served through a ReadAheadStream. Streams are kept per
+// client connection and file between requests, so a player issuing
+// successive range requests over a keep-alive connection is recognised as
+// sequential and read ahead of. Kept streams are dropped once idle for
+// SERVE_READER_IDLE, whether or not other requests arrive, or beyond
+// SERVE_MAX_READERS.
+class HttpGateway {
+public:
+    struct Source {
+        // Size of the file at `path`, or nullopt if there is none.
+        std::function<std::optional<std::int64_t>(const std::string& path)> file_size;
+        std::function<std::unique_ptr<ReadAheadStream>(const std::string& path)> open;
+        // Listing of a directory, or null JSON if there is no such directory.
+        std::function<nlohmann::json(const std::string& dir)> list;
+    };
+
+    explicit HttpGateway(Source source);
+
+    // Serves until stop() is called. Returns false if the address cannot be
+    // bound.
+    bool listen(const std::string& host, int port);
+    void stop();
+
+private:
+    void serveFile(const httplib::Request& req, httplib::Response& res, const std::string& path, std::int64_t size);
+    std::shared_ptr<ReadAheadStream> takeReader(const std::string& key, const std::string& path);
+    void returnReader(const std::string& key, std::shared_ptr<ReadAheadStream> reader);
+    void dropIdleLocked(std::vector<std::shared_ptr<ReadAheadStream>>& dropped);
+    void expireReaders();
+
+    struct IdleReader {
+        std::shared_ptr<ReadAheadStream> stream;
+        std::chrono::steady_clock::time_point since;
+    };
+
+    Source m_source;
+    httplib::Server m_server;
+    std::mutex m_readers_mutex;
+    std::map<std::string, IdleReader> m_readers;   // "<addr>:<port> <path>" -> stream between requests
+    std::condition_variable m_expiry_wake;
+    bool m_listening = false;
+};
+
+#endif // HTTP_GATEWAY_H
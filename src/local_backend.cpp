@@ -0,0 +1,150 @@
+#include "local_backend.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <mutex>
+#include "fs_util.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+    constexpr std::size_t kBlockBytes = 1024 * 1024;   // progress granularity
+    const char* kTempPrefix = ".tmp-";
+
+    // Ids are random, with the object name appended for anyone browsing the
+    // directory; only characters safe in a file name are kept.
+    std::string newId(const std::string& name) {
+        static std::mutex mutex;
+        static std::mt19937_64 random(std::random_device{}());
+        char prefix[17];
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::snprintf(prefix, sizeof(prefix), "%016llx", static_cast<unsigned long long>(random()));
+        }
+        std::string id = std::string(prefix) + "-";
+        for (char c : name) {
+            const bool safe = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                              c == '.' || c == '_' || c == '-';
+            id += safe ? c : '_';
+        }
+        return id;
+    }
+}
+
+LocalBackend::LocalBackend(std::string dir) : m_dir(std::move(dir)) {
+    fs::create_directories(m_dir);
+    // Leftovers of puts interrupted by a crash.
+    for (const auto& entry : fs::directory_iterator(m_dir)) {
+        if (entry.path().filename().string().rfind(kTempPrefix, 0) == 0) {
+            std::error_code ec;
+            fs::remove(entry.path(), ec);
+        }
+    }
+}
+
+std::string LocalBackend::pathFor(const std::string& id) const {
+    if (id.empty() || id.find_first_of("/\\") != std::string::npos || id[0] == '.') {
+        throw std::runtime_error("Invalid object id: " + id);
+    }
+    return (fs::path(m_dir) / id).string();
+}
+
+std::string LocalBackend::put(const std::vector<char>& data, const std::string& name, const std::string&,
+                              const Progress& progress) {
+    const std::string id = newId(name);
+    const std::string temp_path = (fs::path(m_dir) / (kTempPrefix + id)).string();
+    std::FILE* out = std::fopen(temp_path.c_str(), "wb");
+    if (!out) {
+        throw std::runtime_error("Cannot write " + temp_path);
+    }
+    const std::int64_t total = static_cast<std::int64_t>(data.size());
+    bool ok = true;
+    for (std::size_t done = 0; ok && done < data.size();) {
+        const std::size_t take = std::min(kBlockBytes, data.size() - done);
+        ok = std::fwrite(data.data() + done, 1, take, out) == take;
+        done += take;
+        ok = ok && (!progress || progress(static_cast<std::int64_t>(done), total));
+    }
+    ok = ok && std::ferror(out) == 0;
+    ok = ok && syncFile(out);
+    ok = std::fclose(out) == 0 && ok;
+    std::error_code ec;
+    if (!ok) {
+        fs::remove(temp_path, ec);
+        throw std::runtime_error("Writing object " + id + " to " + m_dir + " failed or was aborted");
+    }
+    fs::rename(temp_path, pathFor(id), ec);
+    if (ec) {
+        fs::remove(temp_path, ec);
+        throw std::runtime_error("Cannot store object " + id + " in " + m_dir);
+    }
+    return id;
+}
+
+void LocalBackend::get(const std::string& id, std::int64_t offset, std::int64_t length, const Sink& sink,
+                       const Progress& progress) {
+    const std::string path = pathFor(id);
+    std::ifstream in(path, std::ios::binary);
+    std::error_code ec;
+    const auto size = fs::file_size(path, ec);
+    if (!in || ec) {
+        throw std::runtime_error("Object not found: " + id);
+    }
+    const std::int64_t end = length < 0 ? static_cast<std::int64_t>(size) : offset + length;
+    if (offset < 0 || end > static_cast<std::int64_t>(size) || offset > end) {
+        throw std::runtime_error("Range outside object " + id);
+    }
+    in.seekg(offset);
+    std::vector<char> block(static_cast<std::size_t>(std::min<std::int64_t>(kBlockBytes, end - offset)));
+    for (std::int64_t pos = offset; pos < end;) {
+        const std::size_t take = static_cast<std::size_t>(std::min<std::int64_t>(block.size(), end - pos));
+        if (!in.read(block.data(), static_cast<std::streamsize>(take))) {
+            throw std::runtime_error("Read of object " + id + " failed");
+        }
+        sink(std::string_view(block.data(), take));
+        pos += static_cast<std::int64_t>(take);
+        if (progress && !progress(pos - offset, end - offset)) {
+            throw std::runtime_error("Read of object " + id + " aborted");
+        }
+    }
+}
+
+std::vector<bool> LocalBackend::remove(const std::vector<std::string>& ids) {
+    std::vector<bool> gone;
+    gone.reserve(ids.size());
+    for (const auto& id : ids) {
+        std::error_code ec;
+        fs::remove(pathFor(id), ec);
+        gone.push_back(!ec);
+    }
+    return gone;
+}
+
+std::vector<StoredObject> LocalBackend::list() {
+    std::vector<StoredObject> objects;
+    for (const auto& entry : fs::directory_iterator(m_dir)) {
+        const std::string id = entry.path().filename().string();
+        if (!entry.is_regular_file() || id.rfind(kTempPrefix, 0) == 0) continue;
+        const std::size_t dash = id.find('-');
+        objects.push_back({id, dash == std::string::npos ? id : id.substr(dash + 1),
+                           static_cast<std::int64_t>(entry.file_size())});
+    }
+    return objects;
+}
+
+StorageQuota LocalBackend::quota() {
+    StorageQuota quota;
+    quota.used = 0;
+    for (const auto& object : list()) {
+        quota.used += object.size;
+    }
+    std::error_code ec;
+    const fs::space_info space = fs::space(m_dir, ec);
+    if (!ec) {
+        quota.limit = quota.used + static_cast<std::int64_t>(space.available);
+    }
+    return quota;
+}
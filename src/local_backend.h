@@ -0,0 +1,29 @@
+#ifndef LOCAL_BACKEND_H
+#define LOCAL_BACKEND_H
+
+#include <string>
+#include "storage_backend.h"
+
+// An "account" that is a directory on a local or mounted filesystem, one
+// file per object. Objects are written under a temporary name, synced and
+// renamed, so a crash never leaves a partial object behind under a real id.
+class LocalBackend : public StorageBackend {
+public:
+    explicit LocalBackend(std::string dir);
+
+    std::string kind() const override { return "local"; }
+    std::string put(const std::vector<char>& data, const std::string& name, const std::string& session,
+                    const Progress& progress) override;
+    void get(const std::string& id, std::int64_t offset, std::int64_t length, const Sink& sink,
+             const Progress& progress) override;
+    std::vector<bool> remove(const std::vector<std::string>& ids) override;
+    std::vector<StoredObject> list() override;
+    StorageQuota quota() override;
+
+private:
+    std::string pathFor(const std::string& id) const;
+
+    std::string m_dir;
+};
+
+#endif // LOCAL_BACKEND_H
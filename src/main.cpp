@@ -1,8 +1,21 @@
 #include "Shell.h"
+#include "daemon.h"
 #include <iostream>
+#include <string>
+#include <vector>
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        if (argc > 1) {
+            const std::vector<std::string> args(argv + 1, argv + argc);
+            // A running daemon has the accounts, catalog and connections
+            // loaded already, so the command goes to it.
+            if (std::optional<int> status = forwardToDaemon(dd::DAEMON_SOCKET, args)) {
+                return *status;
+            }
+            Shell app_shell;
+            return app_shell.execute(args);
+        }
         Shell app_shell;
         app_shell.run();
     } catch (const std::exception& e) {
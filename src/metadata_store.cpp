@@ -0,0 +1,392 @@
+#include "metadata_store.h"
+#include "DDConfig.h"
+#include "fs_util.h"
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+MetadataStore::MetadataStore(std::string catalog_path, std::string log_path, std::string legacy_json_path)
+    : m_catalog_path(std::move(catalog_path)),
+      m_log_path(std::move(log_path)),
+      m_old_log_path(m_log_path + ".old"),
+      m_legacy_json_path(std::move(legacy_json_path)) {
+    load();
+    m_flusher = std::thread([this] { flusherLoop(); });
+    m_compactor = std::thread([this] { compactorLoop(); });
+}
+
+MetadataStore::~MetadataStore() {
+    {
+        std::lock_guard<std::mutex> lock(m_compact_mutex);
+        m_stopping = true;
+        m_compact_cv.notify_all();
+    }
+    m_compactor.join();
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        m_flush_cv.notify_all();
+    }
+    m_flusher.join();
+    if (m_log) std::fclose(m_log);
+}
+
+void MetadataStore::load() {
+    m_catalog.setBase(CatalogSnapshot::open(m_catalog_path));
+    m_snapshot_seq = m_catalog.baseSeq();
+
+    // First start after the switch to the binary catalog: the old JSON
+    // snapshot becomes the overlay and the log replays on top of it as before.
+    bool migrating = false;
+    if (!fs::exists(m_catalog_path)) {
+        if (!m_legacy_json_path.empty() && fs::exists(m_legacy_json_path)) {
+            json legacy;
+            std::ifstream in(m_legacy_json_path);
+            if (in.peek() != std::ifstream::traits_type::eof()) {
+                in >> legacy;
+            }
+            if (legacy.is_object()) {
+                m_snapshot_seq = legacy.value("log_seq", std::uint64_t{0});
+                const json files = legacy.value("files", json::object());
+                for (const auto& [name, entry] : files.items()) {
+                    json record = entry;
+                    record["op"] = "put_file";
+                    record["file"] = name;
+                    m_catalog.apply(record, 0);
+                }
+            }
+            migrating = true;
+        }
+    }
+
+    m_last_seq = m_snapshot_seq;
+    replay(m_old_log_path);
+    replay(m_log_path);
+
+    // A compaction was interrupted (or we are migrating): fold everything
+    // into a fresh snapshot now, before any new segment could be rotated on
+    // top of the old one.
+    if (migrating || fs::exists(m_old_log_path)) {
+        writeSnapshot(m_catalog.freeze(m_last_seq));
+        m_catalog.adopt(CatalogSnapshot::open(m_catalog_path), m_last_seq);
+        fs::remove(m_old_log_path);
+        std::ofstream truncate(m_log_path, std::ios::trunc);
+        m_snapshot_seq = m_last_seq;
+        m_log_records = 0;
+        if (migrating) {
+            fs::rename(m_legacy_json_path, m_legacy_json_path + ".imported");
+        }
+    }
+
+    m_log = std::fopen(m_log_path.c_str(), "ab");
+    if (!m_log) {
+        throw std::runtime_error("Cannot open metadata log: " + m_log_path);
+    }
+    m_durable_seq = m_last_seq;
+}
+
+void MetadataStore::replay(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return;
+
+    std::string line;
+    std::streamoff good_end = 0;
+    bool torn = false;
+    while (std::getline(in, line)) {
+        // A record is only acknowledged once its newline is fsynced, so an
+        // unterminated or unparsable last line is a write the crash cut short.
+        if (in.eof()) { torn = !line.empty(); break; }
+        if (!line.empty()) {
+            json record;
+            try {
+                record = json::parse(line);
+            } catch (const json::parse_error&) {
+                torn = true;
+                break;
+            }
+            std::uint64_t seq = record.value("seq", std::uint64_t{0});
+            if (seq > m_snapshot_seq) {
+                m_catalog.apply(record, seq);
+                m_last_seq = std::max(m_last_seq, seq);
+            }
+            if (path == m_log_path) m_log_records++;
+        }
+        good_end = in.tellg();
+    }
+    in.close();
+
+    if (torn) {
+        std::cerr << "Warning: discarding incomplete record at the end of " << path << std::endl;
+        fs::resize_file(path, static_cast<std::uintmax_t>(good_end));
+    }
+}
+
+std::uint64_t MetadataStore::apply(json record) {
+    throwIfFailed();
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    record["seq"] = ++m_last_seq;
+    m_catalog.apply(record, m_last_seq);
+    m_pending.push_back(record.dump());
+    m_flush_cv.notify_one();
+    return m_last_seq;
+}
+
+void MetadataStore::waitDurable(std::uint64_t seq) {
+    std::unique_lock<std::mutex> lock(m_durable_mutex);
+    m_durable_cv.wait(lock, [&] { return m_durable_seq >= seq || !m_failure.empty(); });
+    if (m_durable_seq < seq) {
+        throw std::runtime_error("Metadata log failed (" + m_failure + "); the change was not saved.");
+    }
+}
+
+void MetadataStore::throwIfFailed() {
+    std::lock_guard<std::mutex> lock(m_durable_mutex);
+    if (!m_failure.empty()) {
+        throw std::runtime_error("Metadata log failed (" + m_failure + "); no further changes can be saved.");
+    }
+}
+
+void MetadataStore::sync() {
+    std::uint64_t seq;
+    {
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        seq = m_last_seq;
+    }
+    waitDurable(seq);
+}
+
+bool MetadataStore::contains(const std::string& file) const {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    return m_catalog.contains(file);
+}
+
+std::optional<FileEntry> MetadataStore::find(const std::string& file) const {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    return m_catalog.find(file);
+}
+
+void MetadataStore::forEachFile(const std::function<void(const FileEntry&)>& fn) const {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    m_catalog.forEach(fn);
+}
+
+bool MetadataStore::dirExists(const std::string& dir) const {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    return m_catalog.dirExists(dir);
+}
+
+DirStats MetadataStore::dirStats(const std::string& dir) const {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    return m_catalog.dirStats(dir);
+}
+
+bool MetadataStore::list(const std::string& dir,
+                         const std::function<void(const std::string& name, const DirStats&)>& on_dir,
+                         const std::function<void(const FileSummary&)>& on_file) const {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    return m_catalog.list(dir, {}, on_dir, on_file);
+}
+
+void MetadataStore::walk(const std::string& dir, const std::function<void(const FileSummary&)>& fn) const {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    m_catalog.walk(dir, fn);
+}
+
+void MetadataStore::glob(const std::string& pattern, const std::function<void(const FileSummary&)>& fn) const {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    m_catalog.glob(pattern, fn);
+}
+
+int MetadataStore::packReferences(const std::string& pack_id) {
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    return m_catalog.packReferences(pack_id);
+}
+
+std::size_t MetadataStore::importJson(const json& metadata) {
+    std::size_t imported = 0;
+    std::uint64_t seq = 0;
+    const json files = metadata.value("files", json::object());
+    for (const auto& [name, entry] : files.items()) {
+        // Round-trip through FileEntry so malformed entries fail here rather
+        // than on replay.
+        json record = toJson(fileFromJson(name, entry));
+        record["op"] = "put_file";
+        record["file"] = name;
+        seq = apply(std::move(record));
+        imported++;
+    }
+    waitDurable(seq);
+    return imported;
+}
+
+json MetadataStore::exportJson() const {
+    json files = json::object();
+    forEachFile([&](const FileEntry& file) { files[file.name] = toJson(file); });
+    return {{"files", files}};
+}
+
+// A failed write or sync is never retried: what reached the file is
+// unknown, so the durable point stops where it was, the failure is latched
+// and every later apply() or waitDurable() throws.
+void MetadataStore::flusherLoop() {
+    std::vector<std::string> before_rotate;
+    std::vector<std::string> batch;
+    try {
+        while (true) {
+            bool rotate = false;
+            std::uint64_t upto;
+            {
+                std::unique_lock<std::mutex> lock(m_state_mutex);
+                m_flush_cv.wait(lock, [&] { return !m_pending.empty() || m_rotate_requested || m_stopping; });
+                if (m_pending.empty() && !m_rotate_requested && m_stopping) break;
+                // Everything queued while the previous batch was being fsynced
+                // goes out together: one write and one fsync for the whole group.
+                batch.swap(m_pending);
+                if (m_rotate_requested) {
+                    // Records up to the compaction point belong to the segment
+                    // being retired; the compactor parked them separately when
+                    // it took its snapshot copy.
+                    before_rotate.swap(m_before_rotate);
+                    m_rotate_requested = false;
+                    rotate = true;
+                }
+                upto = m_last_seq;
+            }
+
+            if (rotate) {
+                writeLines(before_rotate);
+                before_rotate.clear();
+                rotateLog();
+            }
+            writeLines(batch);
+            m_log_records += batch.size();
+            batch.clear();
+            if (!syncFile(m_log)) {
+                throw std::runtime_error("cannot sync " + m_log_path);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(m_durable_mutex);
+                m_durable_seq = upto;
+                if (rotate) m_rotated = true;
+            }
+            m_durable_cv.notify_all();
+
+            if (m_log_records >= dd::METADATA_COMPACT_RECORDS) {
+                // If the lock is taken a compaction is already under way.
+                std::unique_lock<std::mutex> lock(m_compact_mutex, std::try_to_lock);
+                if (lock.owns_lock()) {
+                    m_compact_requested = true;
+                    m_compact_cv.notify_one();
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "\nError: metadata log failed: " << e.what() << std::endl;
+        {
+            std::lock_guard<std::mutex> lock(m_durable_mutex);
+            m_failure = e.what();
+        }
+        m_durable_cv.notify_all();
+    }
+}
+
+void MetadataStore::writeLines(const std::vector<std::string>& lines) {
+    for (const auto& line : lines) {
+        if (std::fputs(line.c_str(), m_log) == EOF || std::fputc('\n', m_log) == EOF) {
+            throw std::runtime_error("cannot write " + m_log_path);
+        }
+    }
+}
+
+void MetadataStore::rotateLog() {
+    if (!syncFile(m_log)) {
+        throw std::runtime_error("cannot sync " + m_log_path);
+    }
+    const bool closed = std::fclose(m_log) == 0;
+    m_log = nullptr;
+    if (!closed) {
+        throw std::runtime_error("cannot close " + m_log_path);
+    }
+    fs::rename(m_log_path, m_old_log_path);
+    m_log = std::fopen(m_log_path.c_str(), "ab");
+    if (!m_log) {
+        throw std::runtime_error("cannot open " + m_log_path);
+    }
+    m_log_records = 0;
+}
+
+void MetadataStore::compactorLoop() {
+    std::unique_lock<std::mutex> lock(m_compact_mutex);
+    while (true) {
+        m_compact_cv.wait(lock, [&] { return m_compact_requested || m_stopping; });
+        if (m_stopping) break;
+        m_compact_requested = false;
+        try {
+            compactLocked();
+        } catch (const std::exception& e) {
+            std::cerr << "\nWarning: metadata compaction failed: " << e.what() << std::endl;
+        }
+    }
+}
+
+void MetadataStore::compactLocked() {
+    Catalog::Frozen frozen;
+    if (fs::exists(m_old_log_path)) {
+        // The last snapshot failed after its rotation, so the retired segment
+        // still holds records no snapshot has. Rotating now would rename over
+        // it; instead snapshot the catalog once it is durable and keep the
+        // current segment, whose older records replay then skips.
+        {
+            std::lock_guard<std::mutex> lock(m_state_mutex);
+            frozen = m_catalog.freeze(m_last_seq);
+        }
+        waitDurable(frozen.seq);
+        writeSnapshot(frozen);
+        auto base = CatalogSnapshot::open(m_catalog_path);
+        fs::remove(m_old_log_path);
+
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        m_catalog.adopt(std::move(base), frozen.seq);
+        m_snapshot_seq = frozen.seq;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_durable_mutex);
+        m_rotated = false;
+    }
+    {
+        // Only the overlay is copied here, so writers are held up for
+        // O(files changed since the last compaction), not O(catalog).
+        std::lock_guard<std::mutex> lock(m_state_mutex);
+        frozen = m_catalog.freeze(m_last_seq);
+        // Hand the not-yet-flushed records up to `seq` to the flusher as the
+        // tail of the segment it is about to retire.
+        m_before_rotate = std::move(m_pending);
+        m_pending.clear();
+        m_rotate_requested = true;
+        m_flush_cv.notify_one();
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_durable_mutex);
+        m_durable_cv.wait(lock, [&] { return m_rotated || !m_failure.empty(); });
+        if (!m_rotated) {
+            throw std::runtime_error("the metadata log failed before it was rotated");
+        }
+    }
+
+    writeSnapshot(frozen);
+    auto base = CatalogSnapshot::open(m_catalog_path);
+    fs::remove(m_old_log_path);
+
+    std::lock_guard<std::mutex> lock(m_state_mutex);
+    m_catalog.adopt(std::move(base), frozen.seq);
+    m_snapshot_seq = frozen.seq;
+}
+
+void MetadataStore::writeSnapshot(const Catalog::Frozen& frozen) {
+    Catalog::write(frozen, m_catalog_path);
+}
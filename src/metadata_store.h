@@ -0,0 +1,119 @@
+#ifndef METADATA_STORE_H
+#define METADATA_STORE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <optional>
+#include <nlohmann/json.hpp>
+#include "catalog.h"
+
+// Owns the file catalog. Every mutation is applied in memory and appended as
+// one JSON line to an append-only log; a background flusher writes and fsyncs
+// whatever has queued up since its last pass (group commit). Once the log
+// grows past a threshold a background compactor folds it into a snapshot.
+//
+// On disk:
+//   <catalog>       memory-mapped binary snapshot (see CatalogSnapshot)
+//   <log>.old       log segment being folded into the next snapshot; never
+//                   rotated over while it exists
+//   <log>           current log segment
+//
+// A JSON snapshot from older versions is imported on first start and then
+// renamed to <legacy>.imported.
+class MetadataStore {
+public:
+    MetadataStore(std::string catalog_path, std::string log_path, std::string legacy_json_path = "");
+    ~MetadataStore();
+
+    MetadataStore(const MetadataStore&) = delete;
+    MetadataStore& operator=(const MetadataStore&) = delete;
+
+    // Applies a mutation and queues it for the log. Returns a sequence number
+    // that can be passed to waitDurable(). Throws, changing nothing, once the
+    // log has failed.
+    //   {"op": "put_file",    "file": name, "total_size": n, "replicas": r, ["chunks": [...]]}
+    //   {"op": "add_chunk",   "file": name, "chunk": {...}}
+    //   {"op": "delete_file", "file": name}
+    std::uint64_t apply(nlohmann::json record);
+
+    // Blocks until the record with `seq` (and everything before it) is on
+    // disk. Throws if the log failed before it got there: the record is then
+    // lost with the process, and nothing it replaced may be deleted.
+    void waitDurable(std::uint64_t seq);
+    void sync();
+
+    bool contains(const std::string& file) const;
+    std::optional<FileEntry> find(const std::string& file) const;
+    void forEachFile(const std::function<void(const FileEntry&)>& fn) const;
+
+    // Directory queries over the virtual namespace (see Catalog). Callbacks
+    // run under the state lock and must not call back into the store.
+    bool dirExists(const std::string& dir) const;
+    DirStats dirStats(const std::string& dir) const;
+    bool list(const std::string& dir,
+              const std::function<void(const std::string& name, const DirStats&)>& on_dir,
+              const std::function<void(const FileSummary&)>& on_file) const;
+    void walk(const std::string& dir, const std::function<void(const FileSummary&)>& fn) const;
+    void glob(const std::string& pattern, const std::function<void(const FileSummary&)>& fn) const;
+
+    // Live files stored in the pack object `pack_id` (see Catalog).
+    int packReferences(const std::string& pack_id);
+
+    // JSON import/export in the metadata.json layout: {"files": {name: {...}}}.
+    std::size_t importJson(const nlohmann::json& metadata);
+    nlohmann::json exportJson() const;
+
+private:
+    void load();
+    void replay(const std::string& path);
+
+    void flusherLoop();
+    void writeLines(const std::vector<std::string>& lines);
+    void throwIfFailed();
+    void compactorLoop();
+    void compactLocked();
+    void writeSnapshot(const Catalog::Frozen& frozen);
+    void rotateLog();
+
+    std::string m_catalog_path;
+    std::string m_log_path;
+    std::string m_old_log_path;
+    std::string m_legacy_json_path;
+
+    // Catalog state and the queue of records not yet handed to the flusher.
+    mutable std::mutex m_state_mutex;
+    Catalog m_catalog;
+    std::uint64_t m_last_seq = 0;
+    std::uint64_t m_snapshot_seq = 0;
+    std::vector<std::string> m_pending;       // serialized records, in seq order
+    std::vector<std::string> m_before_rotate; // records owed to the retiring segment
+    bool m_rotate_requested = false;
+    std::condition_variable m_flush_cv;
+
+    // Durability progress, published by the flusher.
+    std::mutex m_durable_mutex;
+    std::condition_variable m_durable_cv;
+    std::uint64_t m_durable_seq = 0;
+    bool m_rotated = false;
+    std::string m_failure;   // why the log stopped being written; latched
+
+    std::FILE* m_log = nullptr;
+    std::size_t m_log_records = 0;
+
+    std::mutex m_compact_mutex;            // one compaction at a time
+    std::condition_variable m_compact_cv;
+    bool m_compact_requested = false;
+
+    std::atomic<bool> m_stopping{false};
+    std::thread m_flusher;
+    std::thread m_compactor;
+};
+
+#endif // METADATA_STORE_H
@@ -0,0 +1,220 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+namespace {
+    // Every exported family and its help text.
+    const std::map<std::string, std::string> kHelp = {
+        {"dd_transfer_bytes_total", "Bytes moved to (up) or from (down) an account's storage."},
+        {"dd_transfers_total", "Object transfers by account, direction and result."},
+        {"dd_transfer_seconds", "Time to move one object to or from an account."},
+        {"dd_transfers_in_flight", "Object transfers currently running against an account."},
+        {"dd_http_requests_total", "Drive API requests by account, endpoint and HTTP status (0: no response)."},
+        {"dd_http_request_seconds", "Drive API request latency by account and endpoint."},
+        {"dd_http_phase_seconds", "Drive API request time by phase: dns, connect, tls, wait (to the first response byte) and transfer."},
+        {"dd_http_connections_total", "New connections opened by Drive API requests; the rest reused one."},
+        {"dd_http_bytes_total", "Bytes sent (up) and received (down) by Drive API requests."},
+        {"dd_retries_total", "Operations retried: batch rounds, stale upload sessions, reads failed over to another replica."},
+        {"dd_token_refreshes_total", "OAuth access token refreshes by result."},
+        {"dd_queue_depth", "Work waiting: chunks not yet started, transfers waiting for an upload slot."},
+        {"dd_buffer_bytes", "Bytes held in transfer buffers and the chunk cache."},
+    };
+
+    // Histogram buckets exported to Prometheus, in seconds; quantiles come
+    // from the full-resolution histogram.
+    const double kExportBounds[] = {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5,
+                                    1, 2.5, 5, 10, 30, 60, 120, 300, 600};
+
+    std::string escapeLabel(const std::string& value) {
+        std::string out;
+        for (char c : value) {
+            if (c == '\\' || c == '"') out += '\\';
+            if (c == '\n') {
+                out += "\\n";
+                continue;
+            }
+            out += c;
+        }
+        return out;
+    }
+
+    // {a="x",b="y"} plus an optional extra label, or nothing for no labels.
+    std::string labelText(const MetricLabels& labels, const std::string& extra = "") {
+        std::string out;
+        for (const auto& [name, value] : labels) {
+            out += (out.empty() ? "" : ",") + name + "=\"" + escapeLabel(value) + "\"";
+        }
+        if (!extra.empty()) out += (out.empty() ? "" : ",") + extra;
+        return out.empty() ? out : "{" + out + "}";
+    }
+
+    void header(std::ostringstream& out, const std::string& name, const char* type) {
+        auto help = kHelp.find(name);
+        if (help != kHelp.end()) out << "# HELP " << name << " " << help->second << "\n";
+        out << "# TYPE " << name << " " << type << "\n";
+    }
+}
+
+int Histogram::bucketOf(std::uint64_t micros) {
+    if (micros < 2 * kSubBuckets) return static_cast<int>(micros);
+    int msb = 0;
+    for (std::uint64_t v = micros; v > 1; v >>= 1) ++msb;
+    const int shift = msb - 4;   // leaves the top five bits: 16..31
+    if (shift > kMaxShift) return kBuckets - 1;
+    const int sub = static_cast<int>(micros >> shift);
+    return 2 * kSubBuckets + (shift - 1) * kSubBuckets + (sub - kSubBuckets);
+}
+
+std::uint64_t Histogram::bucketUpperBound(int bucket) {
+    if (bucket < 2 * kSubBuckets) return static_cast<std::uint64_t>(bucket);
+    const int shift = (bucket - 2 * kSubBuckets) / kSubBuckets + 1;
+    const std::uint64_t sub = static_cast<std::uint64_t>((bucket - 2 * kSubBuckets) % kSubBuckets + kSubBuckets);
+    return ((sub + 1) << shift) - 1;
+}
+
+void Histogram::record(double seconds) {
+    const std::uint64_t micros = seconds > 0 ? static_cast<std::uint64_t>(std::llround(seconds * 1e6)) : 0;
+    m_buckets[static_cast<size_t>(bucketOf(micros))].fetch_add(1, std::memory_order_relaxed);
+    m_sum_micros.fetch_add(static_cast<std::int64_t>(micros), std::memory_order_relaxed);
+    std::int64_t seen = m_max_micros.load(std::memory_order_relaxed);
+    while (static_cast<std::int64_t>(micros) > seen &&
+           !m_max_micros.compare_exchange_weak(seen, static_cast<std::int64_t>(micros), std::memory_order_relaxed)) {
+    }
+}
+
+Histogram::Snapshot Histogram::snapshot() const {
+    Snapshot snap;
+    snap.buckets.resize(kBuckets);
+    for (int i = 0; i < kBuckets; ++i) {
+        snap.buckets[static_cast<size_t>(i)] = m_buckets[static_cast<size_t>(i)].load(std::memory_order_relaxed);
+        snap.count += snap.buckets[static_cast<size_t>(i)];
+    }
+    // Read without a lock while recording goes on: the count is taken from
+    // the buckets so that quantiles stay consistent with them.
+    snap.sum = static_cast<double>(m_sum_micros.load(std::memory_order_relaxed)) / 1e6;
+    snap.max = static_cast<double>(m_max_micros.load(std::memory_order_relaxed)) / 1e6;
+    return snap;
+}
+
+double Histogram::Snapshot::quantile(double q) const {
+    if (count == 0) return 0;
+    const std::int64_t rank = std::max<std::int64_t>(1, static_cast<std::int64_t>(std::ceil(q * static_cast<double>(count))));
+    std::int64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(static_cast<double>(bucketUpperBound(static_cast<int>(i))) / 1e6, max);
+        }
+    }
+    return max;
+}
+
+void Histogram::Snapshot::merge(const Snapshot& other) {
+    buckets.resize(std::max(buckets.size(), other.buckets.size()));
+    for (size_t i = 0; i < other.buckets.size(); ++i) buckets[i] += other.buckets[i];
+    count += other.count;
+    sum += other.sum;
+    max = std::max(max, other.max);
+}
+
+std::int64_t Histogram::Snapshot::countAtMost(double seconds) const {
+    const double micros = seconds * 1e6;
+    double total = 0;
+    double lower = 0;   // smallest value of bucket i
+    for (size_t i = 0; i < buckets.size() && lower <= micros; ++i) {
+        const double upper = static_cast<double>(bucketUpperBound(static_cast<int>(i)));
+        // A bucket straddling the bound contributes in proportion to the
+        // part of its range below it.
+        total += upper <= micros ? static_cast<double>(buckets[i])
+                                 : static_cast<double>(buckets[i]) * (micros - lower + 1) / (upper - lower + 1);
+        lower = upper + 1;
+    }
+    return static_cast<std::int64_t>(std::llround(total));
+}
+
+Metrics& Metrics::instance() {
+    static Metrics registry;
+    return registry;
+}
+
+template <typename T>
+T& Metrics::lookup(std::map<std::string, Family<T>>& families, const std::string& name, const MetricLabels& labels) {
+    std::unique_ptr<T>& series = families[name][labels];
+    if (!series) series = std::make_unique<T>();
+    return *series;
+}
+
+template <typename T>
+Metrics::Series<T> Metrics::list(const std::map<std::string, Family<T>>& families, const std::string& name) {
+    Series<T> series;
+    auto family = families.find(name);
+    if (family == families.end()) return series;
+    for (const auto& [labels, value] : family->second) {
+        series.emplace_back(labels, value.get());
+    }
+    return series;
+}
+
+Counter& Metrics::counter(const std::string& name, const MetricLabels& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return lookup(m_counters, name, labels);
+}
+
+Gauge& Metrics::gauge(const std::string& name, const MetricLabels& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return lookup(m_gauges, name, labels);
+}
+
+Histogram& Metrics::histogram(const std::string& name, const MetricLabels& labels) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return lookup(m_histograms, name, labels);
+}
+
+Metrics::Series<Counter> Metrics::counters(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return list(m_counters, name);
+}
+
+Metrics::Series<Gauge> Metrics::gauges(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return list(m_gauges, name);
+}
+
+Metrics::Series<Histogram> Metrics::histograms(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return list(m_histograms, name);
+}
+
+std::string Metrics::prometheus() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    std::ostringstream out;
+    out.precision(9);
+    for (const auto& [name, family] : m_counters) {
+        header(out, name, "counter");
+        for (const auto& [labels, counter] : family) {
+            out << name << labelText(labels) << " " << counter->value() << "\n";
+        }
+    }
+    for (const auto& [name, family] : m_gauges) {
+        header(out, name, "gauge");
+        for (const auto& [labels, gauge] : family) {
+            out << name << labelText(labels) << " " << gauge->value() << "\n";
+        }
+    }
+    for (const auto& [name, family] : m_histograms) {
+        header(out, name, "histogram");
+        for (const auto& [labels, histogram] : family) {
+            const Histogram::Snapshot snap = histogram->snapshot();
+            for (double bound : kExportBounds) {
+                std::ostringstream le;
+                le << "le=\"" << bound << "\"";
+                out << name << "_bucket" << labelText(labels, le.str()) << " " << snap.countAtMost(bound) << "\n";
+            }
+            out << name << "_bucket" << labelText(labels, "le=\"+Inf\"") << " " << snap.count << "\n"
+                << name << "_sum" << labelText(labels) << " " << snap.sum << "\n"
+                << name << "_count" << labelText(labels) << " " << snap.count << "\n";
+        }
+    }
+    return out.str();
+}
@@ -0,0 +1,132 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Label set of one series, e.g. {{"account", "a@gmail.com"}, {"direction", "up"}}.
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;
+
+// A monotonically increasing count. Updates are a single relaxed atomic add.
+class Counter {
+public:
+    void add(std::int64_t n = 1) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    std::int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<std::int64_t> m_value{0};
+};
+
+// A value that goes up and down, such as a queue depth.
+class Gauge {
+public:
+    void add(std::int64_t n) { m_value.fetch_add(n, std::memory_order_relaxed); }
+    void set(std::int64_t n) { m_value.store(n, std::memory_order_relaxed); }
+    std::int64_t value() const { return m_value.load(std::memory_order_relaxed); }
+
+    // Adds `n` for the lifetime of the scope, e.g. one in-flight transfer or
+    // the bytes of a buffer.
+    class Scope {
+    public:
+        Scope(Gauge& gauge, std::int64_t n = 1) : m_gauge(gauge), m_n(n) { m_gauge.add(m_n); }
+        ~Scope() { m_gauge.add(-m_n); }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Gauge& m_gauge;
+        std::int64_t m_n;
+    };
+
+private:
+    std::atomic<std::int64_t> m_value{0};
+};
+
+// Latency distribution in the layout of an HDR histogram: values are kept in
+// microseconds, exactly below 32 and otherwise in 16 linear sub-buckets per
+// power of two, so any quantile is within about 6% of the true value from a
+// microsecond up to days. Recording is a few relaxed atomic adds; there are
+// no locks and no allocation.
+class Histogram {
+public:
+    static constexpr int kSubBuckets = 16;
+    static constexpr int kMaxShift = 40;   // 2^45 us, about a year
+    static constexpr int kBuckets = 2 * kSubBuckets + kMaxShift * kSubBuckets;
+
+    void record(double seconds);
+
+    struct Snapshot {
+        std::int64_t count = 0;
+        double sum = 0;   // seconds
+        double max = 0;   // seconds
+        std::vector<std::int64_t> buckets;
+
+        // Upper bound of the bucket holding quantile `q` (0..1), in seconds.
+        double quantile(double q) const;
+        // Observations of at most `seconds`, for cumulative buckets.
+        std::int64_t countAtMost(double seconds) const;
+        // Adds another series' observations, e.g. to total over accounts.
+        void merge(const Snapshot& other);
+    };
+    Snapshot snapshot() const;
+
+    static int bucketOf(std::uint64_t micros);
+    static std::uint64_t bucketUpperBound(int bucket);   // inclusive, in microseconds
+
+private:
+    std::array<std::atomic<std::int64_t>, kBuckets> m_buckets{};
+    std::atomic<std::int64_t> m_sum_micros{0};
+    std::atomic<std::int64_t> m_max_micros{0};
+};
+
+// Process-wide registry of named metric families. Looking a series up takes a
+// lock; the returned reference stays valid for the life of the process, so
+// hot paths look up once and then update without locking.
+//
+// Families are named and described in metrics.cpp, which is also the list of
+// everything exported.
+class Metrics {
+public:
+    static Metrics& instance();
+
+    Counter& counter(const std::string& name, const MetricLabels& labels = {});
+    Gauge& gauge(const std::string& name, const MetricLabels& labels = {});
+    Histogram& histogram(const std::string& name, const MetricLabels& labels = {});
+
+    // Every series of a family, in label order.
+    template <typename T>
+    using Series = std::vector<std::pair<MetricLabels, const T*>>;
+    Series<Counter> counters(const std::string& name) const;
+    Series<Gauge> gauges(const std::string& name) const;
+    Series<Histogram> histograms(const std::string& name) const;
+
+    // All families in the Prometheus text exposition format (version 0.0.4).
+    std::string prometheus() const;
+
+private:
+    Metrics() = default;
+
+    template <typename T>
+    using Family = std::map<MetricLabels, std::unique_ptr<T>>;
+
+    template <typename T>
+    static T& lookup(std::map<std::string, Family<T>>& families, const std::string& name, const MetricLabels& labels);
+    template <typename T>
+    static Series<T> list(const std::map<std::string, Family<T>>& families, const std::string& name);
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, Family<Counter>> m_counters;
+    std::map<std::string, Family<Gauge>> m_gauges;
+    std::map<std::string, Family<Histogram>> m_histograms;
+};
+
+inline Metrics& metrics() { return Metrics::instance(); }
+
+#endif // METRICS_H
@@ -0,0 +1,34 @@
+#include "metrics_server.h"
+#include <exception>
+#include <utility>
+
+MetricsServer::MetricsServer(Render render) : m_render(std::move(render)) {
+    m_server.new_task_queue = [] { return new httplib::ThreadPool(2); };
+    m_server.Get("/metrics", [this](const httplib::Request&, httplib::Response& res) {
+        try {
+            res.set_content(m_render(), "text/plain; version=0.0.4");
+        } catch (const std::exception& e) {
+            res.status = 500;
+            res.set_content(std::string(e.what()) + "\n", "text/plain");
+        }
+    });
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+bool MetricsServer::start(const std::string& host, int port) {
+    if (m_thread.joinable() || !m_server.bind_to_port(host, port)) {
+        return false;
+    }
+    m_thread = std::thread([this] { m_server.listen_after_bind(); });
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (m_thread.joinable()) {
+        m_server.stop();
+        m_thread.join();
+    }
+}
@@ -0,0 +1,34 @@
+#ifndef METRICS_SERVER_H
+#define METRICS_SERVER_H
+
+#include <functional>
+#include <string>
+#include <thread>
+#include <httplib.h>
+
+// Serves GET /metrics in the Prometheus text format from a background
+// thread, so a scraper (or curl) can watch a transfer while the command
+// running it holds the foreground.
+class MetricsServer {
+public:
+    // Produces the response body; called on a server thread per request.
+    using Render = std::function<std::string()>;
+
+    explicit MetricsServer(Render render);
+    ~MetricsServer();   // stops serving
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // Binds the address and starts serving. Returns false if it cannot be
+    // bound.
+    bool start(const std::string& host, int port);
+    void stop();
+
+private:
+    Render m_render;
+    httplib::Server m_server;
+    std::thread m_thread;
+};
+
+#endif // METRICS_SERVER_H
@@ -0,0 +1,87 @@
+#include "ordered_fetch.h"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+void fetchInOrder(std::size_t count, std::size_t workers, std::size_t window,
+                  const std::function<std::string(std::size_t index)>& fetch,
+                  const std::function<void(std::string&& piece)>& emit) {
+    window = std::max<std::size_t>(window, 1);
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<std::size_t, std::string> ready;   // fetched, waiting for their turn
+    std::size_t next_fetch = 0;
+    std::size_t emitted = 0;
+    std::exception_ptr error;
+
+    auto worker = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [&] { return error || next_fetch >= count || next_fetch < emitted + window; });
+            if (error || next_fetch >= count) {
+                return;
+            }
+            const std::size_t index = next_fetch++;
+            lock.unlock();
+
+            std::string piece;
+            std::exception_ptr failure;
+            try {
+                piece = fetch(index);
+            } catch (...) {
+                failure = std::current_exception();
+            }
+
+            lock.lock();
+            if (failure) {
+                if (!error) error = failure;
+            } else {
+                ready.emplace(index, std::move(piece));
+            }
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < std::min(std::max<std::size_t>(workers, 1), count); ++i) {
+        threads.emplace_back(worker);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (emitted < count) {
+            cv.wait(lock, [&] { return error || ready.count(emitted) > 0; });
+            if (error) {
+                break;
+            }
+            auto node = ready.extract(emitted);
+            lock.unlock();
+            std::exception_ptr failure;
+            try {
+                emit(std::move(node.mapped()));
+            } catch (...) {
+                failure = std::current_exception();
+            }
+            lock.lock();
+            if (failure) {
+                if (!error) error = failure;
+                cv.notify_all();
+                break;
+            }
+            ++emitted;
+            cv.notify_all();
+        }
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
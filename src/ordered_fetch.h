@@ -0,0 +1,19 @@
+#ifndef ORDERED_FETCH_H
+#define ORDERED_FETCH_H
+
+#include <cstddef>
+#include <functional>
+#include <string>
+
+// Fetches pieces 0..count-1 on up to `workers` threads and passes them to
+// `emit`, on the calling thread, strictly in index order. Workers always take
+// the lowest piece not yet started, and piece i is not started until piece
+// i - window has been emitted, so at most `window` pieces are in flight or
+// waiting at any time: a slow `emit` stalls the fetches instead of growing
+// the buffer. The first exception from `fetch` or `emit` stops the remaining
+// work and is rethrown once all workers have finished.
+void fetchInOrder(std::size_t count, std::size_t workers, std::size_t window,
+                  const std::function<std::string(std::size_t index)>& fetch,
+                  const std::function<void(std::string&& piece)>& emit);
+
+#endif // ORDERED_FETCH_H
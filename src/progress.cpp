@@ -0,0 +1,223 @@
+#include "progress.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include "DDConfig.h"
+
+#if defined(_WIN32)
+#include <io.h>
+#include <windows.h>
+#else
+#include <sys/ioctl.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr int kBarWidth = 30;
+
+    std::atomic<int> g_columns{-1};   // see setTerminalColumns
+
+    bool stderrIsTerminal() {
+        const int columns = g_columns.load();
+        if (columns >= 0) return columns > 0;
+#if defined(_WIN32)
+        return _isatty(_fileno(stderr)) != 0;
+#else
+        return isatty(STDERR_FILENO) != 0;
+#endif
+    }
+
+    // Lines longer than the terminal wrap, and "\r" then no longer returns
+    // to their start.
+    std::size_t terminalWidth() {
+        const int columns = g_columns.load();
+        if (columns > 0) return static_cast<std::size_t>(columns);
+#if defined(_WIN32)
+        CONSOLE_SCREEN_BUFFER_INFO info;
+        if (GetConsoleScreenBufferInfo(GetStdHandle(STD_ERROR_HANDLE), &info)) {
+            return static_cast<std::size_t>(info.srWindow.Right - info.srWindow.Left + 1);
+        }
+#else
+        winsize size{};
+        if (ioctl(STDERR_FILENO, TIOCGWINSZ, &size) == 0 && size.ws_col > 0) {
+            return size.ws_col;
+        }
+#endif
+        return 100;
+    }
+
+    // The local part of an e-mail address; other account names as they are.
+    std::string shortName(const std::string& account) {
+        return account.substr(0, account.find('@'));
+    }
+
+    std::string duration(double seconds) {
+        const long long s = static_cast<long long>(seconds + 0.5);
+        std::ostringstream out;
+        out << s / 60 << ":" << std::setw(2) << std::setfill('0') << s % 60;
+        return out.str();
+    }
+}
+
+ProgressDisplay::ProgressDisplay(std::string title, const std::vector<std::string>& accounts, std::int64_t total,
+                                 Unit unit, std::int64_t items, std::string item_name)
+    : m_title(std::move(title)),
+      m_accounts(accounts),
+      m_total(total),
+      m_unit(unit),
+      m_items(items),
+      m_item_name(std::move(item_name)),
+      m_terminal(stderrIsTerminal()),
+      m_start(std::chrono::steady_clock::now()) {
+    std::sort(m_accounts.begin(), m_accounts.end());
+    m_accounts.erase(std::unique(m_accounts.begin(), m_accounts.end()), m_accounts.end());
+    m_slots = std::make_unique<Slot[]>(m_accounts.size() + 1);
+    if (m_terminal) {
+        m_renderer = std::thread([this] { run(); });
+    }
+}
+
+ProgressDisplay::~ProgressDisplay() {
+    stop();
+    // Whatever is printed next, such as an error, starts on its own line.
+    if (!m_finished && m_drawn > 0) {
+        std::cerr << std::endl;
+    }
+}
+
+void ProgressDisplay::setTerminalColumns(int columns) {
+    g_columns = columns;
+}
+
+void ProgressDisplay::add(const std::string& account, std::int64_t n) {
+    auto it = std::lower_bound(m_accounts.begin(), m_accounts.end(), account);
+    const std::size_t slot = it != m_accounts.end() && *it == account ? static_cast<std::size_t>(it - m_accounts.begin())
+                                                                      : m_accounts.size();
+    m_slots[slot].value.fetch_add(n, std::memory_order_relaxed);
+}
+
+void ProgressDisplay::finish(const std::string& status) {
+    stop();
+    if (m_finished) return;
+    m_finished = true;
+    draw(sample(), true, status);
+}
+
+void ProgressDisplay::stop() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    if (m_renderer.joinable()) {
+        m_renderer.join();
+    }
+}
+
+void ProgressDisplay::run() {
+    const auto period = std::chrono::milliseconds(1000 / dd::PROGRESS_REFRESH_HZ);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_wake.wait_for(lock, period, [this] { return m_stopping; })) {
+        lock.unlock();
+        Sample now = sample();
+        // Keep the newest sample at least a window old as the base of the rates.
+        while (m_history.size() > 1 && now.at - m_history[1].at >= dd::PROGRESS_RATE_WINDOW) {
+            m_history.pop_front();
+        }
+        m_history.push_back(now);
+        draw(now, false, {});
+        lock.lock();
+    }
+}
+
+ProgressDisplay::Sample ProgressDisplay::sample() const {
+    Sample s{std::chrono::steady_clock::now(), std::vector<std::int64_t>(m_accounts.size() + 1)};
+    for (std::size_t i = 0; i < s.values.size(); ++i) {
+        s.values[i] = m_slots[i].value.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+std::string ProgressDisplay::amount(double n) const {
+    std::ostringstream out;
+    out << std::fixed;
+    if (m_unit == Unit::Bytes) {
+        out << std::setprecision(1) << n / (1024.0 * 1024.0);
+    } else {
+        out << std::setprecision(0) << n;
+    }
+    return out.str();
+}
+
+// One line: title, bar, amount done, overall rate and time left, items done,
+// then the rate of each account busy in the window. The final line has the
+// average rate and elapsed time instead, and the status.
+void ProgressDisplay::draw(const Sample& now, bool final, const std::string& status) {
+    const char* unit = m_unit == Unit::Bytes ? "MB" : "objects";
+    std::int64_t done = 0;
+    for (std::int64_t value : now.values) done += value;
+    done = std::max<std::int64_t>(done, 0);
+    if (m_total > 0) done = std::min(done, m_total);
+
+    std::ostringstream line;
+    line << m_title;
+    if (m_total > 0) {
+        const int filled = static_cast<int>(kBarWidth * done / m_total);
+        line << " [" << std::string(static_cast<size_t>(filled), '=') << (filled < kBarWidth ? ">" : "")
+             << std::string(static_cast<size_t>(std::max(0, kBarWidth - filled - 1)), ' ') << "] " << std::setw(3)
+             << 100 * done / m_total << "%  " << amount(static_cast<double>(done)) << "/"
+             << amount(static_cast<double>(m_total)) << " " << unit;
+    } else {
+        line << "  " << amount(static_cast<double>(done)) << " " << unit;
+    }
+
+    const double elapsed = std::chrono::duration<double>(now.at - m_start).count();
+    std::vector<double> rates(now.values.size(), 0.0);
+    double rate = 0;
+    if (final) {
+        rate = elapsed > 0 ? static_cast<double>(done) / elapsed : 0;
+    } else if (!m_history.empty()) {
+        const Sample& base = m_history.front();
+        const double window = std::chrono::duration<double>(now.at - base.at).count();
+        for (std::size_t i = 0; window > 0 && i < rates.size(); ++i) {
+            rates[i] = static_cast<double>(now.values[i] - base.values[i]) / window;
+            rate += rates[i];
+        }
+    }
+    line << "  " << amount(std::max(rate, 0.0)) << " " << unit << "/s";
+    if (final) {
+        line << " in " << duration(elapsed);
+    } else if (m_total > 0 && rate > 0) {
+        line << "  ETA " << duration(static_cast<double>(m_total - done) / rate);
+    }
+    if (m_items > 0) {
+        line << "  " << m_items_done.load(std::memory_order_relaxed) << "/" << m_items << " " << m_item_name;
+    }
+    if (!final) {
+        const char* separator = "  | ";
+        for (std::size_t i = 0; i < m_accounts.size(); ++i) {
+            if (rates[i] <= 0) continue;
+            line << separator << shortName(m_accounts[i]) << " " << amount(rates[i]);
+            separator = ", ";
+        }
+        if (separator[0] == ',') line << " " << unit << "/s";
+    } else if (!status.empty()) {
+        line << "  " << status;
+    }
+
+    std::string text = line.str();
+    if (!m_terminal) {
+        std::cerr << text << std::endl;
+        return;
+    }
+    text.resize(std::min(text.size(), terminalWidth() - 1));
+    // Blank out the rest of a longer previous line rather than relying on
+    // an erase-line escape the console may not support.
+    const std::size_t drawn = text.size();
+    if (drawn < m_drawn) text.append(m_drawn - drawn, ' ');
+    m_drawn = drawn;
+    std::cerr << "\r" << text << (final ? "\n" : "") << std::flush;
+}
@@ -0,0 +1,90 @@
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Live progress of one command, drawn on stderr by a renderer thread of its
+// own. Transfer threads only add to a per-account atomic counter (each on its
+// own cache line); PROGRESS_REFRESH_HZ times a second the renderer sums the
+// counters and draws one line with the overall and per-account rates over the
+// last PROGRESS_RATE_WINDOW. Nothing on the transfer path locks, formats or
+// writes to the terminal. When stderr is not a terminal only the final line
+// is written.
+class ProgressDisplay {
+public:
+    enum class Unit { Bytes, Objects };
+
+    // `total` is the work in `unit`s, or 0 if unknown (a stream). `items`,
+    // if non-zero, is a count of whole pieces of work such as files, shown as
+    // "3/10 files" and advanced with itemDone().
+    ProgressDisplay(std::string title, const std::vector<std::string>& accounts, std::int64_t total,
+                    Unit unit = Unit::Bytes, std::int64_t items = 0, std::string item_name = {});
+    ~ProgressDisplay();   // stops the renderer if finish() was not called
+
+    ProgressDisplay(const ProgressDisplay&) = delete;
+    ProgressDisplay& operator=(const ProgressDisplay&) = delete;
+
+    // Work done against `account`; a negative `n` takes back the progress of
+    // a failed transfer. Work of any other account name (such as cache hits)
+    // counts towards the total but has no rate of its own.
+    void add(const std::string& account, std::int64_t n);
+    void itemDone() { m_items_done.fetch_add(1, std::memory_order_relaxed); }
+
+    // Stops the renderer and draws the final line, ending with `status`.
+    void finish(const std::string& status);
+
+    // Where displays created from now on draw when stderr is not this
+    // process's own, as for a command run by the daemon: the width of the
+    // client's terminal, 0 if it is not a terminal, or -1 to go back to
+    // looking at stderr.
+    static void setTerminalColumns(int columns);
+
+private:
+    // Padded so that accounts updated from different threads never share a
+    // cache line.
+    struct alignas(64) Slot {
+        std::atomic<std::int64_t> value{0};
+    };
+    struct Sample {
+        std::chrono::steady_clock::time_point at;
+        std::vector<std::int64_t> values;   // per slot
+    };
+
+    void run();
+    void stop();
+    Sample sample() const;
+    void draw(const Sample& now, bool final, const std::string& status);
+    std::string amount(double n) const;
+
+    const std::string m_title;
+    std::vector<std::string> m_accounts;   // sorted; slot i, plus one last slot for other work
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<std::int64_t> m_items_done{0};
+    const std::int64_t m_total;
+    const Unit m_unit;
+    const std::int64_t m_items;
+    const std::string m_item_name;
+    const bool m_terminal;
+    const std::chrono::steady_clock::time_point m_start;
+
+    // Renderer only.
+    std::deque<Sample> m_history;   // samples covering the rate window
+    std::size_t m_drawn = 0;        // length of the line on screen
+
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    bool m_stopping = false;
+    bool m_finished = false;
+    std::thread m_renderer;
+};
+
+#endif // PROGRESS_H
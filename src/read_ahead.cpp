@@ -0,0 +1,145 @@
+#include "read_ahead.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+ReadAheadStream::ReadAheadStream(std::int64_t size, Fetch fetch, std::int64_t block_bytes, std::int64_t window_bytes,
+                                 std::shared_ptr<PrefetchBudget> budget)
+    : m_size(size), m_fetch(std::move(fetch)), m_block_bytes(std::max<std::int64_t>(block_bytes, 1)),
+      m_window_bytes(std::max<std::int64_t>(window_bytes, 0)), m_budget(std::move(budget)) {}
+
+ReadAheadStream::~ReadAheadStream() {
+    while (!m_blocks.empty()) {
+        cancel(m_blocks.begin());
+    }
+    // Futures from std::async wait for their task when destroyed.
+    m_cancelled.clear();
+}
+
+std::int64_t ReadAheadStream::blockLength(std::int64_t index) const {
+    return std::min(m_block_bytes, m_size - blockStart(index));
+}
+
+void ReadAheadStream::launch(std::int64_t index) {
+    Block& block = m_blocks[index];
+    block.cancel = std::make_shared<std::atomic<bool>>(false);
+    block.pending = std::async(std::launch::async,
+                               [fetch = m_fetch, offset = blockStart(index), length = blockLength(index),
+                                cancel = block.cancel] { return fetch(offset, length, cancel.get()); });
+}
+
+void ReadAheadStream::cancel(std::map<std::int64_t, Block>::iterator it) {
+    Block& block = it->second;
+    if (!block.ready && !block.failed) {
+        block.cancel->store(true);
+        m_cancelled.push_back(std::move(block.pending));
+    }
+    if (!block.failed && !block.touched) {
+        m_wasted += blockLength(it->first);
+    }
+    erase(it);
+}
+
+void ReadAheadStream::erase(std::map<std::int64_t, Block>::iterator it) {
+    if (it->second.charged) {
+        m_budget->give(blockLength(it->first));
+    }
+    m_blocks.erase(it);
+}
+
+ReadAheadStream::Block* ReadAheadStream::await(std::int64_t index) {
+    Block& block = m_blocks.at(index);
+    if (!block.ready && !block.failed) {
+        try {
+            block.data = block.pending.get();
+            block.ready = static_cast<std::int64_t>(block.data.size()) == blockLength(index);
+            block.failed = !block.ready;
+        } catch (const std::exception&) {
+            block.failed = true;
+        }
+    }
+    return &block;
+}
+
+void ReadAheadStream::prefetchFrom(std::int64_t offset) {
+    if (m_window_bytes == 0 || offset >= m_size) return;
+    const std::int64_t first = offset / m_block_bytes;
+    const std::int64_t last = (std::min(offset + m_window_bytes, m_size) - 1) / m_block_bytes;
+    for (std::int64_t index = first; index <= last; ++index) {
+        if (m_blocks.find(index) == m_blocks.end()) {
+            if (m_budget && !m_budget->tryTake(blockLength(index))) return;
+            launch(index);
+            m_blocks[index].charged = m_budget != nullptr;
+        }
+    }
+}
+
+std::string ReadAheadStream::read(std::int64_t offset, std::int64_t length) {
+    if (offset < 0 || length < 0) {
+        throw std::runtime_error("Invalid read range");
+    }
+    offset = std::min(offset, m_size);
+    length = std::min(length, m_size - offset);
+    const std::int64_t end = offset + length;
+    const bool sequential = offset == m_next_offset;
+    m_next_offset = end;
+
+    // Prefetches cancelled earlier are released once they have wound down.
+    m_cancelled.erase(std::remove_if(m_cancelled.begin(), m_cancelled.end(),
+                                     [](const std::future<std::string>& f) {
+                                         return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+                                     }),
+                      m_cancelled.end());
+
+    // A jump means the prefetched blocks are probably not going to be read.
+    if (!sequential) {
+        for (auto it = m_blocks.begin(); it != m_blocks.end();) {
+            auto current = it++;
+            const std::int64_t start = blockStart(current->first);
+            if (start >= end || start + blockLength(current->first) <= offset) {
+                cancel(current);
+            }
+        }
+    }
+
+    std::string out;
+    out.reserve(static_cast<std::size_t>(length));
+    for (std::int64_t pos = offset; pos < end;) {
+        const std::int64_t index = pos / m_block_bytes;
+        if (sequential && m_blocks.find(index) == m_blocks.end()) {
+            launch(index);
+        }
+        if (m_blocks.count(index) > 0) {
+            Block* block = await(index);
+            if (!block->failed) {
+                const std::int64_t within = pos - blockStart(index);
+                const std::int64_t take = std::min(end, blockStart(index) + blockLength(index)) - pos;
+                out.append(block->data, static_cast<std::size_t>(within), static_cast<std::size_t>(take));
+                block->touched = true;
+                m_used += take;
+                pos += take;
+                continue;
+            }
+            erase(m_blocks.find(index));
+        }
+        // Not prefetched (or the prefetch failed): fetch directly, up to the
+        // next block that is.
+        std::int64_t stop = end;
+        auto next = m_blocks.upper_bound(index);
+        if (next != m_blocks.end()) {
+            stop = std::min(stop, std::max(pos, blockStart(next->first)));
+        }
+        out += m_fetch(pos, stop - pos, nullptr);
+        pos = stop;
+    }
+
+    // Blocks wholly behind the reader are done with.
+    while (!m_blocks.empty() && blockStart(m_blocks.begin()->first) + blockLength(m_blocks.begin()->first) <= end) {
+        cancel(m_blocks.begin());
+    }
+    if (sequential) {
+        prefetchFrom(end);
+    }
+    return out;
+}
@@ -0,0 +1,101 @@
+#ifndef READ_AHEAD_H
+#define READ_AHEAD_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Bytes that several streams together may hold in prefetched blocks. A
+// prefetch that does not fit is skipped rather than waited for; the reader
+// fetches that block itself when it gets there.
+class PrefetchBudget {
+public:
+    explicit PrefetchBudget(std::int64_t bytes) : m_available(bytes) {}
+
+    bool tryTake(std::int64_t bytes) {
+        std::int64_t available = m_available.load();
+        while (available >= bytes) {
+            if (m_available.compare_exchange_weak(available, available - bytes)) return true;
+        }
+        return false;
+    }
+    void give(std::int64_t bytes) { m_available.fetch_add(bytes); }
+
+private:
+    std::atomic<std::int64_t> m_available;
+};
+
+// Reader for one open stream over a stored file that detects sequential
+// access and fetches ahead of the consumer.
+//
+// The file is viewed as blocks of `block_bytes`. As long as each read starts
+// where the previous one ended, the blocks covering the next `window_bytes`
+// are fetched in the background, several at a time, so the consumer finds
+// its data already local instead of waiting a round trip per request. When a
+// read jumps elsewhere the stream counts as random again: prefetches outside
+// the new position are cancelled and reads fetch exactly what they ask for.
+// Memory is bounded by the window plus the read in progress, and the blocks
+// prefetched by every stream sharing a PrefetchBudget by that budget.
+//
+// One consumer per stream: read() must not be called concurrently.
+class ReadAheadStream {
+public:
+    // Fetches [offset, offset + length) of the file; should give up early
+    // (by throwing) once `*cancel` becomes true.
+    using Fetch = std::function<std::string(std::int64_t offset, std::int64_t length, const std::atomic<bool>* cancel)>;
+
+    ReadAheadStream(std::int64_t size, Fetch fetch, std::int64_t block_bytes, std::int64_t window_bytes,
+                    std::shared_ptr<PrefetchBudget> budget = nullptr);
+    ~ReadAheadStream();   // cancels prefetches and waits for them
+
+    ReadAheadStream(const ReadAheadStream&) = delete;
+    ReadAheadStream& operator=(const ReadAheadStream&) = delete;
+
+    std::int64_t size() const { return m_size; }
+
+    // Returns bytes [offset, offset + length), clipped to the end of the file.
+    std::string read(std::int64_t offset, std::int64_t length);
+
+    // Bytes served from prefetched blocks, and bytes prefetched but dropped
+    // unread because the access pattern changed.
+    std::int64_t prefetchedBytesUsed() const { return m_used; }
+    std::int64_t prefetchedBytesWasted() const { return m_wasted; }
+
+private:
+    struct Block {
+        std::shared_ptr<std::atomic<bool>> cancel;
+        std::future<std::string> pending;
+        std::string data;
+        bool ready = false;
+        bool failed = false;
+        bool touched = false;   // at least partly read by the consumer
+        bool charged = false;   // counted against the budget
+    };
+
+    std::int64_t blockStart(std::int64_t index) const { return index * m_block_bytes; }
+    std::int64_t blockLength(std::int64_t index) const;
+    void launch(std::int64_t index);
+    void cancel(std::map<std::int64_t, Block>::iterator it);
+    void erase(std::map<std::int64_t, Block>::iterator it);
+    Block* await(std::int64_t index);
+    void prefetchFrom(std::int64_t offset);
+
+    std::int64_t m_size;
+    Fetch m_fetch;
+    std::int64_t m_block_bytes;
+    std::int64_t m_window_bytes;
+    std::shared_ptr<PrefetchBudget> m_budget;
+
+    std::map<std::int64_t, Block> m_blocks;              // by block index
+    std::vector<std::future<std::string>> m_cancelled;   // still winding down
+    std::int64_t m_next_offset = -1;                     // where a sequential read would start
+    std::int64_t m_used = 0;
+    std::int64_t m_wasted = 0;
+};
+
+#endif // READ_AHEAD_H
@@ -0,0 +1,593 @@
+#include "s3_gateway.h"
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include "DDConfig.h"
+
+namespace {
+    const char* kXmlHeader = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n";
+    const char* kNamespace = "http://s3.amazonaws.com/doc/2006-03-01/";
+    // The catalog keeps no modification times.
+    const char* kLastModified = "1970-01-01T00:00:00.000Z";
+
+    std::string xmlEscape(const std::string& text) {
+        std::string out;
+        out.reserve(text.size());
+        for (char c : text) {
+            switch (c) {
+                case '&': out += "&amp;"; break;
+                case '<': out += "&lt;"; break;
+                case '>': out += "&gt;"; break;
+                case '"': out += "&quot;"; break;
+                case '\'': out += "&apos;"; break;
+                default: out += c;
+            }
+        }
+        return out;
+    }
+
+    std::string xmlUnescape(const std::string& text) {
+        static const std::pair<const char*, char> entities[] = {
+            {"&amp;", '&'}, {"&lt;", '<'}, {"&gt;", '>'}, {"&quot;", '"'}, {"&apos;", '\''},
+        };
+        std::string out;
+        for (std::size_t i = 0; i < text.size();) {
+            bool replaced = false;
+            for (const auto& [entity, c] : entities) {
+                if (text.compare(i, std::char_traits<char>::length(entity), entity) == 0) {
+                    out += c;
+                    i += std::char_traits<char>::length(entity);
+                    replaced = true;
+                    break;
+                }
+            }
+            if (!replaced) out += text[i++];
+        }
+        return out;
+    }
+
+    // The contents of every <tag>...</tag> in `xml`, in order. Request bodies
+    // here are flat enough that this is all the parsing they need.
+    std::vector<std::string> elements(const std::string& xml, const std::string& tag) {
+        std::vector<std::string> found;
+        const std::string open = "<" + tag + ">";
+        const std::string close = "</" + tag + ">";
+        for (std::size_t pos = xml.find(open); pos != std::string::npos; pos = xml.find(open, pos)) {
+            const std::size_t start = pos + open.size();
+            const std::size_t end = xml.find(close, start);
+            if (end == std::string::npos) break;
+            found.push_back(xml.substr(start, end - start));
+            pos = end + close.size();
+        }
+        return found;
+    }
+
+    std::string element(const std::string& xml, const std::string& tag) {
+        std::vector<std::string> found = elements(xml, tag);
+        return found.empty() ? std::string() : xmlUnescape(found.front());
+    }
+
+    void sendError(httplib::Response& res, int status, const std::string& code, const std::string& message) {
+        res.status = status;
+        res.set_content(std::string(kXmlHeader) + "<Error><Code>" + code + "</Code><Message>" + xmlEscape(message) +
+                            "</Message></Error>",
+                        "application/xml");
+    }
+
+    // Objects are immutable once stored, so their Drive ids identify the
+    // content. Deliberately not 32 hex digits, so that clients do not take it
+    // for an MD5 of the data.
+    std::string etagOf(const std::vector<ChunkEntry>& chunks) {
+        std::uint64_t hash = 14695981039346656037ull;
+        for (const auto& chunk : chunks) {
+            for (char c : packId(chunk) + '/') {
+                hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+            }
+        }
+        char hex[17];
+        std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(hash));
+        return "\"" + std::string(hex) + "\"";
+    }
+
+    std::string unquote(std::string etag) {
+        etag = xmlUnescape(etag);
+        etag.erase(std::remove(etag.begin(), etag.end(), '"'), etag.end());
+        return etag;
+    }
+
+    std::string newUploadId() {
+        static std::mutex mutex;
+        static std::mt19937_64 random(std::random_device{}());
+        std::lock_guard<std::mutex> lock(mutex);
+        char id[33];
+        std::snprintf(id, sizeof(id), "%016llx%016llx", static_cast<unsigned long long>(random()),
+                      static_cast<unsigned long long>(random()));
+        return id;
+    }
+
+    // Handlers answer failures in S3's XML error format.
+    httplib::Server::Handler guarded(httplib::Server::Handler handler) {
+        return [handler](const httplib::Request& req, httplib::Response& res) {
+            try {
+                handler(req, res);
+            } catch (const std::exception& e) {
+                sendError(res, 500, "InternalError", e.what());
+            }
+        };
+    }
+
+    httplib::Server::HandlerWithContentReader guarded(httplib::Server::HandlerWithContentReader handler) {
+        return [handler](const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+            try {
+                handler(req, res, reader);
+            } catch (const std::exception& e) {
+                sendError(res, 500, "InternalError", e.what());
+            }
+        };
+    }
+
+    // Decodes an aws-chunked body as it streams in:
+    //   <hex size>[;chunk-signature=...]\r\n<data>\r\n ... 0[;...]\r\n[trailers]\r\n
+    // Chunk signatures and trailing checksums are not verified.
+    class AwsChunkedDecoder {
+    public:
+        explicit AwsChunkedDecoder(const S3Gateway::Sink& sink) : m_sink(sink) {}
+
+        bool feed(const char* data, std::size_t size) {
+            while (size > 0 && m_state != State::Done) {
+                if (m_state == State::Data) {
+                    const std::size_t take = static_cast<std::size_t>(std::min<std::uint64_t>(m_remaining, size));
+                    if (!m_sink(data, take)) return false;
+                    data += take;
+                    size -= take;
+                    m_remaining -= take;
+                    if (m_remaining == 0) m_state = State::DataEnd;
+                    continue;
+                }
+                m_line += *data++;
+                --size;
+                if (m_line.size() > 4096) return false;
+                if (m_line.size() < 2 || m_line.compare(m_line.size() - 2, 2, "\r\n") != 0) continue;
+                const std::string line = m_line.substr(0, m_line.size() - 2);
+                m_line.clear();
+                if (m_state == State::DataEnd) {
+                    if (!line.empty()) return false;
+                    m_state = State::Header;
+                } else if (m_state == State::Header) {
+                    try {
+                        m_remaining = std::stoull(line.substr(0, line.find(';')), nullptr, 16);
+                    } catch (const std::exception&) {
+                        return false;
+                    }
+                    m_state = m_remaining > 0 ? State::Data : State::Trailer;
+                } else if (line.empty()) {   // end of the trailers
+                    m_state = State::Done;
+                }
+            }
+            return true;
+        }
+
+        bool done() const { return m_state == State::Done || m_state == State::Trailer; }
+
+    private:
+        enum class State { Header, Data, DataEnd, Trailer, Done };
+        const S3Gateway::Sink& m_sink;
+        State m_state = State::Header;
+        std::uint64_t m_remaining = 0;
+        std::string m_line;
+    };
+}
+
+S3Gateway::S3Gateway(Backend backend) : m_backend(std::move(backend)) {
+    m_server.new_task_queue = [] { return new httplib::ThreadPool(dd::SERVE_THREADS); };
+
+    auto objectPath = [](const httplib::Request& req) {
+        return normalizePath(req.matches[1].str() + "/" + req.matches[2].str());
+    };
+    const std::string bucket_route = "/([^/]+)/?";
+    const std::string object_route = "/([^/]+)/(.+)";
+
+    m_server.Get("/", guarded([this](const httplib::Request&, httplib::Response& res) { listBuckets(res); }));
+    m_server.Get(bucket_route, guarded([this](const httplib::Request& req, httplib::Response& res) {
+        if (req.has_param("location")) {
+            res.set_content(std::string(kXmlHeader) + "<LocationConstraint xmlns=\"" + kNamespace + "\"/>",
+                            "application/xml");
+            return;
+        }
+        listObjects(req, res, req.matches[1].str());
+    }));
+    // Buckets are directories, which exist as soon as they hold a file.
+    m_server.Head(bucket_route, [](const httplib::Request&, httplib::Response& res) { res.status = 200; });
+    m_server.Put(bucket_route, [](const httplib::Request&, httplib::Response& res) { res.status = 200; });
+    m_server.Delete(bucket_route, guarded([this](const httplib::Request& req, httplib::Response& res) {
+        if (!m_backend.list(req.matches[1].str() + "/").empty()) {
+            sendError(res, 409, "BucketNotEmpty", "The bucket still holds objects");
+            return;
+        }
+        res.status = 204;
+    }));
+    m_server.Post(bucket_route, guarded([this](const httplib::Request& req, httplib::Response& res,
+                                               const httplib::ContentReader& reader) {
+        if (!req.has_param("delete")) {
+            sendError(res, 501, "NotImplemented", "Unsupported bucket operation");
+            return;
+        }
+        deleteObjects(req, res, reader, req.matches[1].str());
+    }));
+
+    m_server.Get(object_route, guarded([this, objectPath](const httplib::Request& req, httplib::Response& res) {
+        getObject(req, res, objectPath(req));
+    }));
+    m_server.Put(object_route, guarded([this, objectPath](const httplib::Request& req, httplib::Response& res,
+                                                          const httplib::ContentReader& reader) {
+        if (req.has_header("x-amz-copy-source")) {
+            sendError(res, 501, "NotImplemented", "CopyObject and UploadPartCopy are not supported");
+        } else if (req.matches[2].str().back() == '/') {
+            // "Folder" markers: directories need no object of their own.
+            reader([](const char*, std::size_t) { return true; });
+            res.set_header("ETag", etagOf({}));
+        } else if (req.has_param("uploadId")) {
+            uploadPart(req, res, reader, objectPath(req));
+        } else {
+            putObject(req, res, reader, objectPath(req));
+        }
+    }));
+    m_server.Post(object_route, guarded([this, objectPath](const httplib::Request& req, httplib::Response& res,
+                                                           const httplib::ContentReader& reader) {
+        if (req.has_param("uploads")) {
+            createUpload(res, req.matches[1].str(), req.matches[2].str(), objectPath(req));
+        } else if (req.has_param("uploadId")) {
+            completeUpload(req, res, reader, req.matches[1].str(), req.matches[2].str(), objectPath(req));
+        } else {
+            sendError(res, 501, "NotImplemented", "Unsupported object operation");
+        }
+    }));
+    m_server.Delete(object_route, guarded([this, objectPath](const httplib::Request& req, httplib::Response& res) {
+        if (req.has_param("uploadId")) {
+            abortUpload(req, res);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(m_commit_mutex);
+        m_backend.remove(objectPath(req));
+        res.status = 204;   // S3 answers the same whether or not the key existed
+    }));
+}
+
+S3Gateway::~S3Gateway() {
+    for (const auto& [id, upload] : m_uploads) {
+        for (const auto& [number, part] : upload.parts) {
+            m_backend.discard(part.chunks);
+        }
+    }
+}
+
+bool S3Gateway::listen(const std::string& host, int port) {
+    return m_server.listen(host, port);
+}
+
+void S3Gateway::stop() {
+    m_server.stop();
+}
+
+void S3Gateway::listBuckets(httplib::Response& res) {
+    std::ostringstream xml;
+    xml << kXmlHeader << "<ListAllMyBucketsResult xmlns=\"" << kNamespace << "\">"
+        << "<Owner><ID>d-drive</ID><DisplayName>d-drive</DisplayName></Owner><Buckets>";
+    for (const auto& bucket : m_backend.buckets()) {
+        xml << "<Bucket><Name>" << xmlEscape(bucket) << "</Name><CreationDate>" << kLastModified
+            << "</CreationDate></Bucket>";
+    }
+    xml << "</Buckets></ListAllMyBucketsResult>";
+    res.set_content(xml.str(), "application/xml");
+}
+
+// ListObjects v1 and v2. Keys are listed in byte order; with a delimiter,
+// keys sharing the next path segment collapse into one common prefix. The
+// continuation token (or marker) is the last key or prefix returned.
+void S3Gateway::listObjects(const httplib::Request& req, httplib::Response& res, const std::string& bucket) {
+    const bool v2 = req.get_param_value("list-type") == "2";
+    const std::string prefix = req.get_param_value("prefix");
+    const std::string delimiter = req.get_param_value("delimiter");
+    std::size_t max_keys = 1000;
+    if (req.has_param("max-keys")) {
+        max_keys = static_cast<std::size_t>(std::clamp(std::stoll(req.get_param_value("max-keys")), 0ll, 1000ll));
+    }
+    std::string after = v2 ? std::max(req.get_param_value("start-after"), req.get_param_value("continuation-token"))
+                           : req.get_param_value("marker");
+
+    std::vector<std::pair<std::string, std::int64_t>> keys;
+    const std::string root = bucket + "/";
+    for (const FileSummary& file : m_backend.list(root + prefix)) {
+        keys.emplace_back(file.name.substr(root.size()), file.total_size);
+    }
+    std::sort(keys.begin(), keys.end());
+
+    std::ostringstream contents;
+    std::size_t count = 0;
+    std::string last;
+    bool truncated = false;
+    for (const auto& [key, size] : keys) {
+        // A prefix already returned covers every key below it.
+        if (key <= after || (!delimiter.empty() && !after.empty() && after.size() >= delimiter.size() &&
+                             after.compare(after.size() - delimiter.size(), delimiter.size(), delimiter) == 0 &&
+                             key.compare(0, after.size(), after) == 0)) {
+            continue;
+        }
+        std::string common;
+        if (!delimiter.empty()) {
+            const std::size_t cut = key.find(delimiter, prefix.size());
+            if (cut != std::string::npos) common = key.substr(0, cut + delimiter.size());
+        }
+        if (!common.empty() && common == last) continue;
+        if (count == max_keys) {
+            truncated = true;
+            break;
+        }
+        if (!common.empty()) {
+            contents << "<CommonPrefixes><Prefix>" << xmlEscape(common) << "</Prefix></CommonPrefixes>";
+            last = common;
+        } else {
+            contents << "<Contents><Key>" << xmlEscape(key) << "</Key><LastModified>" << kLastModified
+                     << "</LastModified><Size>" << size << "</Size><StorageClass>STANDARD</StorageClass></Contents>";
+            last = key;
+        }
+        ++count;
+    }
+
+    std::ostringstream xml;
+    xml << kXmlHeader << "<ListBucketResult xmlns=\"" << kNamespace << "\"><Name>" << xmlEscape(bucket)
+        << "</Name><Prefix>" << xmlEscape(prefix) << "</Prefix><MaxKeys>" << max_keys << "</MaxKeys>";
+    if (!delimiter.empty()) xml << "<Delimiter>" << xmlEscape(delimiter) << "</Delimiter>";
+    xml << "<IsTruncated>" << (truncated ? "true" : "false") << "</IsTruncated>";
+    if (v2) {
+        xml << "<KeyCount>" << count << "</KeyCount>";
+        if (req.has_param("continuation-token")) {
+            xml << "<ContinuationToken>" << xmlEscape(req.get_param_value("continuation-token")) << "</ContinuationToken>";
+        }
+        if (truncated) xml << "<NextContinuationToken>" << xmlEscape(last) << "</NextContinuationToken>";
+    } else {
+        xml << "<Marker>" << xmlEscape(req.get_param_value("marker")) << "</Marker>";
+        if (truncated) xml << "<NextMarker>" << xmlEscape(last) << "</NextMarker>";
+    }
+    xml << contents.str() << "</ListBucketResult>";
+    res.set_content(xml.str(), "application/xml");
+}
+
+// httplib answers HEAD and works out Range (206, 416, multipart/byteranges);
+// the body is read on demand through a read-ahead stream, so a ranged GET
+// touches only the chunks it covers and a whole-object GET is fetched ahead
+// of the client.
+void S3Gateway::getObject(const httplib::Request&, httplib::Response& res, const std::string& path) {
+    const std::optional<FileEntry> file = m_backend.find(path);
+    if (!file) {
+        sendError(res, 404, "NoSuchKey", "The specified key does not exist");
+        return;
+    }
+    res.set_header("ETag", etagOf(file->chunks));
+    res.set_header("Last-Modified", "Thu, 01 Jan 1970 00:00:00 GMT");
+    res.set_header("Accept-Ranges", "bytes");
+    auto reader = std::make_shared<std::unique_ptr<ReadAheadStream>>();
+    res.set_content_provider(
+        static_cast<std::size_t>(file->total_size), "application/octet-stream",
+        [this, path, reader](std::size_t offset, std::size_t length, httplib::DataSink& sink) {
+            try {
+                if (!*reader) *reader = m_backend.open(path);
+                const std::int64_t want = std::min<std::int64_t>(static_cast<std::int64_t>(length), dd::READ_SPAN_BYTES);
+                const std::string data = (*reader)->read(static_cast<std::int64_t>(offset), want);
+                return !data.empty() && sink.write(data.data(), data.size());
+            } catch (const std::exception&) {
+                return false;   // drops the connection; the client sees a short body
+            }
+        });
+}
+
+std::vector<ChunkEntry> S3Gateway::storeBody(const httplib::Request& req, const httplib::ContentReader& reader,
+                                             const std::string& path, std::size_t stripe) {
+    const bool chunked = req.get_header_value("Content-Encoding").find("aws-chunked") != std::string::npos ||
+                         req.get_header_value("x-amz-content-sha256").rfind("STREAMING-", 0) == 0;
+    std::int64_t size_hint = -1;
+    const std::string length = req.get_header_value(chunked ? "x-amz-decoded-content-length" : "Content-Length");
+    if (!length.empty()) size_hint = std::stoll(length);
+
+    return m_backend.store(path, stripe, size_hint, [&](const Sink& sink) {
+        if (!chunked) {
+            return reader([&](const char* data, std::size_t size) { return sink(data, size); });
+        }
+        AwsChunkedDecoder decoder(sink);
+        return reader([&](const char* data, std::size_t size) { return decoder.feed(data, size); }) && decoder.done();
+    });
+}
+
+void S3Gateway::putObject(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader,
+                          const std::string& path) {
+    // Successive objects start on successive accounts.
+    const std::vector<ChunkEntry> chunks = storeBody(req, reader, path, m_next_stripe++);
+    {
+        std::lock_guard<std::mutex> lock(m_commit_mutex);
+        m_backend.commit(path, chunks);
+    }
+    res.set_header("ETag", etagOf(chunks));
+    res.status = 200;
+}
+
+void S3Gateway::deleteObjects(const httplib::Request&, httplib::Response& res,
+                              const httplib::ContentReader& reader, const std::string& bucket) {
+    std::string body;
+    reader([&](const char* data, std::size_t size) {
+        body.append(data, size);
+        return body.size() <= 16 * 1024 * 1024;
+    });
+    const bool quiet = element(body, "Quiet") == "true";
+    std::ostringstream xml;
+    xml << kXmlHeader << "<DeleteResult xmlns=\"" << kNamespace << "\">";
+    for (const auto& object : elements(body, "Object")) {
+        const std::string key = element(object, "Key");
+        try {
+            std::lock_guard<std::mutex> lock(m_commit_mutex);
+            m_backend.remove(normalizePath(bucket + "/" + key));
+            if (!quiet) xml << "<Deleted><Key>" << xmlEscape(key) << "</Key></Deleted>";
+        } catch (const std::exception& e) {
+            xml << "<Error><Key>" << xmlEscape(key) << "</Key><Code>InternalError</Code><Message>"
+                << xmlEscape(e.what()) << "</Message></Error>";
+        }
+    }
+    xml << "</DeleteResult>";
+    res.set_content(xml.str(), "application/xml");
+}
+
+void S3Gateway::createUpload(httplib::Response& res, const std::string& bucket, const std::string& key,
+                             const std::string& path) {
+    const std::string id = newUploadId();
+    {
+        std::lock_guard<std::mutex> lock(m_uploads_mutex);
+        m_uploads[id].path = path;
+    }
+    res.set_content(std::string(kXmlHeader) + "<InitiateMultipartUploadResult xmlns=\"" + kNamespace + "\"><Bucket>" +
+                        xmlEscape(bucket) + "</Bucket><Key>" + xmlEscape(key) + "</Key><UploadId>" + id +
+                        "</UploadId></InitiateMultipartUploadResult>",
+                    "application/xml");
+}
+
+// Parts arrive in parallel, each streamed into chunk uploads of its own.
+// Part n starts on account n, so concurrent parts spread over all accounts.
+void S3Gateway::uploadPart(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader,
+                           const std::string& path) {
+    const std::string id = req.get_param_value("uploadId");
+    int number = 0;
+    try {
+        number = std::stoi(req.get_param_value("partNumber"));
+    } catch (const std::exception&) {
+    }
+    if (number < 1 || number > 10000) {
+        sendError(res, 400, "InvalidArgument", "Part number must be between 1 and 10000");
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_uploads_mutex);
+        if (m_uploads.count(id) == 0) {
+            sendError(res, 404, "NoSuchUpload", "The specified upload does not exist");
+            return;
+        }
+    }
+
+    Part part;
+    part.chunks = storeBody(req, reader, path, static_cast<std::size_t>(number));
+    part.etag = etagOf(part.chunks);
+    const std::string etag = part.etag;
+
+    // A part sent again replaces the earlier copy; an upload completed or
+    // aborted meanwhile leaves this one with nowhere to go.
+    std::vector<ChunkEntry> replaced;
+    bool orphaned = false;
+    {
+        std::lock_guard<std::mutex> lock(m_uploads_mutex);
+        auto upload = m_uploads.find(id);
+        if (upload == m_uploads.end()) {
+            orphaned = true;
+            replaced = std::move(part.chunks);
+        } else {
+            Part& slot = upload->second.parts[number];
+            replaced = std::move(slot.chunks);
+            slot = std::move(part);
+        }
+    }
+    m_backend.discard(replaced);
+    if (orphaned) {
+        sendError(res, 404, "NoSuchUpload", "The upload was completed or aborted while the part was sent");
+        return;
+    }
+    res.set_header("ETag", etag);
+    res.status = 200;
+}
+
+// The listed parts' chunks are renumbered into one run, in part order, and
+// committed as the object; parts that were uploaded but not listed are
+// deleted.
+void S3Gateway::completeUpload(const httplib::Request& req, httplib::Response& res,
+                               const httplib::ContentReader& reader, const std::string& bucket,
+                               const std::string& key, const std::string& path) {
+    std::string body;
+    reader([&](const char* data, std::size_t size) {
+        body.append(data, size);
+        return body.size() <= 16 * 1024 * 1024;
+    });
+    std::vector<std::pair<int, std::string>> listed;
+    for (const auto& part : elements(body, "Part")) {
+        try {
+            listed.emplace_back(std::stoi(element(part, "PartNumber")), unquote(element(part, "ETag")));
+        } catch (const std::exception&) {
+            sendError(res, 400, "MalformedXML", "Could not parse the part list");
+            return;
+        }
+    }
+    if (listed.empty()) {
+        sendError(res, 400, "MalformedXML", "The part list is empty");
+        return;
+    }
+
+    const std::string id = req.get_param_value("uploadId");
+    Upload upload;
+    {
+        std::lock_guard<std::mutex> lock(m_uploads_mutex);
+        auto it = m_uploads.find(id);
+        if (it == m_uploads.end()) {
+            sendError(res, 404, "NoSuchUpload", "The specified upload does not exist");
+            return;
+        }
+        for (std::size_t i = 0; i < listed.size(); ++i) {
+            auto part = it->second.parts.find(listed[i].first);
+            if (part == it->second.parts.end() || unquote(part->second.etag) != listed[i].second) {
+                sendError(res, 400, "InvalidPart", "Part " + std::to_string(listed[i].first) + " was not uploaded");
+                return;
+            }
+            if (i > 0 && listed[i].first <= listed[i - 1].first) {
+                sendError(res, 400, "InvalidPartOrder", "Parts must be listed in ascending order");
+                return;
+            }
+        }
+        upload = std::move(it->second);
+        m_uploads.erase(it);
+    }
+
+    std::vector<ChunkEntry> chunks;
+    for (const auto& [number, etag] : listed) {
+        for (ChunkEntry& chunk : upload.parts[number].chunks) {
+            chunk.part = static_cast<int>(chunks.size());
+            chunks.push_back(std::move(chunk));
+        }
+        upload.parts.erase(number);
+    }
+    for (const auto& [number, part] : upload.parts) {
+        m_backend.discard(part.chunks);
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_commit_mutex);
+        m_backend.commit(path, chunks);
+    }
+    res.set_content(std::string(kXmlHeader) + "<CompleteMultipartUploadResult xmlns=\"" + kNamespace +
+                        "\"><Bucket>" + xmlEscape(bucket) + "</Bucket><Key>" + xmlEscape(key) + "</Key><ETag>" +
+                        xmlEscape(etagOf(chunks)) + "</ETag></CompleteMultipartUploadResult>",
+                    "application/xml");
+}
+
+void S3Gateway::abortUpload(const httplib::Request& req, httplib::Response& res) {
+    Upload upload;
+    {
+        std::lock_guard<std::mutex> lock(m_uploads_mutex);
+        auto it = m_uploads.find(req.get_param_value("uploadId"));
+        if (it == m_uploads.end()) {
+            sendError(res, 404, "NoSuchUpload", "The specified upload does not exist");
+            return;
+        }
+        upload = std::move(it->second);
+        m_uploads.erase(it);
+    }
+    for (const auto& [number, part] : upload.parts) {
+        m_backend.discard(part.chunks);
+    }
+    res.status = 204;
+}
@@ -0,0 +1,101 @@
+#ifndef S3_GATEWAY_H
+#define S3_GATEWAY_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <httplib.h>
+#include "catalog.h"
+#include "read_ahead.h"
+
+// Local endpoint speaking enough of the S3 REST API for backup tools:
+// ListBuckets, ListObjects (v1 and v2), GetObject (with Range), HeadObject,
+// PutObject, DeleteObject, DeleteObjects and multipart uploads. Requests are
+// path-style (http://host:port/<bucket>/<key>); a bucket is a top-level
+// directory of the catalog and its keys are the paths below it. Signatures
+// are not checked, so the endpoint is meant for localhost.
+//
+// Uploaded bodies are streamed straight into chunk uploads as they arrive,
+// including aws-chunked bodies. Each multipart part becomes its own run of
+// chunks while the upload is open; completing it stitches the parts' chunks
+// into one file in part order, so nothing is copied again. Open multipart
+// uploads live in memory only.
+class S3Gateway {
+public:
+    using Sink = std::function<bool(const char* data, std::size_t size)>;
+    // Pushes a request body into a sink; false if the body could not be read
+    // or the sink refused it.
+    using Body = std::function<bool(const Sink& sink)>;
+
+    struct Backend {
+        std::function<std::optional<FileEntry>(const std::string& path)> find;
+        std::function<std::unique_ptr<ReadAheadStream>(const std::string& path)> open;
+        // Every stored file whose path starts with `prefix`, in any order.
+        std::function<std::vector<FileSummary>(const std::string& prefix)> list;
+        std::function<std::vector<std::string>()> buckets;
+        // Stores what `body` pushes as chunks named after `path`, striped over
+        // the accounts from `stripe` on. Returns them in order with their
+        // sizes set, or throws after deleting whatever was stored.
+        std::function<std::vector<ChunkEntry>(const std::string& path, std::size_t stripe, std::int64_t size_hint,
+                                              const Body& body)> store;
+        // Makes `chunks` the contents of `path`, releasing any previous
+        // version's objects. Calls to commit and remove are serialised.
+        std::function<void(const std::string& path, const std::vector<ChunkEntry>& chunks)> commit;
+        // Deletes stored chunks that will not be committed.
+        std::function<void(const std::vector<ChunkEntry>& chunks)> discard;
+        // Removes a file and its objects; false if there is none.
+        std::function<bool(const std::string& path)> remove;
+    };
+
+    explicit S3Gateway(Backend backend);
+    ~S3Gateway();   // discards open multipart uploads
+
+    // Serves until stop() is called. Returns false if the address cannot be
+    // bound.
+    bool listen(const std::string& host, int port);
+    void stop();
+
+private:
+    struct Part {
+        std::string etag;
+        std::vector<ChunkEntry> chunks;
+    };
+    struct Upload {
+        std::string path;
+        std::map<int, Part> parts;
+    };
+
+    void listBuckets(httplib::Response& res);
+    void listObjects(const httplib::Request& req, httplib::Response& res, const std::string& bucket);
+    void getObject(const httplib::Request& req, httplib::Response& res, const std::string& path);
+    void putObject(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader,
+                   const std::string& path);
+    void deleteObjects(const httplib::Request&, httplib::Response& res, const httplib::ContentReader& reader,
+                       const std::string& bucket);
+    void createUpload(httplib::Response& res, const std::string& bucket, const std::string& key,
+                      const std::string& path);
+    void uploadPart(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader,
+                    const std::string& path);
+    void completeUpload(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader,
+                        const std::string& bucket, const std::string& key, const std::string& path);
+    void abortUpload(const httplib::Request& req, httplib::Response& res);
+
+    std::vector<ChunkEntry> storeBody(const httplib::Request& req, const httplib::ContentReader& reader,
+                                      const std::string& path, std::size_t stripe);
+
+    Backend m_backend;
+    httplib::Server m_server;
+    std::atomic<std::size_t> m_next_stripe{0};
+    std::mutex m_commit_mutex;
+    std::mutex m_uploads_mutex;
+    std::map<std::string, Upload> m_uploads;   // by upload id
+};
+
+#endif // S3_GATEWAY_H
@@ -0,0 +1,65 @@
+#include "session_pool.h"
+#include <exception>
+#include <thread>
+#include <utility>
+
+UploadSessionPool::UploadSessionPool(Factory factory, std::size_t per_account, std::chrono::seconds max_age)
+    : m_factory(std::move(factory)), m_per_account(per_account), m_max_age(max_age) {}
+
+UploadSessionPool::~UploadSessionPool() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_per_account = 0;   // no further refills
+    m_idle_cv.wait(lock, [this] { return m_in_flight == 0; });
+}
+
+void UploadSessionPool::prefill(const std::string& account) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    AccountPool& pool = m_accounts[account];
+    dropExpiredLocked(pool);
+    refillLocked(account, pool);
+}
+
+std::string UploadSessionPool::take(const std::string& account) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    AccountPool& pool = m_accounts[account];
+    dropExpiredLocked(pool);
+    std::string uri;
+    if (!pool.ready.empty()) {
+        uri = std::move(pool.ready.front().uri);
+        pool.ready.pop_front();
+    }
+    refillLocked(account, pool);
+    return uri;
+}
+
+void UploadSessionPool::dropExpiredLocked(AccountPool& pool) {
+    const auto now = std::chrono::steady_clock::now();
+    while (!pool.ready.empty() && now - pool.ready.front().created > m_max_age) {
+        pool.ready.pop_front();
+    }
+}
+
+void UploadSessionPool::refillLocked(const std::string& account, AccountPool& pool) {
+    // Initiations run detached; the destructor waits for m_in_flight to drain,
+    // and a thread touches the pool only while holding the lock.
+    while (pool.ready.size() + pool.pending < m_per_account) {
+        pool.pending++;
+        m_in_flight++;
+        std::thread([this, account] {
+            std::string uri;
+            try {
+                uri = m_factory(account);
+            } catch (const std::exception&) {
+                // Left empty: the next take() tries again.
+            }
+            std::lock_guard<std::mutex> lock(m_mutex);
+            AccountPool& pool = m_accounts[account];
+            pool.pending--;
+            if (!uri.empty() && m_per_account > 0) {
+                pool.ready.push_back({std::move(uri), std::chrono::steady_clock::now()});
+            }
+            m_in_flight--;
+            m_idle_cv.notify_all();
+        }).detach();
+    }
+}
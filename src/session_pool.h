@@ -0,0 +1,59 @@
+#ifndef SESSION_POOL_H
+#define SESSION_POOL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+
+// Keeps a few resumable upload sessions per account initiated ahead of need,
+// so an upload worker can start sending data at once instead of first paying
+// the initiation round trip. Every take() tops the account back up in the
+// background. Sessions older than `max_age` are dropped unused; Drive keeps
+// them valid for a week, so this stays well clear of expiry.
+class UploadSessionPool {
+public:
+    // Initiates one session for `account` and returns its URI. Throws on failure.
+    using Factory = std::function<std::string(const std::string& account)>;
+
+    UploadSessionPool(Factory factory, std::size_t per_account, std::chrono::seconds max_age);
+    ~UploadSessionPool();   // waits for initiations still in flight
+
+    UploadSessionPool(const UploadSessionPool&) = delete;
+    UploadSessionPool& operator=(const UploadSessionPool&) = delete;
+
+    // Starts initiating sessions until `account` holds per_account of them.
+    void prefill(const std::string& account);
+
+    // Returns a ready session URI for `account`, or an empty string if none
+    // is ready yet.
+    std::string take(const std::string& account);
+
+private:
+    struct Entry {
+        std::string uri;
+        std::chrono::steady_clock::time_point created;
+    };
+    struct AccountPool {
+        std::deque<Entry> ready;
+        std::size_t pending = 0;
+    };
+
+    void refillLocked(const std::string& account, AccountPool& pool);
+    void dropExpiredLocked(AccountPool& pool);
+
+    Factory m_factory;
+    std::size_t m_per_account;
+    std::chrono::seconds m_max_age;
+
+    std::mutex m_mutex;
+    std::condition_variable m_idle_cv;
+    std::map<std::string, AccountPool> m_accounts;
+    std::size_t m_in_flight = 0;
+};
+
+#endif // SESSION_POOL_H
@@ -0,0 +1,56 @@
+#include "storage_backend.h"
+#include <stdexcept>
+#include <utility>
+#include "emulator_backend.h"
+#include "local_backend.h"
+
+std::string StorageBackend::startUpload(const std::string&) {
+    return std::string();
+}
+
+std::string StorageBackend::read(const std::string& id, std::int64_t offset, std::int64_t length,
+                                 const Progress& progress) {
+    std::string data;
+    if (length <= 0) {
+        return data;
+    }
+    data.reserve(static_cast<size_t>(length));
+    get(id, offset, length, [&](std::string_view part) { data.append(part.data(), part.size()); }, progress);
+    if (static_cast<std::int64_t>(data.size()) != length) {
+        throw std::runtime_error("Short read of object " + id + ": got " + std::to_string(data.size()) + " of " +
+                                 std::to_string(length) + " bytes");
+    }
+    return data;
+}
+
+std::future<std::string> StorageBackend::putAsync(std::vector<char> data, std::string name, std::string session,
+                                                  Progress progress) {
+    return std::async(std::launch::async, [this, data = std::move(data), name = std::move(name),
+                                           session = std::move(session), progress = std::move(progress)] {
+        return put(data, name, session, progress);
+    });
+}
+
+std::future<std::string> StorageBackend::readAsync(std::string id, std::int64_t offset, std::int64_t length,
+                                                   Progress progress) {
+    return std::async(std::launch::async, [this, id = std::move(id), offset, length, progress = std::move(progress)] {
+        return read(id, offset, length, progress);
+    });
+}
+
+std::shared_ptr<StorageBackend> makeBackend(const nlohmann::json& spec) {
+    const std::string kind = spec.value("kind", "");
+    if (kind == "local") {
+        return std::make_shared<LocalBackend>(spec.at("path").get<std::string>());
+    }
+    if (kind == "emulator") {
+        EmulatorBackend::Options options;
+        options.bandwidth_bytes_per_sec = spec.value("bandwidth_mbps", 0.0) * 1024 * 1024;
+        options.latency = std::chrono::milliseconds(spec.value("latency_ms", 0));
+        options.error_rate = spec.value("error_rate", 0.0);
+        const double quota_gb = spec.value("quota_gb", 0.0);
+        options.quota_bytes = quota_gb > 0 ? static_cast<std::int64_t>(quota_gb * 1024 * 1024 * 1024) : -1;
+        return std::make_shared<EmulatorBackend>(options);
+    }
+    throw std::runtime_error("Unknown storage backend kind '" + kind + "'");
+}
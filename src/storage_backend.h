@@ -0,0 +1,87 @@
+#ifndef STORAGE_BACKEND_H
+#define STORAGE_BACKEND_H
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// An object as its backend lists it.
+struct StoredObject {
+    std::string id;
+    std::string name;
+    std::int64_t size = -1;
+};
+
+// Space on one account; -1 where the backend does not know or has no limit.
+struct StorageQuota {
+    std::int64_t used = -1;
+    std::int64_t limit = -1;
+};
+
+// One account's object store. Every chunk, pack and replica is an immutable
+// object named by the id put() returns; striping, replication, caching and
+// the catalog all sit above this interface and do not care what is behind it.
+//
+// Implementations are shared by every transfer on the account and must be
+// thread-safe.
+class StorageBackend {
+public:
+    // Called as bytes move; returning false aborts the transfer, which then
+    // throws.
+    using Progress = std::function<bool(std::int64_t done, std::int64_t total)>;
+    using Sink = std::function<void(std::string_view data)>;
+
+    virtual ~StorageBackend() = default;
+
+    // "drive", "local" or "emulator".
+    virtual std::string kind() const = 0;
+
+    // Backends where starting an upload costs a round trip can start one
+    // ahead of the data (see UploadSessionPool) and hand it to put().
+    virtual bool hasUploadSessions() const { return false; }
+    virtual std::string startUpload(const std::string& name);
+
+    // Stores `data` as a new object and returns its id. `session`, if not
+    // empty, comes from startUpload(); a stale one makes put() throw, and the
+    // caller retries without it.
+    virtual std::string put(const std::vector<char>& data, const std::string& name, const std::string& session,
+                            const Progress& progress) = 0;
+
+    // Streams bytes [offset, offset + length) of an object into `sink`; a
+    // negative length reads to the end.
+    virtual void get(const std::string& id, std::int64_t offset, std::int64_t length, const Sink& sink,
+                     const Progress& progress) = 0;
+
+    // Result i is true if ids[i] is gone (already missing counts as deleted).
+    virtual std::vector<bool> remove(const std::vector<std::string>& ids) = 0;
+
+    // The objects D-Drive has stored on the account.
+    virtual std::vector<StoredObject> list() = 0;
+    virtual StorageQuota quota() = 0;
+
+    // Reads a range into memory. Throws on a short read.
+    std::string read(const std::string& id, std::int64_t offset, std::int64_t length,
+                     const Progress& progress = nullptr);
+
+    // Asynchronous forms. The defaults run the blocking call on a thread of
+    // its own; a backend with a native asynchronous path can override them.
+    // The backend must outlive the returned futures.
+    virtual std::future<std::string> putAsync(std::vector<char> data, std::string name, std::string session,
+                                              Progress progress);
+    virtual std::future<std::string> readAsync(std::string id, std::int64_t offset, std::int64_t length,
+                                               Progress progress);
+};
+
+// Builds a non-Drive backend from its entry in data/backends.json:
+//   {"name": n, "kind": "local", "path": dir}
+//   {"name": n, "kind": "emulator", "bandwidth_mbps": 50, "latency_ms": 80,
+//    "error_rate": 0.01, "quota_gb": 15}
+// Throws std::runtime_error on an unknown kind.
+std::shared_ptr<StorageBackend> makeBackend(const nlohmann::json& spec);
+
+#endif // STORAGE_BACKEND_H
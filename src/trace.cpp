@@ -0,0 +1,145 @@
+#include "trace.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "DDConfig.h"
+
+namespace {
+    struct Event {
+        const char* category;
+        const char* name;
+        std::string object;
+        std::string account;
+        std::int64_t start;   // microseconds since the trace started
+        std::int64_t duration;
+    };
+
+    // One thread's spans. Only its thread appends; the mutex is there for
+    // the writer, which reads every buffer, so it is all but uncontended.
+    struct Buffer {
+        std::mutex mutex;
+        int tid = 0;
+        std::vector<Event> events;   // ring of TRACE_BUFFER_EVENTS
+        std::size_t next = 0;
+        std::int64_t overwritten = 0;
+    };
+
+    std::atomic<bool> g_enabled{false};
+    std::atomic<std::int64_t> g_epoch{0};   // steady_clock ticks at start()
+
+    std::mutex g_buffers_mutex;
+    std::vector<std::shared_ptr<Buffer>> g_buffers;   // kept after their thread exits
+    int g_next_tid = 1;
+
+    std::int64_t now() {
+        return std::chrono::steady_clock::now().time_since_epoch().count();
+    }
+
+    std::int64_t micros(std::int64_t ticks) {
+        using Ticks = std::chrono::steady_clock::duration;
+        return std::chrono::duration_cast<std::chrono::microseconds>(Ticks(ticks)).count();
+    }
+
+    Buffer& threadBuffer() {
+        thread_local std::shared_ptr<Buffer> buffer = [] {
+            auto created = std::make_shared<Buffer>();
+            std::lock_guard<std::mutex> lock(g_buffers_mutex);
+            created->tid = g_next_tid++;
+            g_buffers.push_back(created);
+            return created;
+        }();
+        return *buffer;
+    }
+}
+
+namespace trace {
+    void start() {
+        std::lock_guard<std::mutex> lock(g_buffers_mutex);
+        g_enabled = false;
+        // Buffers only the registry still holds belong to exited threads.
+        g_buffers.erase(std::remove_if(g_buffers.begin(), g_buffers.end(),
+                                       [](const std::shared_ptr<Buffer>& b) { return b.use_count() == 1; }),
+                        g_buffers.end());
+        for (const auto& buffer : g_buffers) {
+            std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+            buffer->events.clear();
+            buffer->next = 0;
+            buffer->overwritten = 0;
+        }
+        g_epoch = now();
+        g_enabled = true;
+    }
+
+    bool enabled() {
+        return g_enabled.load(std::memory_order_relaxed);
+    }
+
+    void writeTo(const std::string& path) {
+        g_enabled = false;
+        nlohmann::json events = nlohmann::json::array();
+        std::int64_t overwritten = 0;
+        {
+            std::lock_guard<std::mutex> lock(g_buffers_mutex);
+            for (const auto& buffer : g_buffers) {
+                std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+                overwritten += buffer->overwritten;
+                for (const Event& event : buffer->events) {
+                    nlohmann::json args = nlohmann::json::object();
+                    if (!event.object.empty()) args["object"] = event.object;
+                    if (!event.account.empty()) args["account"] = event.account;
+                    events.push_back({{"name", event.name}, {"cat", event.category}, {"ph", "X"},
+                                      {"ts", event.start}, {"dur", event.duration}, {"pid", 1},
+                                      {"tid", buffer->tid}, {"args", std::move(args)}});
+                }
+            }
+        }
+        // Viewers sort by timestamp themselves, but a sorted file diffs and
+        // greps better.
+        std::sort(events.begin(), events.end(), [](const nlohmann::json& a, const nlohmann::json& b) {
+            return a["ts"].get<std::int64_t>() < b["ts"].get<std::int64_t>();
+        });
+        events.push_back({{"name", "process_name"}, {"ph", "M"}, {"pid", 1}, {"args", {{"name", "filesplitter"}}}});
+
+        std::ofstream out(path);
+        out << nlohmann::json{{"traceEvents", std::move(events)},
+                              {"displayTimeUnit", "ms"},
+                              {"otherData", {{"overwritten_spans", overwritten}}}}.dump()
+            << std::endl;
+        if (!out) {
+            throw std::runtime_error("Could not write trace to " + path);
+        }
+    }
+}
+
+TraceSpan::TraceSpan(const char* category, const char* name, std::string_view object, std::string_view account)
+    : m_category(category), m_name(name) {
+    if (!trace::enabled()) return;
+    m_object = object;
+    m_account = account;
+    m_start = now();
+}
+
+TraceSpan::~TraceSpan() {
+    if (m_start < 0 || !trace::enabled()) return;
+    const std::int64_t end = now();
+    const std::int64_t epoch = g_epoch.load(std::memory_order_relaxed);
+    if (m_start < epoch) return;   // began before the current trace
+    Event event{m_category, m_name, std::move(m_object), std::move(m_account), micros(m_start - epoch),
+                micros(end - m_start)};
+
+    Buffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.events.size() < dd::TRACE_BUFFER_EVENTS) {
+        buffer.events.push_back(std::move(event));
+    } else {
+        buffer.events[buffer.next] = std::move(event);
+        buffer.next = (buffer.next + 1) % buffer.events.size();
+        buffer.overwritten++;
+    }
+}
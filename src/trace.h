@@ -0,0 +1,41 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Span tracing in the Chrome trace event format, viewable in Perfetto or
+// chrome://tracing. Each thread appends finished spans to its own ring
+// buffer of TRACE_BUFFER_EVENTS entries (the oldest are overwritten), so
+// recording takes no shared lock; the buffers are gathered when the trace is
+// written. While no trace is running a span costs one relaxed atomic load.
+namespace trace {
+    // Starts a new trace, discarding spans from any earlier one.
+    void start();
+    bool enabled();
+    // Stops recording and writes every buffered span to `path`. Throws if
+    // the file cannot be written.
+    void writeTo(const std::string& path);
+}
+
+// Records the time from construction to destruction as one span on the
+// current thread. `object` and `account`, if given, are shown as the span's
+// arguments; they are copied only while a trace is running.
+class TraceSpan {
+public:
+    TraceSpan(const char* category, const char* name, std::string_view object = {}, std::string_view account = {});
+    ~TraceSpan();
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* m_category;
+    const char* m_name;
+    std::string m_object;
+    std::string m_account;
+    std::int64_t m_start = -1;   // -1: not recording
+};
+
+#endif // TRACE_H
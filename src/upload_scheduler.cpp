@@ -0,0 +1,133 @@
+#include "upload_scheduler.h"
+#include "catalog.h"
+#include <algorithm>
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace fs = std::filesystem;
+
+std::vector<UploadJob> scanUploadTree(const std::string& local_dir, const std::string& remote_dir, int threads) {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::pair<fs::path, std::string>> pending{{fs::path(local_dir), remote_dir}};
+    int active = 0;
+    std::vector<UploadJob> jobs;
+    std::exception_ptr error;
+
+    auto worker = [&] {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            // Idle workers wait for more directories until the last busy one
+            // finishes without adding any.
+            cv.wait(lock, [&] { return !pending.empty() || active == 0 || error; });
+            if (pending.empty() || error) {
+                return;
+            }
+            auto [dir, remote] = std::move(pending.back());
+            pending.pop_back();
+            ++active;
+            lock.unlock();
+
+            std::vector<UploadJob> found;
+            std::vector<std::pair<fs::path, std::string>> subdirs;
+            std::exception_ptr failure;
+            try {
+                for (const auto& entry : fs::directory_iterator(dir, fs::directory_options::skip_permission_denied)) {
+                    const std::string name = entry.path().filename().generic_string();
+                    if (entry.is_directory() && !entry.is_symlink()) {
+                        subdirs.emplace_back(entry.path(), joinPath(remote, name));
+                    } else if (entry.is_regular_file()) {
+                        found.push_back({entry.path().string(), joinPath(remote, name),
+                                         static_cast<std::int64_t>(entry.file_size())});
+                    }
+                }
+            } catch (...) {
+                failure = std::current_exception();
+            }
+
+            lock.lock();
+            --active;
+            if (failure && !error) error = failure;
+            jobs.insert(jobs.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+            pending.insert(pending.end(), std::make_move_iterator(subdirs.begin()), std::make_move_iterator(subdirs.end()));
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (int i = 0; i < std::max(1, threads); ++i) {
+        workers.emplace_back(worker);
+    }
+    for (auto& t : workers) t.join();
+    if (error) std::rethrow_exception(error);
+
+    std::sort(jobs.begin(), jobs.end(),
+              [](const UploadJob& a, const UploadJob& b) { return PathLess()(a.remote_path, b.remote_path); });
+    return jobs;
+}
+
+std::vector<PackPlan> planPacks(const std::vector<UploadJob>& jobs, std::int64_t max_file_bytes,
+                                std::int64_t target_bytes) {
+    std::vector<std::size_t> candidates;
+    for (std::size_t j = 0; j < jobs.size(); ++j) {
+        if (jobs[j].size > 0 && jobs[j].size <= max_file_bytes) candidates.push_back(j);
+    }
+    std::vector<PackPlan> packs;
+    if (candidates.size() < 2) return packs;
+
+    for (std::size_t j : candidates) {
+        if (packs.empty() || packs.back().size + jobs[j].size > target_bytes) {
+            packs.emplace_back();
+        }
+        PackPlan& pack = packs.back();
+        pack.jobs.push_back(j);
+        pack.offsets.push_back(pack.size);
+        pack.size += jobs[j].size;
+    }
+    return packs;
+}
+
+std::vector<ChunkTask> scheduleChunks(const std::vector<UploadJob>& jobs, const std::vector<PackPlan>& packs,
+                                      std::int64_t chunk_size, std::int64_t small_bytes) {
+    std::vector<ChunkTask> bulk;
+    std::vector<ChunkTask> small;
+    std::vector<bool> packed(jobs.size(), false);
+    for (std::size_t p = 0; p < packs.size(); ++p) {
+        for (std::size_t j : packs[p].jobs) packed[j] = true;
+        ChunkTask task{packs[p].jobs.front(), 0, 0, packs[p].size, static_cast<int>(p)};
+        (task.length < small_bytes ? small : bulk).push_back(task);
+    }
+    for (std::size_t j = 0; j < jobs.size(); ++j) {
+        if (packed[j]) continue;
+        int part = 0;
+        for (std::int64_t offset = 0; offset < jobs[j].size; offset += chunk_size) {
+            ChunkTask task{j, part++, offset, std::min(chunk_size, jobs[j].size - offset), -1};
+            (task.length < small_bytes ? small : bulk).push_back(task);
+        }
+    }
+
+    auto larger = [&](const ChunkTask& a, const ChunkTask& b) {
+        if (a.length != b.length) return a.length > b.length;
+        if (jobs[a.job].size != jobs[b.job].size) return jobs[a.job].size > jobs[b.job].size;
+        if (a.job != b.job) return a.job < b.job;
+        return a.part < b.part;
+    };
+    std::sort(bulk.begin(), bulk.end(), larger);
+    std::sort(small.begin(), small.end(), larger);
+
+    // Take from whichever stream is proportionally further behind, so both
+    // drain at the same rate.
+    std::vector<ChunkTask> order;
+    order.reserve(bulk.size() + small.size());
+    std::size_t b = 0, s = 0;
+    while (b < bulk.size() || s < small.size()) {
+        bool take_small = s < small.size() && (b == bulk.size() || s * bulk.size() <= b * small.size());
+        order.push_back(take_small ? small[s++] : bulk[b++]);
+    }
+    return order;
+}
@@ -0,0 +1,54 @@
+#ifndef UPLOAD_SCHEDULER_H
+#define UPLOAD_SCHEDULER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One local file to be stored at a remote path.
+struct UploadJob {
+    std::string local_path;
+    std::string remote_path;
+    std::int64_t size = 0;
+};
+
+// Small files uploaded together as one Drive object; jobs[i] starts at
+// offsets[i] within it.
+struct PackPlan {
+    std::vector<std::size_t> jobs;
+    std::vector<std::int64_t> offsets;
+    std::int64_t size = 0;
+};
+
+// Bytes [offset, offset + length) of jobs[job], stored as chunk `part`, or,
+// when `pack` is set, the whole of packs[pack] (length is the pack size).
+struct ChunkTask {
+    std::size_t job = 0;
+    int part = 0;
+    std::int64_t offset = 0;
+    std::int64_t length = 0;
+    int pack = -1;
+};
+
+// Lists every regular file below `local_dir` as a job under `remote_dir`.
+// Subdirectories are read concurrently on `threads` threads; symlinked
+// directories are not followed. Jobs come back sorted by remote path.
+std::vector<UploadJob> scanUploadTree(const std::string& local_dir, const std::string& remote_dir, int threads);
+
+// Groups non-empty files of at most `max_file_bytes` into packs of up to
+// `target_bytes`, in job order so that neighbouring files share a pack.
+// Returns no packs when fewer than two files qualify.
+std::vector<PackPlan> planPacks(const std::vector<UploadJob>& jobs, std::int64_t max_file_bytes,
+                                std::int64_t target_bytes);
+
+// Splits every job outside a pack into chunks, adds one task per pack, and
+// orders the lot for one shared worker pool. Tasks of at least `small_bytes`
+// go largest first (ties: larger file first, then part order), which keeps
+// the makespan close to optimal. Smaller tasks are latency-bound, so instead
+// of trailing at the end they are spread evenly through that sequence,
+// keeping every account busy while the bulk transfers run.
+std::vector<ChunkTask> scheduleChunks(const std::vector<UploadJob>& jobs, const std::vector<PackPlan>& packs,
+                                      std::int64_t chunk_size, std::int64_t small_bytes);
+
+#endif // UPLOAD_SCHEDULER_H
@@ -0,0 +1,441 @@
+#include "bench.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include "DDConfig.h"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+namespace {
+    constexpr double kMB = 1024.0 * 1024.0;
+
+    // 64M, 1G, 16K, or plain bytes.
+    std::string sizeLabel(std::int64_t bytes) {
+        const char* units[] = {"G", "M", "K"};
+        const std::int64_t scales[] = {1ll << 30, 1ll << 20, 1ll << 10};
+        for (int i = 0; i < 3; ++i) {
+            if (bytes >= scales[i] && bytes % scales[i] == 0) return std::to_string(bytes / scales[i]) + units[i];
+        }
+        return std::to_string(bytes);
+    }
+
+    std::string megabytes(std::int64_t bytes) {
+        std::ostringstream out;
+        out << std::setprecision(12) << bytes / kMB;
+        return out.str();
+    }
+
+    // Nearest-rank percentile of sorted samples.
+    double percentile(const std::vector<double>& sorted, double p) {
+        if (sorted.empty()) return 0;
+        const size_t rank = static_cast<size_t>(std::ceil(p * static_cast<double>(sorted.size())));
+        return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+    }
+
+    double rounded(double value, int digits = 3) {
+        const double scale = std::pow(10.0, digits);
+        return std::round(value * scale) / scale;
+    }
+
+    json orNull(std::int64_t value) {
+        return value < 0 ? json(nullptr) : json(value);
+    }
+
+    std::string resultKey(const json& result) {
+        return result.value("scenario", "") + "/" + sizeLabel(result.value("file_bytes", std::int64_t{0})) + "/" +
+               sizeLabel(result.value("chunk_bytes", std::int64_t{0})) + "/a" +
+               std::to_string(result.value("accounts", 0)) + "/c" + std::to_string(result.value("concurrency", 0));
+    }
+
+    std::string utcNow() {
+        const std::time_t now = std::time(nullptr);
+        char stamp[32];
+        std::strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        return stamp;
+    }
+
+    const char* platformName() {
+#if defined(_WIN32)
+        return "windows";
+#elif defined(__APPLE__)
+        return "macos";
+#elif defined(__linux__)
+        return "linux";
+#else
+        return "unknown";
+#endif
+    }
+}
+
+Benchmark::Benchmark(Options options) : m_options(std::move(options)) {
+    if (m_options.file_sizes.empty() || m_options.chunk_sizes.empty() || m_options.accounts.empty() ||
+        m_options.concurrency.empty()) {
+        throw std::runtime_error("Every matrix dimension needs at least one value.");
+    }
+    m_options.filesplitter = fs::absolute(m_options.filesplitter).string();
+    if (!fs::is_regular_file(m_options.filesplitter)) {
+        throw std::runtime_error("filesplitter binary not found: " + m_options.filesplitter);
+    }
+    m_options.work_dir = fs::absolute(m_options.work_dir).string();
+    fs::create_directories(fs::path(m_options.work_dir) / "logs");
+}
+
+json Benchmark::run() {
+    json results = json::array();
+    int cell_number = 0;
+    for (size_t s = 0; s < m_options.file_sizes.size(); ++s) {
+        for (size_t c = 0; c < m_options.chunk_sizes.size(); ++c) {
+            for (int accounts : m_options.accounts) {
+                for (int concurrency : m_options.concurrency) {
+                    const Cell cell{m_options.file_sizes[s], m_options.chunk_sizes[c], accounts, concurrency};
+                    const bool small_files = s == 0 && c == 0;
+
+                    // A fresh emulator per cell: empty accounts, and memory
+                    // from the previous cell's files is released.
+                    DriveEmulator emulator(m_options.emulator);
+                    const int port = emulator.bindToAnyPort("127.0.0.1");
+                    if (port < 0) {
+                        throw std::runtime_error("The Drive emulator could not bind a port.");
+                    }
+                    std::thread server([&] { emulator.listenAfterBind(); });
+                    while (!emulator.running()) {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    }
+                    m_env[dd::DRIVE_API_URL_ENV] = "http://127.0.0.1:" + std::to_string(port);
+
+                    const std::string cell_dir =
+                        (fs::path(m_options.work_dir) / ("cell-" + std::to_string(cell_number++))).string();
+                    try {
+                        const std::vector<std::string> clients = makeClients(cell_dir, cell);
+                        const std::string& exe = m_options.filesplitter;
+                        const std::string remote = "bench.bin";
+                        const std::int64_t k = concurrency;
+
+                        std::vector<Commands> upload(clients.size(), {{exe, "upload", inputFile(cell.file_bytes), "--to",
+                                                                      remote, "--chunk-size", megabytes(cell.chunk_bytes)}});
+                        json uploaded = measure(emulator, "upload", cell, clients, upload, k * cell.file_bytes, true);
+                        const bool ok = uploaded["ok"].get<bool>();
+                        results.push_back(std::move(uploaded));
+
+                        if (ok) {
+                            // Uploads leave their chunks in the local cache;
+                            // reads must come from the emulator.
+                            prepare(clients, {exe, "cache", "clear"});
+                            const std::int64_t range = std::min(m_options.range_bytes, cell.file_bytes);
+                            std::vector<Commands> reads(clients.size());
+                            for (size_t i = 0; i < clients.size(); ++i) {
+                                std::mt19937_64 random(m_options.seed + i);
+                                std::uniform_int_distribution<std::int64_t> offset(0, cell.file_bytes - range);
+                                for (int r = 0; r < m_options.range_reads; ++r) {
+                                    reads[i].push_back({exe, "cat", remote, "--range",
+                                                        std::to_string(offset(random)) + ":" + std::to_string(range)});
+                                }
+                            }
+                            results.push_back(measure(emulator, "range-read", cell, clients, reads,
+                                                      k * m_options.range_reads * range, false));
+
+                            prepare(clients, {exe, "cache", "clear"});
+                            std::vector<Commands> download(clients.size(), {{exe, "download", remote, "bench.out"}});
+                            json downloaded = measure(emulator, "download", cell, clients, download, k * cell.file_bytes, false);
+                            for (const auto& client : clients) {
+                                const fs::path out = fs::path(client) / "bench.out";
+                                std::error_code ec;
+                                if (downloaded["ok"].get<bool>() &&
+                                    static_cast<std::int64_t>(fs::file_size(out, ec)) != cell.file_bytes) {
+                                    downloaded["ok"] = false;
+                                    downloaded["error"] = "downloaded file in " + client + " has the wrong size";
+                                }
+                                fs::remove(out, ec);
+                            }
+                            results.push_back(std::move(downloaded));
+
+                            std::vector<Commands> remove(clients.size(), {{exe, "delete", remote}});
+                            results.push_back(measure(emulator, "delete", cell, clients, remove, k * cell.file_bytes, false));
+                        }
+
+                        if (small_files) {
+                            std::vector<Commands> tree(clients.size(), {{exe, "upload", "-r", smallFilesDir(), "--to", "small"}});
+                            const Cell small{m_options.small_file_bytes, cell.chunk_bytes, accounts, concurrency};
+                            json packed = measure(emulator, "small-files", small, clients, tree,
+                                                  k * m_options.small_files * m_options.small_file_bytes, true);
+                            packed["files"] = m_options.small_files;
+                            results.push_back(std::move(packed));
+                        }
+                    } catch (const std::exception& e) {
+                        std::cerr << "Cell " << cell_dir << " aborted: " << e.what() << std::endl;
+                    }
+
+                    emulator.stop();
+                    server.join();
+                    std::error_code ec;
+                    fs::remove_all(cell_dir, ec);
+                }
+            }
+        }
+    }
+
+    json emulator = {{"bandwidth_mb_per_s", rounded(m_options.emulator.bandwidth_bytes_per_sec / kMB)},
+                     {"rtt_ms", m_options.emulator.rtt.count()},
+                     {"rate_limit_rate", m_options.emulator.rate_limit_rate},
+                     {"server_error_rate", m_options.emulator.server_error_rate},
+                     {"reset_rate", m_options.emulator.reset_rate},
+                     {"seed", m_options.emulator.seed}};
+    return {{"benchmark", "dd_bench"},
+            {"format", 1},
+            {"label", m_options.label},
+            {"started", utcNow()},
+            {"host", {{"os", platformName()}, {"cpus", std::thread::hardware_concurrency()}}},
+            {"emulator", emulator},
+            {"options", {{"range_reads", m_options.range_reads},
+                         {"range_bytes", m_options.range_bytes},
+                         {"small_files", m_options.small_files},
+                         {"small_file_bytes", m_options.small_file_bytes},
+                         {"seed", m_options.seed}}},
+            {"results", results}};
+}
+
+json Benchmark::measure(DriveEmulator& emulator, const std::string& scenario, const Cell& cell,
+                        const std::vector<std::string>& clients, const std::vector<Commands>& commands,
+                        std::int64_t bytes, bool upload) {
+    emulator.takeTransfers();
+    const DriveEmulator::Counters before = emulator.counters();
+
+    std::mutex mutex;
+    std::vector<ProcessUsage> usages;
+    std::string error;
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < clients.size(); ++i) {
+        threads.emplace_back([&, i] {
+            for (const auto& command : commands[i]) {
+                const std::string log = logPath(scenario);
+                std::string failure;
+                try {
+                    ProcessUsage usage = ChildProcess(command, clients[i], m_env, log).wait();
+                    if (usage.exit_code != 0) {
+                        failure = command[1] + " exited with status " + std::to_string(usage.exit_code) + "; see " + log;
+                    }
+                    std::lock_guard<std::mutex> lock(mutex);
+                    usages.push_back(usage);
+                } catch (const std::exception& e) {
+                    failure = e.what();
+                }
+                if (!failure.empty()) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (error.empty()) error = failure;
+                    return;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::vector<double> latencies;
+    for (const auto& transfer : emulator.takeTransfers()) {
+        if (transfer.upload == upload) latencies.push_back(transfer.seconds * 1000);
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const DriveEmulator::Counters after = emulator.counters();
+
+    double user = 0, system = 0;
+    std::int64_t peak_rss = -1, reads = -1, writes = -1, other = -1, switches = -1;
+    auto add = [](std::int64_t& total, std::int64_t value) {
+        if (value >= 0) total = std::max<std::int64_t>(total, 0) + value;
+    };
+    for (const auto& usage : usages) {
+        user += usage.user_seconds;
+        system += usage.system_seconds;
+        peak_rss = std::max(peak_rss, usage.peak_rss_bytes);
+        add(reads, usage.read_syscalls);
+        add(writes, usage.write_syscalls);
+        add(other, usage.other_syscalls);
+        add(switches, usage.context_switches);
+    }
+
+    json result = {{"scenario", scenario},
+                   {"file_bytes", cell.file_bytes},
+                   {"chunk_bytes", cell.chunk_bytes},
+                   {"accounts", cell.accounts},
+                   {"concurrency", cell.concurrency},
+                   {"ok", error.empty()},
+                   {"commands", usages.size()},
+                   {"bytes", bytes},
+                   {"seconds", rounded(seconds, 4)},
+                   {"mb_per_s", rounded(seconds > 0 ? bytes / kMB / seconds : 0)},
+                   {"chunk_latency_ms", {{"count", latencies.size()},
+                                         {"p50", rounded(percentile(latencies, 0.50))},
+                                         {"p99", rounded(percentile(latencies, 0.99))},
+                                         {"max", rounded(latencies.empty() ? 0 : latencies.back())}}},
+                   {"peak_rss_bytes", orNull(peak_rss)},
+                   {"cpu_seconds", {{"user", rounded(user, 4)}, {"system", rounded(system, 4)}}},
+                   {"syscalls", {{"read", orNull(reads)}, {"write", orNull(writes)}, {"other", orNull(other)}}},
+                   {"context_switches", orNull(switches)},
+                   {"emulator", {{"requests", after.requests - before.requests},
+                                 {"rate_limited", after.rate_limited - before.rate_limited},
+                                 {"server_errors", after.server_errors - before.server_errors},
+                                 {"resets", after.resets - before.resets}}}};
+    if (!error.empty()) result["error"] = error;
+
+    std::cerr << std::left << std::setw(11) << scenario << " file " << std::setw(5) << sizeLabel(cell.file_bytes)
+              << " chunk " << std::setw(5) << sizeLabel(cell.chunk_bytes) << " accounts " << std::setw(3)
+              << cell.accounts << " clients " << std::setw(3) << cell.concurrency << std::right;
+    if (error.empty()) {
+        std::cerr << std::fixed << std::setprecision(1) << std::setw(9) << result["mb_per_s"].get<double>()
+                  << " MB/s  p50 " << result["chunk_latency_ms"]["p50"].get<double>() << " ms  p99 "
+                  << result["chunk_latency_ms"]["p99"].get<double>() << " ms" << std::endl;
+    } else {
+        std::cerr << "  FAILED: " << error << std::endl;
+    }
+    return result;
+}
+
+void Benchmark::prepare(const std::vector<std::string>& clients, const std::vector<std::string>& command) {
+    for (const auto& client : clients) {
+        const std::string log = logPath(command[1]);
+        if (ChildProcess(command, client, m_env, log).wait().exit_code != 0) {
+            throw std::runtime_error(command[1] + " failed; see " + log);
+        }
+    }
+}
+
+// Each client is a working directory with its own catalog and cache, linked
+// to accounts bench0..benchN-1 through token files the emulator accepts.
+std::vector<std::string> Benchmark::makeClients(const std::string& cell_dir, const Cell& cell) {
+    std::vector<std::string> clients;
+    for (int i = 0; i < cell.concurrency; ++i) {
+        const fs::path dir = fs::path(cell_dir) / ("client-" + std::to_string(i));
+        fs::create_directories(dir / "data" / "credentials");
+        fs::create_directories(dir / "data" / "tokens");
+        std::ofstream(dir / "data" / "credentials" / "credentials.json")
+            << json{{"installed", {{"client_id", "dd-bench"}, {"client_secret", "dd-bench"},
+                                   {"token_uri", m_env.at(dd::DRIVE_API_URL_ENV) + "/token"}}}}.dump(2);
+        for (int a = 0; a < cell.accounts; ++a) {
+            const std::string account = "bench" + std::to_string(a);
+            std::ofstream(dir / "data" / "tokens" / (account + ".json")) << json{{"refresh_token", account}}.dump(2);
+        }
+        clients.push_back(dir.string());
+    }
+    return clients;
+}
+
+// Random contents, so nothing along the way can shortcut repeated bytes.
+// Inputs are kept in the work directory and reused by later runs.
+std::string Benchmark::inputFile(std::int64_t size) {
+    const fs::path path = fs::path(m_options.work_dir) / ("input-" + sizeLabel(size) + "-" +
+                                                          std::to_string(m_options.seed) + ".bin");
+    std::error_code ec;
+    if (fs::is_regular_file(path) && static_cast<std::int64_t>(fs::file_size(path, ec)) == size) {
+        return path.string();
+    }
+    const fs::path temp = path.string() + ".tmp";
+    std::ofstream out(temp, std::ios::binary | std::ios::trunc);
+    std::mt19937_64 random(m_options.seed);
+    std::vector<std::uint64_t> block(128 * 1024);
+    for (std::int64_t written = 0; written < size;) {
+        for (auto& word : block) word = random();
+        const std::int64_t take = std::min<std::int64_t>(size - written, static_cast<std::int64_t>(block.size() * 8));
+        out.write(reinterpret_cast<const char*>(block.data()), static_cast<std::streamsize>(take));
+        written += take;
+    }
+    if (!out.flush()) {
+        throw std::runtime_error("Cannot write benchmark input " + temp.string());
+    }
+    out.close();
+    fs::rename(temp, path);
+    return path.string();
+}
+
+std::string Benchmark::smallFilesDir() {
+    const fs::path dir = fs::path(m_options.work_dir) /
+                         ("small-" + std::to_string(m_options.small_files) + "x" + sizeLabel(m_options.small_file_bytes));
+    if (fs::is_directory(dir)) return dir.string();
+    const fs::path temp = dir.string() + ".tmp";
+    fs::remove_all(temp);
+    fs::create_directories(temp);
+    std::mt19937_64 random(m_options.seed);
+    std::string contents(static_cast<size_t>(m_options.small_file_bytes), '\0');
+    for (int i = 0; i < m_options.small_files; ++i) {
+        for (auto& c : contents) c = static_cast<char>(random());
+        // Spread over subdirectories the way a source tree would be.
+        const fs::path file = temp / ("d" + std::to_string(i % 16)) / ("f" + std::to_string(i) + ".dat");
+        fs::create_directories(file.parent_path());
+        std::ofstream(file, std::ios::binary).write(contents.data(), static_cast<std::streamsize>(contents.size()));
+    }
+    fs::rename(temp, dir);
+    return dir.string();
+}
+
+std::string Benchmark::logPath(const std::string& name) {
+    return (fs::path(m_options.work_dir) / "logs" / (std::to_string(m_log_count++) + "-" + name + ".log")).string();
+}
+
+int compareResults(const json& baseline, const json& current, double tolerance) {
+    std::map<std::string, json> base;
+    for (const auto& result : baseline.at("results")) {
+        base[resultKey(result)] = result;
+    }
+    auto change = [](double before, double after) {
+        return before > 0 ? (after - before) / before : 0.0;
+    };
+    auto percent = [](double fraction) {
+        std::ostringstream out;
+        out << std::showpos << std::fixed << std::setprecision(1) << fraction * 100 << "%";
+        return out.str();
+    };
+
+    std::cout << "baseline: " << baseline.value("label", "") << " (" << baseline.value("started", "") << ")\n"
+              << "current:  " << current.value("label", "") << " (" << current.value("started", "") << ")\n\n"
+              << std::left << std::setw(36) << "scenario/file/chunk/accounts/clients" << std::right << std::setw(10)
+              << "MB/s" << std::setw(10) << "change" << std::setw(12) << "p99 ms" << std::setw(10) << "change"
+              << std::setw(10) << "cpu s" << std::setw(10) << "change" << "\n";
+    int regressions = 0;
+    for (const auto& result : current.at("results")) {
+        const std::string key = resultKey(result);
+        std::cout << std::left << std::setw(36) << key << std::right;
+        auto found = base.find(key);
+        if (found == base.end()) {
+            std::cout << "  (not in baseline)\n";
+            continue;
+        }
+        const json& before = found->second;
+        if (!result.value("ok", false)) {
+            const bool regressed = before.value("ok", false);
+            regressions += regressed ? 1 : 0;
+            std::cout << "  FAILED" << (regressed ? "  << regression" : "") << "\n";
+            continue;
+        }
+        if (!before.value("ok", false)) {
+            std::cout << "  (failed in baseline)\n";
+            continue;
+        }
+        auto cpu = [](const json& r) {
+            return r["cpu_seconds"]["user"].get<double>() + r["cpu_seconds"]["system"].get<double>();
+        };
+        const double rate = change(before["mb_per_s"].get<double>(), result["mb_per_s"].get<double>());
+        const double p99 = change(before["chunk_latency_ms"]["p99"].get<double>(),
+                                  result["chunk_latency_ms"]["p99"].get<double>());
+        const double cpu_change = change(cpu(before), cpu(result));
+        const bool regressed = rate < -tolerance || p99 > tolerance;
+        regressions += regressed ? 1 : 0;
+        std::cout << std::fixed << std::setprecision(1) << std::setw(10) << result["mb_per_s"].get<double>()
+                  << std::setw(10) << percent(rate) << std::setw(12) << result["chunk_latency_ms"]["p99"].get<double>()
+                  << std::setw(10) << percent(p99) << std::setprecision(2) << std::setw(10) << cpu(result)
+                  << std::setw(10) << percent(cpu_change) << (regressed ? "  << regression" : "") << "\n";
+    }
+    std::cout << "\n" << regressions << " regression(s) beyond " << tolerance * 100 << "%" << std::endl;
+    return regressions;
+}
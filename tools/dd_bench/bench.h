@@ -0,0 +1,82 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "child_process.h"
+#include "drive_emulator.h"
+
+// End-to-end benchmark of the filesplitter binary against an in-process
+// DriveEmulator. For every combination of file size, chunk size, account
+// count and concurrency it starts a fresh emulator, sets up `concurrency`
+// independent clients (each its own data/ directory, all linked to the same
+// emulated accounts, so they share each account's bandwidth) and times
+// upload, range-read, download and delete of one file per client, plus an
+// upload of many small files once per account count and concurrency.
+//
+// Each scenario's commands run as child processes, so CPU time, peak RSS
+// and syscall counts are the client's own; chunk latencies are the
+// emulator's timings of each media transfer. Results come out as JSON meant
+// to be kept per commit and compared with compareResults().
+class Benchmark {
+public:
+    struct Options {
+        std::string filesplitter;             // client binary
+        std::string work_dir;                 // scratch space; inputs and logs are kept here
+        std::vector<std::int64_t> file_sizes;
+        std::vector<std::int64_t> chunk_sizes;
+        std::vector<int> accounts;
+        std::vector<int> concurrency;
+        int range_reads = 8;                  // cat --range calls per client
+        std::int64_t range_bytes = 4ll * 1024 * 1024;
+        int small_files = 500;
+        std::int64_t small_file_bytes = 16 * 1024;
+        std::uint64_t seed = 1;               // input contents and range offsets
+        std::string label;                    // e.g. the commit being measured
+        DriveEmulator::Options emulator;
+    };
+
+    explicit Benchmark(Options options);
+
+    // Runs the whole matrix, reporting progress on stderr.
+    nlohmann::json run();
+
+private:
+    struct Cell {
+        std::int64_t file_bytes;
+        std::int64_t chunk_bytes;
+        int accounts;
+        int concurrency;
+    };
+
+    // One step per client; a step's commands run one after another, clients
+    // in parallel.
+    using Commands = std::vector<std::vector<std::string>>;
+
+    // Runs each client's commands against the emulator and returns the
+    // scenario's result.
+    nlohmann::json measure(DriveEmulator& emulator, const std::string& scenario, const Cell& cell,
+                           const std::vector<std::string>& clients, const std::vector<Commands>& commands,
+                           std::int64_t bytes, bool upload);
+    // Runs one command in every client without measuring it; throws if one fails.
+    void prepare(const std::vector<std::string>& clients, const std::vector<std::string>& command);
+    std::vector<std::string> makeClients(const std::string& cell_dir, const Cell& cell);
+    std::string inputFile(std::int64_t size);
+    std::string smallFilesDir();
+    std::string logPath(const std::string& name);
+
+    Options m_options;
+    std::map<std::string, std::string> m_env;
+    std::atomic<std::uint64_t> m_log_count{0};   // numbers the command logs
+};
+
+// Matches the results of two runs by scenario and parameters and prints the
+// change in throughput, p99 chunk latency and CPU time. Returns the number
+// of results that regressed by more than `tolerance` (a fraction).
+int compareResults(const nlohmann::json& baseline, const nlohmann::json& current, double tolerance);
+
+#endif // BENCH_H
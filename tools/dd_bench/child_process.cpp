@@ -0,0 +1,203 @@
+#include "child_process.h"
+#include <cstring>
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+extern char** environ;
+#endif
+
+#ifdef _WIN32
+
+namespace {
+    // Quotes one argument the way CommandLineToArgvW splits it back.
+    std::string quoteArgument(const std::string& arg) {
+        if (!arg.empty() && arg.find_first_of(" \t\"") == std::string::npos) return arg;
+        std::string out = "\"";
+        size_t backslashes = 0;
+        for (char c : arg) {
+            if (c == '\\') {
+                ++backslashes;
+                continue;
+            }
+            out.append(c == '"' ? backslashes * 2 + 1 : backslashes, '\\');
+            backslashes = 0;
+            out += c;
+        }
+        out.append(backslashes * 2, '\\');
+        return out + "\"";
+    }
+
+    double seconds(const FILETIME& time) {
+        ULARGE_INTEGER value;
+        value.LowPart = time.dwLowDateTime;
+        value.HighPart = time.dwHighDateTime;
+        return static_cast<double>(value.QuadPart) / 1e7;
+    }
+}
+
+ChildProcess::ChildProcess(const std::vector<std::string>& argv, const std::string& cwd,
+                           const std::map<std::string, std::string>& env, const std::string& log_path) {
+    std::string command;
+    for (const auto& arg : argv) {
+        if (!command.empty()) command += ' ';
+        command += quoteArgument(arg);
+    }
+
+    // The parent's environment with `env` laid over it.
+    std::string block;
+    if (char* strings = GetEnvironmentStringsA()) {
+        for (const char* entry = strings; *entry; entry += std::strlen(entry) + 1) {
+            const std::string var(entry);
+            const size_t eq = var.find('=', 1);
+            if (eq == std::string::npos || !env.count(var.substr(0, eq))) block.append(var).push_back('\0');
+        }
+        FreeEnvironmentStringsA(strings);
+    }
+    for (const auto& [name, value] : env) block.append(name + "=" + value).push_back('\0');
+    block.push_back('\0');
+
+    SECURITY_ATTRIBUTES inherit{sizeof(SECURITY_ATTRIBUTES), nullptr, TRUE};
+    HANDLE log = CreateFileA(log_path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, &inherit,
+                             OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    HANDLE null = CreateFileA("NUL", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, &inherit,
+                              OPEN_EXISTING, 0, nullptr);
+    STARTUPINFOA startup{};
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = null;
+    startup.hStdOutput = null;
+    startup.hStdError = log;
+    PROCESS_INFORMATION info{};
+    m_start = std::chrono::steady_clock::now();
+    const BOOL started = CreateProcessA(nullptr, command.data(), nullptr, nullptr, TRUE, 0, block.data(),
+                                        cwd.c_str(), &startup, &info);
+    if (log != INVALID_HANDLE_VALUE) CloseHandle(log);
+    if (null != INVALID_HANDLE_VALUE) CloseHandle(null);
+    if (!started) {
+        throw std::runtime_error("Cannot start " + argv[0] + " (error " + std::to_string(GetLastError()) + ")");
+    }
+    CloseHandle(info.hThread);
+    m_process = info.hProcess;
+}
+
+ChildProcess::~ChildProcess() {
+    if (!m_waited) {
+        WaitForSingleObject(m_process, INFINITE);
+    }
+    CloseHandle(m_process);
+}
+
+ProcessUsage ChildProcess::wait() {
+    ProcessUsage usage;
+    WaitForSingleObject(m_process, INFINITE);
+    m_waited = true;
+    usage.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    DWORD code = 0;
+    if (GetExitCodeProcess(m_process, &code)) usage.exit_code = static_cast<int>(code);
+    FILETIME created, exited, kernel, user;
+    if (GetProcessTimes(m_process, &created, &exited, &kernel, &user)) {
+        usage.user_seconds = seconds(user);
+        usage.system_seconds = seconds(kernel);
+    }
+    PROCESS_MEMORY_COUNTERS memory{};
+    if (GetProcessMemoryInfo(m_process, &memory, sizeof(memory))) {
+        usage.peak_rss_bytes = static_cast<std::int64_t>(memory.PeakWorkingSetSize);
+    }
+    IO_COUNTERS io{};
+    if (GetProcessIoCounters(m_process, &io)) {
+        usage.read_syscalls = static_cast<std::int64_t>(io.ReadOperationCount);
+        usage.write_syscalls = static_cast<std::int64_t>(io.WriteOperationCount);
+        usage.other_syscalls = static_cast<std::int64_t>(io.OtherOperationCount);
+    }
+    return usage;
+}
+
+#else
+
+ChildProcess::ChildProcess(const std::vector<std::string>& argv, const std::string& cwd,
+                           const std::map<std::string, std::string>& env, const std::string& log_path) {
+    // Everything the child needs is built before fork(): the benchmark has
+    // server threads running, so the child may only make async-signal-safe
+    // calls until it execs.
+    std::vector<std::string> vars;
+    for (char** entry = environ; *entry; ++entry) {
+        const std::string var(*entry);
+        const size_t eq = var.find('=');
+        if (eq == std::string::npos || !env.count(var.substr(0, eq))) vars.push_back(var);
+    }
+    for (const auto& [name, value] : env) vars.push_back(name + "=" + value);
+    std::vector<char*> envp;
+    for (auto& var : vars) envp.push_back(var.data());
+    envp.push_back(nullptr);
+    std::vector<std::string> args(argv);
+    std::vector<char*> argp;
+    for (auto& arg : args) argp.push_back(arg.data());
+    argp.push_back(nullptr);
+
+    m_start = std::chrono::steady_clock::now();
+    m_pid = fork();
+    if (m_pid < 0) {
+        throw std::runtime_error(std::string("fork failed: ") + std::strerror(errno));
+    }
+    if (m_pid == 0) {
+        const int null = open("/dev/null", O_RDWR);
+        const int log = open(log_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (null < 0 || log < 0 || chdir(cwd.c_str()) != 0) _exit(126);
+        dup2(null, STDIN_FILENO);
+        dup2(null, STDOUT_FILENO);
+        dup2(log, STDERR_FILENO);
+        execve(argp[0], argp.data(), envp.data());
+        _exit(127);
+    }
+}
+
+ChildProcess::~ChildProcess() {
+    if (!m_waited) {
+        int status = 0;
+        waitpid(m_pid, &status, 0);
+    }
+}
+
+ProcessUsage ChildProcess::wait() {
+    ProcessUsage usage;
+    // Wait without reaping, so the exited child's I/O counters can still be
+    // read from /proc.
+    siginfo_t info{};
+    while (waitid(P_PID, static_cast<id_t>(m_pid), &info, WEXITED | WNOWAIT) != 0 && errno == EINTR) {
+    }
+    usage.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    std::ifstream io("/proc/" + std::to_string(m_pid) + "/io");
+    std::string key;
+    std::int64_t value = 0;
+    while (io >> key >> value) {
+        if (key == "syscr:") usage.read_syscalls = value;
+        if (key == "syscw:") usage.write_syscalls = value;
+    }
+
+    int status = 0;
+    rusage usage_info{};
+    while (wait4(m_pid, &status, 0, &usage_info) < 0 && errno == EINTR) {
+    }
+    m_waited = true;
+    usage.exit_code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    usage.user_seconds = static_cast<double>(usage_info.ru_utime.tv_sec) + usage_info.ru_utime.tv_usec / 1e6;
+    usage.system_seconds = static_cast<double>(usage_info.ru_stime.tv_sec) + usage_info.ru_stime.tv_usec / 1e6;
+#ifdef __APPLE__
+    usage.peak_rss_bytes = static_cast<std::int64_t>(usage_info.ru_maxrss);          // bytes
+#else
+    usage.peak_rss_bytes = static_cast<std::int64_t>(usage_info.ru_maxrss) * 1024;   // kilobytes
+#endif
+    usage.context_switches = static_cast<std::int64_t>(usage_info.ru_nvcsw + usage_info.ru_nivcsw);
+    return usage;
+}
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef CHILD_PROCESS_H
+#define CHILD_PROCESS_H
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// What a finished child process cost, as reported by the OS once it exits.
+// Counters the platform cannot report are left at -1.
+struct ProcessUsage {
+    int exit_code = -1;
+    double seconds = 0;                 // wall time from start to exit
+    double user_seconds = 0;
+    double system_seconds = 0;
+    std::int64_t peak_rss_bytes = -1;
+    std::int64_t read_syscalls = -1;    // Linux: syscr; Windows: read operations
+    std::int64_t write_syscalls = -1;   // Linux: syscw; Windows: write operations
+    std::int64_t other_syscalls = -1;   // Windows only: other I/O operations
+    std::int64_t context_switches = -1; // voluntary + involuntary (POSIX)
+};
+
+// Runs a program in its own working directory with extra environment
+// variables; stdout is discarded and stderr appended to `log_path`.
+class ChildProcess {
+public:
+    ChildProcess(const std::vector<std::string>& argv, const std::string& cwd,
+                 const std::map<std::string, std::string>& env, const std::string& log_path);
+    ~ChildProcess();   // waits for the child if wait() was not called
+
+    ChildProcess(const ChildProcess&) = delete;
+    ChildProcess& operator=(const ChildProcess&) = delete;
+
+    // Waits for the child to exit and collects its usage. Call once.
+    ProcessUsage wait();
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+    bool m_waited = false;
+#ifdef _WIN32
+    void* m_process = nullptr;
+#else
+    int m_pid = -1;
+#endif
+};
+
+#endif // CHILD_PROCESS_H
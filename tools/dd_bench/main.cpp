@@ -0,0 +1,136 @@
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "bench.h"
+
+namespace {
+    // "64M" -> bytes; K, M and G suffixes are powers of 1024.
+    std::int64_t parseSize(const std::string& text) {
+        size_t used = 0;
+        const double value = std::stod(text, &used);
+        const std::string unit = text.substr(used);
+        const double scale = unit.empty() ? 1 : unit == "K" || unit == "k" ? 1024.0
+                           : unit == "M" || unit == "m" ? 1024.0 * 1024
+                           : unit == "G" || unit == "g" ? 1024.0 * 1024 * 1024 : -1;
+        if (scale < 0 || value <= 0) throw std::invalid_argument("bad size " + text);
+        return static_cast<std::int64_t>(value * scale);
+    }
+
+    template <typename T, typename Parse>
+    std::vector<T> parseList(const std::string& text, Parse parse) {
+        std::vector<T> values;
+        std::stringstream in(text);
+        for (std::string item; std::getline(in, item, ',');) {
+            if (!item.empty()) values.push_back(static_cast<T>(parse(item)));
+        }
+        return values;
+    }
+
+    nlohmann::json readJson(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) throw std::runtime_error("Cannot open " + path);
+        nlohmann::json value;
+        in >> value;
+        return value;
+    }
+}
+
+// dd_bench [--filesplitter path] [--work-dir dir] [--out results.json] [--label name]
+//          [--sizes 32M,256M] [--chunks 8M,64M] [--accounts 1,4] [--concurrency 1,4]
+//          [--range-reads N] [--range-size 4M] [--small-files N] [--small-file-size 16K]
+//          [--bandwidth MB/s] [--rtt ms] [--rate-limit p] [--server-error p] [--reset p] [--seed N]
+// dd_bench --compare baseline.json current.json [--tolerance percent]
+int main(int argc, char* argv[]) {
+    const std::string usage =
+        "Usage: dd_bench [--filesplitter path] [--work-dir dir] [--out results.json] [--label name]\n"
+        "                [--sizes 32M,256M] [--chunks 8M,64M] [--accounts 1,4] [--concurrency 1,4]\n"
+        "                [--range-reads N] [--range-size 4M] [--small-files N] [--small-file-size 16K]\n"
+        "                [--bandwidth MB/s] [--rtt ms] [--rate-limit p] [--server-error p] [--reset p] [--seed N]\n"
+        "       dd_bench --compare baseline.json current.json [--tolerance percent]\n";
+
+    if (argc >= 4 && std::string(argv[1]) == "--compare") {
+        try {
+            double tolerance = 0.10;
+            if (argc == 6 && std::string(argv[4]) == "--tolerance") {
+                tolerance = std::stod(argv[5]) / 100;
+            } else if (argc != 4) {
+                std::cerr << usage;
+                return 2;
+            }
+            return compareResults(readJson(argv[2]), readJson(argv[3]), tolerance) > 0 ? 1 : 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 2;
+        }
+    }
+
+    Benchmark::Options options;
+    options.filesplitter = "filesplitter";
+    options.work_dir = "dd_bench_work";
+    options.file_sizes = {32ll << 20, 256ll << 20};
+    options.chunk_sizes = {8ll << 20, 64ll << 20};
+    options.accounts = {1, 4};
+    options.concurrency = {1, 4};
+    options.emulator.bandwidth_bytes_per_sec = 100.0 * 1024 * 1024;
+    options.emulator.rtt = std::chrono::milliseconds(20);
+    std::string out_path;
+    try {
+        for (int i = 1; i < argc; i += 2) {
+            const std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h" || i + 1 >= argc) {
+                std::cout << usage;
+                return flag == "--help" || flag == "-h" ? 0 : 2;
+            }
+            const std::string value = argv[i + 1];
+            if (flag == "--filesplitter") options.filesplitter = value;
+            else if (flag == "--work-dir") options.work_dir = value;
+            else if (flag == "--out") out_path = value;
+            else if (flag == "--label") options.label = value;
+            else if (flag == "--sizes") options.file_sizes = parseList<std::int64_t>(value, parseSize);
+            else if (flag == "--chunks") options.chunk_sizes = parseList<std::int64_t>(value, parseSize);
+            else if (flag == "--accounts") options.accounts = parseList<int>(value, [](const std::string& v) { return std::stoi(v); });
+            else if (flag == "--concurrency") options.concurrency = parseList<int>(value, [](const std::string& v) { return std::stoi(v); });
+            else if (flag == "--range-reads") options.range_reads = std::stoi(value);
+            else if (flag == "--range-size") options.range_bytes = parseSize(value);
+            else if (flag == "--small-files") options.small_files = std::stoi(value);
+            else if (flag == "--small-file-size") options.small_file_bytes = parseSize(value);
+            else if (flag == "--bandwidth") options.emulator.bandwidth_bytes_per_sec = std::stod(value) * 1024 * 1024;
+            else if (flag == "--rtt") options.emulator.rtt = std::chrono::milliseconds(std::stoll(value));
+            else if (flag == "--rate-limit") options.emulator.rate_limit_rate = std::stod(value);
+            else if (flag == "--server-error") options.emulator.server_error_rate = std::stod(value);
+            else if (flag == "--reset") options.emulator.reset_rate = std::stod(value);
+            else if (flag == "--seed") options.seed = options.emulator.seed = std::stoull(value);
+            else {
+                std::cerr << "Unknown option " << flag << "\n" << usage;
+                return 2;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    try {
+        Benchmark bench(options);
+        const nlohmann::json results = bench.run();
+        if (out_path.empty()) {
+            std::cout << results.dump(2) << std::endl;
+        } else {
+            std::ofstream out(out_path);
+            out << results.dump(2) << std::endl;
+            if (!out) throw std::runtime_error("Cannot write " + out_path);
+            std::cerr << "Results written to " << out_path << std::endl;
+        }
+        for (const auto& result : results["results"]) {
+            if (!result["ok"].get<bool>()) return 1;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,315 @@
+#include "kernels.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <thread>
+#include "Shell.h"
+#include "base64url.h"
+#include "catalog.h"
+#include "checksum.h"
+#include "ordered_fetch.h"
+#include "upload_scheduler.h"
+
+namespace fs = std::filesystem;
+using json = nlohmann::json;
+
+namespace {
+    // 64M, 16K, 1k: sizes in powers of 1024 with an upper-case unit, counts
+    // in powers of 1000 with a lower-case one.
+    std::string bytesLabel(std::int64_t bytes) {
+        if (bytes >= (1 << 20) && bytes % (1 << 20) == 0) return std::to_string(bytes >> 20) + "M";
+        if (bytes >= (1 << 10) && bytes % (1 << 10) == 0) return std::to_string(bytes >> 10) + "K";
+        return std::to_string(bytes);
+    }
+
+    std::string countLabel(std::int64_t count) {
+        if (count >= 1000000 && count % 1000000 == 0) return std::to_string(count / 1000000) + "M";
+        if (count >= 1000 && count % 1000 == 0) return std::to_string(count / 1000) + "k";
+        return std::to_string(count);
+    }
+
+    std::vector<char> randomBytes(std::int64_t size) {
+        std::vector<char> data(static_cast<size_t>(size));
+        std::mt19937_64 random(42);
+        for (auto& c : data) c = static_cast<char>(random());
+        return data;
+    }
+
+    // A catalog of `chunks` chunks shaped like a real one: files of up to 100
+    // 256 MB chunks, one replica each on one of four accounts, with Drive-like
+    // 33-character ids. Names come back in PathLess order.
+    std::vector<FileEntry> makeCatalog(std::int64_t chunks) {
+        std::vector<FileEntry> files;
+        std::mt19937_64 random(7);
+        const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+        for (std::int64_t done = 0; done < chunks;) {
+            FileEntry file;
+            const std::size_t index = files.size();
+            char name[64];
+            std::snprintf(name, sizeof(name), "backups/set%04zu/file%08zu.tar", index / 1000, index);
+            file.name = name;
+            const int count = static_cast<int>(std::min<std::int64_t>(100, chunks - done));
+            for (int part = 0; part < count; ++part) {
+                ChunkEntry chunk;
+                chunk.part = part;
+                chunk.size = dd::UPLOAD_CHUNK_BYTES;
+                std::string id(33, ' ');
+                for (auto& c : id) c = alphabet[random() % 64];
+                chunk.replicas.push_back({"account" + std::to_string(random() % 4) + "@gmail.com", id});
+                file.chunks.push_back(std::move(chunk));
+            }
+            file.total_size = count * dd::UPLOAD_CHUNK_BYTES;
+            files.push_back(std::move(file));
+            done += count;
+        }
+        std::sort(files.begin(), files.end(),
+                  [](const FileEntry& a, const FileEntry& b) { return PathLess()(a.name, b.name); });
+        return files;
+    }
+
+    json exportCatalog(const std::vector<FileEntry>& files) {
+        json out = json::object();
+        for (const auto& file : files) out[file.name] = toJson(file);
+        return {{"files", out}};
+    }
+
+    void addQueue(MicroBench& bench) {
+        for (int threads : {1, 4}) {
+            bench.add("thread-safe-queue/push-pop", std::to_string(threads) + "x" + std::to_string(threads), [threads] {
+                MicroBench::Case c;
+                c.body = [threads](std::int64_t n) {
+                    ThreadSafeQueue<std::int64_t> queue;
+                    std::vector<std::thread> producers, consumers;
+                    for (int t = 0; t < threads; ++t) {
+                        producers.emplace_back([&queue, n, threads, t] {
+                            for (std::int64_t i = t; i < n; i += threads) queue.push(i);
+                        });
+                        consumers.emplace_back([&queue] {
+                            std::int64_t value;
+                            while (queue.pop(value)) keep(&value);
+                        });
+                    }
+                    for (auto& p : producers) p.join();
+                    queue.done();
+                    for (auto& c : consumers) c.join();
+                };
+                return c;
+            });
+        }
+    }
+
+    void addSemaphore(MicroBench& bench) {
+        // 16 permits, as Shell's upload slots.
+        for (int threads : {1, 32}) {
+            bench.add("semaphore/acquire-release", std::to_string(threads) + (threads == 1 ? " thread" : " threads"), [threads] {
+                MicroBench::Case c;
+                c.body = [threads](std::int64_t n) {
+                    Semaphore slots(16);
+                    std::vector<std::thread> workers;
+                    for (int t = 0; t < threads; ++t) {
+                        workers.emplace_back([&slots, n, threads, t] {
+                            for (std::int64_t i = t; i < n; i += threads) {
+                                slots.acquire();
+                                slots.release();
+                            }
+                        });
+                    }
+                    for (auto& w : workers) w.join();
+                };
+                return c;
+            });
+        }
+    }
+
+    // The upload path allocates a zeroed buffer per chunk, reads the file into
+    // it, and GDriveHandler::uploadChunk copies it into a std::string body.
+    void addUploadBuffers(MicroBench& bench) {
+        for (std::int64_t size : {5ll << 20, 64ll << 20, 256ll << 20}) {
+            bench.add("upload-buffer/allocate", bytesLabel(size), [size] {
+                MicroBench::Case c;
+                c.bytes = size;
+                c.body = [size](std::int64_t n) {
+                    for (std::int64_t i = 0; i < n; ++i) {
+                        std::vector<char> buffer(static_cast<size_t>(size));
+                        keep(buffer.data() + buffer.size() - 1);
+                    }
+                };
+                return c;
+            });
+            bench.add("upload-buffer/vector-to-string", bytesLabel(size), [size] {
+                auto source = std::make_shared<std::vector<char>>(randomBytes(size));
+                MicroBench::Case c;
+                c.bytes = size;
+                c.body = [source](std::int64_t n) {
+                    for (std::int64_t i = 0; i < n; ++i) {
+                        std::string body(source->begin(), source->end());
+                        keep(body.data() + body.size() - 1);
+                    }
+                };
+                return c;
+            });
+        }
+    }
+
+    void addChecksum(MicroBench& bench) {
+        for (std::int64_t size : {4ll << 10, 1ll << 20, 64ll << 20}) {
+            bench.add("checksum/fnv1a64", bytesLabel(size), [size] {
+                auto data = std::make_shared<std::vector<char>>(randomBytes(size));
+                MicroBench::Case c;
+                c.bytes = size;
+                c.body = [data](std::int64_t n) {
+                    for (std::int64_t i = 0; i < n; ++i) {
+                        Checksum checksum;
+                        checksum.update(data->data(), data->size());
+                        const std::uint64_t value = checksum.finish();
+                        keep(&value);
+                    }
+                };
+                return c;
+            });
+        }
+    }
+
+    void addBase64(MicroBench& bench) {
+        // An id-token payload is a few hundred characters; 1M shows the
+        // per-byte cost.
+        for (std::int64_t size : {600ll, 1ll << 20}) {
+            bench.add("base64url/decode", size == 600 ? "id-token" : bytesLabel(size), [size] {
+                const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+                auto text = std::make_shared<std::string>(static_cast<size_t>(size), 'A');
+                std::mt19937 random(3);
+                for (auto& ch : *text) ch = alphabet[random() % 64];
+                MicroBench::Case c;
+                c.bytes = size;
+                c.body = [text](std::int64_t n) {
+                    for (std::int64_t i = 0; i < n; ++i) {
+                        const std::string decoded = decode_base64url(*text);
+                        keep(decoded.data());
+                    }
+                };
+                return c;
+            });
+        }
+    }
+
+    void addCatalog(MicroBench& bench, const KernelOptions& options) {
+        for (std::int64_t chunks = 1000; chunks <= options.max_catalog_chunks; chunks *= 10) {
+            const std::string label = countLabel(chunks) + " chunks";
+            bench.add("catalog-json/serialize", label, [chunks] {
+                auto files = std::make_shared<std::vector<FileEntry>>(makeCatalog(chunks));
+                MicroBench::Case c;
+                c.bytes = static_cast<std::int64_t>(exportCatalog(*files).dump().size());
+                c.items = chunks;
+                c.body = [files](std::int64_t n) {
+                    for (std::int64_t i = 0; i < n; ++i) {
+                        const std::string text = exportCatalog(*files).dump();
+                        keep(text.data());
+                    }
+                };
+                return c;
+            });
+            bench.add("catalog-json/parse", label, [chunks] {
+                auto text = std::make_shared<std::string>(exportCatalog(makeCatalog(chunks)).dump());
+                MicroBench::Case c;
+                c.bytes = static_cast<std::int64_t>(text->size());
+                c.items = chunks;
+                c.body = [text](std::int64_t n) {
+                    for (std::int64_t i = 0; i < n; ++i) {
+                        const json catalog = json::parse(*text);
+                        std::vector<FileEntry> files;
+                        for (const auto& [name, entry] : catalog["files"].items()) {
+                            files.push_back(fileFromJson(name, entry));
+                        }
+                        keep(files.data());
+                    }
+                };
+                return c;
+            });
+
+            // The binary snapshot the catalog actually lives in, for comparison.
+            const std::string path = (fs::temp_directory_path() / ("dd_microbench_" + countLabel(chunks) + ".bin")).string();
+            auto write = [path](const std::vector<FileEntry>& files) {
+                CatalogSnapshot::write(path, 1, [&](const std::function<void(const FileEntry&)>& emit) {
+                    for (const auto& file : files) emit(file);
+                });
+            };
+            bench.add("catalog-snapshot/write", label, [chunks, path, write] {
+                auto files = std::make_shared<std::vector<FileEntry>>(makeCatalog(chunks));
+                write(*files);
+                MicroBench::Case c;
+                c.bytes = static_cast<std::int64_t>(fs::file_size(path));
+                c.items = chunks;
+                c.body = [files, write](std::int64_t n) {
+                    for (std::int64_t i = 0; i < n; ++i) write(*files);
+                };
+                c.cleanup = [path] { fs::remove(path); };
+                return c;
+            });
+            bench.add("catalog-snapshot/open-decode", label, [chunks, path, write] {
+                write(makeCatalog(chunks));
+                MicroBench::Case c;
+                c.bytes = static_cast<std::int64_t>(fs::file_size(path));
+                c.items = chunks;
+                c.body = [path](std::int64_t n) {
+                    for (std::int64_t i = 0; i < n; ++i) {
+                        const auto snapshot = CatalogSnapshot::open(path);
+                        std::int64_t decoded = 0;
+                        for (std::size_t f = 0; f < snapshot->fileCount(); ++f) {
+                            decoded += static_cast<std::int64_t>(snapshot->file(f).chunks.size());
+                        }
+                        keep(&decoded);
+                    }
+                };
+                c.cleanup = [path] { fs::remove(path); };
+                return c;
+            });
+        }
+    }
+
+    void addPipeline(MicroBench& bench) {
+        // Reorder-buffer overhead per piece, with pieces that cost nothing to fetch.
+        bench.add("fetch-in-order/piece", "8 workers", [] {
+            MicroBench::Case c;
+            c.body = [](std::int64_t n) {
+                std::int64_t bytes = 0;
+                fetchInOrder(static_cast<std::size_t>(n), dd::READ_WORKERS, 16,
+                             [](std::size_t) { return std::string(64, 'x'); },
+                             [&](std::string&& piece) { bytes += static_cast<std::int64_t>(piece.size()); });
+                keep(&bytes);
+            };
+            return c;
+        });
+
+        // Planning a 100k-file upload -r: packing and chunk ordering.
+        bench.add("upload-scheduler/plan", "100k files", [] {
+            auto jobs = std::make_shared<std::vector<UploadJob>>();
+            std::mt19937_64 random(11);
+            std::lognormal_distribution<double> size(11, 3);   // median ~60 KB, long tail
+            for (int i = 0; i < 100000; ++i) {
+                jobs->push_back({"", "tree/d" + std::to_string(i % 100) + "/f" + std::to_string(i),
+                                 std::min<std::int64_t>(static_cast<std::int64_t>(size(random)), 8ll << 30)});
+            }
+            MicroBench::Case c;
+            c.items = static_cast<std::int64_t>(jobs->size());
+            c.body = [jobs](std::int64_t n) {
+                for (std::int64_t i = 0; i < n; ++i) {
+                    const auto packs = planPacks(*jobs, dd::PACK_MAX_FILE_BYTES, dd::PACK_TARGET_BYTES);
+                    const auto tasks = scheduleChunks(*jobs, packs, dd::UPLOAD_CHUNK_BYTES, dd::SMALL_UPLOAD_BYTES);
+                    keep(tasks.data());
+                }
+            };
+            return c;
+        });
+    }
+}
+
+void registerKernels(MicroBench& bench, const KernelOptions& options) {
+    addQueue(bench);
+    addSemaphore(bench);
+    addUploadBuffers(bench);
+    addChecksum(bench);
+    addBase64(bench);
+    addCatalog(bench, options);
+    addPipeline(bench);
+}
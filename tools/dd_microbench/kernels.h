@@ -0,0 +1,17 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+#include <cstdint>
+#include "microbench.h"
+
+struct KernelOptions {
+    std::int64_t max_catalog_chunks = 1000000;   // catalogs of 1k, 10k, ... chunks up to this
+};
+
+// The CPU-bound pieces of the transfer pipeline: the queue and semaphore in
+// Shell.h, per-chunk buffer handling on the upload path, the cache checksum,
+// token decoding, catalog JSON and snapshot encoding, the ordered-fetch
+// reorder buffer and upload planning.
+void registerKernels(MicroBench& bench, const KernelOptions& options);
+
+#endif // KERNELS_H
@@ -0,0 +1,96 @@
+#include <ctime>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "kernels.h"
+
+namespace {
+    nlohmann::json readJson(const std::string& path) {
+        std::ifstream in(path);
+        if (!in) throw std::runtime_error("Cannot open " + path);
+        nlohmann::json value;
+        in >> value;
+        return value;
+    }
+}
+
+// dd_microbench [--filter text] [--min-time s] [--repetitions N] [--max-chunks N]
+//               [--out results.json] [--label name]
+// dd_microbench --compare baseline.json current.json [--tolerance percent]
+int main(int argc, char* argv[]) {
+    const std::string usage =
+        "Usage: dd_microbench [--filter text] [--min-time s] [--repetitions N] [--max-chunks N]\n"
+        "                     [--out results.json] [--label name]\n"
+        "       dd_microbench --compare baseline.json current.json [--tolerance percent]\n";
+
+    if (argc >= 4 && std::string(argv[1]) == "--compare") {
+        try {
+            double tolerance = 0.10;
+            if (argc == 6 && std::string(argv[4]) == "--tolerance") {
+                tolerance = std::stod(argv[5]) / 100;
+            } else if (argc != 4) {
+                std::cerr << usage;
+                return 2;
+            }
+            return compareMicroResults(readJson(argv[2]), readJson(argv[3]), tolerance) > 0 ? 1 : 0;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 2;
+        }
+    }
+
+    MicroBench::Options options;
+    KernelOptions kernels;
+    std::string out_path, label;
+    try {
+        for (int i = 1; i < argc; i += 2) {
+            const std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h" || i + 1 >= argc) {
+                std::cout << usage;
+                return flag == "--help" || flag == "-h" ? 0 : 2;
+            }
+            const std::string value = argv[i + 1];
+            if (flag == "--filter") options.filter = value;
+            else if (flag == "--min-time") options.min_seconds = std::stod(value);
+            else if (flag == "--repetitions") options.repetitions = std::stoi(value);
+            else if (flag == "--max-chunks") kernels.max_catalog_chunks = std::stoll(value);
+            else if (flag == "--out") out_path = value;
+            else if (flag == "--label") label = value;
+            else {
+                std::cerr << "Unknown option " << flag << "\n" << usage;
+                return 2;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << usage;
+        return 2;
+    }
+
+    try {
+        MicroBench bench;
+        registerKernels(bench, kernels);
+        const std::time_t now = std::time(nullptr);
+        char started[32];
+        std::strftime(started, sizeof(started), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+        const nlohmann::json results = {{"benchmark", "dd_microbench"},
+                                        {"format", 1},
+                                        {"label", label},
+                                        {"started", started},
+                                        {"host", {{"cpus", std::thread::hardware_concurrency()}}},
+                                        {"results", bench.run(options)}};
+        if (out_path.empty()) {
+            std::cout << results.dump(2) << std::endl;
+        } else {
+            std::ofstream out(out_path);
+            out << results.dump(2) << std::endl;
+            if (!out) throw std::runtime_error("Cannot write " + out_path);
+            std::cerr << "Results written to " << out_path << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
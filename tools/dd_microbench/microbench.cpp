@@ -0,0 +1,156 @@
+#include "microbench.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+using json = nlohmann::json;
+
+namespace {
+    double rounded(double value, int digits = 3) {
+        const double scale = std::pow(10.0, digits);
+        return std::round(value * scale) / scale;
+    }
+
+    double median(std::vector<double> values) {
+        std::sort(values.begin(), values.end());
+        const size_t n = values.size();
+        return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+    }
+
+    std::atomic<unsigned> g_sink{0};
+}
+
+double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME created, exited, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user)) return 0;
+    auto seconds = [](const FILETIME& time) {
+        ULARGE_INTEGER value;
+        value.LowPart = time.dwLowDateTime;
+        value.HighPart = time.dwHighDateTime;
+        return static_cast<double>(value.QuadPart) / 1e7;
+    };
+    return seconds(user) + seconds(kernel);
+#else
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<double>(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+#endif
+}
+
+void keep(const void* value) {
+    g_sink.fetch_xor(*static_cast<const volatile unsigned char*>(value), std::memory_order_relaxed);
+}
+
+void MicroBench::add(const std::string& name, const std::string& param, Prepare prepare) {
+    m_entries.push_back({name, param, std::move(prepare)});
+}
+
+json MicroBench::run(const Options& options) const {
+    json results = json::array();
+    for (const auto& entry : m_entries) {
+        const std::string id = entry.name + "/" + entry.param;
+        if (!options.filter.empty() && id.find(options.filter) == std::string::npos) continue;
+        const Case bench = entry.prepare();
+
+        auto timed = [&](std::int64_t iterations) {
+            const auto start = std::chrono::steady_clock::now();
+            const double cpu_start = processCpuSeconds();
+            bench.body(iterations);
+            const double cpu = processCpuSeconds() - cpu_start;
+            return std::make_pair(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), cpu);
+        };
+
+        // Grow the iteration count until a run is long enough to time, then
+        // size it for the target duration.
+        std::int64_t iterations = 1;
+        double elapsed = timed(iterations).first;
+        while (elapsed < options.min_seconds / 10) {
+            iterations *= elapsed > 0 ? std::clamp<std::int64_t>(static_cast<std::int64_t>(options.min_seconds / 10 / elapsed) + 1, 2, 100) : 100;
+            elapsed = timed(iterations).first;
+        }
+        iterations = std::max<std::int64_t>(1, static_cast<std::int64_t>(iterations * options.min_seconds / elapsed));
+
+        std::vector<double> wall, cpu;
+        for (int r = 0; r < std::max(options.repetitions, 1); ++r) {
+            const auto [seconds, cpu_seconds] = timed(iterations);
+            wall.push_back(seconds / static_cast<double>(iterations));
+            cpu.push_back(cpu_seconds / static_cast<double>(iterations));
+        }
+        const double per_op = median(wall);
+        const double cpu_per_op = median(cpu);
+        if (bench.cleanup) bench.cleanup();
+
+        json result = {{"name", entry.name},
+                       {"param", entry.param},
+                       {"iterations", iterations},
+                       {"repetitions", wall.size()},
+                       {"ns_per_op", {{"median", rounded(per_op * 1e9)},
+                                      {"min", rounded(*std::min_element(wall.begin(), wall.end()) * 1e9)}}},
+                       {"cpu_ns_per_op", rounded(cpu_per_op * 1e9)},
+                       {"items_per_op", bench.items},
+                       {"items_per_s", rounded(per_op > 0 ? bench.items / per_op : 0, 1)}};
+        if (bench.bytes > 0) {
+            const double gb = static_cast<double>(bench.bytes) / (1024.0 * 1024 * 1024);
+            result["bytes_per_op"] = bench.bytes;
+            result["mb_per_s"] = rounded(per_op > 0 ? bench.bytes / (1024.0 * 1024) / per_op : 0);
+            result["cpu_ms_per_gb"] = rounded(cpu_per_op * 1000 / gb);
+        }
+        results.push_back(result);
+
+        std::cerr << std::left << std::setw(44) << id << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(14) << per_op * 1e9 << " ns/op";
+        if (bench.bytes > 0) {
+            std::cerr << std::setw(11) << result["mb_per_s"].get<double>() << " MB/s" << std::setw(10)
+                      << result["cpu_ms_per_gb"].get<double>() << " CPU ms/GB";
+        } else {
+            std::cerr << std::setw(14) << std::setprecision(0) << result["items_per_s"].get<double>() << " items/s";
+        }
+        std::cerr << std::endl;
+    }
+    return results;
+}
+
+int compareMicroResults(const json& baseline, const json& current, double tolerance) {
+    std::map<std::string, double> base;
+    for (const auto& result : baseline.at("results")) {
+        base[result["name"].get<std::string>() + "/" + result["param"].get<std::string>()] =
+            result["ns_per_op"]["median"].get<double>();
+    }
+    std::cout << "baseline: " << baseline.value("label", "") << " (" << baseline.value("started", "") << ")\n"
+              << "current:  " << current.value("label", "") << " (" << current.value("started", "") << ")\n\n"
+              << std::left << std::setw(44) << "kernel" << std::right << std::setw(16) << "base ns/op" << std::setw(16)
+              << "ns/op" << std::setw(10) << "change" << "\n";
+    int regressions = 0;
+    for (const auto& result : current.at("results")) {
+        const std::string id = result["name"].get<std::string>() + "/" + result["param"].get<std::string>();
+        const double now = result["ns_per_op"]["median"].get<double>();
+        std::cout << std::left << std::setw(44) << id << std::right << std::fixed << std::setprecision(1);
+        auto found = base.find(id);
+        if (found == base.end()) {
+            std::cout << std::setw(16) << "-" << std::setw(16) << now << "  (not in baseline)\n";
+            continue;
+        }
+        const double change = found->second > 0 ? (now - found->second) / found->second : 0;
+        const bool regressed = change > tolerance;
+        regressions += regressed ? 1 : 0;
+        std::ostringstream percent;
+        percent << std::showpos << std::fixed << std::setprecision(1) << change * 100 << "%";
+        std::cout << std::setw(16) << found->second << std::setw(16) << now << std::setw(10) << percent.str()
+                  << (regressed ? "  << regression" : "") << "\n";
+    }
+    std::cout << "\n" << regressions << " regression(s) beyond " << tolerance * 100 << "%" << std::endl;
+    return regressions;
+}
@@ -0,0 +1,61 @@
+#ifndef MICROBENCH_H
+#define MICROBENCH_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// A minimal microbenchmark runner. Each case is prepared only if selected
+// (building large inputs can take seconds), calibrated until one run of the
+// body lasts a tenth of the target time, then timed over several repetitions
+// of a fixed iteration count; the median is reported, with process CPU time
+// alongside wall time so that multi-threaded kernels show their real cost.
+class MicroBench {
+public:
+    // Runs the kernel `iterations` times.
+    using Body = std::function<void(std::int64_t iterations)>;
+
+    // What one iteration processes, used to derive throughput figures.
+    struct Case {
+        Body body;
+        std::int64_t bytes = 0;    // 0: not a byte-oriented kernel
+        std::int64_t items = 1;
+        std::function<void()> cleanup;   // run once the case is measured
+    };
+    using Prepare = std::function<Case()>;
+
+    struct Options {
+        double min_seconds = 0.25;   // target duration of one repetition
+        int repetitions = 5;
+        std::string filter;          // substring of "name/param"; empty runs all
+    };
+
+    void add(const std::string& name, const std::string& param, Prepare prepare);
+
+    // Runs the selected cases, printing a line per case to stderr, and
+    // returns one JSON result per case.
+    nlohmann::json run(const Options& options) const;
+
+private:
+    struct Entry {
+        std::string name;
+        std::string param;
+        Prepare prepare;
+    };
+    std::vector<Entry> m_entries;
+};
+
+// Process CPU time (all threads, user + system) in seconds.
+double processCpuSeconds();
+
+// Keeps the compiler from discarding a computed value by reading the byte
+// at `value`.
+void keep(const void* value);
+
+// Matches results by name and parameter and prints the change in time per
+// iteration. Returns how many got slower by more than `tolerance` (a fraction).
+int compareMicroResults(const nlohmann::json& baseline, const nlohmann::json& current, double tolerance);
+
+#endif // MICROBENCH_H
@@ -0,0 +1,726 @@
+#include "drive_emulator.h"
+#include <algorithm>
+#include <cstdio>
+#include <regex>
+#include <thread>
+#include <utility>
+#include "drive_batch.h"
+
+namespace {
+    // Downloads are written, and paced, in slices this size.
+    constexpr std::size_t kSliceBytes = 256 * 1024;
+    const char* kFolderMimeType = "application/vnd.google-apps.folder";
+
+    std::string errorBody(int code, const std::string& reason, const std::string& message) {
+        return nlohmann::json{{"error", {{"code", code},
+                                         {"message", message},
+                                         {"errors", {{{"domain", "usageLimits"}, {"reason", reason}, {"message", message}}}}}}}
+            .dump();
+    }
+
+    // Accounts are named by the access token the emulator handed out.
+    const std::string kTokenPrefix = "emu.";
+
+    std::string bearerAccount(const httplib::Request& req) {
+        const std::string header = req.get_header_value("Authorization");
+        const std::string prefix = "Bearer " + kTokenPrefix;
+        return header.compare(0, prefix.size(), prefix) == 0 ? header.substr(prefix.size()) : std::string();
+    }
+
+    const char* statusText(int status) {
+        switch (status) {
+            case 200: return "OK";
+            case 204: return "No Content";
+            case 400: return "Bad Request";
+            case 401: return "Unauthorized";
+            case 403: return "Forbidden";
+            case 404: return "Not Found";
+            case 429: return "Too Many Requests";
+            case 500: return "Internal Server Error";
+            case 503: return "Service Unavailable";
+            default: return "Unknown";
+        }
+    }
+}
+
+DriveEmulator::DriveEmulator(Options options) : m_options(options), m_random(options.seed) {
+    m_server.new_task_queue = [this] { return new httplib::ThreadPool(m_options.threads); };
+
+    m_server.Post("/token", [this](const httplib::Request& req, httplib::Response& res) { token(req, res); });
+    m_server.Get("/drive/v3/about", [this](const httplib::Request& req, httplib::Response& res) { about(req, res); });
+    m_server.Get("/drive/v3/files/generateIds",
+                 [this](const httplib::Request& req, httplib::Response& res) { generateIds(req, res); });
+    m_server.Get("/drive/v3/files", [this](const httplib::Request& req, httplib::Response& res) { listFiles(req, res); });
+    m_server.Post("/drive/v3/files",
+                  [this](const httplib::Request& req, httplib::Response& res) { createFolder(req, res); });
+    m_server.Get("/drive/v3/files/([^/]+)",
+                 [this](const httplib::Request& req, httplib::Response& res) { getFile(req, res); });
+    m_server.Delete("/drive/v3/files/([^/]+)",
+                    [this](const httplib::Request& req, httplib::Response& res) { deleteFile(req, res); });
+    m_server.Post("/upload/drive/v3/files",
+                  [this](const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+                      upload(req, res, reader);
+                  });
+    m_server.Put("/upload/drive/v3/files",
+                 [this](const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+                     uploadChunk(req, res, reader);
+                 });
+    m_server.Patch("/upload/drive/v3/files/([^/]+)",
+                   [this](const httplib::Request& req, httplib::Response& res) { updateMedia(req, res); });
+    m_server.Post("/batch/drive/v3", [this](const httplib::Request& req, httplib::Response& res) { batch(req, res); });
+    m_server.Get("/emulator/stats", [this](const httplib::Request&, httplib::Response& res) {
+        const Counters c = counters();
+        res.set_content(nlohmann::json{{"requests", c.requests},
+                                       {"rate_limited", c.rate_limited},
+                                       {"server_errors", c.server_errors},
+                                       {"resets", c.resets},
+                                       {"bytes_in", c.bytes_in},
+                                       {"bytes_out", c.bytes_out}}
+                            .dump(2),
+                        "application/json");
+    });
+}
+
+bool DriveEmulator::listen(const std::string& host, int port) {
+    return m_server.listen(host, port);
+}
+
+int DriveEmulator::bindToAnyPort(const std::string& host) {
+    return m_server.bind_to_any_port(host);
+}
+
+bool DriveEmulator::listenAfterBind() {
+    return m_server.listen_after_bind();
+}
+
+bool DriveEmulator::running() const {
+    return m_server.is_running();
+}
+
+void DriveEmulator::stop() {
+    m_server.stop();
+}
+
+DriveEmulator::Counters DriveEmulator::counters() const {
+    Counters c;
+    c.requests = m_requests;
+    c.rate_limited = m_rate_limited;
+    c.server_errors = m_server_errors;
+    c.resets = m_resets;
+    c.bytes_in = m_bytes_in;
+    c.bytes_out = m_bytes_out;
+    return c;
+}
+
+std::vector<DriveEmulator::Transfer> DriveEmulator::takeTransfers() {
+    std::lock_guard<std::mutex> lock(m_transfers_mutex);
+    return std::exchange(m_transfers, {});
+}
+
+void DriveEmulator::recordTransfer(bool upload, std::int64_t bytes, std::chrono::steady_clock::time_point start) {
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::lock_guard<std::mutex> lock(m_transfers_mutex);
+    m_transfers.push_back({upload, bytes, elapsed.count()});
+}
+
+DriveEmulator::Fault DriveEmulator::begin() {
+    m_requests++;
+    if (m_options.rtt.count() > 0) {
+        std::this_thread::sleep_for(m_options.rtt);
+    }
+    if (draw(m_options.rate_limit_rate)) return Fault::RateLimit;
+    if (draw(m_options.server_error_rate)) return Fault::ServerError;
+    if (draw(m_options.reset_rate)) return Fault::Reset;
+    return Fault::None;
+}
+
+bool DriveEmulator::draw(double rate) {
+    if (rate <= 0) return false;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return std::uniform_real_distribution<double>(0, 1)(m_random) < rate;
+}
+
+bool DriveEmulator::injectError(Fault fault, httplib::Response& res) {
+    // An unread request body cannot be left on a kept-alive connection.
+    if (fault == Fault::RateLimit) {
+        m_rate_limited++;
+        res.set_header("Connection", "close");
+        reply(res, Fault::None, 429, errorBody(429, "userRateLimitExceeded", "User rate limit exceeded."));
+        return true;
+    }
+    if (fault == Fault::ServerError) {
+        m_server_errors++;
+        res.set_header("Connection", "close");
+        const bool unavailable = draw(0.5);
+        reply(res, Fault::None, unavailable ? 503 : 500,
+              errorBody(unavailable ? 503 : 500, "backendError", "Backend Error"));
+        return true;
+    }
+    return false;
+}
+
+void DriveEmulator::reply(httplib::Response& res, Fault fault, int status, const std::string& body,
+                          const std::string& content_type) {
+    res.status = status;
+    if (fault != Fault::Reset) {
+        res.set_content(body, content_type);
+        return;
+    }
+    // The status line and headers go out, then the connection closes with
+    // the body owed.
+    m_resets++;
+    res.set_content_provider(std::max<size_t>(body.size(), 1), content_type,
+                             [](size_t, size_t, httplib::DataSink&) { return false; });
+}
+
+DriveEmulator::Account* DriveEmulator::authorize(const httplib::Request& req, httplib::Response& res) {
+    const std::string name = bearerAccount(req);
+    if (!name.empty()) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_accounts.find(name);
+        if (it != m_accounts.end()) return it->second.get();
+    }
+    res.status = 401;
+    res.set_header("Connection", "close");
+    res.set_content(errorBody(401, "authError", "Invalid Credentials"), "application/json; charset=UTF-8");
+    return nullptr;
+}
+
+std::string DriveEmulator::newId() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    char id[40];
+    std::snprintf(id, sizeof(id), "emu%016llx%08llx", static_cast<unsigned long long>(m_random()),
+                  static_cast<unsigned long long>(m_next_id++));
+    return id;
+}
+
+nlohmann::json DriveEmulator::describe(const std::string& id, const File& file) const {
+    nlohmann::json out = {{"kind", "drive#file"},
+                          {"id", id},
+                          {"name", file.name},
+                          {"mimeType", file.mime_type},
+                          {"parents", {file.parent}}};
+    if (file.data) {
+        out["size"] = std::to_string(file.data->size());
+    }
+    return out;
+}
+
+std::int64_t DriveEmulator::cutPoint(const httplib::Request& req, Fault fault) {
+    if (fault != Fault::Reset) return -1;
+    const std::int64_t length = req.has_header("Content-Length")
+                                    ? std::stoll(req.get_header_value("Content-Length"))
+                                    : 0;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return length > 0 ? std::uniform_int_distribution<std::int64_t>(0, length - 1)(m_random) : 0;
+}
+
+bool DriveEmulator::readBody(const httplib::ContentReader& reader, Account& account, std::int64_t cut,
+                             std::string& body) {
+    const bool whole = reader([&](const char* data, size_t length) {
+        if (cut >= 0 && static_cast<std::int64_t>(body.size() + length) > cut) {
+            return false;
+        }
+        account.link.pace(static_cast<std::int64_t>(length));
+        body.append(data, length);
+        m_bytes_in += static_cast<std::int64_t>(length);
+        return true;
+    });
+    return whole && cut < 0;
+}
+
+// Refresh-token grants only; there is no consent screen to run the
+// authorization-code flow against. Faults are never injected here: a failed
+// refresh sends the client into interactive sign-in.
+void DriveEmulator::token(const httplib::Request& req, httplib::Response& res) {
+    m_requests++;
+    if (m_options.rtt.count() > 0) {
+        std::this_thread::sleep_for(m_options.rtt);
+    }
+    const std::string account = req.get_param_value("refresh_token");
+    if (req.get_param_value("grant_type") != "refresh_token" || account.empty()) {
+        res.status = 400;
+        res.set_content(nlohmann::json{{"error", "unsupported_grant_type"}}.dump(), "application/json");
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& slot = m_accounts[account];
+        if (!slot) slot = std::make_unique<Account>(m_options.bandwidth_bytes_per_sec);
+    }
+    res.set_content(nlohmann::json{{"access_token", kTokenPrefix + account}, {"expires_in", 3599}, {"token_type", "Bearer"}}
+                        .dump(),
+                    "application/json");
+}
+
+void DriveEmulator::about(const httplib::Request& req, httplib::Response& res) {
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+    nlohmann::json quota;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        quota = {{"usage", std::to_string(account->used)}, {"usageInDrive", std::to_string(account->used)}};
+    }
+    if (m_options.quota_bytes >= 0) {
+        quota["limit"] = std::to_string(m_options.quota_bytes);
+    }
+    reply(res, fault, 200, nlohmann::json{{"storageQuota", quota}}.dump());
+}
+
+void DriveEmulator::generateIds(const httplib::Request& req, httplib::Response& res) {
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+    const int count = req.has_param("count") ? std::clamp(std::stoi(req.get_param_value("count")), 1, 1000) : 10;
+    nlohmann::json ids = nlohmann::json::array();
+    for (int i = 0; i < count; ++i) {
+        const std::string id = newId();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reserved_ids.insert(id);
+        ids.push_back(id);
+    }
+    reply(res, fault, 200, nlohmann::json{{"kind", "drive#generatedIds"}, {"space", "drive"}, {"ids", ids}}.dump());
+}
+
+// Understands the two query shapes the client sends:
+//   name = '<name>' and '<parent>' in parents and trashed = false
+//   '<parent>' in parents and trashed = false
+void DriveEmulator::listFiles(const httplib::Request& req, httplib::Response& res) {
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+
+    static const std::regex name_re(R"(name\s*=\s*'([^']*)')");
+    static const std::regex parent_re(R"('([^']*)'\s+in\s+parents)");
+    const std::string q = req.get_param_value("q");
+    std::smatch match;
+    const bool by_name = std::regex_search(q, match, name_re);
+    const std::string name = by_name ? match[1].str() : std::string();
+    const bool by_parent = std::regex_search(q, match, parent_re);
+    const std::string parent = by_parent ? match[1].str() : std::string();
+
+    const size_t page_size =
+        req.has_param("pageSize") ? std::clamp(std::stoi(req.get_param_value("pageSize")), 1, 1000) : 100;
+    const size_t first = req.has_param("pageToken") ? std::stoul(req.get_param_value("pageToken")) : 0;
+
+    nlohmann::json files = nlohmann::json::array();
+    bool more = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        size_t index = 0;
+        for (const auto& [id, file] : account->files) {
+            if ((by_name && file.name != name) || (by_parent && file.parent != parent)) continue;
+            if (index++ < first) continue;
+            if (files.size() == page_size) {
+                more = true;
+                break;
+            }
+            files.push_back(describe(id, file));
+        }
+    }
+    nlohmann::json out = {{"kind", "drive#fileList"}, {"files", files}};
+    if (more) {
+        out["nextPageToken"] = std::to_string(first + page_size);
+    }
+    reply(res, fault, 200, out.dump());
+}
+
+void DriveEmulator::createFolder(const httplib::Request& req, httplib::Response& res) {
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+    const nlohmann::json metadata = nlohmann::json::parse(req.body, nullptr, false);
+    if (!metadata.is_object()) {
+        reply(res, fault, 400, errorBody(400, "parseError", "Parse Error"));
+        return;
+    }
+    createFile(*account, metadata, std::string(), fault, res);
+}
+
+void DriveEmulator::createFile(Account& account, const nlohmann::json& metadata, std::string data, Fault fault,
+                               httplib::Response& res) {
+    File file;
+    file.name = metadata.value("name", "Untitled");
+    file.mime_type = metadata.value("mimeType", "application/octet-stream");
+    file.parent = metadata.contains("parents") && !metadata["parents"].empty()
+                      ? metadata["parents"][0].get<std::string>()
+                      : std::string("root");
+    const std::int64_t size = static_cast<std::int64_t>(data.size());
+    if (file.mime_type != kFolderMimeType) {
+        file.data = std::make_shared<const std::string>(std::move(data));
+    }
+    std::string id = metadata.value("id", "");
+    if (id.empty()) id = newId();
+
+    nlohmann::json described;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (file.parent != "root") {
+            auto parent = account.files.find(file.parent);
+            if (parent == account.files.end() || parent->second.data) {
+                res.status = 404;
+                res.set_content(errorBody(404, "notFound", "File not found: " + file.parent + "."),
+                                "application/json; charset=UTF-8");
+                return;
+            }
+        }
+        if (m_options.quota_bytes >= 0 && account.used + size > m_options.quota_bytes) {
+            res.status = 403;
+            res.set_content(errorBody(403, "storageQuotaExceeded", "The user's Drive storage quota has been exceeded."),
+                            "application/json; charset=UTF-8");
+            return;
+        }
+        if (metadata.contains("id")) {
+            auto reserved = m_reserved_ids.find(id);
+            if (reserved == m_reserved_ids.end() || account.files.count(id)) {
+                res.status = 400;
+                res.set_content(errorBody(400, "invalid", "The provided file ID is not usable."),
+                                "application/json; charset=UTF-8");
+                return;
+            }
+            m_reserved_ids.erase(reserved);
+        }
+        account.used += size;
+        described = describe(id, file);
+        account.files.emplace(id, std::move(file));
+    }
+    reply(res, fault, 200, described.dump());
+}
+
+// Metadata, or with alt=media the content. httplib answers Range requests
+// itself (206, 416, multipart/byteranges) and asks for the bytes in pieces.
+void DriveEmulator::getFile(const httplib::Request& req, httplib::Response& res) {
+    const auto start = std::chrono::steady_clock::now();
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+    const std::string id = req.matches[1].str();
+    File file;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = account->files.find(id);
+        if (it == account->files.end()) {
+            reply(res, fault, 404, errorBody(404, "notFound", "File not found: " + id + "."));
+            return;
+        }
+        file = it->second;
+    }
+    if (req.get_param_value("alt") != "media") {
+        reply(res, fault, 200, describe(id, file).dump());
+        return;
+    }
+    if (!file.data) {
+        reply(res, fault, 403, errorBody(403, "fileNotDownloadable", "Only files with binary content can be downloaded."));
+        return;
+    }
+
+    // A reset cuts the transfer at a random fraction of whatever range is
+    // being sent.
+    double cut_fraction = -1;
+    if (fault == Fault::Reset) {
+        m_resets++;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        cut_fraction = std::uniform_real_distribution<double>(0, 1)(m_random);
+    }
+    // The provider is asked for each requested range in pieces; a range's
+    // transfer ends with the piece that reaches its end.
+    auto cut = std::make_shared<std::int64_t>(-1);
+    auto range = std::make_shared<std::pair<size_t, size_t>>(0, 0);   // [begin, end) being sent
+    const std::shared_ptr<const std::string> data = file.data;
+    res.set_content_provider(
+        data->size(), file.mime_type,
+        [this, account, data, cut, cut_fraction, range, start](size_t offset, size_t length, httplib::DataSink& sink) {
+            if (cut_fraction >= 0 && *cut < 0) {
+                *cut = static_cast<std::int64_t>(offset) + static_cast<std::int64_t>(cut_fraction * length);
+            }
+            if (offset >= range->second) *range = {offset, offset + length};
+            const size_t take = std::min(length, kSliceBytes);
+            if (*cut >= 0 && static_cast<std::int64_t>(offset + take) > *cut) {
+                const size_t partial = static_cast<size_t>(*cut - static_cast<std::int64_t>(offset));
+                account->link.pace(static_cast<std::int64_t>(partial));
+                if (partial > 0) sink.write(data->data() + offset, partial);
+                return false;
+            }
+            account->link.pace(static_cast<std::int64_t>(take));
+            m_bytes_out += static_cast<std::int64_t>(take);
+            if (!sink.write(data->data() + offset, take)) return false;
+            if (offset + take == range->second) {
+                recordTransfer(false, static_cast<std::int64_t>(range->second - range->first), start);
+            }
+            return true;
+        });
+}
+
+void DriveEmulator::deleteFile(const httplib::Request& req, httplib::Response& res) {
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+    const auto [status, body] = batchCall(*account, "DELETE", "/drive/v3/files/" + req.matches[1].str());
+    reply(res, fault, status, body);
+}
+
+// uploadType=multipart carries metadata and media in one multipart/related
+// body; uploadType=resumable opens a session whose URI comes back in
+// Location.
+void DriveEmulator::upload(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader) {
+    const auto start = std::chrono::steady_clock::now();
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+    const std::string type = req.get_param_value("uploadType");
+    const std::string content_type = req.get_header_value("Content-Type");
+    if (type != "resumable" && (type != "multipart" || content_type.rfind("multipart/related", 0) != 0)) {
+        res.set_header("Connection", "close");
+        reply(res, fault, 400, errorBody(400, "badRequest", "Unsupported upload: uploadType=" + type + ", " + content_type));
+        return;
+    }
+
+    std::string body;
+    if (!readBody(reader, *account, cutPoint(req, fault), body)) {
+        if (fault == Fault::Reset) m_resets++;
+        res.status = 400;
+        res.set_header("Connection", "close");
+        return;
+    }
+
+    if (type == "resumable") {
+        nlohmann::json metadata = body.empty() ? nlohmann::json::object() : nlohmann::json::parse(body, nullptr, false);
+        if (!metadata.is_object()) {
+            reply(res, fault, 400, errorBody(400, "parseError", "Parse Error"));
+            return;
+        }
+        const std::string session_id = newId();
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            UploadSession& session = m_sessions[session_id];
+            session.account = bearerAccount(req);
+            session.metadata = std::move(metadata);
+        }
+        const std::string host = req.has_header("Host") ? req.get_header_value("Host") : std::string("localhost");
+        res.set_header("Location",
+                       "http://" + host + "/upload/drive/v3/files?uploadType=resumable&upload_id=" + session_id);
+        reply(res, fault, 200, std::string(), "text/plain");
+        return;
+    }
+
+    // --boundary CRLF headers CRLF CRLF metadata CRLF --boundary CRLF headers
+    // CRLF CRLF media CRLF --boundary-- CRLF
+    const std::string delimiter = "--" + multipartBoundary(content_type);
+    const size_t meta_start = body.find("\r\n\r\n");
+    const size_t meta_end = meta_start == std::string::npos ? std::string::npos : body.find("\r\n" + delimiter, meta_start);
+    const size_t media_start = meta_end == std::string::npos ? std::string::npos : body.find("\r\n\r\n", meta_end + 2);
+    const size_t media_end = body.rfind("\r\n" + delimiter + "--");
+    if (delimiter.size() == 2 || media_start == std::string::npos || media_end == std::string::npos ||
+        media_end < media_start + 4) {
+        reply(res, fault, 400, errorBody(400, "badContent", "Malformed multipart body"));
+        return;
+    }
+    const nlohmann::json metadata = nlohmann::json::parse(body.substr(meta_start + 4, meta_end - meta_start - 4), nullptr, false);
+    if (!metadata.is_object()) {
+        reply(res, fault, 400, errorBody(400, "parseError", "Parse Error"));
+        return;
+    }
+    const size_t media_size = media_end - media_start - 4;
+    createFile(*account, metadata, body.substr(media_start + 4, media_size), fault, res);
+    if (res.status == 200 && fault == Fault::None) {
+        recordTransfer(true, static_cast<std::int64_t>(media_size), start);
+    }
+}
+
+// Data for a resumable session. Without Content-Range the body is the whole
+// file; with "bytes a-b/total" it is the next piece, answered with 308 and
+// the received Range until the last one; "bytes */total" asks how much has
+// arrived.
+void DriveEmulator::uploadChunk(const httplib::Request& req, httplib::Response& res,
+                                const httplib::ContentReader& reader) {
+    const auto start = std::chrono::steady_clock::now();
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+    const std::string session_id = req.get_param_value("upload_id");
+    const std::string name = bearerAccount(req);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_sessions.find(session_id);
+        if (it == m_sessions.end() || it->second.account != name) {
+            res.status = 404;
+            res.set_header("Connection", "close");
+            res.set_content(errorBody(404, "notFound", "Upload session not found."), "application/json; charset=UTF-8");
+            return;
+        }
+    }
+
+    static const std::regex range_re(R"(bytes (\d+)-(\d+)/(\d+|\*))");
+    static const std::regex query_re(R"(bytes \*/(\d+))");
+    const std::string content_range = req.get_header_value("Content-Range");
+    std::smatch match;
+    std::int64_t first = 0, last = -1, total = -1;
+    bool piece = false;
+    if (std::regex_match(content_range, match, range_re)) {
+        piece = true;
+        first = std::stoll(match[1].str());
+        last = std::stoll(match[2].str());
+        if (match[3].str() != "*") total = std::stoll(match[3].str());
+    } else if (std::regex_match(content_range, match, query_re)) {
+        total = std::stoll(match[1].str());
+    } else if (!content_range.empty()) {
+        res.set_header("Connection", "close");
+        reply(res, fault, 400, errorBody(400, "badRequest", "Invalid Content-Range: " + content_range));
+        return;
+    }
+
+    std::string body;
+    if (!readBody(reader, *account, cutPoint(req, fault), body)) {
+        if (fault == Fault::Reset) m_resets++;
+        res.status = 400;
+        res.set_header("Connection", "close");
+        return;
+    }
+
+    nlohmann::json metadata;
+    std::string data;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_sessions.find(session_id);
+        if (it == m_sessions.end()) {
+            res.status = 404;
+            res.set_content(errorBody(404, "notFound", "Upload session not found."), "application/json; charset=UTF-8");
+            return;
+        }
+        UploadSession& session = it->second;
+        if (content_range.empty()) {
+            session.data = std::move(body);
+            session.total = static_cast<std::int64_t>(session.data.size());
+        } else if (piece) {
+            if (first != static_cast<std::int64_t>(session.data.size()) ||
+                last - first + 1 != static_cast<std::int64_t>(body.size())) {
+                res.status = 400;
+                res.set_content(errorBody(400, "badRequest", "Content-Range does not continue the upload."),
+                                "application/json; charset=UTF-8");
+                return;
+            }
+            session.data += body;
+        }
+        if (total >= 0) session.total = total;
+        if (session.total < 0 || static_cast<std::int64_t>(session.data.size()) < session.total) {
+            res.status = 308;
+            if (!session.data.empty()) {
+                res.set_header("Range", "bytes=0-" + std::to_string(session.data.size() - 1));
+            }
+            return;
+        }
+        metadata = std::move(session.metadata);
+        data = std::move(session.data);
+        m_sessions.erase(it);
+    }
+    const std::int64_t size = static_cast<std::int64_t>(data.size());
+    createFile(*account, metadata, std::move(data), fault, res);
+    if (res.status == 200 && fault == Fault::None) {
+        recordTransfer(true, size, start);
+    }
+}
+
+void DriveEmulator::updateMedia(const httplib::Request& req, httplib::Response& res) {
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+    account->link.pace(static_cast<std::int64_t>(req.body.size()));
+    m_bytes_in += static_cast<std::int64_t>(req.body.size());
+    const std::string id = req.matches[1].str();
+    nlohmann::json described;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = account->files.find(id);
+        if (it == account->files.end() || !it->second.data) {
+            reply(res, fault, 404, errorBody(404, "notFound", "File not found: " + id + "."));
+            return;
+        }
+        account->used += static_cast<std::int64_t>(req.body.size()) - static_cast<std::int64_t>(it->second.data->size());
+        it->second.data = std::make_shared<const std::string>(req.body);
+        described = describe(id, it->second);
+    }
+    reply(res, fault, 200, described.dump());
+}
+
+std::pair<int, std::string> DriveEmulator::batchCall(Account& account, const std::string& method,
+                                                     const std::string& path) {
+    const std::string prefix = "/drive/v3/files/";
+    if (path.compare(0, prefix.size(), prefix) != 0) {
+        return {400, errorBody(400, "badRequest", "Unsupported batch call: " + method + " " + path)};
+    }
+    const std::string id = path.substr(prefix.size(), path.find('?', prefix.size()) - prefix.size());
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = account.files.find(id);
+    if (it == account.files.end()) {
+        return {404, errorBody(404, "notFound", "File not found: " + id + ".")};
+    }
+    if (method == "GET") {
+        return {200, describe(id, it->second).dump()};
+    }
+    if (method == "DELETE") {
+        if (it->second.data) account.used -= static_cast<std::int64_t>(it->second.data->size());
+        account.files.erase(it);
+        return {204, std::string()};
+    }
+    return {400, errorBody(400, "badRequest", "Unsupported batch call: " + method + " " + path)};
+}
+
+// Each part of a multipart/mixed batch is one call. Calls fail on their own
+// with rate-limit and server errors, as they do on Drive, so the client's
+// per-call retries get exercised.
+void DriveEmulator::batch(const httplib::Request& req, httplib::Response& res) {
+    const Fault fault = begin();
+    Account* account = authorize(req, res);
+    if (!account || injectError(fault, res)) return;
+    const std::string boundary = multipartBoundary(req.get_header_value("Content-Type"));
+    if (boundary.empty()) {
+        reply(res, fault, 400, errorBody(400, "badRequest", "Batch requests must be multipart/mixed"));
+        return;
+    }
+
+    const std::string delimiter = "--" + boundary;
+    const std::string out_boundary = "batch_emulator_" + boundary;
+    std::string out;
+    static const std::regex content_id_re(R"(Content-ID:\s*<([^>]*)>)", std::regex::icase);
+    for (size_t pos = req.body.find(delimiter); pos != std::string::npos;) {
+        const size_t start = pos + delimiter.size();
+        if (req.body.compare(start, 2, "--") == 0) break;
+        const size_t next = req.body.find(delimiter, start);
+        const std::string part = req.body.substr(start, next == std::string::npos ? std::string::npos : next - start);
+        pos = next;
+
+        const size_t blank = part.find("\r\n\r\n");
+        if (blank == std::string::npos) continue;
+        std::smatch match;
+        const std::string head = part.substr(0, blank);
+        const std::string content_id = std::regex_search(head, match, content_id_re) ? match[1].str() : std::string();
+        const std::string request_line = part.substr(blank + 4, part.find("\r\n", blank + 4) - blank - 4);
+        const size_t space = request_line.find(' ');
+        const std::string method = request_line.substr(0, space);
+        const std::string path = space == std::string::npos ? std::string()
+                                                            : request_line.substr(space + 1, request_line.find(' ', space + 1) - space - 1);
+
+        std::pair<int, std::string> result;
+        if (draw(m_options.rate_limit_rate)) {
+            m_rate_limited++;
+            result = {429, errorBody(429, "userRateLimitExceeded", "User rate limit exceeded.")};
+        } else if (draw(m_options.server_error_rate)) {
+            m_server_errors++;
+            result = {503, errorBody(503, "backendError", "Backend Error")};
+        } else {
+            result = batchCall(*account, method, path);
+        }
+
+        out += "--" + out_boundary + "\r\nContent-Type: application/http\r\n";
+        if (!content_id.empty()) out += "Content-ID: <response-" + content_id + ">\r\n";
+        out += "\r\nHTTP/1.1 " + std::to_string(result.first) + " " + statusText(result.first) + "\r\n";
+        if (!result.second.empty()) {
+            out += "Content-Type: application/json; charset=UTF-8\r\nContent-Length: " +
+                   std::to_string(result.second.size()) + "\r\n";
+        }
+        out += "\r\n" + result.second + "\r\n";
+    }
+    out += "--" + out_boundary + "--\r\n";
+    reply(res, fault, 200, out, "multipart/mixed; boundary=" + out_boundary);
+}
@@ -0,0 +1,155 @@
+#ifndef DRIVE_EMULATOR_H
+#define DRIVE_EMULATOR_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <httplib.h>
+#include <nlohmann/json.hpp>
+#include "bandwidth_limiter.h"
+
+// A local stand-in for the parts of the Drive v3 API that GDriveHandler
+// uses: token refresh, files list/create/get/delete, generateIds, multipart
+// and resumable uploads (with Content-Range), media downloads with Range,
+// batch requests and about.storageQuota. Files live in memory.
+//
+// Accounts are named by their refresh token: a token file holding
+// {"refresh_token": "alice"} refreshes to an access token for account
+// "alice", which is created on first use. Each account gets its own link of
+// the configured bandwidth, shared by its uploads and downloads, and every
+// request can be delayed and answered with injected faults, so pipeline
+// changes can be measured repeatably without touching real quota.
+class DriveEmulator {
+public:
+    struct Options {
+        double bandwidth_bytes_per_sec = 0;   // per account; 0: unlimited
+        std::chrono::milliseconds rtt{0};     // added to every request
+        double rate_limit_rate = 0;           // probability of a 429
+        double server_error_rate = 0;         // probability of a 500 or 503
+        double reset_rate = 0;                // probability the connection drops mid-transfer
+        std::int64_t quota_bytes = -1;        // per account; -1: unlimited
+        std::uint64_t seed = 1;               // fault draws and ids repeat for a given seed
+        std::size_t threads = 64;             // requests handled concurrently
+    };
+
+    // Requests served and faults injected so far.
+    struct Counters {
+        std::int64_t requests = 0;
+        std::int64_t rate_limited = 0;
+        std::int64_t server_errors = 0;
+        std::int64_t resets = 0;
+        std::int64_t bytes_in = 0;
+        std::int64_t bytes_out = 0;
+    };
+
+    // One media transfer: an object stored by an upload, or the bytes of a
+    // download, timed from the request's arrival to its last byte.
+    struct Transfer {
+        bool upload = false;
+        std::int64_t bytes = 0;
+        double seconds = 0;
+    };
+
+    explicit DriveEmulator(Options options);
+
+    bool listen(const std::string& host, int port);
+    // For running in-process: binds a free port and returns it (-1 on
+    // failure); listenAfterBind() then serves until stop().
+    int bindToAnyPort(const std::string& host);
+    bool listenAfterBind();
+    bool running() const;
+    void stop();
+    Counters counters() const;
+    // The transfers completed since the previous call.
+    std::vector<Transfer> takeTransfers();
+
+private:
+    enum class Fault { None, RateLimit, ServerError, Reset };
+
+    struct File {
+        std::string name;
+        std::string parent;
+        std::string mime_type;
+        std::shared_ptr<const std::string> data;   // null for folders
+    };
+    struct Account {
+        explicit Account(double bandwidth) : link(bandwidth) {}
+        std::map<std::string, File> files;
+        std::int64_t used = 0;
+        BandwidthLimiter link;
+    };
+    struct UploadSession {
+        std::string account;
+        nlohmann::json metadata;
+        std::string data;
+        std::int64_t total = -1;   // -1 until a Content-Range names it
+    };
+
+    // Waits out the RTT, then draws this request's fault.
+    Fault begin();
+    bool draw(double rate);
+    // Answers with an injected error; returns false for Fault::None.
+    bool injectError(Fault fault, httplib::Response& res);
+    // Sends `body`, or drops the connection before it if `fault` is a reset.
+    void reply(httplib::Response& res, Fault fault, int status, const std::string& body,
+               const std::string& content_type = "application/json; charset=UTF-8");
+
+    // The account named by the request's bearer token, or null after
+    // answering 401.
+    Account* authorize(const httplib::Request& req, httplib::Response& res);
+    std::string newId();
+    // Stores a finished upload and answers with its metadata.
+    void createFile(Account& account, const nlohmann::json& metadata, std::string data, Fault fault,
+                    httplib::Response& res);
+    nlohmann::json describe(const std::string& id, const File& file) const;
+    // Where a reset fault cuts the request body, or -1 for no cut.
+    std::int64_t cutPoint(const httplib::Request& req, Fault fault);
+    // Reads the request body at the account's bandwidth, stopping at `cut`.
+    // Returns false if the body did not arrive whole.
+    bool readBody(const httplib::ContentReader& reader, Account& account, std::int64_t cut, std::string& body);
+
+    void token(const httplib::Request& req, httplib::Response& res);
+    void about(const httplib::Request& req, httplib::Response& res);
+    void generateIds(const httplib::Request& req, httplib::Response& res);
+    void listFiles(const httplib::Request& req, httplib::Response& res);
+    void createFolder(const httplib::Request& req, httplib::Response& res);
+    void getFile(const httplib::Request& req, httplib::Response& res);
+    void deleteFile(const httplib::Request& req, httplib::Response& res);
+    void upload(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader);
+    void uploadChunk(const httplib::Request& req, httplib::Response& res, const httplib::ContentReader& reader);
+    void updateMedia(const httplib::Request& req, httplib::Response& res);
+    void batch(const httplib::Request& req, httplib::Response& res);
+    // Runs one call from a batch request; returns its status and JSON body.
+    std::pair<int, std::string> batchCall(Account& account, const std::string& method, const std::string& path);
+    void recordTransfer(bool upload, std::int64_t bytes, std::chrono::steady_clock::time_point start);
+
+    Options m_options;
+    httplib::Server m_server;
+
+    mutable std::mutex m_mutex;
+    std::map<std::string, std::unique_ptr<Account>> m_accounts;
+    std::map<std::string, UploadSession> m_sessions;
+    std::set<std::string> m_reserved_ids;   // handed out by generateIds, not yet used
+    std::uint64_t m_next_id = 0;
+    std::mt19937_64 m_random;
+
+    std::atomic<std::int64_t> m_requests{0};
+    std::atomic<std::int64_t> m_rate_limited{0};
+    std::atomic<std::int64_t> m_server_errors{0};
+    std::atomic<std::int64_t> m_resets{0};
+    std::atomic<std::int64_t> m_bytes_in{0};
+    std::atomic<std::int64_t> m_bytes_out{0};
+
+    std::mutex m_transfers_mutex;
+    std::vector<Transfer> m_transfers;
+};
+
+#endif // DRIVE_EMULATOR_H
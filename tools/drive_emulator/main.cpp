@@ -0,0 +1,60 @@
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <string>
+#include "drive_emulator.h"
+
+// drive_emulator [--port N] [--bind addr] [--bandwidth MB/s] [--rtt ms]
+//                [--rate-limit p] [--server-error p] [--reset p]
+//                [--quota GB] [--seed N] [--threads N]
+//
+// Point D-Drive at it with DD_DRIVE_API_URL=http://127.0.0.1:<port>.
+int main(int argc, char* argv[]) {
+    const std::string usage =
+        "Usage: drive_emulator [--port N] [--bind addr] [--bandwidth MB/s] [--rtt ms] [--rate-limit p]\n"
+        "                      [--server-error p] [--reset p] [--quota GB] [--seed N] [--threads N]\n";
+    DriveEmulator::Options options;
+    std::string host = "127.0.0.1";
+    int port = 9090;
+    try {
+        for (int i = 1; i < argc; i += 2) {
+            const std::string flag = argv[i];
+            if (flag == "--help" || flag == "-h" || i + 1 >= argc) {
+                std::cout << usage;
+                return flag == "--help" || flag == "-h" ? 0 : 1;
+            }
+            const std::string value = argv[i + 1];
+            if (flag == "--port") port = std::stoi(value);
+            else if (flag == "--bind") host = value;
+            else if (flag == "--bandwidth") options.bandwidth_bytes_per_sec = std::stod(value) * 1024 * 1024;
+            else if (flag == "--rtt") options.rtt = std::chrono::milliseconds(std::stoll(value));
+            else if (flag == "--rate-limit") options.rate_limit_rate = std::stod(value);
+            else if (flag == "--server-error") options.server_error_rate = std::stod(value);
+            else if (flag == "--reset") options.reset_rate = std::stod(value);
+            else if (flag == "--quota") options.quota_bytes = static_cast<std::int64_t>(std::stod(value) * 1024 * 1024 * 1024);
+            else if (flag == "--seed") options.seed = std::stoull(value);
+            else if (flag == "--threads") options.threads = std::stoul(value);
+            else {
+                std::cerr << "Unknown option " << flag << "\n" << usage;
+                return 1;
+            }
+        }
+    } catch (const std::exception&) {
+        std::cerr << usage;
+        return 1;
+    }
+
+    DriveEmulator emulator(options);
+    std::cout << "Drive API emulator on http://" << host << ":" << port << " (stats at /emulator/stats)\n"
+              << "  bandwidth per account: "
+              << (options.bandwidth_bytes_per_sec > 0 ? std::to_string(options.bandwidth_bytes_per_sec / (1024 * 1024)) + " MB/s"
+                                                      : std::string("unlimited"))
+              << ", rtt " << options.rtt.count() << " ms, 429 " << options.rate_limit_rate << ", 5xx "
+              << options.server_error_rate << ", reset " << options.reset_rate << ", seed " << options.seed << "\n"
+              << "Run D-Drive with DD_DRIVE_API_URL=http://" << host << ":" << port << std::endl;
+    if (!emulator.listen(host, port)) {
+        std::cerr << "Could not listen on " << host << ":" << port << std::endl;
+        return 1;
+    }
+    return 0;
+}